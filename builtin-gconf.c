@@ -21,6 +21,7 @@
 #include "mce-log.h"
 #include "mce-io.h"
 #include "mce-dbus.h"
+#include "mce-cache.h"
 
 #include "powerkey.h"
 #include "tklock.h"
@@ -53,6 +54,12 @@
 /** Path to persistent storage file */
 #define VALUES_PATH G_STRINGIFY(MCE_VAR_DIR)"/builtin-gconf.values"
 
+/** Delay from the latest change to saving values [s] */
+#define GCONF_SAVE_DELAY_S 2
+
+/** Maximum delay from the first unsaved change to saving values [s] */
+#define GCONF_SAVE_MAX_DELAY_S 10
+
 /* ========================================================================= *
  *
  * MACROS
@@ -90,6 +97,7 @@ static GSList *gconf_value_list_free(GSList *list);
 static void gconf_value_set_from_string(GConfValue *self, const char *data);
 static GConfValue *gconf_value_init(GConfValueType type, GConfValueType list_type, const char *data);
 GConfValue *gconf_value_copy(const GConfValue *src);
+static gboolean gconf_value_equal(const GConfValue *a, const GConfValue *b);
 GConfValue *gconf_value_new(GConfValueType type);
 void gconf_value_free(GConfValue *self);
 gboolean gconf_value_get_bool(const GConfValue *self);
@@ -130,6 +138,7 @@ gboolean gconf_client_set_float(GConfClient *client, const gchar *key, double va
 gboolean gconf_client_set_string(GConfClient *client, const gchar *key, const gchar *val, GError **err);
 gboolean gconf_client_set_list(GConfClient *client, const gchar *key, GConfValueType list_type, GSList *list, GError **err);
 void gconf_client_suggest_sync(GConfClient *client, GError **err);
+void gconf_client_flush_values(GConfClient *client);
 
 /* ========================================================================= *
  *
@@ -806,6 +815,68 @@ cleanup:
   return self;
 }
 
+/** Compare two values without converting them to strings
+ *
+ * @return TRUE if type and content are the same, FALSE otherwise
+ */
+static
+gboolean
+gconf_value_equal(const GConfValue *a, const GConfValue *b)
+{
+  if( a == b )
+  {
+    return TRUE;
+  }
+
+  if( !a || !b || a->type != b->type )
+  {
+    return FALSE;
+  }
+
+  switch( a->type )
+  {
+  case GCONF_VALUE_BOOL:
+    return !a->data.b == !b->data.b;
+
+  case GCONF_VALUE_INT:
+    return a->data.i == b->data.i;
+
+  case GCONF_VALUE_FLOAT:
+    return a->data.f == b->data.f;
+
+  case GCONF_VALUE_STRING:
+    if( !a->data.s || !b->data.s )
+    {
+      return a->data.s == b->data.s;
+    }
+    return !strcmp(a->data.s, b->data.s);
+
+  case GCONF_VALUE_LIST:
+    if( a->list_type != b->list_type )
+    {
+      return FALSE;
+    }
+    {
+      const GSList *x = a->list_head;
+      const GSList *y = b->list_head;
+
+      for( ; x && y; x = x->next, y = y->next )
+      {
+        if( !gconf_value_equal(x->data, y->data) )
+        {
+          return FALSE;
+        }
+      }
+      return !x && !y;
+    }
+
+  default:
+    break;
+  }
+
+  return FALSE;
+}
+
 /** See GConf API documentation */
 GConfValue *
 gconf_value_new(GConfValueType type)
@@ -991,6 +1062,12 @@ gconf_entry_free(GConfEntry *self)
 {
   if( self )
   {
+    // the notify objects are owned by the client
+    g_slist_free(self->notify_list);
+    if( self->signal_sent )
+    {
+      gconf_value_free(self->signal_sent);
+    }
     gconf_value_free(self->value);
     free(self->key);
     free(self->def);
@@ -1109,6 +1186,16 @@ static const setting_t gconf_defaults[] =
     .type = "i",
     .def  = G_STRINGIFY(ALS_SAMPLE_TIME_DEFAULT),
   },
+  {
+    .key  = MCE_GCONF_DISPLAY_ALS_MEDIAN_SIZE,
+    .type = "i",
+    .def  = G_STRINGIFY(ALS_MEDIAN_SIZE_DEFAULT),
+  },
+  {
+    .key  = MCE_GCONF_DISPLAY_ALS_SAMPLE_BATCHES,
+    .type = "b",
+    .def  = G_STRINGIFY(ALS_SAMPLE_BATCHES_DEFAULT),
+  },
   {
     // MCE_GCONF_DISPLAY_COLOR_PROFILE @ modules/display.h
     .key  = "/system/osso/dsm/display/color_profile",
@@ -1777,8 +1864,11 @@ static const setting_t gconf_defaults[] =
 /** The one and only GConfClient we expect to see */
 static GConfClient *default_client = 0;
 
-/** Lookup table for latest change signals sent */
-static GHashTable *gconf_signal_sent = 0;
+/** Entries with change signals queued for broadcasting */
+static GSList *gconf_signal_queue = 0;
+
+/** Idle callback id for broadcasting queued change signals */
+static guint gconf_signal_id = 0;
 
 /** Save values to persistent storage file */
 static void gconf_client_save_values(GConfClient *self, const char *path)
@@ -1818,6 +1908,9 @@ static void gconf_client_save_values(GConfClient *self, const char *path)
   if( data )
   {
     mce_io_update_file_atomic(path, data, size, 0664, FALSE);
+
+    // binary cache needs to be refreshed to match the values file
+    self->cache_stale = TRUE;
   }
 
 cleanup:
@@ -1918,11 +2011,14 @@ static int gconf_client_glob_error_cb(const char *path, int err)
   return 0;
 }
 
+/** Glob pattern for config override files */
+#define OVERRIDES_PATTERN MCE_CONF_DIR"/[0-9][0-9]*.conf"
+
 /** Process config data from /etc/mce/NN.xxx.conf files
  */
 static void gconf_client_load_overrides(GConfClient *self)
 {
-  static const char pattern[] = MCE_CONF_DIR"/[0-9][0-9]*.conf";
+  static const char pattern[] = OVERRIDES_PATTERN;
 
   glob_t gb;
 
@@ -1944,6 +2040,94 @@ cleanup:
   globfree(&gb);
 }
 
+#ifdef ENABLE_CONF_CACHE
+/** Compute stamp for the files default and custom values come from */
+static guint64 gconf_client_cache_stamp(void)
+{
+  static const char pattern[] = OVERRIDES_PATTERN;
+
+  guint64 stamp = 0;
+  glob_t  gb;
+
+  memset(&gb, 0, sizeof gb);
+
+  // no matches is fine, the values file is always included
+  if( glob(pattern, 0, 0, &gb) != 0 )
+  {
+    gb.gl_pathc = 0;
+  }
+
+  char **paths = g_malloc0_n(gb.gl_pathc + 1, sizeof *paths);
+
+  for( size_t i = 0; i < gb.gl_pathc; ++i )
+  {
+    paths[i] = gb.gl_pathv[i];
+  }
+  paths[gb.gl_pathc] = (char *)VALUES_PATH;
+
+  stamp = mce_cache_stamp("gconf", paths, gb.gl_pathc + 1);
+
+  g_free(paths);
+  globfree(&gb);
+
+  return stamp;
+}
+
+/** Callback for restoring default and custom values from binary cache */
+static void gconf_client_load_cache_cb(const char *key, const char *def,
+                                       const char *val, gpointer aptr)
+{
+  GConfClient *self  = aptr;
+  GConfEntry  *entry = g_hash_table_lookup(self->index, key);
+
+  if( !entry )
+  {
+    mce_log(LL_WARN, "%s: unknown key in cache", key);
+    return;
+  }
+
+  free(entry->def), entry->def = strdup(def);
+  gconf_value_set_from_string(entry->value, val);
+}
+
+/** Restore state equivalent to parsing overrides and values files
+ *
+ * @return TRUE if valid cache was found, FALSE otherwise
+ */
+static gboolean gconf_client_load_cache(GConfClient *self)
+{
+  return mce_cache_load(MCE_CACHE_GCONF_PATH, gconf_client_cache_stamp(),
+                        gconf_client_load_cache_cb, self);
+}
+
+/** Store default and custom values to binary cache
+ *
+ * Must be called after the values file has been written so
+ * that the stamp matches what will be seen on the next startup.
+ */
+static void gconf_client_save_cache(GConfClient *self)
+{
+  mce_cache_t *cache = mce_cache_create();
+
+  self->cache_stale = FALSE;
+
+  for( GSList *e_iter = self->entries; e_iter; e_iter = e_iter->next )
+  {
+    GConfEntry *entry = e_iter->data;
+    char *str = gconf_value_str(entry->value);
+
+    if( str && entry->def )
+    {
+      mce_cache_add(cache, entry->key, entry->def, str);
+    }
+    free(str);
+  }
+
+  mce_cache_save(cache, MCE_CACHE_GCONF_PATH, gconf_client_cache_stamp());
+  mce_cache_delete(cache);
+}
+#endif /* ENABLE_CONF_CACHE */
+
 /** Set default value state based on the current data
  *
  * The gconf_client_save_values() function will write only
@@ -1967,6 +2151,23 @@ static void gconf_client_mark_defaults(GConfClient *self)
   }
 }
 
+/** Apply override and custom values from text files
+ */
+static void gconf_client_load_text(GConfClient *self)
+{
+  // override hard coded defaults via /etc/nn.*.conf
+  gconf_client_load_overrides(self);
+
+  // mark down what the state is after hardcoded + overrides
+  gconf_client_mark_defaults(self);
+
+  // load custom values
+  gconf_client_load_values(self, VALUES_PATH);
+
+  // save back - will be nop unless defaults have changed since last save
+  gconf_client_save_values(self, VALUES_PATH);
+}
+
 /** Reset to configured default values
  */
 int gconf_client_reset_defaults(GConfClient *self, const char *keyish)
@@ -2016,6 +2217,22 @@ static void gconf_client_free_default(void)
 {
   if( default_client )
   {
+    // write back changes that are still pending
+    gconf_client_flush_values(default_client);
+
+#ifdef ENABLE_CONF_CACHE
+    // make the next startup see the values file as it is now
+    if( default_client->cache_stale )
+    {
+      gconf_client_save_cache(default_client);
+    }
+#endif
+
+    if( default_client->index )
+    {
+      g_hash_table_unref(default_client->index);
+    }
+
     g_slist_free_full(default_client->entries,
                       gconf_entry_free_cb);
 
@@ -2025,10 +2242,11 @@ static void gconf_client_free_default(void)
     free(default_client), default_client = 0;
   }
 
-  if( gconf_signal_sent )
+  if( gconf_signal_id )
   {
-    g_hash_table_unref(gconf_signal_sent),  gconf_signal_sent = 0;
+    g_source_remove(gconf_signal_id), gconf_signal_id = 0;
   }
+  g_slist_free(gconf_signal_queue), gconf_signal_queue = 0;
 }
 
 /** See GConf API documentation */
@@ -2039,12 +2257,22 @@ gconf_client_get_default(void)
   {
     GConfClient *self = calloc(1, sizeof *self);
 
+    // key -> entry lookup table; the keys are owned by the entries
+    self->index = g_hash_table_new(g_str_hash, g_str_equal);
+
     // initialize to hard coded defaults
     for( const setting_t *elem = gconf_defaults; elem->key; ++elem )
     {
       mce_log(LL_DEBUG, "%s = '%s' (%s)", elem->key, elem->def, elem->type);
       GConfEntry *add = gconf_entry_init(elem->key, elem->type, elem->def);
       self->entries = g_slist_prepend(self->entries, add);
+
+      if( g_hash_table_lookup(self->index, add->key) )
+      {
+        mce_log(LL_WARN, "%s: duplicate key in defaults", add->key);
+        continue;
+      }
+      g_hash_table_insert(self->index, add->key, add);
     }
     self->entries = g_slist_reverse(self->entries);
 
@@ -2052,17 +2280,16 @@ gconf_client_get_default(void)
     default_client = self;
     atexit(gconf_client_free_default);
 
-    // override hard coded defaults via /etc/nn.*.conf
-    gconf_client_load_overrides(self);
-
-    // mark down what the state is after hardcoded + overrides
-    gconf_client_mark_defaults(self);
-
-    // load custom values
-    gconf_client_load_values(self, VALUES_PATH);
-
-    // save back - will be nop unless defaults have changed since last save
-    gconf_client_save_values(self, VALUES_PATH);
+#ifdef ENABLE_CONF_CACHE
+    // skip text parsing if none of the source files have changed
+    if( !gconf_client_load_cache(self) )
+    {
+      gconf_client_load_text(self);
+      gconf_client_save_cache(self);
+    }
+#else
+    gconf_client_load_text(self);
+#endif
 
 #if GCONF_ENABLE_DEBUG_LOGGING
     if( gconf_log_debug_p() )
@@ -2099,17 +2326,7 @@ gconf_client_find_entry(GConfClient *self, const gchar *key, GError **err)
     goto cleanup;
   }
 
-  for( GSList *e_iter = self->entries; e_iter; e_iter = e_iter->next )
-  {
-    GConfEntry *entry = e_iter->data;
-    if( !strcmp(entry->key, key) )
-    {
-      res = entry;
-      break;
-    }
-  }
-
-  if( !res )
+  if( !(res = g_hash_table_lookup(self->index, key)) )
   {
 #if 0
     /* missing key is ok, just return NULL - this is what real
@@ -2311,14 +2528,94 @@ gconf_client_set_list(GConfClient *client,
   return res;
 }
 
-/** See GConf API documentation */
+/** Timer callback for writing unsaved values to persistent storage */
+static
+gboolean
+gconf_client_save_cb(gpointer aptr)
+{
+  GConfClient *self = aptr;
+
+  if( self->save_id )
+  {
+    self->save_id = 0;
+    gconf_client_flush_values(self);
+  }
+
+  return FALSE;
+}
+
+/** See GConf API documentation
+ *
+ * Values are not written immediately. Saving happens after no
+ * changes have been made for GCONF_SAVE_DELAY_S seconds, but
+ * at most GCONF_SAVE_MAX_DELAY_S seconds after the first change.
+ * Second granularity timers allow glib to align the wakeup with
+ * other timers that are due around the same time.
+ */
 void
 gconf_client_suggest_sync(GConfClient *client, GError **err)
 {
-  if( gconf_client_is_valid(client, err) ) {
-    // FIXME: do we need delayed save?
+  gint64 now;
+
+  if( !gconf_client_is_valid(client, err) )
+  {
+    goto cleanup;
+  }
+
+  now = g_get_monotonic_time();
+
+  if( !client->dirty )
+  {
+    client->dirty = TRUE;
+    client->dirty_since = now;
+  }
+
+  /* Restart the delay, unless changes have been held back too long */
+  if( client->save_id )
+  {
+    if( now - client->dirty_since >= (GCONF_SAVE_MAX_DELAY_S -
+                                      GCONF_SAVE_DELAY_S) * G_USEC_PER_SEC )
+    {
+      goto cleanup;
+    }
+    g_source_remove(client->save_id), client->save_id = 0;
+  }
+
+  client->save_id = g_timeout_add_seconds(GCONF_SAVE_DELAY_S,
+                                          gconf_client_save_cb, client);
+
+cleanup:
+
+  return;
+}
+
+/** Write unsaved values to persistent storage immediately
+ *
+ * For use on shutdown and when the caller needs the values
+ * to be on disk, e.g. before handing over the storage file.
+ */
+void
+gconf_client_flush_values(GConfClient *client)
+{
+  if( !gconf_client_is_valid(client, 0) )
+  {
+    goto cleanup;
+  }
+
+  if( client->save_id )
+  {
+    g_source_remove(client->save_id), client->save_id = 0;
+  }
+
+  if( client->dirty )
+  {
+    client->dirty = FALSE;
     gconf_client_save_values(client, VALUES_PATH);
   }
+
+cleanup:
+
+  return;
 }
 
 /* ========================================================================= *
@@ -2378,41 +2675,71 @@ gconf_client_notify_new(const gchar           *namespace_section,
   return self;
 }
 
-/** Broadcast value change on D-Bus */
+/** Broadcast queued value changes on D-Bus
+ *
+ * The builtin-gconf does not care if the value actually changes
+ * or not. To avoid sending "no change" signals the values are
+ * compared against copies of what was broadcast the last time.
+ */
 static
-void
-gconf_signal_value_change(GConfEntry *entry)
+gboolean
+gconf_signal_flush_cb(gpointer aptr)
 {
+  unused(aptr);
+
+  GSList *queue = g_slist_reverse(gconf_signal_queue);
 
-  const char *prev = 0;
-  char       *curr = 0;
+  gconf_signal_queue = 0;
+  gconf_signal_id = 0;
 
-  /* HACK: The builtin-gconf does not care if the value actually changes
-   *       or not. To avoid sending "no change" signals we keep track
-   *       of the string representation of the last change that was
-   *       broadcast ... */
-  if( !gconf_signal_sent )
+  for( GSList *item = queue; item; item = item->next )
   {
-    gconf_signal_sent = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    GConfEntry *entry = item->data;
+
+    entry->signal_pending = FALSE;
+
+    if( gconf_value_equal(entry->signal_sent, entry->value) )
+    {
+      continue;
+    }
+
+    if( entry->signal_sent )
+    {
+      gconf_value_free(entry->signal_sent);
+    }
+    entry->signal_sent = gconf_value_copy(entry->value);
+
+    mce_dbus_send_config_notification(entry);
   }
 
-  if( !(curr = gconf_value_str(entry->value)) )
+  g_slist_free(queue);
+
+  return FALSE;
+}
+
+/** Queue value change for broadcasting on D-Bus
+ *
+ * Changes made during one main loop iteration, e.g. by
+ * gconf_client_reset_defaults(), are sent out as one burst.
+ */
+static
+void
+gconf_signal_value_change(GConfEntry *entry)
+{
+  if( entry->signal_pending )
   {
     goto EXIT;
   }
 
-  prev = g_hash_table_lookup(gconf_signal_sent, entry->key);
+  entry->signal_pending = TRUE;
+  gconf_signal_queue = g_slist_prepend(gconf_signal_queue, entry);
 
-  if( prev && !strcmp(prev, curr) )
+  if( !gconf_signal_id )
   {
-    goto EXIT;
+    gconf_signal_id = g_idle_add(gconf_signal_flush_cb, 0);
   }
 
-  g_hash_table_insert(gconf_signal_sent, strdup(entry->key), curr), curr = 0;
-  mce_dbus_send_config_notification(entry);
-
 EXIT:
-  free(curr);
   return;
 }
 
@@ -2427,21 +2754,27 @@ gconf_client_notify_change(GConfClient           *client,
 
   if( entry )
   {
-    /* handle internal notifications */
-    for( GSList *item = client->notify_list; item; item = item->next )
+    /* handle internal notifications; callbacks are allowed to
+     * remove notifiers, which then just clear the list links */
+    entry->notify_busy += 1;
+
+    for( GSList *item = entry->notify_list; item; item = item->next )
     {
       GConfClientNotify *notify = item->data;
 
-      if( notify->func == 0 )
+      if( !notify || notify->func == 0 )
       {
         continue;
       }
 
-      if( !strcmp(notify->namespace_section, namespace_section) )
-      {
-        gconf_log_debug("id=%u, namespace=%s", notify->id, notify->namespace_section);
-        notify->func(client, notify->id, entry, notify->user_data);
-      }
+      gconf_log_debug("id=%u, namespace=%s", notify->id, notify->namespace_section);
+      notify->func(client, notify->id, entry, notify->user_data);
+    }
+
+    if( --entry->notify_busy == 0 && entry->notify_dirty )
+    {
+      entry->notify_dirty = FALSE;
+      entry->notify_list = g_slist_remove_all(entry->notify_list, 0);
     }
 
     /* broadcast change also on dbus */
@@ -2461,19 +2794,22 @@ gconf_client_notify_add(GConfClient *client,
                         GError **err)
 {
   GConfClientNotify *notify = 0;
+  GConfEntry        *entry  = 0;
 
   if( !gconf_client_is_valid(client, err) )
   {
     goto cleanup;
   }
 
-  if( gconf_client_find_value(client, namespace_section, err) )
+  if( (entry = gconf_client_find_entry(client, namespace_section, err)) )
   {
     notify = gconf_client_notify_new(namespace_section,
                                      func, user_data,
                                      destroy_notify);
+    notify->entry = entry;
 
     client->notify_list = g_slist_prepend(client->notify_list, notify);
+    entry->notify_list = g_slist_prepend(entry->notify_list, notify);
   }
 
 cleanup:
@@ -2496,6 +2832,20 @@ gconf_client_notify_remove(GConfClient *client, guint cnxn)
 
     if( notify->id == cnxn )
     {
+      GConfEntry *entry = notify->entry;
+      GSList     *link  = entry ? g_slist_find(entry->notify_list, notify) : 0;
+
+      if( link && entry->notify_busy )
+      {
+        /* Notification is being dispatched, just detach */
+        link->data = 0;
+        entry->notify_dirty = TRUE;
+      }
+      else if( link )
+      {
+        entry->notify_list = g_slist_delete_link(entry->notify_list, link);
+      }
+
       gconf_client_notify_free(notify);
       client->notify_list = g_slist_delete_link(client->notify_list, item);
       break;
@@ -90,6 +90,13 @@ typedef struct GConfEntry
 
   char *def;
 
+  GSList     *notify_list;    // GConfClientNotify objects, newest first
+  guint       notify_busy;    // notify_list iteration nesting level
+  gboolean    notify_dirty;   // notify_list has NULL links
+
+  GConfValue *signal_sent;    // value last broadcast on D-Bus
+  gboolean    signal_pending; // queued for D-Bus broadcast
+
 } GConfEntry;
 
 typedef struct GConfClient
@@ -102,8 +109,15 @@ typedef struct GConfClient
 
   GSList  *entries;
 
+  GHashTable *index;
+
   GSList  *notify_list;
 
+  gboolean dirty;
+  gint64   dirty_since;
+  guint    save_id;
+  gboolean cache_stale;
+
 } GConfClient;
 
 typedef enum
@@ -122,6 +136,7 @@ typedef struct GConfClientNotify
 {
   guint                 id;
   gchar                *namespace_section;
+  GConfEntry           *entry;
   GConfClientNotifyFunc func;
   gpointer              user_data;
   GFreeFunc             destroy_notify;
@@ -162,6 +177,7 @@ gboolean gconf_client_set_float(GConfClient *client, const gchar *key, double va
 gboolean gconf_client_set_string(GConfClient *client, const gchar *key, const gchar *val, GError **err);
 gboolean gconf_client_set_list(GConfClient *client, const gchar *key, GConfValueType list_type, GSList *list, GError **err);
 void gconf_client_suggest_sync(GConfClient *client, GError **err);
+void gconf_client_flush_values(GConfClient *client);
 guint gconf_client_notify_add(GConfClient *client, const gchar *namespace_section, GConfClientNotifyFunc func, gpointer user_data, GFreeFunc destroy_notify, GError **err);
 void gconf_client_notify_remove(GConfClient *client, guint cnxn);
 
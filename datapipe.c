@@ -23,11 +23,16 @@
 #include "mce.h"
 #include "mce-log.h"
 #include "mce-lib.h"
+#include "mce-trace.h"
 
 #include <mce/mode-names.h>
 
 #include <linux/input.h>
 
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+
 /* Available datapipes */
 
 /** LED brightness */
@@ -211,6 +216,257 @@ datapipe_struct music_playback_pipe;
 /** proximity blanking; read only */
 datapipe_struct proximity_blank_pipe;
 
+/* ========================================================================= *
+ * CALLBACK ARRAYS
+ * ========================================================================= */
+
+/** Minimum number of slots to allocate for a callback array */
+#define DATAPIPE_CALLBACKS_MIN_SIZE 4
+
+/** Initialize callback array
+ *
+ * @param self callback array
+ */
+static void datapipe_callbacks_init(datapipe_callbacks_t *self)
+{
+	self->items = NULL;
+	self->used = 0;
+	self->size = 0;
+	self->count = 0;
+	self->busy = 0;
+}
+
+/** Release dynamic resources held by callback array
+ *
+ * @param self callback array
+ */
+static void datapipe_callbacks_quit(datapipe_callbacks_t *self)
+{
+	g_free(self->items);
+	datapipe_callbacks_init(self);
+}
+
+/** Squeeze out slots cleared during iteration
+ *
+ * @param self callback array
+ */
+static void datapipe_callbacks_compact(datapipe_callbacks_t *self)
+{
+	guint dst = 0;
+
+	if (self->busy || self->count == self->used)
+		goto EXIT;
+
+	for (guint src = 0; src < self->used; ++src) {
+		if (self->items[src])
+			self->items[dst++] = self->items[src];
+	}
+	self->used = dst;
+
+EXIT:
+	return;
+}
+
+/** Mark start of callback array iteration
+ *
+ * While iteration is in progress, removed callbacks leave holes in
+ * the array so that slot indexes of the remaining callbacks stay valid.
+ *
+ * @param self callback array
+ */
+static inline void datapipe_callbacks_begin(datapipe_callbacks_t *self)
+{
+	self->busy += 1;
+}
+
+/** Mark end of callback array iteration
+ *
+ * @param self callback array
+ */
+static inline void datapipe_callbacks_end(datapipe_callbacks_t *self)
+{
+	if (--self->busy == 0)
+		datapipe_callbacks_compact(self);
+}
+
+/** Append callback to the end of callback array
+ *
+ * @param self callback array
+ * @param item callback to add
+ */
+static void datapipe_callbacks_append(datapipe_callbacks_t *self,
+				      gpointer item)
+{
+	if (self->used == self->size) {
+		self->size = MAX(self->size * 2, DATAPIPE_CALLBACKS_MIN_SIZE);
+		self->items = g_renew(gpointer, self->items, self->size);
+	}
+
+	self->items[self->used++] = item;
+	self->count += 1;
+}
+
+/** Remove the first instance of callback from callback array
+ *
+ * @param self callback array
+ * @param item callback to remove
+ *
+ * @return TRUE if callback was removed, or FALSE if not found
+ */
+static gboolean datapipe_callbacks_remove(datapipe_callbacks_t *self,
+					  gpointer item)
+{
+	gboolean removed = FALSE;
+
+	for (guint i = 0; i < self->used; ++i) {
+		if (self->items[i] != item)
+			continue;
+
+		self->items[i] = NULL;
+		self->count -= 1;
+		removed = TRUE;
+		break;
+	}
+
+	if (removed)
+		datapipe_callbacks_compact(self);
+
+	return removed;
+}
+
+/** Execute all reference count triggers of a datapipe
+ *
+ * @param datapipe The datapipe to execute
+ */
+static void datapipe_exec_refcount_triggers(datapipe_struct *const datapipe)
+{
+	datapipe_callbacks_t *callbacks = &datapipe->refcount_triggers;
+
+	datapipe_callbacks_begin(callbacks);
+
+	for (guint i = 0; i < callbacks->used; ++i) {
+		void (*trigger)(void) = callbacks->items[i];
+
+		if (trigger)
+			trigger();
+	}
+
+	datapipe_callbacks_end(callbacks);
+}
+
+/* ========================================================================= *
+ * STATISTICS
+ * ========================================================================= */
+
+/** Get monotonic time stamp for datapipe statistics
+ *
+ * @return current time in nanoseconds
+ */
+static inline gint64 datapipe_stats_tick(void)
+{
+	struct timespec ts = { 0, 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+/** Whether individual callbacks and passes are timed */
+static gboolean datapipe_stats_enabled = FALSE;
+
+/** Get time stamp for timing datapipe callbacks
+ *
+ * @return current time in nanoseconds, or 0 if timing is disabled
+ */
+static inline gint64 datapipe_stats_cb_tick(void)
+{
+	return datapipe_stats_enabled ? datapipe_stats_tick() : 0;
+}
+
+/** Account time spent in a single datapipe callback
+ *
+ * @param datapipe The datapipe that was executed
+ * @param callback The callback that was called
+ * @param ns       Time spent in the callback
+ */
+static void datapipe_stats_callback(datapipe_struct *const datapipe,
+				    gpointer callback, gint64 ns)
+{
+	datapipe_stats_t *stats = &datapipe->stats;
+
+	if (stats->slowest_ns < ns) {
+		stats->slowest_ns = ns;
+		stats->slowest_cb = callback;
+	}
+}
+
+/** Account time spent in a filter pass
+ *
+ * @param datapipe The datapipe that was executed
+ * @param ns       Time spent in all filters
+ */
+static void datapipe_stats_filters(datapipe_struct *const datapipe,
+				   gint64 ns)
+{
+	datapipe_stats_t *stats = &datapipe->stats;
+
+	stats->filter_ns += ns;
+	if (stats->filter_max_ns < ns)
+		stats->filter_max_ns = ns;
+}
+
+/** Account time spent in a trigger pass
+ *
+ * @param datapipe The datapipe that was executed
+ * @param ns       Time spent in all input or output triggers
+ */
+static void datapipe_stats_triggers(datapipe_struct *const datapipe,
+				    gint64 ns)
+{
+	datapipe_stats_t *stats = &datapipe->stats;
+
+	stats->trigger_ns += ns;
+	if (stats->trigger_max_ns < ns)
+		stats->trigger_max_ns = ns;
+}
+
+/** Account one datapipe execution
+ *
+ * @param datapipe The datapipe that was executed
+ * @param ns       Time spent executing the datapipe
+ */
+static void datapipe_stats_execution(datapipe_struct *const datapipe,
+				     gint64 ns)
+{
+	datapipe_stats_t *stats = &datapipe->stats;
+	guint bucket = 0;
+
+	/* Bucket N holds executions that took less than 2^N us */
+	for (gint64 us = ns / 1000; us > 0; us >>= 1) {
+		if (bucket == DATAPIPE_STATS_BUCKETS - 1)
+			break;
+		bucket += 1;
+	}
+
+	stats->executions += 1;
+	stats->histogram[bucket] += 1;
+}
+
+/* ========================================================================= *
+ * DATAPIPE EXECUTION
+ * ========================================================================= */
+
+/** Check if datapipe caches values in the inline slot
+ *
+ * @param datapipe The datapipe to check
+ *
+ * @return TRUE if cached values are copied to datapipe->slot,
+ *         FALSE if cached values are stored as pointers
+ */
+static inline gboolean datapipe_has_inline_slot(const datapipe_struct *datapipe)
+{
+	return (datapipe->datasize > 0 &&
+		datapipe->datasize <= sizeof datapipe->slot);
+}
+
 /**
  * Execute the input triggers of a datapipe
  *
@@ -226,9 +482,9 @@ void execute_datapipe_input_triggers(datapipe_struct *const datapipe,
 				     const data_source_t use_cache,
 				     const caching_policy_t cache_indata)
 {
-	void (*trigger)(gconstpointer const input);
+	datapipe_callbacks_t *callbacks;
 	gpointer data;
-	gint i;
+	gint64 t_beg, t_end;
 
 	if (datapipe == NULL) {
 		/* Potential memory leak! */
@@ -245,15 +501,38 @@ void execute_datapipe_input_triggers(datapipe_struct *const datapipe,
 			if (datapipe->free_cache == FREE_CACHE)
 				g_free(datapipe->cached_data);
 
-			datapipe->cached_data = data;
+			if (datapipe_has_inline_slot(datapipe) && data) {
+				memcpy(datapipe->slot.bytes, data,
+				       datapipe->datasize);
+				datapipe->cached_data = datapipe->slot.bytes;
+			} else {
+				datapipe->cached_data = data;
+			}
 		}
 	}
 
-	for (i = 0; (trigger = g_slist_nth_data(datapipe->input_triggers,
-						i)) != NULL; i++) {
+	callbacks = &datapipe->input_triggers;
+	datapipe_callbacks_begin(callbacks);
+
+	t_beg = t_end = datapipe_stats_cb_tick();
+
+	for (guint i = 0; i < callbacks->used; ++i) {
+		void (*trigger)(gconstpointer input) = callbacks->items[i];
+		gint64 t_cb = t_end;
+
+		if (!trigger)
+			continue;
+
 		trigger(data);
+
+		t_end = datapipe_stats_cb_tick();
+		datapipe_stats_callback(datapipe, trigger, t_end - t_cb);
 	}
 
+	datapipe_stats_triggers(datapipe, t_end - t_beg);
+
+	datapipe_callbacks_end(callbacks);
+
 EXIT:
 	return;
 }
@@ -271,10 +550,11 @@ gconstpointer execute_datapipe_filters(datapipe_struct *const datapipe,
 				       gpointer indata,
 				       const data_source_t use_cache)
 {
-	gpointer (*filter)(gpointer input);
+	datapipe_callbacks_t *callbacks;
 	gpointer data;
 	gconstpointer retval = NULL;
-	gint i;
+	gboolean owned;
+	gint64 t_beg, t_end;
 
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
@@ -285,20 +565,42 @@ gconstpointer execute_datapipe_filters(datapipe_struct *const datapipe,
 
 	data = (use_cache == USE_CACHE) ? datapipe->cached_data : indata;
 
-	for (i = 0; (filter = g_slist_nth_data(datapipe->filters,
-					       i)) != NULL; i++) {
-		gpointer tmp = filter(data);
+	/* The cached data is owned by the datapipe, everything
+	 * else needs to be freed after passing it to a filter */
+	owned = (use_cache == USE_INDATA);
+
+	callbacks = &datapipe->filters;
+	datapipe_callbacks_begin(callbacks);
+
+	t_beg = t_end = datapipe_stats_cb_tick();
+
+	for (guint i = 0; i < callbacks->used; ++i) {
+		gpointer (*filter)(gpointer input) = callbacks->items[i];
+		gint64 t_cb = t_end;
+		gpointer tmp;
+
+		if (!filter)
+			continue;
+
+		tmp = filter(data);
+
+		t_end = datapipe_stats_cb_tick();
+		datapipe_stats_callback(datapipe, filter, t_end - t_cb);
 
 		/* If the data needs to be freed, and this isn't the indata,
 		 * or if we're not using the cache, then free the data
 		 */
-		if ((datapipe->free_cache == FREE_CACHE) &&
-		    ((i > 0) || (use_cache == USE_INDATA)))
+		if ((datapipe->free_cache == FREE_CACHE) && owned)
 			g_free(data);
 
 		data = tmp;
+		owned = TRUE;
 	}
 
+	datapipe_stats_filters(datapipe, t_end - t_beg);
+
+	datapipe_callbacks_end(callbacks);
+
 	retval = data;
 
 EXIT:
@@ -313,13 +615,13 @@ EXIT:
  * @param use_cache USE_CACHE to use data from cache,
  *                  USE_INDATA to use indata
  */
-void execute_datapipe_output_triggers(const datapipe_struct *const datapipe,
+void execute_datapipe_output_triggers(datapipe_struct *const datapipe,
 				      gconstpointer indata,
 				      const data_source_t use_cache)
 {
-	void (*trigger)(gconstpointer input);
+	datapipe_callbacks_t *callbacks;
 	gconstpointer data;
-	gint i;
+	gint64 t_beg, t_end;
 
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
@@ -330,15 +632,330 @@ void execute_datapipe_output_triggers(const datapipe_struct *const datapipe,
 
 	data = (use_cache == USE_CACHE) ? datapipe->cached_data : indata;
 
-	for (i = 0; (trigger = g_slist_nth_data(datapipe->output_triggers,
-						i)) != NULL; i++) {
+	callbacks = &datapipe->output_triggers;
+	datapipe_callbacks_begin(callbacks);
+
+	t_beg = t_end = datapipe_stats_cb_tick();
+
+	for (guint i = 0; i < callbacks->used; ++i) {
+		void (*trigger)(gconstpointer input) = callbacks->items[i];
+		gint64 t_cb = t_end;
+
+		if (!trigger)
+			continue;
+
 		trigger(data);
+
+		t_end = datapipe_stats_cb_tick();
+		datapipe_stats_callback(datapipe, trigger, t_end - t_cb);
+	}
+
+	datapipe_stats_triggers(datapipe, t_end - t_beg);
+
+	datapipe_callbacks_end(callbacks);
+
+EXIT:
+	return;
+}
+
+/**
+ * Pass filtered data to the output triggers of a datapipe
+ *
+ * Applies the change suppression dispatch policy, if any.
+ *
+ * @param datapipe The datapipe to execute
+ * @param data The processed data
+ */
+static void datapipe_dispatch_output(datapipe_struct *const datapipe,
+				     gconstpointer data)
+{
+	if ((datapipe->dispatch & DATAPIPE_DISPATCH_ON_CHANGE) &&
+	    datapipe->output_valid && datapipe->output_data == data) {
+		datapipe->suppressed += 1;
+		goto EXIT;
+	}
+
+	datapipe->output_data = data;
+	datapipe->output_valid = TRUE;
+
+	execute_datapipe_output_triggers(datapipe, data, USE_INDATA);
+
+EXIT:
+	return;
+}
+
+/**
+ * Idle callback for executing coalesced datapipe re-evaluations
+ *
+ * @param aptr The datapipe to execute
+ *
+ * @return FALSE to stop the idle callback from repeating
+ */
+static gboolean datapipe_coalesce_cb(gpointer aptr)
+{
+	datapipe_struct *datapipe = aptr;
+	gconstpointer data;
+	gint64 t_beg, t_end;
+
+	if (!datapipe->coalesce_id)
+		goto EXIT;
+
+	datapipe->coalesce_id = 0;
+
+	t_beg = datapipe_stats_tick();
+
+	if (datapipe->read_only == READ_ONLY) {
+		data = datapipe->cached_data;
+	} else {
+		data = execute_datapipe_filters(datapipe, NULL, USE_CACHE);
+	}
+
+	datapipe_dispatch_output(datapipe, data);
+
+	t_end = datapipe_stats_tick();
+	datapipe_stats_execution(datapipe, t_end - t_beg);
+	mce_trace_add(MCE_TRACE_DATAPIPE, datapipe->trace_name,
+		      GPOINTER_TO_INT(data), (t_end - t_beg) / 1000);
+
+EXIT:
+	return FALSE;
+}
+
+/**
+ * Cancel pending coalesced datapipe re-evaluation
+ *
+ * @param datapipe The datapipe to manipulate
+ */
+static void datapipe_coalesce_cancel(datapipe_struct *const datapipe)
+{
+	if (datapipe->coalesce_id) {
+		g_source_remove(datapipe->coalesce_id),
+			datapipe->coalesce_id = 0;
+	}
+}
+
+/* ========================================================================= *
+ * TRANSACTIONS
+ * ========================================================================= */
+
+/** Transaction nesting depth */
+static guint datapipe_txn_depth = 0;
+
+/** Datapipes with output triggers deferred to transaction commit */
+static datapipe_callbacks_t datapipe_txn_pending = { 0, };
+
+/** Generation counter for marking datapipes during dependency walks */
+static guint datapipe_txn_generation = 0;
+
+/** Check if output triggers of a datapipe can be deferred
+ *
+ * Deferring requires that the filtered value stays valid until
+ * the transaction is committed, i.e. the datapipe must carry plain
+ * values stored in pointers.
+ *
+ * @param datapipe The datapipe to check
+ *
+ * @return TRUE if output can be deferred, FALSE otherwise
+ */
+static gboolean datapipe_txn_can_defer(const datapipe_struct *datapipe)
+{
+	return (datapipe->datasize == 0 &&
+		datapipe->free_cache == DONT_FREE_CACHE);
+}
+
+/** Defer passing filtered data to output triggers until commit
+ *
+ * If the datapipe is executed several times within a transaction,
+ * only the last value is passed to the output triggers.
+ *
+ * @param datapipe The datapipe that was executed
+ * @param data The processed data
+ */
+static void datapipe_txn_defer(datapipe_struct *const datapipe,
+			       gconstpointer data)
+{
+	if (!datapipe->txn_pending) {
+		datapipe->txn_pending = TRUE;
+		datapipe_callbacks_append(&datapipe_txn_pending, datapipe);
+	}
+	datapipe->txn_data = data;
+}
+
+/** Drop datapipe from the set of deferred datapipes
+ *
+ * @param datapipe The datapipe to manipulate
+ */
+static void datapipe_txn_forget(datapipe_struct *const datapipe)
+{
+	if (datapipe->txn_pending) {
+		datapipe->txn_pending = FALSE;
+		datapipe_callbacks_remove(&datapipe_txn_pending, datapipe);
+	}
+}
+
+/** Check if datapipe depends on another one, directly or indirectly
+ *
+ * @param datapipe The datapipe to start the walk from
+ * @param prerequisite The datapipe to look for
+ *
+ * @return TRUE if prerequisite is reachable from datapipe, FALSE otherwise
+ */
+static gboolean datapipe_txn_reachable(datapipe_struct *const datapipe,
+				       const datapipe_struct *prerequisite)
+{
+	gboolean reachable = FALSE;
+
+	if (datapipe == prerequisite) {
+		reachable = TRUE;
+		goto EXIT;
+	}
+
+	if (datapipe->txn_visit == datapipe_txn_generation)
+		goto EXIT;
+
+	datapipe->txn_visit = datapipe_txn_generation;
+
+	for (guint i = 0; i < datapipe->depends_on.used; ++i) {
+		if (datapipe_txn_reachable(datapipe->depends_on.items[i],
+					   prerequisite)) {
+			reachable = TRUE;
+			break;
+		}
+	}
+
+EXIT:
+	return reachable;
+}
+
+/** Add deferred datapipes to dispatch order, prerequisites first
+ *
+ * @param datapipe The datapipe to start the walk from
+ * @param order Array where to append the deferred datapipes
+ */
+static void datapipe_txn_sort(datapipe_struct *const datapipe,
+			      datapipe_callbacks_t *order)
+{
+	if (datapipe->txn_visit == datapipe_txn_generation)
+		goto EXIT;
+
+	datapipe->txn_visit = datapipe_txn_generation;
+
+	/* Prerequisites that were not executed in the transaction are
+	 * walked too, so that indirect dependencies are honored */
+	for (guint i = 0; i < datapipe->depends_on.used; ++i)
+		datapipe_txn_sort(datapipe->depends_on.items[i], order);
+
+	if (datapipe->txn_pending)
+		datapipe_callbacks_append(order, datapipe);
+
+EXIT:
+	return;
+}
+
+/** Execute deferred output triggers in dependency order
+ */
+static void datapipe_txn_flush(void)
+{
+	datapipe_callbacks_t order;
+
+	datapipe_callbacks_init(&order);
+
+	datapipe_txn_generation += 1;
+
+	for (guint i = 0; i < datapipe_txn_pending.used; ++i)
+		datapipe_txn_sort(datapipe_txn_pending.items[i], &order);
+
+	/* Output triggers are free to start new transactions */
+	datapipe_txn_pending.used = 0;
+	datapipe_txn_pending.count = 0;
+
+	for (guint i = 0; i < order.used; ++i) {
+		datapipe_struct *datapipe = order.items[i];
+
+		/* Skip datapipes that have already been executed
+		 * again by the output triggers of prerequisites */
+		if (!datapipe->txn_pending)
+			continue;
+
+		datapipe->txn_pending = FALSE;
+		datapipe_dispatch_output(datapipe, datapipe->txn_data);
+	}
+
+	datapipe_callbacks_quit(&order);
+}
+
+/**
+ * Declare execution order dependency between datapipes
+ *
+ * When both datapipes are executed within the same transaction, the
+ * output triggers of the prerequisite datapipe are run first.
+ *
+ * @param datapipe The dependent datapipe
+ * @param prerequisite The datapipe that must be dispatched first
+ */
+void datapipe_add_dependency(datapipe_struct *const datapipe,
+			     datapipe_struct *const prerequisite)
+{
+	if (datapipe == NULL || prerequisite == NULL) {
+		mce_log(LL_ERR,
+			"datapipe_add_dependency() called "
+			"without a valid datapipe");
+		goto EXIT;
+	}
+
+	datapipe_txn_generation += 1;
+
+	if (datapipe_txn_reachable(prerequisite, datapipe)) {
+		mce_log(LL_ERR,
+			"datapipe_add_dependency() called "
+			"with dependency that would create a cycle");
+		goto EXIT;
+	}
+
+	datapipe_callbacks_append(&datapipe->depends_on, prerequisite);
+
+EXIT:
+	return;
+}
+
+/**
+ * Start a datapipe transaction
+ *
+ * Until the matching datapipe_transaction_commit() call, executing
+ * datapipes that carry plain values updates the cached value and runs
+ * input triggers and filters as usual, but the output triggers are run
+ * only once on commit, with the last value, and in dependency order.
+ *
+ * Transactions can be nested; only the outermost commit is effective.
+ */
+void datapipe_transaction_begin(void)
+{
+	datapipe_txn_depth += 1;
+}
+
+/**
+ * Commit a datapipe transaction
+ */
+void datapipe_transaction_commit(void)
+{
+	if (datapipe_txn_depth == 0) {
+		mce_log(LL_ERR,
+			"datapipe_transaction_commit() called "
+			"without matching datapipe_transaction_begin()");
+		goto EXIT;
 	}
 
+	if (--datapipe_txn_depth == 0)
+		datapipe_txn_flush();
+
 EXIT:
 	return;
 }
 
+/* ========================================================================= *
+ * DATAPIPE EXECUTION API
+ * ========================================================================= */
+
 /**
  * Execute the datapipe
  *
@@ -348,7 +965,9 @@ EXIT:
  *                  USE_INDATA to use indata
  * @param cache_indata CACHE_INDATA to cache the indata,
  *                     DONT_CACHE_INDATA to keep the old data
- * @return The processed data
+ * @return The processed data; for coalesced executions the filters
+ *         have not been run yet, and the cached unfiltered data is
+ *         returned instead
  */
 gconstpointer execute_datapipe(datapipe_struct *const datapipe,
 			       gpointer indata,
@@ -356,6 +975,7 @@ gconstpointer execute_datapipe(datapipe_struct *const datapipe,
 			       const caching_policy_t cache_indata)
 {
 	gconstpointer data = NULL;
+	gint64 t_beg, t_end;
 
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
@@ -364,6 +984,26 @@ gconstpointer execute_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
+	/* Re-evaluations from cache are merged into one pass that
+	 * is made on the next main loop iteration */
+	if ((datapipe->dispatch & DATAPIPE_DISPATCH_COALESCE) &&
+	    use_cache == USE_CACHE) {
+		if (datapipe->coalesce_id)
+			datapipe->coalesced += 1;
+		else
+			datapipe->coalesce_id =
+				g_idle_add_full(G_PRIORITY_HIGH,
+						datapipe_coalesce_cb,
+						datapipe, NULL);
+		data = datapipe->cached_data;
+		goto EXIT;
+	}
+
+	/* Immediate execution makes pending re-evaluation redundant */
+	datapipe_coalesce_cancel(datapipe);
+
+	t_beg = datapipe_stats_tick();
+
 	execute_datapipe_input_triggers(datapipe, indata, use_cache,
 					cache_indata);
 
@@ -373,12 +1013,63 @@ gconstpointer execute_datapipe(datapipe_struct *const datapipe,
 		data = execute_datapipe_filters(datapipe, indata, use_cache);
 	}
 
-	execute_datapipe_output_triggers(datapipe, data, USE_INDATA);
+	if (datapipe_txn_depth && datapipe_txn_can_defer(datapipe)) {
+		datapipe_txn_defer(datapipe, data);
+	} else {
+		/* Latest value supersedes what was deferred */
+		datapipe_txn_forget(datapipe);
+		datapipe_dispatch_output(datapipe, data);
+	}
+
+	t_end = datapipe_stats_tick();
+	datapipe_stats_execution(datapipe, t_end - t_beg);
+	mce_trace_add(MCE_TRACE_DATAPIPE, datapipe->trace_name,
+		      GPOINTER_TO_INT(data), (t_end - t_beg) / 1000);
 
 EXIT:
 	return data;
 }
 
+/**
+ * Set dispatch policy of a datapipe
+ *
+ * DATAPIPE_DISPATCH_ON_CHANGE compares values as pointers and can thus
+ * be used only on datapipes that carry values stored in pointers.
+ *
+ * @param datapipe The datapipe to manipulate
+ * @param dispatch Bitmask of datapipe_dispatch_t flags, or
+ *                 DATAPIPE_DISPATCH_ALWAYS for default behavior
+ */
+void datapipe_set_dispatch_policy(datapipe_struct *const datapipe,
+				  const guint dispatch)
+{
+	if (datapipe == NULL) {
+		mce_log(LL_ERR,
+			"datapipe_set_dispatch_policy() called "
+			"without a valid datapipe");
+		goto EXIT;
+	}
+
+	if ((dispatch & DATAPIPE_DISPATCH_ON_CHANGE) &&
+	    (datapipe->datasize != 0 ||
+	     datapipe->free_cache == FREE_CACHE)) {
+		mce_log(LL_ERR,
+			"datapipe_set_dispatch_policy() called "
+			"with DATAPIPE_DISPATCH_ON_CHANGE on "
+			"datapipe that does not carry plain values");
+		goto EXIT;
+	}
+
+	if (!(dispatch & DATAPIPE_DISPATCH_COALESCE))
+		datapipe_coalesce_cancel(datapipe);
+
+	datapipe->dispatch = dispatch;
+	datapipe->output_valid = FALSE;
+
+EXIT:
+	return;
+}
+
 /**
  * Append a filter to an existing datapipe
  *
@@ -388,9 +1079,6 @@ EXIT:
 void append_filter_to_datapipe(datapipe_struct *const datapipe,
 			       gpointer (*filter)(gpointer data))
 {
-	void (*refcount_trigger)(void);
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"append_filter_to_datapipe() called "
@@ -412,11 +1100,9 @@ void append_filter_to_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->filters = g_slist_append(datapipe->filters, filter);
+	datapipe_callbacks_append(&datapipe->filters, filter);
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	datapipe_exec_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -432,10 +1118,6 @@ EXIT:
 void remove_filter_from_datapipe(datapipe_struct *const datapipe,
 				 gpointer (*filter)(gpointer data))
 {
-	void (*refcount_trigger)(void);
-	guint oldlen;
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"remove_filter_from_datapipe() called "
@@ -457,20 +1139,13 @@ void remove_filter_from_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	oldlen = g_slist_length(datapipe->filters);
-
-	datapipe->filters = g_slist_remove(datapipe->filters, filter);
-
-	/* Did we remove any entry? */
-	if (oldlen == g_slist_length(datapipe->filters)) {
+	if (!datapipe_callbacks_remove(&datapipe->filters, filter)) {
 		mce_log(LL_DEBUG,
 			"Trying to remove non-existing filter");
 		goto EXIT;
 	}
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	datapipe_exec_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -485,9 +1160,6 @@ EXIT:
 void append_input_trigger_to_datapipe(datapipe_struct *const datapipe,
 				      void (*trigger)(gconstpointer data))
 {
-	void (*refcount_trigger)(void);
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"append_input_trigger_to_datapipe() called "
@@ -502,12 +1174,9 @@ void append_input_trigger_to_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->input_triggers = g_slist_append(datapipe->input_triggers,
-						  trigger);
+	datapipe_callbacks_append(&datapipe->input_triggers, trigger);
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	datapipe_exec_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -523,10 +1192,6 @@ EXIT:
 void remove_input_trigger_from_datapipe(datapipe_struct *const datapipe,
 					void (*trigger)(gconstpointer data))
 {
-	void (*refcount_trigger)(void);
-	guint oldlen;
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"remove_input_trigger_from_datapipe() called "
@@ -541,21 +1206,13 @@ void remove_input_trigger_from_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	oldlen = g_slist_length(datapipe->input_triggers);
-
-	datapipe->input_triggers = g_slist_remove(datapipe->input_triggers,
-						  trigger);
-
-	/* Did we remove any entry? */
-	if (oldlen == g_slist_length(datapipe->input_triggers)) {
+	if (!datapipe_callbacks_remove(&datapipe->input_triggers, trigger)) {
 		mce_log(LL_DEBUG,
 			"Trying to remove non-existing input trigger");
 		goto EXIT;
 	}
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	datapipe_exec_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -570,9 +1227,6 @@ EXIT:
 void append_output_trigger_to_datapipe(datapipe_struct *const datapipe,
 				       void (*trigger)(gconstpointer data))
 {
-	void (*refcount_trigger)(void);
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"append_output_trigger_to_datapipe() called "
@@ -587,12 +1241,9 @@ void append_output_trigger_to_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->output_triggers = g_slist_append(datapipe->output_triggers,
-						   trigger);
+	datapipe_callbacks_append(&datapipe->output_triggers, trigger);
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	datapipe_exec_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -608,10 +1259,6 @@ EXIT:
 void remove_output_trigger_from_datapipe(datapipe_struct *const datapipe,
 					 void (*trigger)(gconstpointer data))
 {
-	void (*refcount_trigger)(void);
-	guint oldlen;
-	gint i;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"remove_output_trigger_from_datapipe() called "
@@ -626,21 +1273,13 @@ void remove_output_trigger_from_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	oldlen = g_slist_length(datapipe->output_triggers);
-
-	datapipe->output_triggers = g_slist_remove(datapipe->output_triggers,
-						   trigger);
-
-	/* Did we remove any entry? */
-	if (oldlen == g_slist_length(datapipe->output_triggers)) {
+	if (!datapipe_callbacks_remove(&datapipe->output_triggers, trigger)) {
 		mce_log(LL_DEBUG,
 			"Trying to remove non-existing output trigger");
 		goto EXIT;
 	}
 
-	for (i = 0; (refcount_trigger = g_slist_nth_data(datapipe->refcount_triggers, i)) != NULL; i++) {
-		refcount_trigger();
-	}
+	datapipe_exec_refcount_triggers(datapipe);
 
 EXIT:
 	return;
@@ -669,7 +1308,7 @@ void append_refcount_trigger_to_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->refcount_triggers = g_slist_append(datapipe->refcount_triggers, trigger);
+	datapipe_callbacks_append(&datapipe->refcount_triggers, trigger);
 
 EXIT:
 	return;
@@ -685,8 +1324,6 @@ EXIT:
 void remove_refcount_trigger_from_datapipe(datapipe_struct *const datapipe,
 					   void (*trigger)(void))
 {
-	guint oldlen;
-
 	if (datapipe == NULL) {
 		mce_log(LL_ERR,
 			"remove_refcount_trigger_from_datapipe() called "
@@ -701,12 +1338,7 @@ void remove_refcount_trigger_from_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	oldlen = g_slist_length(datapipe->refcount_triggers);
-
-	datapipe->refcount_triggers = g_slist_remove(datapipe->refcount_triggers, trigger);
-
-	/* Did we remove any entry? */
-	if (oldlen == g_slist_length(datapipe->refcount_triggers)) {
+	if (!datapipe_callbacks_remove(&datapipe->refcount_triggers, trigger)) {
 		mce_log(LL_DEBUG,
 			"Trying to remove non-existing refcount trigger");
 		goto EXIT;
@@ -725,7 +1357,9 @@ EXIT:
  * @param free_cache FREE_CACHE if the cached data needs to be freed,
  *                   DONT_FREE_CACHE if the cache data should not be freed
  * @param datasize Pass size of memory to copy,
- *		   or 0 if only passing pointers or data as pointers
+ *		   or 0 if only passing pointers or data as pointers;
+ *		   values up to DATAPIPE_SLOT_SIZE bytes are cached
+ *		   within the datapipe itself
  * @param initial_data Initial cache content
  */
 void setup_datapipe(datapipe_struct *const datapipe,
@@ -740,14 +1374,39 @@ void setup_datapipe(datapipe_struct *const datapipe,
 		goto EXIT;
 	}
 
-	datapipe->filters = NULL;
-	datapipe->input_triggers = NULL;
-	datapipe->output_triggers = NULL;
-	datapipe->refcount_triggers = NULL;
+	datapipe_callbacks_init(&datapipe->filters);
+	datapipe_callbacks_init(&datapipe->input_triggers);
+	datapipe_callbacks_init(&datapipe->output_triggers);
+	datapipe_callbacks_init(&datapipe->refcount_triggers);
 	datapipe->datasize = datasize;
 	datapipe->read_only = read_only;
 	datapipe->free_cache = free_cache;
 	datapipe->cached_data = initial_data;
+	memset(&datapipe->slot, 0, sizeof datapipe->slot);
+	datapipe->dispatch = DATAPIPE_DISPATCH_ALWAYS;
+	datapipe->output_data = NULL;
+	datapipe->output_valid = FALSE;
+	datapipe->coalesce_id = 0;
+	datapipe->suppressed = 0;
+	datapipe->coalesced = 0;
+	datapipe->name = NULL;
+	datapipe->trace_name = MCE_TRACE_NAME_UNKNOWN;
+	memset(&datapipe->stats, 0, sizeof datapipe->stats);
+	datapipe_callbacks_init(&datapipe->depends_on);
+	datapipe->txn_pending = FALSE;
+	datapipe->txn_data = NULL;
+	datapipe->txn_visit = 0;
+
+	/* Small values are cached in the inline slot, which
+	 * is owned by the datapipe and must not be freed */
+	if (datapipe_has_inline_slot(datapipe)) {
+		datapipe->free_cache = DONT_FREE_CACHE;
+
+		if (initial_data) {
+			memcpy(datapipe->slot.bytes, initial_data, datasize);
+			datapipe->cached_data = datapipe->slot.bytes;
+		}
+	}
 
 EXIT:
 	return;
@@ -768,34 +1427,43 @@ void free_datapipe(datapipe_struct *const datapipe)
 	}
 
 	/* Warn about still registered filters/triggers */
-	if (datapipe->filters != NULL) {
+	if (datapipe->filters.count != 0) {
 		mce_log(LL_INFO,
 			"free_datapipe() called on a datapipe that "
 			"still has registered filter(s)");
 	}
 
-	if (datapipe->input_triggers != NULL) {
+	if (datapipe->input_triggers.count != 0) {
 		mce_log(LL_INFO,
 			"free_datapipe() called on a datapipe that "
 			"still has registered input_trigger(s)");
 	}
 
-	if (datapipe->output_triggers != NULL) {
+	if (datapipe->output_triggers.count != 0) {
 		mce_log(LL_INFO,
 			"free_datapipe() called on a datapipe that "
 			"still has registered output_trigger(s)");
 	}
 
-	if (datapipe->refcount_triggers != NULL) {
+	if (datapipe->refcount_triggers.count != 0) {
 		mce_log(LL_INFO,
 			"free_datapipe() called on a datapipe that "
 			"still has registered refcount_trigger(s)");
 	}
 
+	datapipe_coalesce_cancel(datapipe);
+	datapipe_txn_forget(datapipe);
+
 	if (datapipe->free_cache == FREE_CACHE) {
 		g_free(datapipe->cached_data);
 	}
 
+	datapipe_callbacks_quit(&datapipe->filters);
+	datapipe_callbacks_quit(&datapipe->input_triggers);
+	datapipe_callbacks_quit(&datapipe->output_triggers);
+	datapipe_callbacks_quit(&datapipe->refcount_triggers);
+	datapipe_callbacks_quit(&datapipe->depends_on);
+
 EXIT:
 	return;
 }
@@ -830,19 +1498,19 @@ void mce_datapipe_init(void)
 		       0, GINT_TO_POINTER(0));
 	setup_datapipe(&lpm_brightness_pipe, READ_WRITE, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&led_pattern_activate_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&led_pattern_activate_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, NULL);
 	setup_datapipe(&device_resumed_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, NULL);
-	setup_datapipe(&led_pattern_deactivate_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&led_pattern_deactivate_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, NULL);
 	setup_datapipe(&user_activity_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, NULL);
 	setup_datapipe(&key_backlight_pipe, READ_WRITE, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(0));
-	setup_datapipe(&keypress_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&keypress_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       sizeof (struct input_event), NULL);
-	setup_datapipe(&touchscreen_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&touchscreen_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       sizeof (struct input_event), NULL);
 	setup_datapipe(&device_inactive_pipe, READ_WRITE, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(TRUE));
@@ -925,6 +1593,35 @@ void mce_datapipe_init(void)
 		       0, GINT_TO_POINTER(FALSE));
 	setup_datapipe(&proximity_blank_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(FALSE));
+
+	/* Brightness re-evaluations from the als filter come in
+	 * bursts and often do not change the resulting level.
+	 *
+	 * The display state machine uses the levels that the display
+	 * and lpm brightness output triggers store synchronously, so
+	 * those can't be coalesced. Led and key backlight levels are
+	 * only pushed to hardware and can be applied a bit later. */
+	datapipe_set_dispatch_policy(&display_brightness_pipe,
+				     DATAPIPE_DISPATCH_ON_CHANGE);
+	datapipe_set_dispatch_policy(&lpm_brightness_pipe,
+				     DATAPIPE_DISPATCH_ON_CHANGE);
+	datapipe_set_dispatch_policy(&led_brightness_pipe,
+				     DATAPIPE_DISPATCH_COALESCE);
+	datapipe_set_dispatch_policy(&key_backlight_pipe,
+				     DATAPIPE_DISPATCH_COALESCE);
+
+	/* Within transactions: the ui must be locked / the proximity
+	 * blanking must be exposed before display state changes */
+	datapipe_add_dependency(&display_state_req_pipe, &tk_lock_pipe);
+	datapipe_add_dependency(&display_state_req_pipe, &proximity_blank_pipe);
+	datapipe_add_dependency(&display_state_req_pipe, &submode_pipe);
+
+	/* Tag datapipes with names */
+#define DATAPIPE_SET_NAME(_datapipe, _type) \
+	_datapipe.name = #_datapipe; \
+	_datapipe.trace_name = mce_trace_intern(#_datapipe);
+	DATAPIPE_TYPE_TABLE(DATAPIPE_SET_NAME)
+#undef DATAPIPE_SET_NAME
 }
 
 /** Free all datapipes
@@ -992,6 +1689,147 @@ void mce_datapipe_quit(void)
 	free_datapipe(&proximity_blank_pipe);
 }
 
+/* ========================================================================= *
+ * STATISTICS REPORT
+ * ========================================================================= */
+
+/** All datapipes, for statistics reporting */
+static datapipe_struct *const datapipe_stats_lut[] =
+{
+#define DATAPIPE_STATS_ENTRY(_datapipe, _type) &_datapipe,
+	DATAPIPE_TYPE_TABLE(DATAPIPE_STATS_ENTRY)
+#undef DATAPIPE_STATS_ENTRY
+	NULL
+};
+
+/** Append human readable callback address to string
+ *
+ * Uses dladdr() to map the address to symbol name, or to
+ * object file + offset suitable for addr2line if the symbol
+ * is not exported (e.g. static functions in plugins).
+ *
+ * @param buf      string to append to
+ * @param callback callback address
+ */
+static void datapipe_stats_append_symbol(GString *buf, gconstpointer callback)
+{
+	Dl_info info;
+
+	memset(&info, 0, sizeof info);
+
+	if (!callback) {
+		g_string_append(buf, "-");
+	} else if (!dladdr(callback, &info) || !info.dli_fname) {
+		g_string_append_printf(buf, "%p", callback);
+	} else if (info.dli_sname) {
+		g_string_append_printf(buf, "%s", info.dli_sname);
+	} else {
+		const char *base = strrchr(info.dli_fname, '/');
+		g_string_append_printf(buf, "%s+0x%lx",
+				       base ? base + 1 : info.dli_fname,
+				       (unsigned long)((const char *)callback -
+						       (const char *)info.dli_fbase));
+	}
+}
+
+/** Get datapipe execution statistics as human readable text
+ *
+ * @return report string, to be released with g_free()
+ */
+gchar *datapipe_stats_report(void)
+{
+	GString *buf = g_string_new(0);
+
+	if (!datapipe_stats_enabled)
+		g_string_append(buf, "# callback timing is disabled\n");
+
+	g_string_append_printf(buf, "%-28s %8s %8s %8s %10s %8s %10s %8s %s\n",
+			       "datapipe", "exec", "skip", "merge",
+			       "filter_ms", "max_us", "trigger_ms", "max_us",
+			       "slowest_callback");
+
+	for (size_t i = 0; datapipe_stats_lut[i]; ++i) {
+		const datapipe_struct *datapipe = datapipe_stats_lut[i];
+		const datapipe_stats_t *stats = &datapipe->stats;
+
+		if (!stats->executions && !stats->trigger_ns)
+			continue;
+
+		g_string_append_printf(buf,
+				       "%-28s %8u %8u %8u %10.3f %8.0f %10.3f %8.0f ",
+				       datapipe->name ?: "unknown",
+				       stats->executions,
+				       datapipe->suppressed,
+				       datapipe->coalesced,
+				       stats->filter_ns * 1e-6,
+				       stats->filter_max_ns * 1e-3,
+				       stats->trigger_ns * 1e-6,
+				       stats->trigger_max_ns * 1e-3);
+		datapipe_stats_append_symbol(buf, stats->slowest_cb);
+		g_string_append_printf(buf, " (%.0f us)\n",
+				       stats->slowest_ns * 1e-3);
+	}
+
+	g_string_append_printf(buf, "\nexecution latency histogram\n");
+
+	for (size_t i = 0; datapipe_stats_lut[i]; ++i) {
+		const datapipe_struct *datapipe = datapipe_stats_lut[i];
+		const datapipe_stats_t *stats = &datapipe->stats;
+
+		if (!stats->executions)
+			continue;
+
+		g_string_append_printf(buf, "%-28s",
+				       datapipe->name ?: "unknown");
+
+		for (guint bucket = 0; bucket < DATAPIPE_STATS_BUCKETS; ++bucket) {
+			if (!stats->histogram[bucket])
+				continue;
+
+			if (bucket == DATAPIPE_STATS_BUCKETS - 1)
+				g_string_append_printf(buf, " >=%uus:%u",
+						       1u << (bucket - 1),
+						       stats->histogram[bucket]);
+			else
+				g_string_append_printf(buf, " <%uus:%u",
+						       1u << bucket,
+						       stats->histogram[bucket]);
+		}
+		g_string_append(buf, "\n");
+	}
+
+	return g_string_free(buf, FALSE);
+}
+
+/** Reset execution statistics of all datapipes
+ */
+static void datapipe_stats_reset(void)
+{
+	for (size_t i = 0; datapipe_stats_lut[i]; ++i) {
+		datapipe_struct *datapipe = datapipe_stats_lut[i];
+
+		memset(&datapipe->stats, 0, sizeof datapipe->stats);
+		datapipe->suppressed = 0;
+		datapipe->coalesced = 0;
+	}
+}
+
+/** Enable/disable timing of individual datapipe callbacks
+ *
+ * Execution counts and latencies are always collected. Filter and
+ * trigger timings cost a clock read per callback and are collected
+ * only while enabled. Enabling clears previously collected statistics.
+ *
+ * @param enabled TRUE to enable callback timing, FALSE to disable
+ */
+void datapipe_stats_set_enabled(gboolean enabled)
+{
+	if (enabled)
+		datapipe_stats_reset();
+
+	datapipe_stats_enabled = enabled;
+}
+
 /** Convert system_state_t enum to human readable string
  *
  * @param state system_state_t enumeration value
@@ -24,6 +24,8 @@
 #include <stdbool.h>
 #include <glib.h>
 
+#include <linux/input.h>
+
 /** Device lock states used in device_lock_state_pipe */
 typedef enum
 {
@@ -39,22 +41,117 @@ typedef enum
 
 const char *device_lock_state_repr(device_lock_state_t state);
 
+/**
+ * Array of datapipe callbacks
+ *
+ * Callbacks are stored in registration order in a contiguous array
+ * so that executing a datapipe is a single linear scan.
+ *
+ * Removing callbacks while the array is being iterated just clears
+ * the slot; the holes are squeezed out once the outermost iteration
+ * finishes. Appending during iteration is always safe since the
+ * iterators re-read the item pointer and count on every round.
+ *
+ * Only access this struct through the datapipe functions
+ */
+typedef struct {
+	gpointer *items;		/**< Callback slots, NULL = removed */
+	guint used;			/**< Number of slots in use */
+	guint size;			/**< Number of slots allocated */
+	guint count;			/**< Number of non-NULL slots */
+	guint busy;			/**< Iteration nesting level */
+} datapipe_callbacks_t;
+
+/** Size of inline value storage within datapipe */
+#define DATAPIPE_SLOT_SIZE 32
+
+/**
+ * Inline storage for small datapipe values
+ *
+ * Datapipes set up with non-zero datasize that fits in the slot
+ * cache values by copying them here instead of using heap memory.
+ */
+typedef union {
+	gint64 align;			/**< Force 64-bit alignment */
+	gpointer pointer;		/**< Force pointer alignment */
+	guchar bytes[DATAPIPE_SLOT_SIZE];	/**< Raw storage */
+} datapipe_slot_t;
+
+/**
+ * Datapipe dispatch policy flags
+ */
+typedef enum {
+	/** Every execution runs all triggers and filters */
+	DATAPIPE_DISPATCH_ALWAYS    = 0,
+
+	/** Output triggers are not called with unchanged data;
+	 *  filters are still run as their state can change the
+	 *  result even when the input value stays the same */
+	DATAPIPE_DISPATCH_ON_CHANGE = 1 << 0,
+
+	/** Re-evaluations from cache are merged into one
+	 *  filter + output trigger pass per main loop iteration;
+	 *  use only on datapipes where nothing depends on output
+	 *  triggers having been run when execute_datapipe() returns;
+	 *  for such re-evaluations execute_datapipe() returns the
+	 *  unfiltered cached data */
+	DATAPIPE_DISPATCH_COALESCE  = 1 << 1,
+} datapipe_dispatch_t;
+
+/** Number of buckets in datapipe execution latency histogram */
+#define DATAPIPE_STATS_BUCKETS 16
+
+/**
+ * Datapipe execution statistics
+ */
+typedef struct {
+	guint executions;		/**< Number of executions */
+	gint64 filter_ns;		/**< Total time spent in filters */
+	gint64 filter_max_ns;		/**< Longest filter pass */
+	gint64 trigger_ns;		/**< Total time spent in triggers */
+	gint64 trigger_max_ns;		/**< Longest trigger pass */
+	gconstpointer slowest_cb;	/**< Slowest individual callback */
+	gint64 slowest_ns;		/**< Time spent in slowest_cb */
+	guint histogram[DATAPIPE_STATS_BUCKETS]; /**< Execution latency;
+						  *   bucket N counts runs
+						  *   under 2^N microseconds */
+} datapipe_stats_t;
+
 /**
  * Datapipe structure
  *
  * Only access this struct through the functions
  */
 typedef struct {
-	GSList *filters;		/**< The filters */
-	GSList *input_triggers;		/**< Triggers called on indata */
-	GSList *output_triggers;	/**< Triggers called on outdata */
-	GSList *refcount_triggers;	/**< Triggers called on
-					 *   reference count changes
-					 */
+	datapipe_callbacks_t filters;		/**< The filters */
+	datapipe_callbacks_t input_triggers;	/**< Triggers called on
+						 *   indata */
+	datapipe_callbacks_t output_triggers;	/**< Triggers called on
+						 *   outdata */
+	datapipe_callbacks_t refcount_triggers;	/**< Triggers called on
+						 *   reference count changes
+						 */
 	gpointer cached_data;		/**< Latest cached data */
 	gsize datasize;			/**< Size of data; NULL == automagic */
 	gboolean free_cache;		/**< Free the cache? */
 	gboolean read_only;		/**< Datapipe is read only */
+	datapipe_slot_t slot;		/**< Inline cache for small values */
+	guint dispatch;			/**< datapipe_dispatch_t flags */
+	gconstpointer output_data;	/**< Latest data passed to
+					 *   output triggers */
+	gboolean output_valid;		/**< output_data has been set */
+	guint coalesce_id;		/**< Pending coalesced execution */
+	guint suppressed;		/**< Output dispatches skipped as no-change */
+	guint coalesced;		/**< Executions merged to pending one */
+	const char *name;		/**< Datapipe name, for diagnostics */
+	guint16 trace_name;		/**< Interned name for mce-trace */
+	datapipe_stats_t stats;		/**< Execution statistics */
+	datapipe_callbacks_t depends_on;	/**< Datapipes whose output
+						 *   triggers must be run
+						 *   first in transactions */
+	gboolean txn_pending;		/**< Output deferred to commit */
+	gconstpointer txn_data;		/**< Deferred output data */
+	guint txn_visit;		/**< Dependency walk generation */
 } datapipe_struct;
 
 /**
@@ -150,33 +247,181 @@ extern datapipe_struct keypad_grab_active_pipe;
 extern datapipe_struct music_playback_pipe;
 extern datapipe_struct proximity_blank_pipe;
 
+/**
+ * Value types carried by the datapipes
+ *
+ * Each X(pipe, type) entry generates a compile time type tag that
+ * the typed accessor macros below check against, i.e. reading
+ * a gboolean pipe with datapipe_get_gint() fails to build.
+ */
+#define DATAPIPE_TYPE_TABLE(X) \
+	X(led_brightness_pipe,		gint) \
+	X(lpm_brightness_pipe,		gint) \
+	X(device_inactive_pipe,		gbool) \
+	X(led_pattern_activate_pipe,	string) \
+	X(led_pattern_deactivate_pipe,	string) \
+	X(device_resumed_pipe,		gpointer) \
+	X(user_activity_pipe,		input_event) \
+	X(display_state_pipe,		gint) \
+	X(display_state_req_pipe,	gint) \
+	X(display_state_next_pipe,	gint) \
+	X(exception_state_pipe,		gint) \
+	X(display_brightness_pipe,	gint) \
+	X(key_backlight_pipe,		guint) \
+	X(keypress_pipe,		input_event) \
+	X(touchscreen_pipe,		input_event) \
+	X(lockkey_pipe,			gint) \
+	X(keyboard_slide_pipe,		gint) \
+	X(keyboard_available_pipe,	gint) \
+	X(lid_sensor_is_working_pipe,	gbool) \
+	X(lid_cover_sensor_pipe,	gint) \
+	X(lid_cover_policy_pipe,	gint) \
+	X(lens_cover_pipe,		gint) \
+	X(proximity_sensor_pipe,	gint) \
+	X(ambient_light_sensor_pipe,	gint) \
+	X(ambient_light_level_pipe,	gint) \
+	X(orientation_sensor_pipe,	gint) \
+	X(alarm_ui_state_pipe,		gint) \
+	X(system_state_pipe,		gint) \
+	X(master_radio_pipe,		gint) \
+	X(submode_pipe,			gint) \
+	X(call_state_pipe,		gint) \
+	X(call_type_pipe,		gint) \
+	X(tk_lock_pipe,			gint) \
+	X(charger_state_pipe,		gint) \
+	X(battery_status_pipe,		gint) \
+	X(battery_level_pipe,		gint) \
+	X(camera_button_pipe,		gint) \
+	X(inactivity_timeout_pipe,	gint) \
+	X(audio_route_pipe,		gint) \
+	X(usb_cable_pipe,		gint) \
+	X(jack_sense_pipe,		gint) \
+	X(power_saving_mode_pipe,	gbool) \
+	X(thermal_state_pipe,		gint) \
+	X(heartbeat_pipe,		gint) \
+	X(compositor_available_pipe,	gint) \
+	X(lipstick_available_pipe,	gint) \
+	X(usbmoded_available_pipe,	gint) \
+	X(ngfd_available_pipe,		gint) \
+	X(dsme_available_pipe,		gint) \
+	X(packagekit_locked_pipe,	gbool) \
+	X(update_mode_pipe,		gbool) \
+	X(shutting_down_pipe,		gbool) \
+	X(device_lock_state_pipe,	gint) \
+	X(touch_grab_wanted_pipe,	gbool) \
+	X(touch_grab_active_pipe,	gbool) \
+	X(keypad_grab_wanted_pipe,	gbool) \
+	X(keypad_grab_active_pipe,	gbool) \
+	X(music_playback_pipe,		gbool) \
+	X(proximity_blank_pipe,		gbool)
+
+/** Generate compile time type tag for a datapipe */
+#define DATAPIPE_TYPE_TAG(_datapipe, _type) \
+	enum { _datapipe##_is_##_type = 1 };
+
+DATAPIPE_TYPE_TABLE(DATAPIPE_TYPE_TAG)
+
+/** Fail build unless datapipe has been declared to carry given type */
+#define datapipe_check_type(_datapipe, _type) \
+	((void)sizeof(char[_datapipe##_is_##_type]))
+
+/** Pass const input_event pointer as datapipe indata
+ *
+ * Using this instead of plain cast makes sure the value
+ * really is an input event pointer.
+ */
+static inline gpointer datapipe_input_event_ptr(const struct input_event *ev)
+{
+	return (gpointer)ev;
+}
+
 /* Data retrieval */
 
 /** Retrieve a gboolean from a datapipe */
-#define datapipe_get_gbool(_datapipe)	(GPOINTER_TO_INT((_datapipe).cached_data))
+#define datapipe_get_gbool(_datapipe) \
+	(datapipe_check_type(_datapipe, gbool), \
+	 GPOINTER_TO_INT((_datapipe).cached_data))
 
 /** Retrieve a gint from a datapipe */
-#define datapipe_get_gint(_datapipe)	(GPOINTER_TO_INT((_datapipe).cached_data))
+#define datapipe_get_gint(_datapipe) \
+	(datapipe_check_type(_datapipe, gint), \
+	 GPOINTER_TO_INT((_datapipe).cached_data))
 
 /** Retrieve a guint from a datapipe */
-#define datapipe_get_guint(_datapipe)	(GPOINTER_TO_UINT((_datapipe).cached_data))
+#define datapipe_get_guint(_datapipe) \
+	(datapipe_check_type(_datapipe, guint), \
+	 GPOINTER_TO_UINT((_datapipe).cached_data))
 
 /** Retrieve a gsize from a datapipe */
-#define datapipe_get_gsize(_datapipe)	(GPOINTER_TO_SIZE((_datapipe).cached_data))
+#define datapipe_get_gsize(_datapipe) \
+	(datapipe_check_type(_datapipe, gsize), \
+	 GPOINTER_TO_SIZE((_datapipe).cached_data))
+
+/** Retrieve a constant string from a datapipe */
+#define datapipe_get_string(_datapipe) \
+	(datapipe_check_type(_datapipe, string), \
+	 (const char *)(_datapipe).cached_data)
+
+/** Retrieve an input event from a datapipe */
+#define datapipe_get_input_event(_datapipe) \
+	(datapipe_check_type(_datapipe, input_event), \
+	 (const struct input_event *)(_datapipe).cached_data)
 
 /** Retrieve a gpointer from a datapipe */
 #define datapipe_get_gpointer(_datapipe)	((_datapipe).cached_data)
 
+/* Typed datapipe execution */
+
+/** Execute datapipe with gint indata, return filtered gint */
+#define datapipe_exec_gint(_datapipe, _value, _cache) \
+	(datapipe_check_type(_datapipe, gint), \
+	 GPOINTER_TO_INT(execute_datapipe(&(_datapipe), \
+					  GINT_TO_POINTER(_value), \
+					  USE_INDATA, (_cache))))
+
+/** Execute datapipe with guint indata, return filtered guint */
+#define datapipe_exec_guint(_datapipe, _value, _cache) \
+	(datapipe_check_type(_datapipe, guint), \
+	 GPOINTER_TO_UINT(execute_datapipe(&(_datapipe), \
+					   GUINT_TO_POINTER(_value), \
+					   USE_INDATA, (_cache))))
+
+/** Execute datapipe with gboolean indata, return filtered gboolean */
+#define datapipe_exec_gbool(_datapipe, _value, _cache) \
+	(datapipe_check_type(_datapipe, gbool), \
+	 GPOINTER_TO_INT(execute_datapipe(&(_datapipe), \
+					  GINT_TO_POINTER((_value) != 0), \
+					  USE_INDATA, (_cache))))
+
+/** Execute datapipe with input event indata
+ *
+ * Caching is done by copying the event to the inline slot
+ * of the datapipe, i.e. no heap allocations are made.
+ */
+#define datapipe_exec_input_event(_datapipe, _ev, _cache) \
+	(datapipe_check_type(_datapipe, input_event), \
+	 (const struct input_event *) \
+	 execute_datapipe(&(_datapipe), \
+			  datapipe_input_event_ptr(_ev), \
+			  USE_INDATA, (_cache)))
+
+/** Execute output triggers of datapipe with string data */
+#define datapipe_exec_output_string(_datapipe, _str) \
+	(datapipe_check_type(_datapipe, string), \
+	 execute_datapipe_output_triggers(&(_datapipe), \
+					  (const char *)(_str), \
+					  USE_INDATA))
+
 /* Reference count */
 
 /** Retrieve the filter reference count from a datapipe */
-#define datapipe_get_filter_refcount(_datapipe)	(g_slist_length((_datapipe).filters))
+#define datapipe_get_filter_refcount(_datapipe)	((_datapipe).filters.count)
 
 /** Retrieve the input trigger reference count from a datapipe */
-#define datapipe_get_input_trigger_refcount(_datapipe)	(g_slist_length((_datapipe).input_triggers))
+#define datapipe_get_input_trigger_refcount(_datapipe)	((_datapipe).input_triggers.count)
 
 /** Retrieve the output trigger reference count from a datapipe */
-#define datapipe_get_output_trigger_refcount(_datapipe)	(g_slist_length((_datapipe).output_triggers))
+#define datapipe_get_output_trigger_refcount(_datapipe)	((_datapipe).output_triggers.count)
 
 /* Datapipe execution */
 void execute_datapipe_input_triggers(datapipe_struct *const datapipe,
@@ -186,7 +431,7 @@ void execute_datapipe_input_triggers(datapipe_struct *const datapipe,
 gconstpointer execute_datapipe_filters(datapipe_struct *const datapipe,
 				       gpointer indata,
 				       const data_source_t use_cache);
-void execute_datapipe_output_triggers(const datapipe_struct *const datapipe,
+void execute_datapipe_output_triggers(datapipe_struct *const datapipe,
 				      gconstpointer indata,
 				      const data_source_t use_cache);
 gconstpointer execute_datapipe(datapipe_struct *const datapipe,
@@ -218,6 +463,19 @@ void append_refcount_trigger_to_datapipe(datapipe_struct *const datapipe,
 void remove_refcount_trigger_from_datapipe(datapipe_struct *const datapipe,
 					   void (*trigger)(void));
 
+void datapipe_set_dispatch_policy(datapipe_struct *const datapipe,
+				  const guint dispatch);
+
+/* Transactions */
+void datapipe_add_dependency(datapipe_struct *const datapipe,
+			     datapipe_struct *const prerequisite);
+void datapipe_transaction_begin(void);
+void datapipe_transaction_commit(void);
+
+/* Execution statistics */
+gchar *datapipe_stats_report(void);
+void datapipe_stats_set_enabled(gboolean enabled);
+
 void setup_datapipe(datapipe_struct *const datapipe,
 		    const read_only_policy_t read_only,
 		    const cache_free_policy_t free_cache,
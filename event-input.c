@@ -33,14 +33,22 @@
 #endif
 #include "mce-sensorfw.h"
 #include "evdev.h"
+#ifdef ENABLE_WAKELOCKS
+# include "libwakelock.h"
+#endif
 
 #include <linux/input.h>
 
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <glib/gstdio.h>
 #include <gio/gio.h>
@@ -303,9 +311,29 @@ static void         evin_iomon_generate_activity                (struct input_ev
 
 // event handling by device type
 
+/** Touchscreen state that stays constant over one SYN_REPORT frame */
+typedef struct
+{
+    /** Whether touch input is grabbed */
+    bool                grabbed;
+
+    /** Submode at the start of the frame */
+    submode_t           submode;
+
+    /** First event in the frame that should generate activity */
+    struct input_event *activity;
+} evin_ts_frame_t;
+
+static void         evin_ts_frame_init                          (evin_ts_frame_t *frame);
+static void         evin_ts_frame_finish                        (evin_ts_frame_t *frame);
+static void         evin_ts_frame_handle_event                  (evin_ts_frame_t *frame, struct input_event *ev);
+
+static gboolean     evin_iomon_frame_end_cb                     (gconstpointer chunk);
+static gboolean     evin_iomon_touchscreen_batch_cb             (gpointer data, gsize chunks);
 static gboolean     evin_iomon_touchscreen_cb                   (gpointer data, gsize bytes_read);
 static gboolean     evin_iomon_evin_doubletap_cb                (gpointer data, gsize bytes_read);
 static gboolean     evin_iomon_keypress_cb                      (gpointer data, gsize bytes_read);
+static void         evin_iomon_keypress_handle_event            (struct input_event *ev);
 static gboolean     evin_iomon_activity_cb                      (gpointer data, gsize bytes_read);
 
 // add/remove devices
@@ -397,6 +425,13 @@ static bool         evin_ts_grab_poll_palm_detect               (evin_input_grab
 
 static void         evin_ts_grab_changed                        (evin_input_grab_t *ctrl, bool grab);
 
+/** Finger on screen tracking state for evin_ts_grab_event_filter() */
+typedef struct
+{
+    bool x, y, p, r;
+} evin_ts_filter_t;
+
+static int          evin_ts_grab_event_filter                   (evin_ts_filter_t *self, const struct input_event *ev);
 static void         evin_ts_grab_event_filter_cb                (struct input_event *ev);
 
 static void         evin_ts_grab_wanted_cb                      (gconstpointer data);
@@ -416,6 +451,99 @@ static void         evin_kp_grab_changed                        (evin_input_grab
 static void         evin_kp_grab_event_filter_cb                (struct input_event *ev);
 static void         evin_kp_grab_wanted_cb                      (gconstpointer data);
 
+/* ------------------------------------------------------------------------- *
+ * INPUT_THREAD  --  OPTIONAL EPOLL BASED EVDEV READER THREAD
+ * ------------------------------------------------------------------------- */
+
+/** Types of messages passed from input thread to main loop */
+typedef enum
+{
+    /** Input event to handle */
+    EVIN_MSG_EVENT,
+
+    /** Finger on screen state change detected from touch input */
+    EVIN_MSG_TOUCHING,
+
+    /** End of events read during one input thread wakeup */
+    EVIN_MSG_DONE,
+} evin_msg_type_t;
+
+/** Message passed from input thread to main loop */
+typedef struct
+{
+    /** Message type */
+    evin_msg_type_t    type;
+
+    /** Type of device the event originates from */
+    evin_evdevtype_t   devtype;
+
+    /** Input event; for EVIN_MSG_TOUCHING the state is in ev.value */
+    struct input_event ev;
+} evin_msg_t;
+
+/** Input device watched by the input thread */
+typedef struct
+{
+    /** Device file descriptor, owned by an I/O monitor */
+    int              fd;
+
+    /** Non-zero identifier used as epoll event data */
+    guint            serial;
+
+    /** Device type from mce point of view */
+    evin_evdevtype_t type;
+
+    /** Time of the last passed through activity event [s] */
+    time_t           activity;
+
+    /** Input thread is reading the device without holding the mutex */
+    bool             reading;
+
+    /** Polling is disabled until main loop has drained the queue */
+    bool             paused;
+} evin_thread_dev_t;
+
+// eventfd helpers
+
+static void         evin_thread_eventfd_signal                  (int fd);
+static void         evin_thread_eventfd_clear                   (int fd);
+
+// input thread to main loop queue
+
+static unsigned     evin_thread_queue_space                     (void);
+static bool         evin_thread_queue_push                      (const evin_msg_t *msg);
+static bool         evin_thread_queue_pop                       (evin_msg_t *msg);
+
+// wakelock held while events are in flight
+
+static void         evin_thread_wakelock_obtain                 (void);
+static void         evin_thread_wakelock_release                (void);
+
+// input thread side processing
+
+static evin_thread_dev_t *evin_thread_dev_find                  (guint serial);
+static void         evin_thread_filter_event                    (evin_thread_dev_t *dev, struct input_event *ev, evin_ts_filter_t *ts_filter, evin_msg_t *out, size_t *count);
+static void         evin_thread_pause_device                    (evin_thread_dev_t *dev);
+static void         evin_thread_read_device                     (guint serial, evin_ts_filter_t *ts_filter);
+static void        *evin_thread_main                            (void *aptr);
+
+// main loop side processing
+
+static void         evin_thread_handle_event                    (evin_msg_t *msg, evin_ts_frame_t *frame, bool *in_frame);
+static void         evin_thread_resume_devices                  (void);
+static void         evin_thread_fallback                        (void);
+static gboolean     evin_thread_notify_cb                       (GIOChannel *chn, GIOCondition cnd, gpointer aptr);
+
+// add/remove devices
+
+static bool         evin_thread_add_device                      (int fd, evin_evdevtype_t type);
+static void         evin_thread_rem_device                      (int fd);
+
+// start/stop input thread
+
+static void         evin_thread_init                            (void);
+static void         evin_thread_quit                            (void);
+
 /* ------------------------------------------------------------------------- *
  * MODULE_INIT
  * ------------------------------------------------------------------------- */
@@ -1789,6 +1917,9 @@ static GSList *evin_iomon_device_list = NULL;
 static void
 evin_iomon_device_delete_cb(mce_io_mon_t *iomon)
 {
+    /* Stop input thread reading before the fd gets closed */
+    evin_thread_rem_device(mce_io_mon_get_fd(iomon));
+
     evin_iomon_device_list = g_slist_remove(evin_iomon_device_list, iomon);
 }
 
@@ -1904,37 +2035,48 @@ EXIT:
     return;
 }
 
-/** I/O monitor callback for handling touchscreen events
- *
- * @param data       The new data
- * @param bytes_read The number of bytes read
+/** Sample state that stays constant over touchscreen event frame
  *
- * @return FALSE to return remaining chunks (if any),
- *         TRUE to flush all remaining chunks
+ * @param frame frame state to initialize
  */
-static gboolean
-evin_iomon_touchscreen_cb(gpointer data, gsize bytes_read)
+static void
+evin_ts_frame_init(evin_ts_frame_t *frame)
 {
-    gboolean flush = FALSE;
-    struct input_event *ev = data;
-
-    if( ev == 0 || bytes_read != sizeof *ev )
-        goto EXIT;
+    frame->grabbed  = datapipe_get_gbool(touch_grab_active_pipe);
+    frame->submode  = mce_get_submode_int32();
+    frame->activity = 0;
+}
 
-    /* Map event before processing */
-    evin_event_mapper_translate_event(ev);
+/** Finish processing touchscreen event frame
+ *
+ * Activity reporting is rate limited anyway, so it is
+ * enough to do it once per frame.
+ *
+ * @param frame frame state
+ */
+static void
+evin_ts_frame_finish(evin_ts_frame_t *frame)
+{
+    if( frame->activity )
+        evin_iomon_generate_activity(frame->activity, true, true);
+    frame->activity = 0;
+}
 
+/** Handle one already mapped and filtered touchscreen event
+ *
+ * @param frame frame state
+ * @param ev    input event
+ */
+static void
+evin_ts_frame_handle_event(evin_ts_frame_t *frame, struct input_event *ev)
+{
     mce_log(LL_DEBUG, "type: %s, code: %s, value: %d",
             evdev_get_event_type_name(ev->type),
             evdev_get_event_code_name(ev->type, ev->code),
             ev->value);
 
-    evin_ts_grab_event_filter_cb(ev);
-
-    bool grabbed = datapipe_get_gint(touch_grab_active_pipe);
-
 #ifdef ENABLE_DOUBLETAP_EMULATION
-    if( grabbed || fake_evin_doubletap_enabled ) {
+    if( frame->grabbed || fake_evin_doubletap_enabled ) {
         /* Note: In case we happen to be in middle of display
          *       state transition the double tap simulation must
          *       use the next stable display state rather than
@@ -1994,13 +2136,11 @@ evin_iomon_touchscreen_cb(gpointer data, gsize bytes_read)
         goto EXIT;
 
     /* Do not generate activity if ts input is grabbed */
-    if( !grabbed )
-        evin_iomon_generate_activity(ev, true, true);
-
-    submode_t submode = mce_get_submode_int32();
+    if( !frame->grabbed && !frame->activity )
+        frame->activity = ev;
 
     /* If the event eater is active, don't send anything */
-    if( submode & MCE_EVEATER_SUBMODE )
+    if( frame->submode & MCE_EVEATER_SUBMODE )
         goto EXIT;
 
     /* Only send pressure and gesture events */
@@ -2008,10 +2148,74 @@ evin_iomon_touchscreen_cb(gpointer data, gsize bytes_read)
         (ev->type == EV_KEY && ev->code == BTN_TOUCH ) ||
         (ev->type == EV_MSC && ev->code == MSC_GESTURE ) ) {
         /* For now there's no reason to cache the value */
-        execute_datapipe(&touchscreen_pipe, &ev,
-                         USE_INDATA, DONT_CACHE_INDATA);
+        (void)datapipe_exec_input_event(touchscreen_pipe, ev,
+                                        DONT_CACHE_INDATA);
+    }
+
+EXIT:
+    return;
+}
+
+/** I/O monitor predicate for detecting end of evdev event frame
+ *
+ * @param chunk input event
+ *
+ * @return TRUE if the event is SYN_REPORT, FALSE otherwise
+ */
+static gboolean
+evin_iomon_frame_end_cb(gconstpointer chunk)
+{
+    const struct input_event *ev = chunk;
+
+    return ev->type == EV_SYN && ev->code == SYN_REPORT;
+}
+
+/** I/O monitor callback for handling touchscreen event frames
+ *
+ * @param data   array of input events, normally ending with SYN_REPORT
+ * @param chunks number of input events
+ *
+ * @return FALSE to return remaining chunks (if any)
+ */
+static gboolean
+evin_iomon_touchscreen_batch_cb(gpointer data, gsize chunks)
+{
+    struct input_event *ev = data;
+    evin_ts_frame_t frame;
+
+    evin_ts_frame_init(&frame);
+
+    for( gsize i = 0; i < chunks; ++i ) {
+        /* Map event before processing */
+        evin_event_mapper_translate_event(ev + i);
+        evin_ts_grab_event_filter_cb(ev + i);
+        evin_ts_frame_handle_event(&frame, ev + i);
     }
 
+    evin_ts_frame_finish(&frame);
+
+    return FALSE;
+}
+
+/** I/O monitor callback for handling touchscreen events
+ *
+ * @param data       The new data
+ * @param bytes_read The number of bytes read
+ *
+ * @return FALSE to return remaining chunks (if any),
+ *         TRUE to flush all remaining chunks
+ */
+static gboolean
+evin_iomon_touchscreen_cb(gpointer data, gsize bytes_read)
+{
+    gboolean flush = FALSE;
+    struct input_event *ev = data;
+
+    if( ev == 0 || bytes_read != sizeof *ev )
+        goto EXIT;
+
+    evin_iomon_touchscreen_batch_cb(ev, 1);
+
 EXIT:
     return flush;
 }
@@ -2054,10 +2258,7 @@ EXIT:
 static gboolean
 evin_iomon_keypress_cb(gpointer data, gsize bytes_read)
 {
-    submode_t submode = mce_get_submode_int32();
-    struct input_event *ev;
-
-    ev = data;
+    struct input_event *ev = data;
 
     /* Don't process invalid reads */
     if( bytes_read != sizeof (*ev) )
@@ -2066,6 +2267,21 @@ evin_iomon_keypress_cb(gpointer data, gsize bytes_read)
     /* Map event before processing */
     evin_event_mapper_translate_event(ev);
 
+    evin_iomon_keypress_handle_event(ev);
+
+EXIT:
+    return FALSE;
+}
+
+/** Handle already mapped keypress event
+ *
+ * @param ev input event
+ */
+static void
+evin_iomon_keypress_handle_event(struct input_event *ev)
+{
+    submode_t submode = mce_get_submode_int32();
+
     mce_log((ev->type == EV_SW && ev->code == SW_LID) ? LL_DEVEL : LL_DEBUG,
             "type: %s, code: %s, value: %d",
             evdev_get_event_type_name(ev->type),
@@ -2080,7 +2296,7 @@ evin_iomon_keypress_cb(gpointer data, gsize bytes_read)
     }
 
     if (ev->type == EV_KEY) {
-        if( datapipe_get_gint(keypad_grab_active_pipe) ) {
+        if( datapipe_get_gbool(keypad_grab_active_pipe) ) {
             switch( ev->code ) {
             case KEY_VOLUMEUP:
             case KEY_VOLUMEDOWN:
@@ -2114,8 +2330,8 @@ evin_iomon_keypress_cb(gpointer data, gsize bytes_read)
              ((((submode & MCE_EVEATER_SUBMODE) == 0) &&
                (ev->value == 1)) || (ev->value == 0))) &&
             ((submode & MCE_PROXIMITY_TKLOCK_SUBMODE) == 0)) {
-            (void)execute_datapipe(&keypress_pipe, &ev,
-                                   USE_INDATA, DONT_CACHE_INDATA);
+            (void)datapipe_exec_input_event(keypress_pipe, ev,
+                                            DONT_CACHE_INDATA);
         }
     }
 
@@ -2195,7 +2411,7 @@ evin_iomon_keypress_cb(gpointer data, gsize bytes_read)
     evin_iomon_generate_activity(ev, true, false);
 
 EXIT:
-    return FALSE;
+    return;
 }
 
 /** I/O monitor callback generatic activity from misc evdev events
@@ -2330,18 +2546,32 @@ evin_iomon_device_add(const gchar *path)
         goto EXIT;
     }
 
-    /* Create io monitor for the device file descriptor */
-    iomon = mce_io_mon_register_chunk(fd, path, MCE_IO_ERROR_POLICY_WARN,
-                                      FALSE, notify,
-                                      evin_iomon_device_delete_cb,
-                                      sizeof (struct input_event));
-    /* After mce_io_mon_register_chunk() returns the fd is either
+    /* Create io monitor for the device file descriptor; touch
+     * input is handled one SYN_REPORT frame at a time */
+    if( extra->ex_type == EVDEV_TOUCH ) {
+        iomon = mce_io_mon_register_batch(fd, path, MCE_IO_ERROR_POLICY_WARN,
+                                          evin_iomon_touchscreen_batch_cb,
+                                          evin_iomon_frame_end_cb,
+                                          evin_iomon_device_delete_cb,
+                                          sizeof (struct input_event));
+    }
+    else {
+        iomon = mce_io_mon_register_chunk(fd, path, MCE_IO_ERROR_POLICY_WARN,
+                                          FALSE, notify,
+                                          evin_iomon_device_delete_cb,
+                                          sizeof (struct input_event));
+    }
+    /* After mce_io_mon_register_xxx() returns the fd is either
      * attached to iomon or closed. */
     fd = -1;
 
     if( !iomon )
         goto EXIT;
 
+    /* Let the input thread do the reading, if enabled */
+    if( evin_thread_add_device(mce_io_mon_get_fd(iomon), extra->ex_type) )
+        mce_io_mon_suspend(iomon);
+
     /* Attach device type information to the io monitor */
     mce_io_mon_set_user_data(iomon, extra, evin_iomon_extra_delete_cb),
         extra = 0;
@@ -3015,7 +3245,7 @@ evin_ts_grab_rethink_led(void)
     {
     case MCE_DISPLAY_ON:
     case MCE_DISPLAY_DIM:
-        enable = datapipe_get_gint(touch_grab_active_pipe);
+        enable = datapipe_get_gbool(touch_grab_active_pipe);
         break;
     default:
         break;
@@ -3171,25 +3401,30 @@ EXIT:
     return;
 }
 
-/** Event filter for determining finger on screen state
+/** Determine finger on screen state from touch input events
+ *
+ * @param self filter state
+ * @param ev   input event
+ *
+ * @return -1 if the event does not complete a report, or
+ *         0/1 for finger off/on screen
  */
-static void
-evin_ts_grab_event_filter_cb(struct input_event *ev)
+static int
+evin_ts_grab_event_filter(evin_ts_filter_t *self, const struct input_event *ev)
 {
-    static bool x = false, y = false, p = false, r = false;
+    int touching = -1;
 
     switch( ev->type ) {
     case EV_SYN:
         switch( ev->code ) {
         case SYN_MT_REPORT:
-            r = true;
+            self->r = true;
             break;
 
         case SYN_REPORT:
-            if( r ) {
-                evin_input_grab_set_touching(&evin_ts_grab_state,
-                                             x && y && p);
-                x = y = p = r = false;
+            if( self->r ) {
+                touching = self->x && self->y && self->p;
+                self->x = self->y = self->p = self->r = false;
             }
             break;
 
@@ -3202,7 +3437,7 @@ evin_ts_grab_event_filter_cb(struct input_event *ev)
         switch( ev->code ) {
         case BTN_TOUCH:
             if( ev->value == 0 )
-                r = true;
+                self->r = true;
             break;
 
         default:
@@ -3213,17 +3448,17 @@ evin_ts_grab_event_filter_cb(struct input_event *ev)
     case EV_ABS:
         switch( ev->code ) {
         case ABS_MT_POSITION_X:
-            x = true;
+            self->x = true;
             break;
 
         case ABS_MT_POSITION_Y:
-            y = true;
+            self->y = true;
             break;
 
         case ABS_MT_TOUCH_MAJOR:
         case ABS_MT_PRESSURE:
             if( ev->value > 0 )
-                p = true;
+                self->p = true;
             break;
 
         default:
@@ -3234,6 +3469,21 @@ evin_ts_grab_event_filter_cb(struct input_event *ev)
     default:
         break;
     }
+
+    return touching;
+}
+
+/** Event filter for determining finger on screen state
+ */
+static void
+evin_ts_grab_event_filter_cb(struct input_event *ev)
+{
+    static evin_ts_filter_t state = { false, false, false, false };
+
+    int touching = evin_ts_grab_event_filter(&state, ev);
+
+    if( touching >= 0 )
+        evin_input_grab_set_touching(&evin_ts_grab_state, touching);
 }
 /** Feed desired touch grab state from datapipe to state machine
  *
@@ -3441,86 +3691,985 @@ evin_kp_grab_wanted_cb(gconstpointer data)
 }
 
 /* ========================================================================= *
- * MODULE_INIT
+ * INPUT_THREAD
  * ========================================================================= */
 
-/** Init function for the /dev/input event component
- *
- * @return TRUE on success, FALSE on failure
+/** Wakelock held while events read by the input thread are in flight */
+#define EVIN_THREAD_WAKELOCK      "mce_input_thread"
+
+/** Capacity of the input thread to main loop queue; must be power of 2 */
+#define EVIN_THREAD_QUEUE_SIZE    256
+
+/** Maximum number of devices the input thread can watch */
+#define EVIN_THREAD_DEVICE_MAX    64
+
+/** Maximum number of events to read from a device at once */
+#define EVIN_THREAD_READ_MAX      64
+
+/** Maximum number of epoll events to handle per wakeup */
+#define EVIN_THREAD_EPOLL_MAX     16
+
+/* The input thread must not use glib or mce logging; everything it
+ * touches is either owned by it, protected by evin_thread_dev_mutex
+ * or handed over to the main loop via the lockless message queue.
  */
-gboolean
-mce_input_init(void)
-{
-    gboolean status = FALSE;
 
-    evin_gpio_init();
+/** Input thread is configured to be used */
+static bool              evin_thread_enabled = false;
 
-    evin_event_mapper_init();
+/** Input thread has been started */
+static bool              evin_thread_running = false;
 
-    evin_ts_grab_init();
+/** Input thread id */
+static pthread_t         evin_thread_id;
 
-#ifdef ENABLE_DOUBLETAP_EMULATION
-    /* Get fake doubletap policy configuration & track changes */
-    mce_gconf_notifier_add(MCE_GCONF_EVENT_INPUT_PATH,
-                           MCE_GCONF_USE_FAKE_DOUBLETAP_PATH,
-                           evin_doubletap_gconf_changed_cb,
-                           &fake_evin_doubletap_id);
+/** Input thread should exit */
+static int               evin_thread_stop = 0;
 
-    mce_gconf_get_bool(MCE_GCONF_USE_FAKE_DOUBLETAP_PATH,
-                       &fake_evin_doubletap_enabled);
-#endif
+/** Input thread has exited */
+static int               evin_thread_exited = 0;
 
-    /* Append triggers/filters to datapipes */
-    append_output_trigger_to_datapipe(&submode_pipe,
-                                      evin_gpio_submode_trigger);
-    append_output_trigger_to_datapipe(&display_state_pipe,
-                                      evin_ts_grab_display_state_cb);
-    append_output_trigger_to_datapipe(&touch_grab_wanted_pipe,
-                                      evin_ts_grab_wanted_cb);
-    append_output_trigger_to_datapipe(&keypad_grab_wanted_pipe,
-                                      evin_kp_grab_wanted_cb);
+/** Input device epoll set */
+static int               evin_thread_epoll_fd = -1;
 
-    /* Register input device directory monitor */
-    if( !evin_devdir_monitor_init() )
-        goto EXIT;
+/** Eventfd for waking up input thread on exit */
+static int               evin_thread_stop_fd = -1;
 
-    /* Find the initial set of input devices */
-    if( !evin_iomon_init() )
-        goto EXIT;
+/** Eventfd for waking up main loop when there are messages */
+static int               evin_thread_notify_fd = -1;
 
-    evin_iomon_switch_states_update();
-    evin_iomon_keyboard_state_update();
+/** I/O watch id for evin_thread_notify_fd */
+static guint             evin_thread_notify_id = 0;
 
-    status = TRUE;
-EXIT:
-    return status;
+/** Mutex protecting the device table */
+static pthread_mutex_t   evin_thread_dev_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Signaled when input thread is done reading a device */
+static pthread_cond_t    evin_thread_dev_cond = PTHREAD_COND_INITIALIZER;
+
+/** Input thread has paused polling of some device */
+static int               evin_thread_dev_paused = 0;
+
+/** Devices watched by the input thread */
+static evin_thread_dev_t evin_thread_dev_tab[EVIN_THREAD_DEVICE_MAX];
+
+/** Number of used evin_thread_dev_tab slots */
+static size_t            evin_thread_dev_cnt = 0;
+
+/** Counter for assigning device serial numbers */
+static guint             evin_thread_dev_serial = 0;
+
+/** Single producer, single consumer message ring */
+static evin_msg_t        evin_thread_queue[EVIN_THREAD_QUEUE_SIZE];
+
+/** Queue write position; modified only by input thread */
+static unsigned          evin_thread_queue_head = 0;
+
+/** Queue read position; modified only by main loop */
+static unsigned          evin_thread_queue_tail = 0;
+
+/** Mutex protecting the in flight wakelock counter */
+static pthread_mutex_t   evin_thread_wakelock_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Number of input thread wakeups not yet handled by main loop */
+static unsigned          evin_thread_wakelock_count = 0;
+
+/** Increment eventfd counter
+ *
+ * @param fd eventfd file descriptor
+ */
+static void
+evin_thread_eventfd_signal(int fd)
+{
+    uint64_t cnt = 1;
+
+    if( fd != -1 && TEMP_FAILURE_RETRY(write(fd, &cnt, sizeof cnt)) == -1 ) {
+        /* EAGAIN = counter saturated, there is a wakeup pending anyway */
+    }
 }
 
-/** Exit function for the /dev/input event component
+/** Reset eventfd counter
+ *
+ * @param fd eventfd file descriptor
  */
-void
-mce_input_exit(void)
+static void
+evin_thread_eventfd_clear(int fd)
 {
-#ifdef ENABLE_DOUBLETAP_EMULATION
-    /* Remove fake doubletap policy change notifier */
-    mce_gconf_notifier_remove(fake_evin_doubletap_id),
-        fake_evin_doubletap_id = 0;
-#endif
+    uint64_t cnt = 0;
 
-    /* Remove triggers/filters from datapipes */
-    remove_output_trigger_from_datapipe(&submode_pipe,
-                                        evin_gpio_submode_trigger);
-    remove_output_trigger_from_datapipe(&display_state_pipe,
-                                        evin_ts_grab_display_state_cb);
-    remove_output_trigger_from_datapipe(&touch_grab_wanted_pipe,
-                                        evin_ts_grab_wanted_cb);
-    remove_output_trigger_from_datapipe(&keypad_grab_wanted_pipe,
-                                        evin_kp_grab_wanted_cb);
+    if( fd != -1 && TEMP_FAILURE_RETRY(read(fd, &cnt, sizeof cnt)) == -1 ) {
+        /* EAGAIN = counter was already zero */
+    }
+}
 
-    /* Remove input device directory monitor */
-    evin_devdir_monitor_quit();
+/** Get number of free non-reserved queue slots; called from input thread
+ *
+ * @return number of EVIN_MSG_EVENT / EVIN_MSG_TOUCHING messages that
+ *         can be queued
+ */
+static unsigned
+evin_thread_queue_space(void)
+{
+    unsigned head = __atomic_load_n(&evin_thread_queue_head,
+                                    __ATOMIC_RELAXED);
+    unsigned tail = __atomic_load_n(&evin_thread_queue_tail,
+                                    __ATOMIC_ACQUIRE);
 
-    evin_iomon_quit();
+    return EVIN_THREAD_QUEUE_SIZE - 1 - (head - tail);
+}
+
+/** Add message to the queue; called from input thread only
+ *
+ * Never blocks. The last free slot is reserved for EVIN_MSG_DONE, so
+ * if even that does not fit, the newest queued message is a DONE that
+ * the main loop has not handled yet.
+ *
+ * @param msg message to add
+ *
+ * @return true if the message was queued, false if the queue was full
+ */
+static bool
+evin_thread_queue_push(const evin_msg_t *msg)
+{
+    unsigned head = __atomic_load_n(&evin_thread_queue_head,
+                                    __ATOMIC_RELAXED);
+    unsigned tail = __atomic_load_n(&evin_thread_queue_tail,
+                                    __ATOMIC_ACQUIRE);
+    unsigned size = EVIN_THREAD_QUEUE_SIZE;
+
+    if( msg->type != EVIN_MSG_DONE )
+        size -= 1;
+
+    if( head - tail >= size )
+        return false;
+
+    evin_thread_queue[head % EVIN_THREAD_QUEUE_SIZE] = *msg;
+    __atomic_store_n(&evin_thread_queue_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/** Remove message from the queue; called from main loop only
+ *
+ * @param msg where to store the message
+ *
+ * @return true if a message was removed, false if queue was empty
+ */
+static bool
+evin_thread_queue_pop(evin_msg_t *msg)
+{
+    unsigned tail = __atomic_load_n(&evin_thread_queue_tail,
+                                    __ATOMIC_RELAXED);
+    unsigned head = __atomic_load_n(&evin_thread_queue_head,
+                                    __ATOMIC_ACQUIRE);
+
+    if( tail == head )
+        return false;
+
+    *msg = evin_thread_queue[tail % EVIN_THREAD_QUEUE_SIZE];
+    __atomic_store_n(&evin_thread_queue_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/** Block suspend while events are in flight; called from input thread
+ *
+ * The kernel evdev wakelock is released as soon as the events
+ * have been read, so the input thread must hold a wakelock of its
+ * own until the main loop has dealt with them.
+ */
+static void
+evin_thread_wakelock_obtain(void)
+{
+    pthread_mutex_lock(&evin_thread_wakelock_mutex);
+    if( evin_thread_wakelock_count++ == 0 ) {
+#ifdef ENABLE_WAKELOCKS
+        wakelock_lock(EVIN_THREAD_WAKELOCK, -1);
+#endif
+    }
+    pthread_mutex_unlock(&evin_thread_wakelock_mutex);
+}
+
+/** Allow suspend after events are handled
+ *
+ * Normally called from main loop, but also from input thread when
+ * the queue is too full to pass EVIN_MSG_DONE.
+ */
+static void
+evin_thread_wakelock_release(void)
+{
+    pthread_mutex_lock(&evin_thread_wakelock_mutex);
+    if( evin_thread_wakelock_count > 0 && --evin_thread_wakelock_count == 0 ) {
+#ifdef ENABLE_WAKELOCKS
+        wakelock_unlock(EVIN_THREAD_WAKELOCK);
+#endif
+    }
+    pthread_mutex_unlock(&evin_thread_wakelock_mutex);
+}
+
+/** Locate watched device by serial; evin_thread_dev_mutex must be held
+ *
+ * @param serial device serial number
+ *
+ * @return device table entry, or NULL if not found
+ */
+static evin_thread_dev_t *
+evin_thread_dev_find(guint serial)
+{
+    for( size_t i = 0; i < evin_thread_dev_cnt; ++i ) {
+        if( evin_thread_dev_tab[i].serial == serial )
+            return evin_thread_dev_tab + i;
+    }
+    return 0;
+}
+
+/** Select events the main loop needs to see; called from input thread
+ *
+ * Does the same filtering the main loop I/O callbacks do for each
+ * device type, so that only events that can have an effect get
+ * passed on. Event mapping is left to the main loop as it can
+ * only affect EV_KEY and EV_SW events, and those are passed as is.
+ *
+ * @param dev       device the event was read from
+ * @param ev        input event
+ * @param ts_filter finger on screen tracking state
+ * @param out       message array to append to
+ * @param count     number of messages in the array
+ */
+static void
+evin_thread_filter_event(evin_thread_dev_t *dev, struct input_event *ev,
+                         evin_ts_filter_t *ts_filter,
+                         evin_msg_t *out, size_t *count)
+{
+    bool pass = false;
+
+    switch( dev->type ) {
+    case EVDEV_TOUCH:
+        {
+            int touching = evin_ts_grab_event_filter(ts_filter, ev);
+            if( touching >= 0 ) {
+                evin_msg_t *msg = out + (*count)++;
+                memset(msg, 0, sizeof *msg);
+                msg->type     = EVIN_MSG_TOUCHING;
+                msg->devtype  = dev->type;
+                msg->ev.value = touching;
+            }
+        }
+        switch( ev->type ) {
+        case EV_SYN:
+            pass = (ev->code == SYN_REPORT || ev->code == SYN_MT_REPORT);
+            break;
+        case EV_ABS:
+        case EV_KEY:
+        case EV_MSC:
+        case EV_REL:
+            pass = true;
+            break;
+        default:
+            break;
+        }
+        break;
+
+    case EVDEV_INPUT:
+    case EVDEV_KEYBOARD:
+    case EVDEV_VOLKEY:
+        pass = (ev->type == EV_KEY || ev->type == EV_SW);
+        break;
+
+    case EVDEV_DBLTAP:
+        pass = (ev->type == EV_KEY && ev->code == KEY_POWER);
+        break;
+
+    case EVDEV_ACTIVITY:
+        switch( ev->type ) {
+        case EV_SYN:
+        case EV_LED:
+        case EV_SND:
+        case EV_FF:
+        case EV_FF_STATUS:
+            break;
+        default:
+            /* Activity is rate limited to once/second anyway */
+            if( dev->activity != ev->time.tv_sec ) {
+                dev->activity = ev->time.tv_sec;
+                pass = true;
+            }
+            break;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if( pass ) {
+        evin_msg_t *msg = out + (*count)++;
+        msg->type    = EVIN_MSG_EVENT;
+        msg->devtype = dev->type;
+        msg->ev      = *ev;
+    }
+}
+
+/** Stop polling a device; called from input thread
+ *
+ * Used when the queue does not have room for more events. Unread
+ * events stay in the kernel buffer, and polling is resumed from
+ * evin_thread_resume_devices() once main loop has drained the queue.
+ *
+ * evin_thread_dev_mutex must be held.
+ *
+ * @param dev device to pause
+ */
+static void
+evin_thread_pause_device(evin_thread_dev_t *dev)
+{
+    struct epoll_event eve;
+
+    memset(&eve, 0, sizeof eve);
+    eve.events   = 0;
+    eve.data.u64 = dev->serial;
+
+    epoll_ctl(evin_thread_epoll_fd, EPOLL_CTL_MOD, dev->fd, &eve);
+    dev->paused = true;
+
+    /* Main loop checks this after handling the queued EVIN_MSG_DONE */
+    __atomic_store_n(&evin_thread_dev_paused, 1, __ATOMIC_RELEASE);
+}
+
+/** Read and filter events from a device; called from input thread
+ *
+ * Only as many events are read as are guaranteed to fit in the
+ * queue, so events are never dropped. If there is no room at all,
+ * the device is paused until the main loop catches up.
+ *
+ * The device mutex is not held during read(); the reading flag
+ * keeps evin_thread_rem_device() from letting the file descriptor
+ * get closed under us.
+ *
+ * @param serial    device serial number
+ * @param ts_filter finger on screen tracking state
+ */
+static void
+evin_thread_read_device(guint serial, evin_ts_filter_t *ts_filter)
+{
+    struct input_event ev[EVIN_THREAD_READ_MAX];
+    evin_msg_t         msg[EVIN_THREAD_READ_MAX * 2];
+    size_t             cnt = 0;
+    ssize_t            rc  = -1;
+    int                err = 0;
+    int                fd  = -1;
+    evin_thread_dev_t *dev = 0;
+
+    /* Each event can produce at most two messages */
+    size_t max = evin_thread_queue_space() / 2;
+    if( max > EVIN_THREAD_READ_MAX )
+        max = EVIN_THREAD_READ_MAX;
+
+    pthread_mutex_lock(&evin_thread_dev_mutex);
+
+    /* Device might have been removed while we were waiting */
+    if( (dev = evin_thread_dev_find(serial)) ) {
+        if( max == 0 )
+            evin_thread_pause_device(dev);
+        else
+            dev->reading = true, fd = dev->fd;
+    }
+
+    pthread_mutex_unlock(&evin_thread_dev_mutex);
+
+    if( fd == -1 )
+        goto EXIT;
+
+    rc  = TEMP_FAILURE_RETRY(read(fd, ev, max * sizeof *ev));
+    err = errno;
+
+    pthread_mutex_lock(&evin_thread_dev_mutex);
+
+    /* Table entries can move while the mutex is not held */
+    if( (dev = evin_thread_dev_find(serial)) ) {
+        dev->reading = false;
+
+        if( rc == 0 || (rc == -1 && err != EAGAIN) ) {
+            /* Stop polling; the device directory monitor on the
+             * main loop takes care of actual device removal */
+            epoll_ctl(evin_thread_epoll_fd, EPOLL_CTL_DEL, dev->fd, 0);
+        }
+
+        for( ssize_t i = 0; i < rc / (ssize_t)sizeof *ev; ++i )
+            evin_thread_filter_event(dev, ev + i, ts_filter, msg, &cnt);
+    }
+
+    pthread_cond_broadcast(&evin_thread_dev_cond);
+    pthread_mutex_unlock(&evin_thread_dev_mutex);
+
+    /* Room was checked before reading, so these can't fail */
+    for( size_t i = 0; i < cnt; ++i )
+        evin_thread_queue_push(msg + i);
+
+EXIT:
+    return;
+}
+
+/** Input thread entry point
+ *
+ * @param aptr (unused)
+ *
+ * @return NULL
+ */
+static void *
+evin_thread_main(void *aptr)
+{
+    (void)aptr;
+
+    struct epoll_event eve[EVIN_THREAD_EPOLL_MAX];
+    evin_ts_filter_t   ts_filter = { false, false, false, false };
+    evin_msg_t         done = { .type = EVIN_MSG_DONE };
+
+    while( !__atomic_load_n(&evin_thread_stop, __ATOMIC_ACQUIRE) ) {
+        int  rc   = epoll_wait(evin_thread_epoll_fd, eve,
+                               EVIN_THREAD_EPOLL_MAX, -1);
+        bool data = false;
+
+        if( rc == -1 ) {
+            if( errno == EINTR )
+                continue;
+            break;
+        }
+
+        /* Serial zero is used for the stop eventfd */
+        for( int i = 0; i < rc; ++i ) {
+            if( eve[i].data.u64 != 0 )
+                data = true;
+        }
+
+        if( !data )
+            continue;
+
+        /* Released by main loop when it handles EVIN_MSG_DONE */
+        evin_thread_wakelock_obtain();
+
+        for( int i = 0; i < rc; ++i ) {
+            if( eve[i].data.u64 != 0 )
+                evin_thread_read_device(eve[i].data.u64, &ts_filter);
+        }
+
+        /* If there is no room, the DONE that is already queued
+         * keeps the wakelock until main loop gets to it */
+        if( !evin_thread_queue_push(&done) )
+            evin_thread_wakelock_release();
+
+        evin_thread_eventfd_signal(evin_thread_notify_fd);
+    }
+
+    /* Let main loop take over if we are exiting on error */
+    __atomic_store_n(&evin_thread_exited, 1, __ATOMIC_RELEASE);
+    evin_thread_eventfd_signal(evin_thread_notify_fd);
+
+    return 0;
+}
+
+/** Pass event from input thread to the handler for its device type
+ *
+ * @param msg      message from input thread
+ * @param frame    touchscreen frame state
+ * @param in_frame whether touchscreen frame has been started
+ */
+static void
+evin_thread_handle_event(evin_msg_t *msg, evin_ts_frame_t *frame,
+                         bool *in_frame)
+{
+    struct input_event *ev = &msg->ev;
+
+    switch( msg->devtype ) {
+    case EVDEV_TOUCH:
+        evin_event_mapper_translate_event(ev);
+
+        if( !*in_frame )
+            evin_ts_frame_init(frame), *in_frame = true;
+
+        evin_ts_frame_handle_event(frame, ev);
+
+        if( ev->type == EV_SYN && ev->code == SYN_REPORT )
+            evin_ts_frame_finish(frame), *in_frame = false;
+        break;
+
+    case EVDEV_INPUT:
+    case EVDEV_KEYBOARD:
+    case EVDEV_VOLKEY:
+        evin_event_mapper_translate_event(ev);
+        evin_iomon_keypress_handle_event(ev);
+        break;
+
+    case EVDEV_DBLTAP:
+        evin_iomon_evin_doubletap_cb(ev, sizeof *ev);
+        break;
+
+    case EVDEV_ACTIVITY:
+        evin_iomon_activity_cb(ev, sizeof *ev);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/** Resume polling of devices paused due to full queue
+ *
+ * Called from main loop after the queue has been drained.
+ */
+static void
+evin_thread_resume_devices(void)
+{
+    struct epoll_event eve;
+
+    if( !__atomic_exchange_n(&evin_thread_dev_paused, 0, __ATOMIC_ACQ_REL) )
+        goto EXIT;
+
+    mce_log(LL_DEBUG, "input thread queue was full; resuming devices");
+
+    pthread_mutex_lock(&evin_thread_dev_mutex);
+
+    for( size_t i = 0; i < evin_thread_dev_cnt; ++i ) {
+        evin_thread_dev_t *dev = evin_thread_dev_tab + i;
+
+        if( !dev->paused )
+            continue;
+
+        memset(&eve, 0, sizeof eve);
+        eve.events   = EPOLLIN;
+        eve.data.u64 = dev->serial;
+
+        if( epoll_ctl(evin_thread_epoll_fd, EPOLL_CTL_MOD,
+                      dev->fd, &eve) == -1 )
+            mce_log(LL_WARN, "epoll_ctl(MOD): %m");
+
+        dev->paused = false;
+    }
+
+    pthread_mutex_unlock(&evin_thread_dev_mutex);
+
+EXIT:
+    return;
+}
+
+/** Switch devices from input thread back to main loop reading
+ *
+ * Used when the input thread has exited or events can't be passed
+ * from it to the main loop anymore. Devices added afterwards are
+ * read from the main loop too.
+ */
+static void
+evin_thread_fallback(void)
+{
+    int    fds[EVIN_THREAD_DEVICE_MAX];
+    size_t cnt = 0;
+
+    if( !evin_thread_running )
+        goto EXIT;
+
+    pthread_mutex_lock(&evin_thread_dev_mutex);
+    for( size_t i = 0; i < evin_thread_dev_cnt; ++i )
+        fds[cnt++] = evin_thread_dev_tab[i].fd;
+    pthread_mutex_unlock(&evin_thread_dev_mutex);
+
+    evin_thread_quit();
+
+    for( GSList *item = evin_iomon_device_list; item; item = item->next ) {
+        mce_io_mon_t *iomon = item->data;
+        int           fd    = mce_io_mon_get_fd(iomon);
+
+        for( size_t i = 0; i < cnt; ++i ) {
+            if( fds[i] == fd ) {
+                mce_io_mon_resume(iomon);
+                break;
+            }
+        }
+    }
+
+    mce_log(LL_WARN, "evdev input is read from the main loop");
+
+EXIT:
+    return;
+}
+
+/** Main loop callback for handling messages from input thread
+ *
+ * @param chn  io channel for evin_thread_notify_fd
+ * @param cnd  io condition that triggered the callback
+ * @param aptr (unused)
+ *
+ * @return TRUE to keep the io watch alive, FALSE to remove it
+ */
+static gboolean
+evin_thread_notify_cb(GIOChannel *chn, GIOCondition cnd, gpointer aptr)
+{
+    (void)chn;
+    (void)aptr;
+
+    gboolean        keep     = FALSE;
+    bool            in_frame = false;
+    evin_ts_frame_t frame;
+    evin_msg_t      msg;
+
+    if( cnd & ~G_IO_IN ) {
+        mce_log(LL_CRIT, "unexpected input thread notify condition 0x%x",
+                (unsigned)cnd);
+        evin_thread_notify_id = 0;
+        evin_thread_fallback();
+        goto EXIT;
+    }
+
+    evin_thread_eventfd_clear(evin_thread_notify_fd);
+
+    while( evin_thread_queue_pop(&msg) ) {
+        switch( msg.type ) {
+        case EVIN_MSG_EVENT:
+            evin_thread_handle_event(&msg, &frame, &in_frame);
+            break;
+
+        case EVIN_MSG_TOUCHING:
+            evin_input_grab_set_touching(&evin_ts_grab_state,
+                                         msg.ev.value);
+            break;
+
+        case EVIN_MSG_DONE:
+            if( in_frame )
+                evin_ts_frame_finish(&frame), in_frame = false;
+            evin_thread_wakelock_release();
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if( in_frame )
+        evin_ts_frame_finish(&frame);
+
+    /* Now that there is room, continue reading paused devices */
+    evin_thread_resume_devices();
+
+    if( __atomic_load_n(&evin_thread_exited, __ATOMIC_ACQUIRE) ) {
+        mce_log(LL_ERR, "input thread exited unexpectedly");
+        evin_thread_notify_id = 0;
+        evin_thread_fallback();
+        goto EXIT;
+    }
+
+    keep = TRUE;
+
+EXIT:
+    return keep;
+}
+
+/** Start reading device from input thread instead of the main loop
+ *
+ * @param fd   device file descriptor, ownership is not transferred
+ * @param type device type
+ *
+ * @return true if the device is handled by input thread, false otherwise
+ */
+static bool
+evin_thread_add_device(int fd, evin_evdevtype_t type)
+{
+    bool               res = false;
+    struct epoll_event eve;
+
+    if( !evin_thread_running )
+        goto EXIT;
+
+    switch( type ) {
+    case EVDEV_TOUCH:
+    case EVDEV_INPUT:
+    case EVDEV_KEYBOARD:
+    case EVDEV_VOLKEY:
+    case EVDEV_DBLTAP:
+    case EVDEV_ACTIVITY:
+        break;
+
+    default:
+        goto EXIT;
+    }
+
+    pthread_mutex_lock(&evin_thread_dev_mutex);
+
+    if( evin_thread_dev_cnt >= EVIN_THREAD_DEVICE_MAX ) {
+        mce_log(LL_WARN, "input thread device table full");
+        goto UNLOCK;
+    }
+
+    if( ++evin_thread_dev_serial == 0 )
+        ++evin_thread_dev_serial;
+
+    memset(&eve, 0, sizeof eve);
+    eve.events   = EPOLLIN;
+    eve.data.u64 = evin_thread_dev_serial;
+
+    if( epoll_ctl(evin_thread_epoll_fd, EPOLL_CTL_ADD, fd, &eve) == -1 ) {
+        mce_log(LL_WARN, "epoll_ctl(ADD): %m");
+        goto UNLOCK;
+    }
+
+    evin_thread_dev_t *dev = evin_thread_dev_tab + evin_thread_dev_cnt++;
+    dev->fd       = fd;
+    dev->serial   = evin_thread_dev_serial;
+    dev->type     = type;
+    dev->activity = 0;
+    dev->reading  = false;
+    dev->paused   = false;
+
+    res = true;
+
+UNLOCK:
+    pthread_mutex_unlock(&evin_thread_dev_mutex);
+
+EXIT:
+    return res;
+}
+
+/** Stop reading device from input thread
+ *
+ * Must be called before the file descriptor is closed.
+ *
+ * @param fd device file descriptor
+ */
+static void
+evin_thread_rem_device(int fd)
+{
+    if( !evin_thread_running || fd == -1 )
+        goto EXIT;
+
+    pthread_mutex_lock(&evin_thread_dev_mutex);
+
+    for( size_t i = 0; i < evin_thread_dev_cnt; ++i ) {
+        if( evin_thread_dev_tab[i].fd != fd )
+            continue;
+
+        /* Fails if input thread already stopped polling, ignore */
+        epoll_ctl(evin_thread_epoll_fd, EPOLL_CTL_DEL, fd, 0);
+
+        /* Wait for read() in progress to finish; does not take long
+         * as device file descriptors are non-blocking. Only the main
+         * loop modifies the table, so the entry does not move. */
+        while( evin_thread_dev_tab[i].reading )
+            pthread_cond_wait(&evin_thread_dev_cond, &evin_thread_dev_mutex);
+
+        evin_thread_dev_tab[i] = evin_thread_dev_tab[--evin_thread_dev_cnt];
+        break;
+    }
+
+    pthread_mutex_unlock(&evin_thread_dev_mutex);
+
+EXIT:
+    return;
+}
+
+/** Start input thread if enabled in configuration
+ */
+static void
+evin_thread_init(void)
+{
+    GIOChannel        *chn = 0;
+    struct epoll_event eve;
+
+    evin_thread_enabled = mce_conf_get_bool(MCE_CONF_EVENT_INPUT_GROUP,
+                                            MCE_CONF_EVENT_INPUT_THREAD,
+                                            DEFAULT_EVENT_INPUT_THREAD);
+
+    if( !evin_thread_enabled )
+        goto EXIT;
+
+    evin_thread_epoll_fd  = epoll_create1(EPOLL_CLOEXEC);
+    evin_thread_stop_fd   = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    evin_thread_notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if( evin_thread_epoll_fd == -1 || evin_thread_stop_fd == -1 ||
+        evin_thread_notify_fd == -1 ) {
+        mce_log(LL_ERR, "failed to create input thread fds: %m");
+        goto EXIT;
+    }
+
+    memset(&eve, 0, sizeof eve);
+    eve.events   = EPOLLIN;
+    eve.data.u64 = 0;
+
+    if( epoll_ctl(evin_thread_epoll_fd, EPOLL_CTL_ADD,
+                  evin_thread_stop_fd, &eve) == -1 ) {
+        mce_log(LL_ERR, "epoll_ctl(ADD): %m");
+        goto EXIT;
+    }
+
+    if( !(chn = g_io_channel_unix_new(evin_thread_notify_fd)) )
+        goto EXIT;
+
+    evin_thread_notify_id = g_io_add_watch(chn,
+                                           G_IO_IN | G_IO_ERR |
+                                           G_IO_HUP | G_IO_NVAL,
+                                           evin_thread_notify_cb, 0);
+    if( !evin_thread_notify_id )
+        goto EXIT;
+
+#ifdef ENABLE_WAKELOCKS
+    /* Make sure libwakelock state for the wakelock used from the
+     * input thread is set up from the main thread */
+    wakelock_unlock(EVIN_THREAD_WAKELOCK);
+#endif
+
+    __atomic_store_n(&evin_thread_stop, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&evin_thread_exited, 0, __ATOMIC_RELEASE);
+
+    if( (errno = pthread_create(&evin_thread_id, 0, evin_thread_main, 0)) ) {
+        mce_log(LL_ERR, "failed to start input thread: %m");
+        goto EXIT;
+    }
+
+    evin_thread_running = true;
+
+    mce_log(LL_NOTICE, "evdev input is read from a separate thread");
+
+EXIT:
+    if( chn )
+        g_io_channel_unref(chn);
+
+    if( evin_thread_enabled && !evin_thread_running )
+        evin_thread_quit();
+
+    return;
+}
+
+/** Stop input thread and release associated resources
+ */
+static void
+evin_thread_quit(void)
+{
+    evin_msg_t msg;
+
+    if( evin_thread_running ) {
+        __atomic_store_n(&evin_thread_stop, 1, __ATOMIC_RELEASE);
+        evin_thread_eventfd_signal(evin_thread_stop_fd);
+        pthread_join(evin_thread_id, 0);
+        evin_thread_running = false;
+    }
+
+    if( evin_thread_notify_id )
+        g_source_remove(evin_thread_notify_id), evin_thread_notify_id = 0;
+
+    /* Discard messages that were not handled */
+    while( evin_thread_queue_pop(&msg) ) {
+        if( msg.type == EVIN_MSG_DONE )
+            evin_thread_wakelock_release();
+    }
+
+    /* Thread might have exited between reading and queuing */
+    pthread_mutex_lock(&evin_thread_wakelock_mutex);
+    if( evin_thread_wakelock_count ) {
+        evin_thread_wakelock_count = 0;
+#ifdef ENABLE_WAKELOCKS
+        wakelock_unlock(EVIN_THREAD_WAKELOCK);
+#endif
+    }
+    pthread_mutex_unlock(&evin_thread_wakelock_mutex);
+
+    evin_thread_dev_cnt = 0;
+    evin_thread_dev_paused = 0;
+
+    if( evin_thread_notify_fd != -1 )
+        close(evin_thread_notify_fd), evin_thread_notify_fd = -1;
+
+    if( evin_thread_stop_fd != -1 )
+        close(evin_thread_stop_fd), evin_thread_stop_fd = -1;
+
+    if( evin_thread_epoll_fd != -1 )
+        close(evin_thread_epoll_fd), evin_thread_epoll_fd = -1;
+}
+
+/* ========================================================================= *
+ * MODULE_INIT
+ * ========================================================================= */
+
+/** Init function for the /dev/input event component
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean
+mce_input_init(void)
+{
+    gboolean status = FALSE;
+
+    evin_gpio_init();
+
+    evin_event_mapper_init();
+
+    evin_ts_grab_init();
+
+#ifdef ENABLE_DOUBLETAP_EMULATION
+    /* Get fake doubletap policy configuration & track changes */
+    mce_gconf_notifier_add(MCE_GCONF_EVENT_INPUT_PATH,
+                           MCE_GCONF_USE_FAKE_DOUBLETAP_PATH,
+                           evin_doubletap_gconf_changed_cb,
+                           &fake_evin_doubletap_id);
+
+    mce_gconf_get_bool(MCE_GCONF_USE_FAKE_DOUBLETAP_PATH,
+                       &fake_evin_doubletap_enabled);
+#endif
+
+    /* Append triggers/filters to datapipes */
+    append_output_trigger_to_datapipe(&submode_pipe,
+                                      evin_gpio_submode_trigger);
+    append_output_trigger_to_datapipe(&display_state_pipe,
+                                      evin_ts_grab_display_state_cb);
+    append_output_trigger_to_datapipe(&touch_grab_wanted_pipe,
+                                      evin_ts_grab_wanted_cb);
+    append_output_trigger_to_datapipe(&keypad_grab_wanted_pipe,
+                                      evin_kp_grab_wanted_cb);
+
+    /* Register input device directory monitor */
+    if( !evin_devdir_monitor_init() )
+        goto EXIT;
+
+    /* Start input thread before any devices get added */
+    evin_thread_init();
+
+    /* Find the initial set of input devices */
+    if( !evin_iomon_init() )
+        goto EXIT;
+
+    evin_iomon_switch_states_update();
+    evin_iomon_keyboard_state_update();
+
+    status = TRUE;
+EXIT:
+    return status;
+}
+
+/** Exit function for the /dev/input event component
+ */
+void
+mce_input_exit(void)
+{
+#ifdef ENABLE_DOUBLETAP_EMULATION
+    /* Remove fake doubletap policy change notifier */
+    mce_gconf_notifier_remove(fake_evin_doubletap_id),
+        fake_evin_doubletap_id = 0;
+#endif
+
+    /* Remove triggers/filters from datapipes */
+    remove_output_trigger_from_datapipe(&submode_pipe,
+                                        evin_gpio_submode_trigger);
+    remove_output_trigger_from_datapipe(&display_state_pipe,
+                                        evin_ts_grab_display_state_cb);
+    remove_output_trigger_from_datapipe(&touch_grab_wanted_pipe,
+                                        evin_ts_grab_wanted_cb);
+    remove_output_trigger_from_datapipe(&keypad_grab_wanted_pipe,
+                                        evin_kp_grab_wanted_cb);
+
+    /* Remove input device directory monitor */
+    evin_devdir_monitor_quit();
+
+    evin_iomon_quit();
+
+    /* Stop input thread after all devices are removed */
+    evin_thread_quit();
 
     /* Reset input grab state machines */
     evin_ts_grab_quit();
@@ -23,6 +23,19 @@
 
 #include <glib.h>
 
+/* ========================================================================= *
+ * STATIC CONFIGURATION
+ * ========================================================================= */
+
+/** Name of event input configuration group */
+#define MCE_CONF_EVENT_INPUT_GROUP	"EventInput"
+
+/** Whether evdev devices are read from a dedicated thread */
+#define MCE_CONF_EVENT_INPUT_THREAD	"InputThread"
+
+/** Default input thread usage */
+#define DEFAULT_EVENT_INPUT_THREAD	FALSE
+
 /** Path to the input device directory */
 #define DEV_INPUT_PATH			"/dev/input"
 
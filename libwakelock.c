@@ -4,9 +4,11 @@
  * License: LGPLv2
  * ------------------------------------------------------------------------- */
 
-/* NOTE: Only async-signal-safe functions can be called from this
- *       module since we might need to use the functionality while
- *       handling non-recoverable signals!
+/* NOTE: The public functions can be called from any thread; the
+ *       book keeping and cached file descriptors are protected by
+ *       lwl_mutex. They must not be called from signal handlers,
+ *       except on exit path after wakelock_block_suspend_until_exit()
+ *       when the mutex is used only if it is not already locked.
  */
 
 #include "libwakelock.h"
@@ -16,6 +18,8 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 
 /** Whether to write debug logging to stderr
  *
@@ -127,9 +131,39 @@ static void lwl_debug_(const char *m, ...)
 # define lwl_debug(MSG, MORE...) do { } while( 0 )
 #endif
 
+/** Lock for all state below, held by the public functions */
+static pthread_mutex_t lwl_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /** Flag that gets set once the process is about to exit */
 static int        lwl_shutting_down = 0;
 
+/** Lock lwl_mutex
+ *
+ * On exit path we might be running in a signal handler that
+ * interrupted a thread holding the mutex, so go ahead without
+ * it rather than deadlock.
+ *
+ * @return 1 if the mutex was locked, 0 otherwise
+ */
+static int lwl_mutex_lock(void)
+{
+	if( __atomic_load_n(&lwl_shutting_down, __ATOMIC_ACQUIRE) )
+		return pthread_mutex_trylock(&lwl_mutex) == 0;
+
+	pthread_mutex_lock(&lwl_mutex);
+	return 1;
+}
+
+/** Unlock lwl_mutex
+ *
+ * @param locked return value from lwl_mutex_lock()
+ */
+static void lwl_mutex_unlock(int locked)
+{
+	if( locked )
+		pthread_mutex_unlock(&lwl_mutex);
+}
+
 /** Sysfs entry for acquiring wakelocks */
 static const char lwl_lock_path[]   = "/sys/power/wake_lock";
 
@@ -160,7 +194,35 @@ static void lwl_write_file(const char *path, const char *data)
 	}
 }
 
+/** Helper for writing to sysfs files kept open between writes
+ *
+ * @param path sysfs file path
+ * @param fd   pointer to cached file descriptor
+ * @param data string to write
+ */
+static void lwl_write_fd(const char *path, int *fd, const char *data)
+{
+	lwl_debug(path, " << ", data, NULL);
+
+	if( *fd == -1 ) {
+		*fd = TEMP_FAILURE_RETRY(open(path, O_WRONLY | O_CLOEXEC));
+		if( *fd == -1 ) {
+			lwl_debug(path, ": open: ", strerror(errno), "\n",
+				  NULL);
+			return;
+		}
+	}
+
+	int size = strlen(data);
+	errno = 0;
+	if( TEMP_FAILURE_RETRY(pwrite(*fd, data, size, 0)) != size ) {
+		lwl_debug(path, ": write: ", strerror(errno), "\n", NULL);
+	}
+}
+
 /** Helper for checking if wakelock interface is supported
+ *
+ * Must be called with lwl_mutex held.
  */
 static int lwl_enabled(void)
 {
@@ -174,7 +236,179 @@ static int lwl_enabled(void)
 	return enabled;
 }
 
+/** Cached file descriptor for lwl_lock_path */
+static int lwl_lock_fd = -1;
+
+/** Cached file descriptor for lwl_unlock_path */
+static int lwl_unlock_fd = -1;
+
+/** Maximum number of wakelocks tracked in userspace */
+#define LWL_SLOT_COUNT 32
+
+/** Maximum length of tracked wakelock name */
+#define LWL_NAME_MAX 48
+
+/** Kernel side wakelock state as far as we know */
+typedef enum {
+	LWL_STATE_UNKNOWN,	/**< Not touched yet, or timed lock */
+	LWL_STATE_LOCKED,	/**< Locked without timeout */
+	LWL_STATE_UNLOCKED,	/**< Unlocked */
+} lwl_state_t;
+
+/** Userspace book keeping for one wakelock name
+ */
+typedef struct {
+	char        name[LWL_NAME_MAX];	/**< Wakelock name */
+	lwl_state_t state;		/**< Kernel side state */
+	int         refs;		/**< Nesting level of acquire/release */
+
+	long long   writes;		/**< Sysfs writes made */
+	long long   saved;		/**< Sysfs writes skipped */
+	long long   since;		/**< Lock time stamp [ns] */
+	long long   held;		/**< Total time locked [ns] */
+	long long   longest;		/**< Longest time locked [ns] */
+} lwl_slot_t;
+
+/** Tracked wakelocks */
+static lwl_slot_t lwl_slot_tab[LWL_SLOT_COUNT];
+
+/** Number of used lwl_slot_tab entries */
+static int lwl_slot_cnt = 0;
+
+/** Get CLOCK_BOOTTIME time stamp in nanoseconds
+ */
+static long long lwl_time_ns(void)
+{
+	struct timespec ts = { 0, 0 };
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** Find book keeping slot for wakelock name
+ *
+ * @param name wakelock name
+ *
+ * @return slot pointer, or NULL if the name can't be tracked
+ */
+static lwl_slot_t *lwl_slot_find(const char *name)
+{
+	lwl_slot_t *slot = 0;
+
+	for( int i = 0; i < lwl_slot_cnt; ++i ) {
+		if( !strcmp(lwl_slot_tab[i].name, name) ) {
+			slot = lwl_slot_tab + i;
+			goto EXIT;
+		}
+	}
+
+	if( lwl_slot_cnt >= LWL_SLOT_COUNT ||
+	    strlen(name) >= LWL_NAME_MAX )
+		goto EXIT;
+
+	slot = lwl_slot_tab + lwl_slot_cnt++;
+	strcpy(slot->name, name);
+	slot->state = LWL_STATE_UNKNOWN;
+
+EXIT:
+	return slot;
+}
+
+/** Update book keeping for kernel side state change
+ *
+ * @param slot  slot to update
+ * @param state new kernel side state
+ */
+static void lwl_slot_set_state(lwl_slot_t *slot, lwl_state_t state)
+{
+	long long now = lwl_time_ns();
+
+	if( slot->since ) {
+		long long t = now - slot->since;
+		slot->held += t;
+		if( slot->longest < t )
+			slot->longest = t;
+		slot->since = 0;
+	}
+
+	if( state != LWL_STATE_UNLOCKED )
+		slot->since = now;
+
+	slot->state = state;
+	slot->writes += 1;
+}
+
+/** Enable a wakelock, with lwl_mutex held
+ *
+ * @param slot book keeping slot, or NULL if the name is not tracked
+ * @param name The name of the wakelock to obtain
+ * @param ns   Timeout in nanoseconds, or negative value for no timeout
+ */
+static void lwl_lock_locked(lwl_slot_t *slot, const char *name, long long ns)
+{
+	char tmp[64];
+	char num[64];
+
+	if( slot && ns < 0 && slot->state == LWL_STATE_LOCKED ) {
+		slot->saved += 1;
+		return;
+	}
+
+	if( ns < 0 ) {
+		lwl_concat(tmp, sizeof tmp, name, "\n", NULL);
+	} else {
+		lwl_concat(tmp, sizeof tmp, name, " ",
+			   lwl_number(num, sizeof num, ns),
+			   "\n", NULL);
+	}
+	lwl_write_fd(lwl_lock_path, &lwl_lock_fd, tmp);
+
+	/* Timed locks can expire behind our back */
+	if( slot )
+		lwl_slot_set_state(slot, ns < 0 ? LWL_STATE_LOCKED :
+				   LWL_STATE_UNKNOWN);
+}
+
+/** Disable a wakelock, with lwl_mutex held
+ *
+ * If the wakelock has been acquired via wakelock_acquire(), one
+ * reference is dropped and the kernel side is updated only when
+ * the last one goes away - except on exit path where the kernel
+ * side is always updated.
+ *
+ * @param slot book keeping slot, or NULL if the name is not tracked
+ * @param name The name of the wakelock to release
+ */
+static void lwl_unlock_locked(lwl_slot_t *slot, const char *name)
+{
+	char tmp[64];
+
+	if( slot ) {
+		if( slot->refs > 1 && !lwl_shutting_down ) {
+			slot->refs -= 1;
+			slot->saved += 1;
+			return;
+		}
+
+		slot->refs = 0;
+
+		if( slot->state == LWL_STATE_UNLOCKED &&
+		    !lwl_shutting_down ) {
+			slot->saved += 1;
+			return;
+		}
+	}
+
+	lwl_concat(tmp, sizeof tmp, name, "\n", NULL);
+	lwl_write_fd(lwl_unlock_path, &lwl_unlock_fd, tmp);
+
+	if( slot )
+		lwl_slot_set_state(slot, LWL_STATE_UNLOCKED);
+}
+
 /** Use sysfs interface to create and enable a wakelock.
+ *
+ * Locking without timeout an already locked wakelock is
+ * handled without making system calls.
  *
  * @param name The name of the wakelock to obtain
  * @param ns   Time in nanoseconds before the wakelock gets released
@@ -182,21 +416,22 @@ static int lwl_enabled(void)
  */
 void wakelock_lock(const char *name, long long ns)
 {
-	if( lwl_enabled() && !lwl_shutting_down ) {
-		char tmp[64];
-		char num[64];
-		if( ns < 0 ) {
-			lwl_concat(tmp, sizeof tmp, name, "\n", NULL);
-		} else {
-			lwl_concat(tmp, sizeof tmp, name, " ",
-				   lwl_number(num, sizeof num, ns),
-				   "\n", NULL);
-		}
-		lwl_write_file(lwl_lock_path, tmp);
-	}
+	int locked = lwl_mutex_lock();
+
+	if( lwl_enabled() && !lwl_shutting_down )
+		lwl_lock_locked(lwl_slot_find(name), name, ns);
+
+	lwl_mutex_unlock(locked);
 }
 
 /** Use sysfs interface to disable a wakelock.
+ *
+ * Unlocking an already unlocked wakelock is handled without
+ * making system calls, except on exit path where the kernel
+ * side is always updated.
+ *
+ * If the wakelock has been acquired via wakelock_acquire(), this
+ * drops one reference, i.e. it works like wakelock_release().
  *
  * @param name The name of the wakelock to release
  *
@@ -204,11 +439,118 @@ void wakelock_lock(const char *name, long long ns)
  */
 void wakelock_unlock(const char *name)
 {
-	if( lwl_enabled() ) {
-		char tmp[64];
-		lwl_concat(tmp, sizeof tmp, name, "\n", NULL);
-		lwl_write_file(lwl_unlock_path, tmp);
+	int locked = lwl_mutex_lock();
+
+	if( lwl_enabled() )
+		lwl_unlock_locked(lwl_slot_find(name), name);
+
+	lwl_mutex_unlock(locked);
+}
+
+/** Acquire nestable wakelock
+ *
+ * Unlike wakelock_lock(), calls are counted and the wakelock
+ * is released only after matching number of wakelock_release()
+ * calls have been made. Only the 0->1 transition can lead to
+ * kernel side changes.
+ *
+ * @param name The name of the wakelock to obtain
+ */
+void wakelock_acquire(const char *name)
+{
+	lwl_slot_t *slot;
+
+	int locked = lwl_mutex_lock();
+
+	if( !lwl_enabled() || lwl_shutting_down )
+		goto EXIT;
+
+	if( !(slot = lwl_slot_find(name)) ) {
+		/* Untracked: fall back to plain locking */
+		lwl_lock_locked(0, name, -1);
+	}
+	else if( slot->refs++ == 0 ) {
+		lwl_lock_locked(slot, name, -1);
+	}
+	else {
+		slot->saved += 1;
 	}
+
+EXIT:
+	lwl_mutex_unlock(locked);
+}
+
+/** Release nestable wakelock
+ *
+ * @param name The name of the wakelock to release
+ */
+void wakelock_release(const char *name)
+{
+	int locked = lwl_mutex_lock();
+
+	/* Untracked names and unbalanced releases unlock directly */
+	if( lwl_enabled() )
+		lwl_unlock_locked(lwl_slot_find(name), name);
+
+	lwl_mutex_unlock(locked);
+}
+
+/** Write wakelock statistics as text
+ *
+ * One line per tracked wakelock:
+ *   name state refs writes saved held_ms longest_ms
+ *
+ * @param buf  output buffer
+ * @param size size of output buffer
+ */
+void wakelock_get_stats(char *buf, size_t size)
+{
+	char *pos = buf;
+	char *end = buf + size - 1;
+	char  num[32];
+	long long now = lwl_time_ns();
+
+	auto void emit(const char *s) {
+		while( pos < end && *s ) *pos++ = *s++;
+	}
+	auto void emit_num(long long n) {
+		emit(" ");
+		emit(lwl_number(num, sizeof num, n));
+	}
+
+	if( !size )
+		return;
+
+	int locked = lwl_mutex_lock();
+
+	for( int i = 0; i < lwl_slot_cnt; ++i ) {
+		const lwl_slot_t *slot = lwl_slot_tab + i;
+		long long held    = slot->held;
+		long long longest = slot->longest;
+
+		/* Include the ongoing lock period */
+		if( slot->since ) {
+			long long t = now - slot->since;
+			held += t;
+			if( longest < t )
+				longest = t;
+		}
+
+		emit(slot->name);
+		emit(slot->state == LWL_STATE_LOCKED   ? " locked"   :
+		     slot->state == LWL_STATE_UNLOCKED ? " unlocked" :
+		     " unknown");
+		emit_num(slot->refs);
+		emit_num(slot->writes);
+		emit_num(slot->saved);
+		emit_num(held / 1000000);
+		emit_num(longest / 1000000);
+		emit("\n");
+	}
+
+	lwl_mutex_unlock(locked);
+
+	*pos = 0;
 }
 
 /** Use sysfs interface to allow automatic entry to suspend
@@ -221,9 +563,13 @@ void wakelock_unlock(const char *name)
  */
 void wakelock_allow_suspend(void)
 {
+	int locked = lwl_mutex_lock();
+
 	if( lwl_enabled() && !lwl_shutting_down ) {
 		lwl_write_file(lwl_state_path, "mem\n");
 	}
+
+	lwl_mutex_unlock(locked);
 }
 
 /** Use sysfs interface to block automatic entry to suspend
@@ -233,9 +579,13 @@ void wakelock_allow_suspend(void)
  */
 void wakelock_block_suspend(void)
 {
+	int locked = lwl_mutex_lock();
+
 	if( lwl_enabled() ) {
 		lwl_write_file(lwl_state_path, "on\n");
 	}
+
+	lwl_mutex_unlock(locked);
 }
 
 /** Block automatic suspend without possibility to unblock it again
@@ -250,7 +600,8 @@ void wakelock_block_suspend(void)
 
 void wakelock_block_suspend_until_exit(void)
 {
-	lwl_shutting_down = 1;
+	__atomic_store_n(&lwl_shutting_down, 1, __ATOMIC_RELEASE);
+
 	wakelock_block_suspend();
 }
 
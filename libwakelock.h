@@ -7,6 +7,8 @@
 #ifndef LIBWAKELOCK_H_
 # define LIBWAKELOCK_H_
 
+# include <stddef.h>
+
 # ifdef __cplusplus
 extern "C" {
 # elif 0
@@ -16,6 +18,11 @@ extern "C" {
 void wakelock_lock  (const char *name, long long ns);
 void wakelock_unlock(const char *name);
 
+void wakelock_acquire(const char *name);
+void wakelock_release(const char *name);
+
+void wakelock_get_stats(char *buf, size_t size);
+
 void wakelock_allow_suspend(void);
 void wakelock_block_suspend(void);
 void wakelock_block_suspend_until_exit(void);
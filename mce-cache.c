@@ -0,0 +1,330 @@
+/**
+ * @file mce-cache.c
+ * Binary configuration cache for Mode Control Entity
+ * <p>
+ * Parsing the text based configuration files is one of the bigger
+ * items on the mce startup path. To avoid doing it on every boot,
+ * the end result can be stored as a flat binary image that is
+ * mmap()ed and walked through on the following startups.
+ * <p>
+ * The image consists of a fixed size header followed by records,
+ * each of which holds three nul terminated strings. The header
+ * contains a stamp computed from the source files the data was
+ * derived from and a checksum of the record data. If either one
+ * does not match, the caller is expected to fall back to parsing
+ * the text files and then write a fresh image.
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mce-cache.h"
+
+#include "mce-log.h"
+#include "mce-io.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/** Cache image identification */
+#define MCE_CACHE_MAGIC		"MCECACHE"
+
+/** Cache image layout version; bump on incompatible changes */
+#define MCE_CACHE_VERSION	1
+
+/** Cache image header */
+typedef struct {
+	char     magic[8];	/**< MCE_CACHE_MAGIC */
+	uint32_t version;	/**< MCE_CACHE_VERSION */
+	uint32_t count;		/**< Number of records */
+	uint64_t stamp;		/**< Source file stamp */
+	uint64_t checksum;	/**< Checksum over record data */
+	uint64_t size;		/**< Size of record data */
+} mce_cache_header_t;
+
+/** Cache image builder */
+struct mce_cache_t {
+	/** Record data */
+	GByteArray *data;
+
+	/** Number of records */
+	guint       count;
+};
+
+/** Update FNV-1a hash
+ *
+ * @param hash value to update
+ * @param data bytes to add
+ * @param size number of bytes
+ *
+ * @return updated hash value
+ */
+static guint64 mce_cache_hash(guint64 hash, const void *data, gsize size)
+{
+	const guint8 *pos = data;
+
+	for( gsize i = 0; i < size; ++i ) {
+		hash ^= pos[i];
+		hash *= G_GUINT64_CONSTANT(0x100000001b3);
+	}
+	return hash;
+}
+
+/** Initial value for FNV-1a hash */
+#define MCE_CACHE_HASH_INIT G_GUINT64_CONSTANT(0xcbf29ce484222325)
+
+/** Compute stamp for validating cache against source files
+ *
+ * The stamp covers the mce version, caller provided tag and the
+ * path and content of each source file. Adding, removing or editing
+ * any of the files changes the stamp, while just touching them or
+ * restoring them from a backup does not.
+ *
+ * Reading the files is cheap compared to parsing them, and hashing
+ * the content does not depend on the file system keeping track of
+ * modification times sensibly.
+ *
+ * @param tag   string identifying the cached data set
+ * @param paths array of source file paths
+ * @param count number of paths
+ *
+ * @return stamp value
+ */
+guint64 mce_cache_stamp(const char *tag, char **paths, gsize count)
+{
+	static const char vers[] = G_STRINGIFY(PRG_VERSION);
+
+	guint64 hash = MCE_CACHE_HASH_INIT;
+
+	hash = mce_cache_hash(hash, vers, sizeof vers);
+	hash = mce_cache_hash(hash, tag, strlen(tag) + 1);
+
+	for( gsize i = 0; i < count; ++i ) {
+		const char *path = paths[i];
+		gchar      *data = 0;
+		gsize       size = 0;
+		int64_t     len  = -1;
+
+		hash = mce_cache_hash(hash, path, strlen(path) + 1);
+
+		/* Missing / unreadable files hash as negative length */
+		if( g_file_get_contents(path, &data, &size, 0) )
+			len = size;
+
+		hash = mce_cache_hash(hash, &len, sizeof len);
+		hash = mce_cache_hash(hash, data, size);
+
+		g_free(data);
+	}
+
+	return hash;
+}
+
+/** Create cache image builder
+ *
+ * @return builder object, release with mce_cache_delete()
+ */
+mce_cache_t *mce_cache_create(void)
+{
+	mce_cache_t *self = g_malloc0(sizeof *self);
+
+	self->data  = g_byte_array_new();
+	self->count = 0;
+
+	return self;
+}
+
+/** Delete cache image builder
+ *
+ * @param self builder object, or NULL
+ */
+void mce_cache_delete(mce_cache_t *self)
+{
+	if( !self )
+		goto EXIT;
+
+	g_byte_array_free(self->data, TRUE);
+	g_free(self);
+
+EXIT:
+	return;
+}
+
+/** Add a record to cache image
+ *
+ * @param self builder object
+ * @param a    1st string, or NULL
+ * @param b    2nd string, or NULL
+ * @param c    3rd string, or NULL
+ */
+void mce_cache_add(mce_cache_t *self, const char *a,
+		   const char *b, const char *c)
+{
+	const char *str[3] = { a ?: "", b ?: "", c ?: "" };
+
+	for( size_t i = 0; i < G_N_ELEMENTS(str); ++i )
+		g_byte_array_append(self->data, (const guint8 *)str[i],
+				    strlen(str[i]) + 1);
+	self->count += 1;
+}
+
+/** Write cache image to a file
+ *
+ * @param self  builder object
+ * @param path  file to write
+ * @param stamp value from mce_cache_stamp()
+ *
+ * @return TRUE if the file was written, FALSE otherwise
+ */
+gboolean mce_cache_save(mce_cache_t *self, const char *path, guint64 stamp)
+{
+	gboolean           res = FALSE;
+	GByteArray        *img = g_byte_array_new();
+	mce_cache_header_t hdr;
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, MCE_CACHE_MAGIC, sizeof hdr.magic);
+	hdr.version  = MCE_CACHE_VERSION;
+	hdr.count    = self->count;
+	hdr.stamp    = stamp;
+	hdr.size     = self->data->len;
+	hdr.checksum = mce_cache_hash(MCE_CACHE_HASH_INIT,
+				      self->data->data, self->data->len);
+
+	g_byte_array_append(img, (const guint8 *)&hdr, sizeof hdr);
+	g_byte_array_append(img, self->data->data, self->data->len);
+
+	if( !mce_io_update_file_atomic(path, img->data, img->len,
+				       0644, FALSE) ) {
+		mce_log(LL_WARN, "%s: failed to write cache", path);
+		goto EXIT;
+	}
+
+	mce_log(LL_DEBUG, "%s: %u records cached", path, hdr.count);
+	res = TRUE;
+
+EXIT:
+	g_byte_array_free(img, TRUE);
+
+	return res;
+}
+
+/** Enumerate records from cache image file
+ *
+ * Nothing is passed to the callback unless the whole image
+ * has been validated first.
+ *
+ * @param path  file to read
+ * @param stamp value from mce_cache_stamp()
+ * @param cb    function to call for each record
+ * @param aptr  user data to pass to the callback
+ *
+ * @return TRUE if cached data was used, FALSE otherwise
+ */
+gboolean mce_cache_load(const char *path, guint64 stamp,
+			mce_cache_record_fn cb, gpointer aptr)
+{
+	gboolean    res  = FALSE;
+	int         fd   = -1;
+	void       *base = MAP_FAILED;
+	size_t      size = 0;
+	guint       strs = 0;
+	struct stat st;
+
+	const mce_cache_header_t *hdr = 0;
+	const char               *pos = 0;
+	const char               *end = 0;
+
+	if( (fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 ) {
+		if( errno != ENOENT )
+			mce_log(LL_WARN, "%s: open: %m", path);
+		goto EXIT;
+	}
+
+	if( fstat(fd, &st) == -1 ) {
+		mce_log(LL_WARN, "%s: stat: %m", path);
+		goto EXIT;
+	}
+
+	if( (size = st.st_size) < sizeof *hdr ) {
+		mce_log(LL_NOTICE, "%s: truncated", path);
+		goto EXIT;
+	}
+
+	base = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if( base == MAP_FAILED ) {
+		mce_log(LL_WARN, "%s: mmap: %m", path);
+		goto EXIT;
+	}
+
+	hdr = base;
+	pos = (const char *)(hdr + 1);
+	end = (const char *)base + size;
+
+	if( memcmp(hdr->magic, MCE_CACHE_MAGIC, sizeof hdr->magic) ||
+	    hdr->version != MCE_CACHE_VERSION ) {
+		mce_log(LL_NOTICE, "%s: unknown format", path);
+		goto EXIT;
+	}
+
+	if( hdr->stamp != stamp ) {
+		mce_log(LL_NOTICE, "%s: out of date", path);
+		goto EXIT;
+	}
+
+	if( hdr->size != (uint64_t)(end - pos) ||
+	    hdr->checksum != mce_cache_hash(MCE_CACHE_HASH_INIT,
+					    pos, hdr->size) ) {
+		mce_log(LL_WARN, "%s: corrupted", path);
+		goto EXIT;
+	}
+
+	/* The data must consist of exactly count * 3 strings */
+	if( hdr->size && end[-1] != 0 ) {
+		mce_log(LL_WARN, "%s: unterminated data", path);
+		goto EXIT;
+	}
+
+	for( const char *zen = pos; zen < end; ++zen ) {
+		if( *zen == 0 )
+			++strs;
+	}
+	if( strs != hdr->count * 3 ) {
+		mce_log(LL_WARN, "%s: record count mismatch", path);
+		goto EXIT;
+	}
+
+	for( guint i = 0; i < hdr->count; ++i ) {
+		const char *a = pos; pos += strlen(pos) + 1;
+		const char *b = pos; pos += strlen(pos) + 1;
+		const char *c = pos; pos += strlen(pos) + 1;
+		cb(a, b, c, aptr);
+	}
+
+	mce_log(LL_DEBUG, "%s: %u records loaded", path, hdr->count);
+	res = TRUE;
+
+EXIT:
+	if( base != MAP_FAILED )
+		munmap(base, size);
+
+	if( fd != -1 )
+		close(fd);
+
+	return res;
+}
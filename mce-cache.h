@@ -0,0 +1,51 @@
+/**
+ * @file mce-cache.h
+ * Headers for the binary configuration cache for Mode Control Entity
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_CACHE_H_
+#define _MCE_CACHE_H_
+
+#include <glib.h>
+
+/** Path to precompiled ini-file configuration */
+#define MCE_CACHE_CONF_PATH	G_STRINGIFY(MCE_VAR_DIR)"/mce-conf.cache"
+
+/** Path to precompiled builtin-gconf settings */
+#define MCE_CACHE_GCONF_PATH	G_STRINGIFY(MCE_VAR_DIR)"/builtin-gconf.cache"
+
+/** Callback for enumerating cached records
+ *
+ * The strings point to read only memory that is valid only
+ * for the duration of the callback.
+ */
+typedef void (*mce_cache_record_fn)(const char *a, const char *b,
+				    const char *c, gpointer aptr);
+
+/** Opaque cache image builder */
+typedef struct mce_cache_t mce_cache_t;
+
+guint64      mce_cache_stamp (const char *tag, char **paths, gsize count);
+
+mce_cache_t *mce_cache_create(void);
+void         mce_cache_delete(mce_cache_t *self);
+void         mce_cache_add   (mce_cache_t *self, const char *a,
+			      const char *b, const char *c);
+gboolean     mce_cache_save  (mce_cache_t *self, const char *path,
+			      guint64 stamp);
+
+gboolean     mce_cache_load  (const char *path, guint64 stamp,
+			      mce_cache_record_fn cb, gpointer aptr);
+
+#endif /* _MCE_CACHE_H_ */
@@ -23,6 +23,7 @@
 
 #include "mce.h"
 #include "mce-log.h"
+#include "mce-cache.h"
 #include "modules/led.h"
 
 #include <string.h>
@@ -413,6 +414,62 @@ static int mce_conf_glob_error_cb(const char *path, int err)
 	return 0;
 }
 
+#ifdef ENABLE_CONF_CACHE
+/** Callback for restoring merged config values from binary cache
+ *
+ * @param group config group name
+ * @param key   config key name
+ * @param value raw config value string
+ * @param aptr  GKeyFile to populate
+ */
+static void mce_conf_cache_load_cb(const char *group, const char *key,
+				   const char *value, gpointer aptr)
+{
+	g_key_file_set_value(aptr, group, key, value);
+}
+
+/** Restore merged config values from binary cache
+ *
+ * @param ini   GKeyFile to populate
+ * @param stamp source file stamp from mce_cache_stamp()
+ *
+ * @return TRUE if valid cache was found, FALSE otherwise
+ */
+static gboolean mce_conf_cache_load(GKeyFile *ini, guint64 stamp)
+{
+	return mce_cache_load(MCE_CACHE_CONF_PATH, stamp,
+			      mce_conf_cache_load_cb, ini);
+}
+
+/** Store merged config values to binary cache
+ *
+ * @param ini   GKeyFile to store
+ * @param stamp source file stamp from mce_cache_stamp()
+ */
+static void mce_conf_cache_save(GKeyFile *ini, guint64 stamp)
+{
+	mce_cache_t *cache  = mce_cache_create();
+	gchar      **groups = g_key_file_get_groups(ini, 0);
+
+	for( size_t g = 0; groups && groups[g]; ++g ) {
+		gchar **keys = g_key_file_get_keys(ini, groups[g], 0, 0);
+
+		for( size_t k = 0; keys && keys[k]; ++k ) {
+			gchar *value = g_key_file_get_value(ini, groups[g],
+							    keys[k], 0);
+			if( value )
+				mce_cache_add(cache, groups[g], keys[k], value);
+			g_free(value);
+		}
+		g_strfreev(keys);
+	}
+	g_strfreev(groups);
+
+	mce_cache_save(cache, MCE_CACHE_CONF_PATH, stamp);
+	mce_cache_delete(cache);
+}
+#endif /* ENABLE_CONF_CACHE */
+
 /** Process config data from /etc/mce/mce.d/xxx.ini files
  */
 static GKeyFile *mce_conf_read_ini_files(void)
@@ -421,6 +478,9 @@ static GKeyFile *mce_conf_read_ini_files(void)
 
 	GKeyFile *ini = g_key_file_new();
 	glob_t    gb;
+#ifdef ENABLE_CONF_CACHE
+	guint64   stamp = 0;
+#endif
 
 	memset(&gb, 0, sizeof gb);
 
@@ -429,6 +489,14 @@ static GKeyFile *mce_conf_read_ini_files(void)
 		goto EXIT;
 	}
 
+#ifdef ENABLE_CONF_CACHE
+	/* Use precompiled values if the ini files have not changed */
+	stamp = mce_cache_stamp("ini", gb.gl_pathv, gb.gl_pathc);
+
+	if( mce_conf_cache_load(ini, stamp) )
+		goto EXIT;
+#endif
+
 	for( size_t i = 0; i < gb.gl_pathc; ++i ) {
 		const char *path = gb.gl_pathv[i];
 		GError     *err  = 0;
@@ -446,6 +514,10 @@ static GKeyFile *mce_conf_read_ini_files(void)
 		g_key_file_free(tmp);
 	}
 
+#ifdef ENABLE_CONF_CACHE
+	mce_conf_cache_save(ini, stamp);
+#endif
+
 EXIT:
 	globfree(&gb);
 
@@ -26,12 +26,18 @@
 #include "mce.h"
 #include "mce-log.h"
 #include "mce-lib.h"
+#include "mce-conf.h"
+#include "mce-trace.h"
+#ifdef ENABLE_WAKELOCKS
+# include "libwakelock.h"
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <dbus/dbus-glib-lowlevel.h>
 
@@ -224,9 +230,33 @@ static DBusConnection *dbus_connection = NULL;
 /** List of all D-Bus handlers */
 static GSList *dbus_handlers = NULL;
 
+/** Flag for: dbus_handlers has links with NULL data */
+static bool dbus_handlers_dirty = false;
+
 /** D-Bus handler callback function */
 typedef gboolean (*handler_callback_t)(DBusMessage *const msg);
 
+/** Rule value is compared against message object path */
+#define HANDLER_RULE_PATH (-1)
+
+/** Pre-parsed D-Bus handler matching rule */
+typedef struct
+{
+	int                 arg;        /**< Argument index, or
+					 *   HANDLER_RULE_PATH */
+	gchar              *value;      /**< Value to match */
+} handler_rule_t;
+
+/** Message (type, interface, member) triplet, for use as hash key */
+typedef struct
+{
+	int                 type;       /**< DBUS_MESSAGE_TYPE */
+	gchar              *interface;  /**< Interface name */
+	gchar              *member;     /**< Member name, or NULL */
+} handler_key_t;
+
+typedef struct handler_bucket_t handler_bucket_t;
+
 /** D-Bus handler structure */
 typedef struct
 {
@@ -236,8 +266,36 @@ typedef struct
 	gchar              *name;       /**< Method call or signal name */
 	gchar              *args;       /**< Introspect XML data */
 	int                 type;       /**< DBUS_MESSAGE_TYPE */
+
+	handler_rule_t     *rule_vec;   /**< Rules parsed from rules string */
+	guint               rule_cnt;   /**< Number of items in rule_vec */
+	bool                rule_err;   /**< Rules could not be parsed */
+
+	guint               seq;        /**< Registration order */
+	handler_bucket_t   *bucket;     /**< Dispatch index bucket */
 } handler_struct_t;
 
+/** Handlers with identical (type, interface, member) triplet
+ *
+ * Handlers that do not specify member name are held in separate
+ * wildcard buckets, with member set to NULL.
+ */
+struct handler_bucket_t
+{
+	handler_key_t       key;        /**< Hash key */
+	GSList             *handlers;   /**< Handlers, newest first */
+	guint               busy;       /**< Dispatch nesting level */
+	bool                dirty;      /**< Handlers has NULL links */
+};
+
+static void mce_dbus_squeeze_slist(GSList **list);
+
+/** Dispatch index: handler_key_t -> handler_bucket_t */
+static GHashTable *handler_index = NULL;
+
+/** Counter for assigning handler_struct_t seq values */
+static guint handler_seq = 0;
+
 /** Set handler type for D-Bus handler structure */
 static inline void handler_struct_set_type(handler_struct_t *self, int val)
 {
@@ -275,12 +333,139 @@ static inline void handler_struct_set_callback(handler_struct_t *self,
 	self->callback = val;
 }
 
+/** Release pre-parsed rules of D-Bus handler structure */
+static void handler_struct_clear_rules(handler_struct_t *self)
+{
+	for( guint i = 0; i < self->rule_cnt; ++i )
+		g_free(self->rule_vec[i].value);
+	g_free(self->rule_vec), self->rule_vec = 0;
+	self->rule_cnt = 0;
+	self->rule_err = false;
+}
+
+/** Pre-parse custom rules for D-Bus handler structure
+ *
+ * Handles the "arg0='value',path='/object/path'" syntax also used
+ * for constructing D-Bus match strings. Unquoted values extend up to
+ * the next comma.
+ *
+ * @param self D-Bus handler structure with rules string set
+ */
+static void handler_struct_parse_rules(handler_struct_t *self)
+{
+	const char *pos = self->rules;
+
+	handler_struct_clear_rules(self);
+
+	if( !pos )
+		goto EXIT;
+
+	pos += strspn(pos, " ");
+
+	while( *pos ) {
+		const char *eq;
+		const char *beg;
+		const char *end;
+		int         arg;
+
+		if( !(eq = strchr(pos, '=')) )
+			goto FAIL;
+
+		if( !strncmp(pos, "arg", 3) )
+			arg = atoi(pos + 3);
+		else if( !strncmp(pos, "path", 4) )
+			arg = HANDLER_RULE_PATH;
+		else
+			goto FAIL;
+
+		eq += 1;
+		eq += strspn(eq, " ");
+
+		if( *eq == '\'' ) {
+			beg = eq + 1;
+			if( !(end = strchr(beg, '\'')) )
+				goto FAIL;
+			pos = end + 1;
+		}
+		else {
+			beg = eq;
+			end = strchrnul(beg, ',');
+			pos = end;
+		}
+
+		self->rule_vec = g_renew(handler_rule_t, self->rule_vec,
+					 self->rule_cnt + 1);
+		self->rule_vec[self->rule_cnt].arg   = arg;
+		self->rule_vec[self->rule_cnt].value = g_strndup(beg, end - beg);
+		self->rule_cnt += 1;
+
+		pos += strspn(pos, " ");
+		if( *pos == ',' )
+			++pos;
+		pos += strspn(pos, " ");
+	}
+
+EXIT:
+	return;
+
+FAIL:
+	mce_log(LL_ERR, "invalid D-Bus handler rules: %s", self->rules);
+	handler_struct_clear_rules(self);
+	self->rule_err = true;
+}
+
+/** Check if D-Bus message matches pre-parsed handler rules
+ *
+ * @param self D-Bus handler structure
+ * @param msg  D-Bus message
+ *
+ * @return true if message matches, false otherwise
+ */
+static bool handler_struct_match_rules(const handler_struct_t *self,
+				       DBusMessage *const msg)
+{
+	if( self->rule_err )
+		return false;
+
+	for( guint i = 0; i < self->rule_cnt; ++i ) {
+		const handler_rule_t *rule = self->rule_vec + i;
+		const char           *val  = 0;
+
+		if( rule->arg == HANDLER_RULE_PATH ) {
+			val = dbus_message_get_path(msg);
+		}
+		else {
+			DBusMessageIter iter;
+
+			if( !dbus_message_iter_init(msg, &iter) )
+				return false;
+
+			for( int fld = rule->arg; fld > 0; --fld ) {
+				if( !dbus_message_iter_next(&iter) )
+					return false;
+			}
+
+			if( dbus_message_iter_get_arg_type(&iter) !=
+			    DBUS_TYPE_STRING )
+				return false;
+
+			dbus_message_iter_get_basic(&iter, &val);
+		}
+
+		if( !val || strcmp(val, rule->value) )
+			return false;
+	}
+
+	return true;
+}
+
 /** Release D-Bus handler structure */
 static void handler_struct_delete(handler_struct_t *self)
 {
 	if( !self )
 		goto EXIT;
 
+	handler_struct_clear_rules(self);
 	g_free(self->args);
 	g_free(self->name);
 	g_free(self->rules);
@@ -301,213 +486,983 @@ static handler_struct_t *handler_struct_create(void)
 	self->name      = 0;
 	self->args      = 0;
 	self->type      = DBUS_MESSAGE_TYPE_INVALID;
+	self->rule_vec  = 0;
+	self->rule_cnt  = 0;
+	self->rule_err  = false;
+	self->seq       = 0;
+	self->bucket    = 0;
 	return self;
 }
 
-/** Return reference to dbus connection cached at mce-dbus module
- *
- * For use in situations where the abstraction provided by mce-dbus
- * makes things too complicated.
- *
- * Caller must release non-null return values with dbus_connection_unref().
- *
- * @return DBusConnection, or NULL if mce has no dbus connection
- */
-DBusConnection *dbus_connection_get(void)
+/** Release dispatch index bucket */
+static void handler_bucket_delete(handler_bucket_t *self)
 {
-	if( !dbus_connection ) {
-		mce_log(LL_WARN, "no dbus connection");
-		return NULL;
-	}
-	return dbus_connection_ref(dbus_connection);
+	if( !self )
+		goto EXIT;
+
+	g_slist_free(self->handlers);
+	g_free(self->key.member);
+	g_free(self->key.interface);
+	g_free(self);
+
+EXIT:
+	return;
 }
 
-/**
- * Create a new D-Bus signal, with proper error checking
- * will exit the mainloop if an error occurs
- *
- * @param path The signal path
- * @param interface The signal interface
- * @param name The name of the signal to send
- * @return A new DBusMessage
- */
-DBusMessage *dbus_new_signal(const gchar *const path,
-			     const gchar *const interface,
-			     const gchar *const name)
+/** Callback for releasing dispatch index buckets */
+static void handler_bucket_delete_cb(gpointer self)
 {
-	DBusMessage *msg = dbus_message_new_signal(path, interface, name);
-
-	if( !msg )
-		mce_abort();
+	handler_bucket_delete(self);
+}
 
-	if( !introspectable_signal(interface, name) ) {
-		mce_log(LL_ERR, "sending non-introspectable signal: %s.%s",
-			interface, name);
-	}
+/** Allocate dispatch index bucket */
+static handler_bucket_t *handler_bucket_create(int type,
+					       const char *interface,
+					       const char *member)
+{
+	handler_bucket_t *self = g_malloc0(sizeof *self);
 
-	return msg;
+	self->key.type      = type;
+	self->key.interface = g_strdup(interface);
+	self->key.member    = member ? g_strdup(member) : 0;
+	self->handlers      = 0;
+	self->busy          = 0;
+	self->dirty         = false;
+	return self;
 }
 
-/**
- * Create a new D-Bus error message, with proper error checking
- * will exit the mainloop if an error occurs
- *
- * @param req  Method call message for which to create an error reply
- * @param err  D-Bus error name
- * @param fmt  Error message format string
- * @param ...  Arguments required by the format string
- *
- * @return A new DBusMessage
- */
+/** Hash function for message triplets */
+static guint handler_key_hash(gconstpointer key)
+{
+	const handler_key_t *self = key;
 
-static DBusMessage *dbus_new_error(DBusMessage *req,
-				   const char *err,
-				   const char *fmt,
-				   ...) __attribute__((format(printf, 3, 4)));
+	guint hash = (guint)self->type;
+	hash = hash * 33 + g_str_hash(self->interface);
+	if( self->member )
+		hash = hash * 33 + g_str_hash(self->member);
+	return hash;
+}
 
-static DBusMessage *dbus_new_error(DBusMessage *req,
-				   const char *err,
-				   const char *fmt,
-				   ...)
+/** Equality function for message triplets */
+static gboolean handler_key_equal(gconstpointer a, gconstpointer b)
 {
-	char *msg = 0;
+	const handler_key_t *x = a;
+	const handler_key_t *y = b;
 
-	va_list va;
-	va_start(va, fmt);
-	if( vasprintf(&msg, fmt, va) < 0 )
-		msg = 0;
-	va_end(va);
+	if( x->type != y->type )
+		return FALSE;
 
-	DBusMessage *rsp = dbus_message_new_error(req, err, msg);
+	if( strcmp(x->interface, y->interface) )
+		return FALSE;
 
-	if( !rsp )
-		mce_abort();
+	if( !x->member || !y->member )
+		return x->member == y->member;
 
-	free(msg);
-	return rsp;
+	return !strcmp(x->member, y->member);
 }
 
-/**
- * Create a new D-Bus method call, with proper error checking
- * will exit the mainloop if an error occurs
+/** Locate dispatch index bucket
  *
- * @param service The method call service
- * @param path The method call path
- * @param interface The method call interface
- * @param name The name of the method to call
- * @return A new DBusMessage
+ * @param type      DBUS_MESSAGE_TYPE
+ * @param interface interface name
+ * @param member    member name, or NULL for wildcard bucket
+ *
+ * @return bucket, or NULL if there are no handlers for the triplet
  */
-DBusMessage *dbus_new_method_call(const gchar *const service,
-				  const gchar *const path,
-				  const gchar *const interface,
-				  const gchar *const name)
+static handler_bucket_t *handler_index_lookup(int type,
+					      const char *interface,
+					      const char *member)
 {
-	DBusMessage *msg = dbus_message_new_method_call(service, path,
-							interface, name);
-	if( !msg )
-		mce_abort();
+	handler_key_t key = {
+		.type      = type,
+		.interface = (gchar *)interface,
+		.member    = (gchar *)member,
+	};
 
-	return msg;
+	if( !handler_index )
+		return 0;
+
+	return g_hash_table_lookup(handler_index, &key);
 }
 
-/**
- * Create a new D-Bus method call reply, with proper error checking
- * will exit the mainloop if an error occurs
+/** Add D-Bus handler to dispatch index
  *
- * @param message The DBusMessage to reply to
- * @return A new DBusMessage
+ * @param handler D-Bus handler structure
  */
-DBusMessage *dbus_new_method_reply(DBusMessage *const message)
-{
-	DBusMessage *msg = dbus_message_new_method_return(message);
+static void handler_index_add(handler_struct_t *handler)
+{
+	handler_bucket_t *bucket;
+
+	if( !handler_index )
+		handler_index = g_hash_table_new_full(handler_key_hash,
+						      handler_key_equal,
+						      0,
+						      handler_bucket_delete_cb);
+
+	bucket = handler_index_lookup(handler->type, handler->interface,
+				      handler->name);
+	if( !bucket ) {
+		bucket = handler_bucket_create(handler->type,
+					       handler->interface,
+					       handler->name);
+		g_hash_table_replace(handler_index, &bucket->key, bucket);
+	}
 
-	if( !msg )
-		mce_abort();
+	handler->seq    = ++handler_seq;
+	handler->bucket = bucket;
 
-	return msg;
+	/* Newest first, as with the dbus_handlers list */
+	bucket->handlers = g_slist_prepend(bucket->handlers, handler);
 }
 
-/**
- * Send a D-Bus message
- * Side-effects: frees msg
+/** Purge removed handlers from dispatch index bucket
  *
- * @param msg The D-Bus message to send
- * @return TRUE on success, FALSE on out of memory
+ * Empty buckets are removed from the index and released.
+ *
+ * @param bucket dispatch index bucket, or NULL
  */
-gboolean dbus_send_message(DBusMessage *const msg)
+static void handler_bucket_cleanup(handler_bucket_t *bucket)
 {
-	gboolean status = FALSE;
-
-	if (dbus_connection_send(dbus_connection, msg, NULL) == FALSE) {
-		mce_log(LL_CRIT,
-			"Out of memory when sending D-Bus message");
+	if( !bucket || bucket->busy || !bucket->dirty )
 		goto EXIT;
-	}
 
-	status = TRUE;
+	bucket->dirty = false;
+	mce_dbus_squeeze_slist(&bucket->handlers);
 
-EXIT:
-	dbus_message_unref(msg);
+	if( !bucket->handlers )
+		g_hash_table_remove(handler_index, &bucket->key);
 
-	return status;
+EXIT:
+	return;
 }
 
-/**
- * Send a D-Bus message and setup a reply callback
- * Side-effects: frees msg
+/** Remove D-Bus handler from dispatch index
  *
- * @param msg The D-Bus message to send
- * @param callback The reply callback
- * @param user_data Data to pass to callback
- * @param user_free Delete callback for user_data
- * @return TRUE on success, FALSE on failure
+ * @param handler D-Bus handler structure
  */
-static gboolean
-dbus_send_message_with_reply_handler(DBusMessage *const msg,
-				     DBusPendingCallNotifyFunction callback,
-				     void *user_data,
-				     DBusFreeFunction user_free,
-				     DBusPendingCall **ppc)
+static void handler_index_remove(handler_struct_t *handler)
 {
-	gboolean         status = FALSE;
-	DBusPendingCall *pc     = 0;
+	handler_bucket_t *bucket = handler->bucket;
+	GSList           *item;
 
-	if( !msg )
+	if( !bucket )
 		goto EXIT;
 
-	if( !dbus_connection_send_with_reply(dbus_connection, msg, &pc, -1) ) {
-		mce_log(LL_CRIT, "Out of memory when sending D-Bus message");
-		goto EXIT;
-	}
+	handler->bucket = 0;
 
-	if( !pc ) {
-		mce_log(LL_ERR, "D-Bus connection disconnected");
-		goto EXIT;
+	/* Detach without modifying the list, so that possible
+	 * ongoing dispatching is not adversely affected */
+	if( (item = g_slist_find(bucket->handlers, handler)) ) {
+		item->data = 0;
+		bucket->dirty = true;
 	}
 
-	if( !dbus_pending_call_set_notify(pc, callback,
-					  user_data, user_free) ) {
-		mce_log(LL_CRIT, "Out of memory when sending D-Bus message");
-		goto EXIT;
-	}
+	handler_bucket_cleanup(bucket);
 
-	/* If caller asked for pending call handle, increase
-	 * the refcount by one */
-	if( ppc )
-		*ppc = dbus_pending_call_ref(pc);
+EXIT:
+	return;
+}
 
-	/* Ownership of user_data passed on */
-	user_free = 0, user_data = 0;
+/** Mark start of dispatching from bucket
+ *
+ * @param bucket dispatch index bucket, or NULL
+ *
+ * @return first link in bucket handler list, or NULL
+ */
+static GSList *handler_bucket_begin(handler_bucket_t *bucket)
+{
+	if( !bucket )
+		return 0;
 
-	status = TRUE;
+	bucket->busy += 1;
+	return bucket->handlers;
+}
 
-EXIT:
-	/* Release user_data if the ownership was not passed on */
-	if( user_free )
-		user_free(user_data);
+/** Mark end of dispatching from bucket
+ *
+ * @param bucket dispatch index bucket, or NULL
+ */
+static void handler_bucket_end(handler_bucket_t *bucket)
+{
+	if( !bucket )
+		return;
 
-	/* If notification was set succesfully above, it will hold
-	 * one reference to the pending call until a) the callback function
+	bucket->busy -= 1;
+	handler_bucket_cleanup(bucket);
+}
+
+/* ========================================================================= *
+ * DISPATCH STATISTICS
+ * ========================================================================= */
+
+/** Number of buckets in dispatch latency histograms */
+#define DBUS_STATS_BUCKETS 16
+
+/** Dispatch statistics for one (type, interface, member) triplet
+ *
+ * Reply callbacks are accounted with type DBUS_MESSAGE_TYPE_METHOD_RETURN
+ * and the interface and member of the method call.
+ */
+typedef struct
+{
+	handler_key_t       key;        /**< Hash key */
+	guint               calls;      /**< Callbacks called */
+	guint               unmatched;  /**< Messages without handlers */
+	gint64              total_ns;   /**< Time spent in callbacks */
+	gint64              max_ns;     /**< Slowest callback */
+	guint16             trace_name; /**< Interned member name */
+	guint               histogram[DBUS_STATS_BUCKETS]; /**< Callback
+							 *   latency; bucket N
+							 *   counts calls under
+							 *   2^N microseconds */
+} dbus_stats_t;
+
+/** Lookup table: handler_key_t -> dbus_stats_t */
+static GHashTable *dbus_stats_lut = 0;
+
+/** Messages that could not be matched against any handler
+ *
+ * Only (type, interface, member) triplets that mce has handlers for
+ * get entries in dbus_stats_lut; everything else is just counted
+ * here, so that clients can't make the table grow without bounds.
+ */
+static guint dbus_stats_unmatched = 0;
+
+/** Get monotonic time stamp for dispatch statistics
+ *
+ * @return current time in nanoseconds
+ */
+static inline gint64 dbus_stats_tick(void)
+{
+	struct timespec ts = { 0, 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+/** Release dispatch statistics entry */
+static void dbus_stats_delete_cb(gpointer aptr)
+{
+	dbus_stats_t *self = aptr;
+
+	if( !self )
+		goto EXIT;
+
+	g_free(self->key.member);
+	g_free(self->key.interface);
+	g_free(self);
+
+EXIT:
+	return;
+}
+
+/** Locate dispatch statistics entry, create if missing
+ *
+ * Entries are created only for members of registered handlers and
+ * for method calls made by mce itself, so interning the member name
+ * for tracing does not let peers fill up the trace name table.
+ *
+ * @param type      DBUS_MESSAGE_TYPE
+ * @param interface interface name, or NULL
+ * @param member    member name, or NULL
+ *
+ * @return statistics entry
+ */
+static dbus_stats_t *dbus_stats_get(int type,
+				    const char *interface,
+				    const char *member)
+{
+	handler_key_t key = {
+		.type      = type,
+		.interface = (gchar *)(interface ?: ""),
+		.member    = (gchar *)member,
+	};
+
+	dbus_stats_t *self = 0;
+
+	if( !dbus_stats_lut )
+		dbus_stats_lut = g_hash_table_new_full(handler_key_hash,
+						       handler_key_equal,
+						       0,
+						       dbus_stats_delete_cb);
+
+	if( (self = g_hash_table_lookup(dbus_stats_lut, &key)) )
+		goto EXIT;
+
+	self = g_malloc0(sizeof *self);
+	self->key.type      = key.type;
+	self->key.interface = g_strdup(key.interface);
+	self->key.member    = member ? g_strdup(member) : 0;
+	self->trace_name    = mce_trace_intern(member);
+
+	g_hash_table_replace(dbus_stats_lut, &self->key, self);
+
+EXIT:
+	return self;
+}
+
+/** Account time spent in a callback
+ *
+ * @param self statistics entry
+ * @param ns   time spent in the callback
+ */
+static void dbus_stats_callback(dbus_stats_t *self, gint64 ns)
+{
+	guint bucket = 0;
+
+	for( gint64 us = ns / 1000; us > 0; us >>= 1 ) {
+		if( bucket == DBUS_STATS_BUCKETS - 1 )
+			break;
+		bucket += 1;
+	}
+
+	self->calls += 1;
+	self->total_ns += ns;
+	if( self->max_ns < ns )
+		self->max_ns = ns;
+	self->histogram[bucket] += 1;
+}
+
+/** Sort dispatch statistics entries by total time spent, descending */
+static gint dbus_stats_compare_cb(gconstpointer a, gconstpointer b)
+{
+	const dbus_stats_t *x = a;
+	const dbus_stats_t *y = b;
+
+	return (y->total_ns > x->total_ns) - (y->total_ns < x->total_ns);
+}
+
+/** Get dispatch statistics as human readable text
+ *
+ * @return report string, to be released with g_free()
+ */
+static gchar *dbus_stats_report(void)
+{
+	GString *buf  = g_string_new(0);
+	GList   *list = 0;
+
+	if( dbus_stats_lut )
+		list = g_hash_table_get_values(dbus_stats_lut);
+	list = g_list_sort(list, dbus_stats_compare_cb);
+
+	g_string_append_printf(buf, "messages without handlers: %u\n\n",
+			       dbus_stats_unmatched);
+
+	g_string_append_printf(buf, "%-14s %8s %8s %10s %8s %s\n",
+			       "type", "calls", "nomatch",
+			       "total_ms", "max_us", "interface.member");
+
+	for( GList *now = list; now; now = now->next ) {
+		const dbus_stats_t *stats = now->data;
+
+		g_string_append_printf(buf, "%-14s %8u %8u %10.3f %8.0f %s.%s\n",
+				       dbus_message_type_to_string(stats->key.type),
+				       stats->calls, stats->unmatched,
+				       stats->total_ns * 1e-6,
+				       stats->max_ns * 1e-3,
+				       stats->key.interface,
+				       stats->key.member ?: "*");
+	}
+
+	g_string_append_printf(buf, "\ncallback latency histogram\n");
+
+	for( GList *now = list; now; now = now->next ) {
+		const dbus_stats_t *stats = now->data;
+
+		if( !stats->calls )
+			continue;
+
+		g_string_append_printf(buf, "%s.%s:",
+				       stats->key.interface,
+				       stats->key.member ?: "*");
+
+		for( guint bucket = 0; bucket < DBUS_STATS_BUCKETS; ++bucket ) {
+			if( !stats->histogram[bucket] )
+				continue;
+
+			if( bucket == DBUS_STATS_BUCKETS - 1 )
+				g_string_append_printf(buf, " >=%uus:%u",
+						       1u << (bucket - 1),
+						       stats->histogram[bucket]);
+			else
+				g_string_append_printf(buf, " <%uus:%u",
+						       1u << bucket,
+						       stats->histogram[bucket]);
+		}
+		g_string_append(buf, "\n");
+	}
+
+	g_list_free(list);
+
+	return g_string_free(buf, FALSE);
+}
+
+/** Bookkeeping data for timing pending call reply callbacks */
+typedef struct
+{
+	DBusPendingCallNotifyFunction  callback;   /**< Actual callback */
+	void                          *user_data;  /**< Actual user data */
+	DBusFreeFunction               user_free;  /**< Actual free func */
+	dbus_stats_t                  *stats;      /**< Where to account,
+						    *   or NULL after
+						    *   dbus_stats_quit() */
+} dbus_stats_reply_t;
+
+/** Reply timing data of pending calls that have not been released */
+static GSList *dbus_stats_reply_list = 0;
+
+/** Allocate reply callback timing data
+ *
+ * @param callback  actual notification callback
+ * @param user_data actual user data
+ * @param user_free actual user data free function
+ * @param msg       method call message
+ *
+ * @return timing data, to be released with dbus_stats_reply_free_cb()
+ */
+static dbus_stats_reply_t *dbus_stats_reply_create(DBusPendingCallNotifyFunction callback,
+						   void *user_data,
+						   DBusFreeFunction user_free,
+						   DBusMessage *msg)
+{
+	dbus_stats_reply_t *self = g_malloc0(sizeof *self);
+
+	self->callback  = callback;
+	self->user_data = user_data;
+	self->user_free = user_free;
+	self->stats     = dbus_stats_get(DBUS_MESSAGE_TYPE_METHOD_RETURN,
+					 dbus_message_get_interface(msg),
+					 dbus_message_get_member(msg));
+
+	dbus_stats_reply_list = g_slist_prepend(dbus_stats_reply_list, self);
+
+	return self;
+}
+
+/** Pending call notification trampoline for timing reply callbacks */
+static void dbus_stats_reply_cb(DBusPendingCall *pc, void *aptr)
+{
+	dbus_stats_reply_t *self = aptr;
+	gint64              t0   = dbus_stats_tick();
+
+	self->callback(pc, self->user_data);
+
+	if( self->stats )
+		dbus_stats_callback(self->stats, dbus_stats_tick() - t0);
+}
+
+/** Release reply callback timing data */
+static void dbus_stats_reply_free_cb(void *aptr)
+{
+	dbus_stats_reply_t *self = aptr;
+
+	dbus_stats_reply_list = g_slist_remove(dbus_stats_reply_list, self);
+
+	if( self->user_free )
+		self->user_free(self->user_data);
+	g_free(self);
+}
+
+/** Release dispatch statistics
+ */
+static void dbus_stats_quit(void)
+{
+	/* Pending calls can outlive the statistics table */
+	for( GSList *now = dbus_stats_reply_list; now; now = now->next ) {
+		dbus_stats_reply_t *reply = now->data;
+		reply->stats = 0;
+	}
+
+	if( dbus_stats_lut )
+		g_hash_table_unref(dbus_stats_lut), dbus_stats_lut = 0;
+}
+
+/** Return reference to dbus connection cached at mce-dbus module
+ *
+ * For use in situations where the abstraction provided by mce-dbus
+ * makes things too complicated.
+ *
+ * Caller must release non-null return values with dbus_connection_unref().
+ *
+ * @return DBusConnection, or NULL if mce has no dbus connection
+ */
+DBusConnection *dbus_connection_get(void)
+{
+	if( !dbus_connection ) {
+		mce_log(LL_WARN, "no dbus connection");
+		return NULL;
+	}
+	return dbus_connection_ref(dbus_connection);
+}
+
+/**
+ * Create a new D-Bus signal, with proper error checking
+ * will exit the mainloop if an error occurs
+ *
+ * @param path The signal path
+ * @param interface The signal interface
+ * @param name The name of the signal to send
+ * @return A new DBusMessage
+ */
+DBusMessage *dbus_new_signal(const gchar *const path,
+			     const gchar *const interface,
+			     const gchar *const name)
+{
+	DBusMessage *msg = dbus_message_new_signal(path, interface, name);
+
+	if( !msg )
+		mce_abort();
+
+	if( !introspectable_signal(interface, name) ) {
+		mce_log(LL_ERR, "sending non-introspectable signal: %s.%s",
+			interface, name);
+	}
+
+	return msg;
+}
+
+/**
+ * Create a new D-Bus error message, with proper error checking
+ * will exit the mainloop if an error occurs
+ *
+ * @param req  Method call message for which to create an error reply
+ * @param err  D-Bus error name
+ * @param fmt  Error message format string
+ * @param ...  Arguments required by the format string
+ *
+ * @return A new DBusMessage
+ */
+
+static DBusMessage *dbus_new_error(DBusMessage *req,
+				   const char *err,
+				   const char *fmt,
+				   ...) __attribute__((format(printf, 3, 4)));
+
+static DBusMessage *dbus_new_error(DBusMessage *req,
+				   const char *err,
+				   const char *fmt,
+				   ...)
+{
+	char *msg = 0;
+
+	va_list va;
+	va_start(va, fmt);
+	if( vasprintf(&msg, fmt, va) < 0 )
+		msg = 0;
+	va_end(va);
+
+	DBusMessage *rsp = dbus_message_new_error(req, err, msg);
+
+	if( !rsp )
+		mce_abort();
+
+	free(msg);
+	return rsp;
+}
+
+/**
+ * Create a new D-Bus method call, with proper error checking
+ * will exit the mainloop if an error occurs
+ *
+ * @param service The method call service
+ * @param path The method call path
+ * @param interface The method call interface
+ * @param name The name of the method to call
+ * @return A new DBusMessage
+ */
+DBusMessage *dbus_new_method_call(const gchar *const service,
+				  const gchar *const path,
+				  const gchar *const interface,
+				  const gchar *const name)
+{
+	DBusMessage *msg = dbus_message_new_method_call(service, path,
+							interface, name);
+	if( !msg )
+		mce_abort();
+
+	return msg;
+}
+
+/**
+ * Create a new D-Bus method call reply, with proper error checking
+ * will exit the mainloop if an error occurs
+ *
+ * @param message The DBusMessage to reply to
+ * @return A new DBusMessage
+ */
+DBusMessage *dbus_new_method_reply(DBusMessage *const message)
+{
+	DBusMessage *msg = dbus_message_new_method_return(message);
+
+	if( !msg )
+		mce_abort();
+
+	return msg;
+}
+
+/* ========================================================================= *
+ * OUTBOUND SIGNAL BATCHING
+ * ========================================================================= */
+
+/** Signal batching window [ms]; 0 = end of iteration, negative = off */
+static gint dbus_batch_window = DEFAULT_DBUS_SIGNAL_BATCH_WINDOW;
+
+/** Queued broadcast signals, in send order */
+static GQueue dbus_batch_queue = G_QUEUE_INIT;
+
+/** Lookup table: batching key -> link in dbus_batch_queue */
+static GHashTable *dbus_batch_lut = 0;
+
+/** Timer / idle callback id for flushing the queue */
+static guint dbus_batch_id = 0;
+
+/** Number of signals that were superseded before sending */
+static guint dbus_batch_collapsed = 0;
+
+/** State signals that can be superseded by a later one
+ *
+ * Each of these carries the full current state, so only the latest
+ * one matters. Event signals, such as power_button_trigger or the
+ * led pattern (de)activation indications, must all be delivered and
+ * are never collapsed.
+ */
+static const char * const dbus_batch_state_signals[] =
+{
+	MCE_DISPLAY_SIG,
+	MCE_TKLOCK_MODE_SIG,
+	MCE_BLANKING_INHIBIT_SIG,
+	MCE_BLANKING_POLICY_SIG,
+	MCE_PREVENT_BLANK_SIG,
+	MCE_CALL_STATE_SIG,
+	MCE_COLOR_PROFILE_SIG,
+	MCE_INACTIVITY_SIG,
+	MCE_KEYBOARD_AVAILABLE_STATE_SIG,
+	MCE_KEYBOARD_SLIDE_STATE_SIG,
+	MCE_LPM_UI_MODE_SIG,
+	MCE_MEMORY_LEVEL_SIG,
+	MCE_PSM_STATE_SIG,
+	MCE_RADIO_STATES_SIG,
+	MCE_CONFIG_CHANGE_SIG,
+	0
+};
+
+/** State signals that are told apart by the first string argument */
+static const char * const dbus_batch_arg0_keyed[] =
+{
+	MCE_CONFIG_CHANGE_SIG,
+	0
+};
+
+static gboolean dbus_send_message_now(DBusMessage *const msg);
+
+/** Check if signal name is listed in a table
+ *
+ * @param table NULL terminated array of signal names
+ * @param member signal name
+ *
+ * @return true if member is in table, false otherwise
+ */
+static bool dbus_batch_listed(const char * const *table, const char *member)
+{
+	if( !member )
+		return false;
+
+	for( size_t i = 0; table[i]; ++i ) {
+		if( !strcmp(table[i], member) )
+			return true;
+	}
+
+	return false;
+}
+
+/** Construct batching key for a signal
+ *
+ * State signals from mce with identical interface, member and path
+ * supersede each other. For signals listed in dbus_batch_arg0_keyed
+ * the first argument is also part of the key.
+ *
+ * @param msg signal message
+ *
+ * @return key string, to be released with g_free(), or
+ *         NULL if the signal must not be collapsed
+ */
+static gchar *dbus_batch_key(DBusMessage *const msg)
+{
+	const char *interface = dbus_message_get_interface(msg);
+	const char *member    = dbus_message_get_member(msg);
+	const char *path      = dbus_message_get_path(msg);
+	const char *arg0      = 0;
+
+	if( !interface || strcmp(interface, MCE_SIGNAL_IF) )
+		return 0;
+
+	if( !dbus_batch_listed(dbus_batch_state_signals, member) )
+		return 0;
+
+	if( dbus_batch_listed(dbus_batch_arg0_keyed, member) ) {
+		DBusMessageIter iter;
+
+		if( dbus_message_iter_init(msg, &iter) &&
+		    dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_STRING )
+			dbus_message_iter_get_basic(&iter, &arg0);
+	}
+
+	return g_strdup_printf("%s\n%s\n%s\n%s",
+			       interface, member,
+			       path ?: "", arg0 ?: "");
+}
+
+/** Check if message can be held in the outbound signal queue
+ *
+ * @param msg D-Bus message
+ *
+ * @return true for broadcast signals when batching is enabled
+ */
+static bool dbus_batch_wanted(DBusMessage *const msg)
+{
+	if( dbus_batch_window < 0 )
+		return false;
+
+	if( dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL )
+		return false;
+
+	/* Unicast signals are sent as-is */
+	if( dbus_message_get_destination(msg) )
+		return false;
+
+	return true;
+}
+
+/** Send all queued signals
+ */
+static void dbus_batch_flush(void)
+{
+	DBusMessage *msg;
+
+	if( dbus_batch_id )
+		g_source_remove(dbus_batch_id), dbus_batch_id = 0;
+
+	if( dbus_batch_lut )
+		g_hash_table_remove_all(dbus_batch_lut);
+
+	while( (msg = g_queue_pop_head(&dbus_batch_queue)) )
+		dbus_send_message_now(msg);
+}
+
+/** Timer / idle callback for sending queued signals
+ *
+ * @param aptr (unused)
+ *
+ * @return FALSE to stop the callback from repeating
+ */
+static gboolean dbus_batch_flush_cb(gpointer aptr)
+{
+	(void)aptr;
+
+	if( !dbus_batch_id )
+		goto EXIT;
+
+	dbus_batch_id = 0;
+
+	dbus_batch_flush();
+
+EXIT:
+	return FALSE;
+}
+
+/** Add signal to the outbound signal queue
+ *
+ * For state signals an already queued signal with the same batching
+ * key is dropped, and the new one is added to the end of the queue.
+ * Other signals are just queued, so that the send order is retained.
+ *
+ * Side-effects: takes ownership of msg
+ *
+ * @param msg signal message
+ */
+static void dbus_batch_push(DBusMessage *const msg)
+{
+	gchar *key  = dbus_batch_key(msg);
+	GList *link = 0;
+
+	if( !dbus_batch_lut )
+		dbus_batch_lut = g_hash_table_new_full(g_str_hash, g_str_equal,
+						       g_free, 0);
+
+	if( !key ) {
+		g_queue_push_tail(&dbus_batch_queue, msg);
+		goto SCHEDULE;
+	}
+
+	if( (link = g_hash_table_lookup(dbus_batch_lut, key)) ) {
+		mce_log(LL_DEBUG, "collapsed: %s.%s",
+			dbus_message_get_interface(msg),
+			dbus_message_get_member(msg));
+		dbus_message_unref(link->data);
+		g_queue_delete_link(&dbus_batch_queue, link);
+		dbus_batch_collapsed += 1;
+	}
+
+	g_queue_push_tail(&dbus_batch_queue, msg);
+	g_hash_table_replace(dbus_batch_lut, key, dbus_batch_queue.tail);
+
+SCHEDULE:
+	if( dbus_batch_id )
+		goto EXIT;
+
+	if( dbus_batch_window > 0 )
+		dbus_batch_id = g_timeout_add(dbus_batch_window,
+					      dbus_batch_flush_cb, 0);
+	else
+		dbus_batch_id = g_idle_add_full(G_PRIORITY_HIGH,
+						dbus_batch_flush_cb, 0, 0);
+
+EXIT:
+	return;
+}
+
+/** Initialize outbound signal batching
+ */
+static void dbus_batch_init(void)
+{
+	dbus_batch_window = mce_conf_get_int(MCE_CONF_DBUS_GROUP,
+					     MCE_CONF_DBUS_SIGNAL_BATCH_WINDOW,
+					     DEFAULT_DBUS_SIGNAL_BATCH_WINDOW);
+
+	mce_log(LL_DEBUG, "signal batching window: %d ms", dbus_batch_window);
+}
+
+/** Stop outbound signal batching, send what is still queued
+ */
+static void dbus_batch_quit(void)
+{
+	dbus_batch_flush();
+
+	/* Anything sent from now on goes out immediately */
+	dbus_batch_window = -1;
+
+	if( dbus_batch_lut )
+		g_hash_table_unref(dbus_batch_lut), dbus_batch_lut = 0;
+
+	mce_log(LL_DEBUG, "collapsed signals: %u", dbus_batch_collapsed);
+}
+
+/**
+ * Send a D-Bus message
+ * Side-effects: frees msg
+ *
+ * When batching is enabled, broadcast signals are queued and sent
+ * at the end of the current main loop iteration, or after the
+ * configured batching window. Repeated state signals with identical
+ * interface, member and path collapse into the latest one. Sending
+ * any other message flushes the queue first, so that the relative
+ * ordering of messages is retained.
+ *
+ * @param msg The D-Bus message to send
+ * @return TRUE on success, FALSE on out of memory
+ */
+gboolean dbus_send_message(DBusMessage *const msg)
+{
+	if( dbus_batch_wanted(msg) ) {
+		dbus_batch_push(msg);
+		return TRUE;
+	}
+
+	dbus_batch_flush();
+
+	return dbus_send_message_now(msg);
+}
+
+/**
+ * Send a D-Bus message without batching
+ * Side-effects: frees msg
+ *
+ * @param msg The D-Bus message to send
+ * @return TRUE on success, FALSE on out of memory
+ */
+static gboolean dbus_send_message_now(DBusMessage *const msg)
+{
+	gboolean status = FALSE;
+
+	if (dbus_connection_send(dbus_connection, msg, NULL) == FALSE) {
+		mce_log(LL_CRIT,
+			"Out of memory when sending D-Bus message");
+		goto EXIT;
+	}
+
+	status = TRUE;
+
+EXIT:
+	dbus_message_unref(msg);
+
+	return status;
+}
+
+/**
+ * Send a D-Bus message and setup a reply callback
+ * Side-effects: frees msg
+ *
+ * @param msg The D-Bus message to send
+ * @param callback The reply callback
+ * @param user_data Data to pass to callback
+ * @param user_free Delete callback for user_data
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean
+dbus_send_message_with_reply_handler(DBusMessage *const msg,
+				     DBusPendingCallNotifyFunction callback,
+				     void *user_data,
+				     DBusFreeFunction user_free,
+				     DBusPendingCall **ppc)
+{
+	gboolean            status = FALSE;
+	DBusPendingCall    *pc     = 0;
+	dbus_stats_reply_t *timing = 0;
+
+	if( !msg )
+		goto EXIT;
+
+	/* Retain ordering with respect to queued signals */
+	dbus_batch_flush();
+
+	if( !dbus_connection_send_with_reply(dbus_connection, msg, &pc, -1) ) {
+		mce_log(LL_CRIT, "Out of memory when sending D-Bus message");
+		goto EXIT;
+	}
+
+	if( !pc ) {
+		mce_log(LL_ERR, "D-Bus connection disconnected");
+		goto EXIT;
+	}
+
+	/* Route the notification via timing trampoline */
+	timing = dbus_stats_reply_create(callback, user_data, user_free, msg);
+
+	if( !dbus_pending_call_set_notify(pc, dbus_stats_reply_cb,
+					  timing, dbus_stats_reply_free_cb) ) {
+		mce_log(LL_CRIT, "Out of memory when sending D-Bus message");
+		dbus_stats_reply_list = g_slist_remove(dbus_stats_reply_list,
+						       timing);
+		g_free(timing);
+		goto EXIT;
+	}
+
+	/* If caller asked for pending call handle, increase
+	 * the refcount by one */
+	if( ppc )
+		*ppc = dbus_pending_call_ref(pc);
+
+	/* Ownership of user_data passed on */
+	user_free = 0, user_data = 0;
+
+	status = TRUE;
+
+EXIT:
+	/* Release user_data if the ownership was not passed on */
+	if( user_free )
+		user_free(user_data);
+
+	/* If notification was set succesfully above, it will hold
+	 * one reference to the pending call until a) the callback function
 	 * gets called, or b) the pending call is canceled */
 	if( pc )
 		dbus_pending_call_unref(pc);
@@ -621,97 +1576,289 @@ gboolean dbus_send_ex(const char *service,
 	return res;
 }
 
-/**
- * Generic function to send D-Bus messages and signals
- * to send a signal, call dbus_send with service == NULL
+/**
+ * Generic function to send D-Bus messages and signals
+ * to send a signal, call dbus_send with service == NULL
+ *
+ * @todo Make it possible to send D-Bus replies as well
+ *
+ * @param service D-Bus service; for signals, set to NULL
+ * @param path D-Bus path
+ * @param interface D-Bus interface
+ * @param name The D-Bus method or signal name to send to
+ * @param callback A reply callback, or NULL to set no reply;
+ *                 for signals, this is unused, but please use NULL
+ *                 for consistency
+ * @param first_arg_type The DBUS_TYPE of the first argument in the list
+ * @param ... The arguments to append to the D-Bus message;
+ *            terminate with DBUS_TYPE_INVALID
+ *            Note: the arguments MUST be passed by reference
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean dbus_send(const gchar *const service, const gchar *const path,
+		   const gchar *const interface, const gchar *const name,
+		   DBusPendingCallNotifyFunction callback,
+		   int first_arg_type, ...)
+{
+	va_list va;
+	va_start(va, first_arg_type);
+	gboolean res = dbus_send_va(service, path, interface, name,
+				    callback, 0, 0, 0, first_arg_type, va);
+	va_end(va);
+	return res;
+}
+
+/**
+ * D-Bus callback for the version get method call
+ *
+ * @param msg The D-Bus message to reply to
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean version_get_dbus_cb(DBusMessage *const msg)
+{
+	static const gchar *const versionstring = G_STRINGIFY(PRG_VERSION);
+	DBusMessage *reply = NULL;
+	gboolean status = FALSE;
+
+	mce_log(LL_DEBUG, "Received version information request");
+
+	/* Create a reply */
+	reply = dbus_new_method_reply(msg);
+
+	/* Append the version information */
+	if (dbus_message_append_args(reply,
+				     DBUS_TYPE_STRING, &versionstring,
+				     DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"Failed to append reply argument to D-Bus message "
+			"for %s.%s",
+			MCE_REQUEST_IF, MCE_VERSION_GET);
+		dbus_message_unref(reply);
+		goto EXIT;
+	}
+
+	/* Send the message */
+	status = dbus_send_message(reply);
+
+EXIT:
+	return status;
+}
+
+/** D-Bus callback for the get suspend time statistics method call
+ *
+ * @param req The D-Bus message to reply to
+ *
+ * @return TRUE
+ */
+static gboolean suspend_stats_get_dbus_cb(DBusMessage *const req)
+{
+	DBusMessage *rsp = 0;
+
+	mce_log(LL_DEVEL, "suspend info request from %s",
+		mce_dbus_get_message_sender_ident(req));
+
+	/* get stats */
+	dbus_int64_t uptime_ms  = mce_lib_get_boot_tick();
+	dbus_int64_t suspend_ms = uptime_ms - mce_lib_get_mono_tick();
+
+	/* create and send reply message */
+	rsp = dbus_new_method_reply(req);
+
+	if( !dbus_message_append_args(rsp,
+				      DBUS_TYPE_INT64, &uptime_ms,
+				      DBUS_TYPE_INT64, &suspend_ms,
+				      DBUS_TYPE_INVALID) ) {
+		mce_log(LL_ERR, "Failed to append arguments");
+		goto EXIT;
+	}
+
+	dbus_send_message(rsp), rsp = 0;
+
+EXIT:
+	if( rsp )
+		dbus_message_unref(rsp);
+
+	return TRUE;
+}
+
+/** D-Bus callback for the get dispatch statistics method call
+ *
+ * @param req The D-Bus message to reply to
+ *
+ * @return TRUE
+ */
+static gboolean dbus_stats_get_dbus_cb(DBusMessage *const req)
+{
+	DBusMessage *rsp = 0;
+	gchar       *txt = 0;
+
+	mce_log(LL_DEVEL, "dbus stats request from %s",
+		mce_dbus_get_message_sender_ident(req));
+
+	/* get stats */
+	txt = dbus_stats_report();
+
+	/* create and send reply message */
+	rsp = dbus_new_method_reply(req);
+
+	if( !dbus_message_append_args(rsp,
+				      DBUS_TYPE_STRING, &txt,
+				      DBUS_TYPE_INVALID) ) {
+		mce_log(LL_ERR, "Failed to append arguments");
+		goto EXIT;
+	}
+
+	dbus_send_message(rsp), rsp = 0;
+
+EXIT:
+	if( rsp )
+		dbus_message_unref(rsp);
+
+	g_free(txt);
+
+	return TRUE;
+}
+
+/** D-Bus callback for the get datapipe statistics method call
+ *
+ * @param req The D-Bus message to reply to
+ *
+ * @return TRUE
+ */
+static gboolean datapipe_stats_get_dbus_cb(DBusMessage *const req)
+{
+	DBusMessage *rsp = 0;
+	gchar       *txt = 0;
+
+	mce_log(LL_DEVEL, "datapipe stats request from %s",
+		mce_dbus_get_message_sender_ident(req));
+
+	/* get stats */
+	txt = datapipe_stats_report();
+
+	/* create and send reply message */
+	rsp = dbus_new_method_reply(req);
+
+	if( !dbus_message_append_args(rsp,
+				      DBUS_TYPE_STRING, &txt,
+				      DBUS_TYPE_INVALID) ) {
+		mce_log(LL_ERR, "Failed to append arguments");
+		goto EXIT;
+	}
+
+	dbus_send_message(rsp), rsp = 0;
+
+EXIT:
+	if( rsp )
+		dbus_message_unref(rsp);
+
+	g_free(txt);
+
+	return TRUE;
+}
+
+/** D-Bus callback for the set datapipe statistics method call
  *
- * @todo Make it possible to send D-Bus replies as well
+ * @param req The D-Bus message to reply to
  *
- * @param service D-Bus service; for signals, set to NULL
- * @param path D-Bus path
- * @param interface D-Bus interface
- * @param name The D-Bus method or signal name to send to
- * @param callback A reply callback, or NULL to set no reply;
- *                 for signals, this is unused, but please use NULL
- *                 for consistency
- * @param first_arg_type The DBUS_TYPE of the first argument in the list
- * @param ... The arguments to append to the D-Bus message;
- *            terminate with DBUS_TYPE_INVALID
- *            Note: the arguments MUST be passed by reference
- * @return TRUE on success, FALSE on failure
+ * @return TRUE
  */
-gboolean dbus_send(const gchar *const service, const gchar *const path,
-		   const gchar *const interface, const gchar *const name,
-		   DBusPendingCallNotifyFunction callback,
-		   int first_arg_type, ...)
+static gboolean datapipe_stats_set_dbus_cb(DBusMessage *const req)
 {
-	va_list va;
-	va_start(va, first_arg_type);
-	gboolean res = dbus_send_va(service, path, interface, name,
-				    callback, 0, 0, 0, first_arg_type, va);
-	va_end(va);
-	return res;
+	DBusError    err     = DBUS_ERROR_INIT;
+	dbus_bool_t  enabled = FALSE;
+	DBusMessage *rsp     = 0;
+
+	mce_log(LL_DEVEL, "datapipe stats control from %s",
+		mce_dbus_get_message_sender_ident(req));
+
+	if( !dbus_message_get_args(req, &err,
+				   DBUS_TYPE_BOOLEAN, &enabled,
+				   DBUS_TYPE_INVALID) ) {
+		mce_log(LL_ERR, "%s: %s", err.name, err.message);
+		goto EXIT;
+	}
+
+	datapipe_stats_set_enabled(enabled);
+
+EXIT:
+	dbus_error_free(&err);
+
+	if( dbus_message_get_no_reply(req) )
+		goto NOREPLY;
+
+	if( !(rsp = dbus_new_method_reply(req)) )
+		goto NOREPLY;
+
+	dbus_send_message(rsp), rsp = 0;
+
+NOREPLY:
+	return TRUE;
 }
 
-/**
- * D-Bus callback for the version get method call
+/** D-Bus callback for the get flight recorder trace method call
  *
- * @param msg The D-Bus message to reply to
- * @return TRUE on success, FALSE on failure
+ * @param req The D-Bus message to reply to
+ *
+ * @return TRUE
  */
-static gboolean version_get_dbus_cb(DBusMessage *const msg)
+static gboolean trace_get_dbus_cb(DBusMessage *const req)
 {
-	static const gchar *const versionstring = G_STRINGIFY(PRG_VERSION);
-	DBusMessage *reply = NULL;
-	gboolean status = FALSE;
+	DBusMessage *rsp  = 0;
+	size_t       size = 0;
+	void        *data = 0;
 
-	mce_log(LL_DEBUG, "Received version information request");
+	mce_log(LL_DEVEL, "trace request from %s",
+		mce_dbus_get_message_sender_ident(req));
 
-	/* Create a reply */
-	reply = dbus_new_method_reply(msg);
+	data = mce_trace_serialize(&size);
 
-	/* Append the version information */
-	if (dbus_message_append_args(reply,
-				     DBUS_TYPE_STRING, &versionstring,
-				     DBUS_TYPE_INVALID) == FALSE) {
-		mce_log(LL_CRIT,
-			"Failed to append reply argument to D-Bus message "
-			"for %s.%s",
-			MCE_REQUEST_IF, MCE_VERSION_GET);
-		dbus_message_unref(reply);
+	/* create and send reply message */
+	rsp = dbus_new_method_reply(req);
+
+	if( !dbus_message_append_args(rsp,
+				      DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+				      &data, (int)size,
+				      DBUS_TYPE_INVALID) ) {
+		mce_log(LL_ERR, "Failed to append arguments");
 		goto EXIT;
 	}
 
-	/* Send the message */
-	status = dbus_send_message(reply);
+	dbus_send_message(rsp), rsp = 0;
 
 EXIT:
-	return status;
+	if( rsp )
+		dbus_message_unref(rsp);
+
+	g_free(data);
+
+	return TRUE;
 }
 
-/** D-Bus callback for the get suspend time statistics method call
+#ifdef ENABLE_WAKELOCKS
+/** D-Bus callback for the get wakelock statistics method call
  *
  * @param req The D-Bus message to reply to
  *
  * @return TRUE
  */
-static gboolean suspend_stats_get_dbus_cb(DBusMessage *const req)
+static gboolean wakelock_stats_get_dbus_cb(DBusMessage *const req)
 {
 	DBusMessage *rsp = 0;
+	char         buf[4096];
+	const char  *txt = buf;
 
-	mce_log(LL_DEVEL, "suspend info request from %s",
+	mce_log(LL_DEVEL, "wakelock stats request from %s",
 		mce_dbus_get_message_sender_ident(req));
 
 	/* get stats */
-	dbus_int64_t uptime_ms  = mce_lib_get_boot_tick();
-	dbus_int64_t suspend_ms = uptime_ms - mce_lib_get_mono_tick();
+	wakelock_get_stats(buf, sizeof buf);
 
 	/* create and send reply message */
 	rsp = dbus_new_method_reply(req);
 
 	if( !dbus_message_append_args(rsp,
-				      DBUS_TYPE_INT64, &uptime_ms,
-				      DBUS_TYPE_INT64, &suspend_ms,
+				      DBUS_TYPE_STRING, &txt,
 				      DBUS_TYPE_INVALID) ) {
 		mce_log(LL_ERR, "Failed to append arguments");
 		goto EXIT;
@@ -725,6 +1872,7 @@ EXIT:
 
 	return TRUE;
 }
+#endif /* ENABLE_WAKELOCKS */
 
 /** Helper for appending gconf string list to dbus message
  *
@@ -1052,13 +2200,6 @@ bailout_message:
 	return FALSE;
 }
 
-/* FIXME: Once the constants are in mce-dev these can be removed */
-#ifndef MCE_CONFIG_GET
-# define MCE_CONFIG_GET         "get_config"
-# define MCE_CONFIG_SET         "set_config"
-# define MCE_CONFIG_CHANGE_SIG  "config_change_ind"
-#endif
-
 /**
  * D-Bus callback for the config get method call
  *
@@ -1362,6 +2503,39 @@ NOREPLY:
 	return TRUE;
 }
 
+/**
+ * D-Bus callback for the config sync method call
+ *
+ * Writes changed settings to persistent storage immediately,
+ * instead of waiting for the delayed save to happen.
+ *
+ * @param msg The D-Bus message to reply to
+ *
+ * @return TRUE
+ */
+static gboolean config_sync_dbus_cb(DBusMessage *const msg)
+{
+	GConfClient  *client = 0;
+	DBusMessage  *reply  = 0;
+
+	mce_log(LL_DEVEL, "Received configuration sync request from %s",
+		mce_dbus_get_message_sender_ident(msg));
+
+	if( (client = gconf_client_get_default()) )
+		gconf_client_flush_values(client);
+
+	if( dbus_message_get_no_reply(msg) )
+		goto NOREPLY;
+
+	if( !(reply = dbus_new_method_reply(msg)) )
+		goto NOREPLY;
+
+	dbus_send_message(reply), reply = 0;
+
+NOREPLY:
+	return TRUE;
+}
+
 /**
  * D-Bus callback for the config set method call
  *
@@ -1529,88 +2703,6 @@ EXIT:
 	return status;
 }
 
-/**
- * D-Bus rule checker
- *
- * @param msg The D-Bus message being checked
- * @param rules The rule string to check against
- * @return TRUE if message matches the rules,
-	   FALSE if not
- */
-static gboolean check_rules(DBusMessage *const msg,
-			    const char *rules)
-{
-	if (rules == NULL)
-		return TRUE;
-	rules += strspn(rules, " ");;
-
-	while (*rules != '\0') {
-		const char *eq;
-		const char *value;
-		const char *value_end;
-		const char *val = NULL;
-		gboolean quot = FALSE;
-
-		if ((eq = strchr(rules, '=')) == NULL)
-			return FALSE;
-		eq += strspn(eq, " ");
-
-		if (eq[1] == '\'') {
-			value = eq + 2;
-			value_end = strchr(value, '\'');
-			quot = TRUE;
-		} else {
-			value = eq + 1;
-			value_end = strchrnul(value, ',');
-		}
-
-		if (value_end == NULL)
-			return FALSE;
-
-		if (strncmp(rules, "arg", 3) == 0) {
-			int fld = atoi(rules + 3);
-
-			DBusMessageIter iter;
-
-			if (dbus_message_iter_init(msg, &iter) == FALSE)
-				return FALSE;
-
-			for (; fld; fld--) {
-				if (dbus_message_iter_has_next(&iter) == FALSE)
-					return FALSE;
-				dbus_message_iter_next(&iter);
-			}
-
-			if (dbus_message_iter_get_arg_type(&iter) !=
-			    DBUS_TYPE_STRING)
-				return FALSE;
-			dbus_message_iter_get_basic(&iter, &val);
-
-		} else if (strncmp(rules, "path", 4) == 0) {
-			val = dbus_message_get_path(msg);
-		}
-
-		if (((value_end != NULL) &&
-		     ((strncmp(value, val, value_end - value) != 0) ||
-		      (val[value_end - value] != '\0'))) ||
-		    ((value_end == NULL) &&
-		     (strcmp(value, val) != 0)))
-			return FALSE;
-
-		if (value_end == NULL)
-			break;
-
-		rules = value_end + (quot == TRUE ? 1 : 0);
-		rules += strspn(rules, " ");;
-
-		if (*rules == ',')
-			rules++;
-		rules += strspn(rules, " ");;
-	}
-
-	return TRUE;
-}
-
 /** Build a dbus signal match string
  *
  * For use from mce_dbus_handler_add() and mce_dbus_handler_remove()
@@ -1677,26 +2769,6 @@ EXIT:
 	return;
 }
 
-/** Check if message attribute value matches handler attribute value
- *
- * @return true on match, false otherwise
- */
-static bool mce_dbus_match(const char *msg_val, const char *hnd_val)
-{
-	/* Special case 1: If message attribute has null value,
-	 *                 no handler value can be a match */
-	if( !msg_val )
-		return false;
-
-	/* Special case 2: If handler attribyte has null value,
-	 *                 it mathes any non-null message value. */
-	if( !hnd_val )
-		return true;
-
-	/* Normally we just test for string equality */
-	return !strcmp(msg_val, hnd_val);
-}
-
 /**
  * D-Bus message handler
  *
@@ -1719,65 +2791,110 @@ static DBusHandlerResult msg_handler(DBusConnection *const connection,
 	const char *interface = dbus_message_get_interface(msg);
 	const char *member    = dbus_message_get_member(msg);
 
-	for( GSList *now = dbus_handlers; now; now = now->next ) {
+	handler_bucket_t *exact = 0;
+	handler_bucket_t *wild  = 0;
+	dbus_stats_t     *stats = 0;
+	bool              found = false;
+	gint64            spent = 0;
 
-		handler_struct_t *handler = now->data;
+	/* Handlers are registered only for method calls and signals,
+	 * and both interface and member name are needed for a match */
+	switch( type ) {
+	case DBUS_MESSAGE_TYPE_METHOD_CALL:
+	case DBUS_MESSAGE_TYPE_SIGNAL:
+		break;
+	default:
+		goto EXIT;
+	}
+
+	if( !interface || !member ) {
+		dbus_stats_unmatched += 1;
+		goto EXIT;
+	}
+
+	exact = handler_index_lookup(type, interface, member);
+	wild  = handler_index_lookup(type, interface, 0);
+
+	/* Account messages for wildcard handlers per interface */
+	if( exact )
+		stats = dbus_stats_get(type, interface, member);
+	else if( wild )
+		stats = dbus_stats_get(type, interface, 0);
+	else {
+		dbus_stats_unmatched += 1;
+		goto EXIT;
+	}
+
+	GSList *now_exact = handler_bucket_begin(exact);
+	GSList *now_wild  = handler_bucket_begin(wild);
+
+	/* Merge the buckets so that handlers get called in the
+	 * same newest-first order they would have in dbus_handlers */
+	for( ;; ) {
+		handler_struct_t *handler;
 
 		/* Skip half removed handlers */
-		if( !handler )
-			continue;
+		while( now_exact && !now_exact->data )
+			now_exact = now_exact->next;
+		while( now_wild && !now_wild->data )
+			now_wild = now_wild->next;
+
+		if( now_exact && now_wild ) {
+			handler_struct_t *he = now_exact->data;
+			handler_struct_t *hw = now_wild->data;
+			if( he->seq > hw->seq )
+				handler = he, now_exact = now_exact->next;
+			else
+				handler = hw, now_wild = now_wild->next;
+		}
+		else if( now_exact ) {
+			handler = now_exact->data, now_exact = now_exact->next;
+		}
+		else if( now_wild ) {
+			handler = now_wild->data, now_wild = now_wild->next;
+		}
+		else {
+			break;
+		}
 
 		/* Skip introspect only entries */
 		if( !handler->callback )
 			continue;
 
-		/* Skip not applicable handlers */
-		if( handler->type != type )
+		if( type == DBUS_MESSAGE_TYPE_SIGNAL &&
+		    !handler_struct_match_rules(handler, msg) )
 			continue;
 
-		switch( handler->type ) {
-		case DBUS_MESSAGE_TYPE_METHOD_CALL:
-			if( !mce_dbus_match(interface, handler->interface) )
-				break;
-
-			if( !mce_dbus_match(member, handler->name) )
-				break;
+		gint64 t0 = dbus_stats_tick();
+		handler->callback(msg);
+		t0 = dbus_stats_tick() - t0;
+		dbus_stats_callback(stats, t0);
+		spent += t0;
+		found = true;
 
-			handler->callback(msg);
+		if( type == DBUS_MESSAGE_TYPE_METHOD_CALL ) {
 			status = DBUS_HANDLER_RESULT_HANDLED;
-			goto EXIT;
-
-		case DBUS_MESSAGE_TYPE_ERROR:
-			if( !mce_dbus_match(member, handler->name) )
-				break;
-
-			handler->callback(msg);
 			break;
+		}
+	}
 
-		case DBUS_MESSAGE_TYPE_SIGNAL:
-			if( !mce_dbus_match(interface, handler->interface) )
-				break;
-
-			if( !mce_dbus_match(member, handler->name) )
-				break;
-
-			if( !check_rules(msg, handler->rules) )
-				break;
+	handler_bucket_end(wild);
+	handler_bucket_end(exact);
 
-			handler->callback(msg);
-			break;
+	if( !found )
+		stats->unmatched += 1;
 
-		default:
-			mce_log(LL_ERR, "There's a bug somewhere in MCE; something "
-				"has registered an invalid D-Bus handler");
-			break;
-		}
-	}
+	if( type == DBUS_MESSAGE_TYPE_METHOD_CALL )
+		mce_trace_add(MCE_TRACE_DBUS, stats->trace_name,
+			      found, spent / 1000);
 
+EXIT:
 	/* Purge half removed handlers */
-	mce_dbus_squeeze_slist(&dbus_handlers);
+	if( dbus_handlers_dirty ) {
+		dbus_handlers_dirty = false;
+		mce_dbus_squeeze_slist(&dbus_handlers);
+	}
 
-EXIT:
 	return status;
 }
 
@@ -1835,12 +2952,14 @@ gconstpointer mce_dbus_handler_add_ex(const gchar *const interface,
 	handler_struct_set_args(handler, args);
 	handler_struct_set_rules(handler, rules);
 	handler_struct_set_callback(handler, callback);
+	handler_struct_parse_rules(handler);
 
 	/* Only register D-Bus matches for inbound signals */
 	if( match && callback )
 		dbus_bus_add_match(dbus_connection, match, 0);
 
 	dbus_handlers = g_slist_prepend(dbus_handlers, handler);
+	handler_index_add(handler);
 
 EXIT:
 	g_free(match);
@@ -1885,8 +3004,11 @@ void mce_dbus_handler_remove(gconstpointer cookie)
 		 * at msg_handler() and mce_dbus_exit().
 		 */
 		item->data = 0;
+		dbus_handlers_dirty = true;
 	}
 
+	handler_index_remove(handler);
+
 	if( handler->type == DBUS_MESSAGE_TYPE_SIGNAL ) {
 		match = mce_dbus_build_signal_match(handler->interface,
 						    handler->name,
@@ -3651,6 +4773,12 @@ static mce_dbus_handler_t mce_dbus_handlers[] =
 			"    <arg direction=\"in\" name=\"key_part\" type=\"s\"/>\n"
 			"    <arg direction=\"out\" name=\"count\" type=\"i\"/>\n"
 	},
+	{
+		.interface = MCE_REQUEST_IF,
+		.name      = "config_sync",
+		.type      = DBUS_MESSAGE_TYPE_METHOD_CALL,
+		.callback  = config_sync_dbus_cb,
+	},
 	{
 		.interface = MCE_REQUEST_IF,
 		.name      = "get_suspend_stats",
@@ -3660,6 +4788,48 @@ static mce_dbus_handler_t mce_dbus_handlers[] =
 			"    <arg direction=\"out\" name=\"uptime_ms\" type=\"x\"/>\n"
 			"    <arg direction=\"out\" name=\"suspend_ms\" type=\"x\"/>\n"
 	},
+	{
+		.interface = MCE_REQUEST_IF,
+		.name      = "get_datapipe_stats",
+		.type      = DBUS_MESSAGE_TYPE_METHOD_CALL,
+		.callback  = datapipe_stats_get_dbus_cb,
+		.args      =
+			"    <arg direction=\"out\" name=\"report\" type=\"s\"/>\n"
+	},
+	{
+		.interface = MCE_REQUEST_IF,
+		.name      = "set_datapipe_stats",
+		.type      = DBUS_MESSAGE_TYPE_METHOD_CALL,
+		.callback  = datapipe_stats_set_dbus_cb,
+		.args      =
+			"    <arg direction=\"in\" name=\"timing_enabled\" type=\"b\"/>\n"
+	},
+	{
+		.interface = MCE_REQUEST_IF,
+		.name      = "get_dbus_stats",
+		.type      = DBUS_MESSAGE_TYPE_METHOD_CALL,
+		.callback  = dbus_stats_get_dbus_cb,
+		.args      =
+			"    <arg direction=\"out\" name=\"report\" type=\"s\"/>\n"
+	},
+	{
+		.interface = MCE_REQUEST_IF,
+		.name      = "get_trace",
+		.type      = DBUS_MESSAGE_TYPE_METHOD_CALL,
+		.callback  = trace_get_dbus_cb,
+		.args      =
+			"    <arg direction=\"out\" name=\"trace\" type=\"ay\"/>\n"
+	},
+#ifdef ENABLE_WAKELOCKS
+	{
+		.interface = MCE_REQUEST_IF,
+		.name      = "get_wakelock_stats",
+		.type      = DBUS_MESSAGE_TYPE_METHOD_CALL,
+		.callback  = wakelock_stats_get_dbus_cb,
+		.args      =
+			"    <arg direction=\"out\" name=\"report\" type=\"s\"/>\n"
+	},
+#endif
 	{
 		.interface = DBUS_INTERFACE_INTROSPECTABLE,
 		.name      = "Introspect",
@@ -3690,6 +4860,8 @@ gboolean mce_dbus_init(const gboolean systembus)
 	if( !systembus )
 		bus_type = DBUS_BUS_SESSION;
 
+	dbus_batch_init();
+
 	mce_log(LL_DEBUG, "Establishing D-Bus connection");
 
 	/* Establish D-Bus connection */
@@ -3732,6 +4904,9 @@ EXIT:
  */
 void mce_dbus_exit(void)
 {
+	/* Send pending signals */
+	dbus_batch_quit();
+
 	/* Stop tracking essential services */
 	mce_dbus_nameowner_quit();
 
@@ -3750,8 +4925,16 @@ void mce_dbus_exit(void)
 		g_slist_foreach(dbus_handlers, mce_dbus_handler_remove_cb, 0);
 		g_slist_free(dbus_handlers);
 		dbus_handlers = 0;
+		dbus_handlers_dirty = false;
 	}
 
+	/* Release the now empty dispatch index */
+	if( handler_index )
+		g_hash_table_unref(handler_index), handler_index = 0;
+
+	/* Release dispatch statistics */
+	dbus_stats_quit();
+
 	/* If there is an established D-Bus connection, unreference it */
 	if (dbus_connection != NULL) {
 		mce_log(LL_DEBUG, "Unreferencing D-Bus connection");
@@ -27,6 +27,56 @@
 
 #include <dbus/dbus.h>
 
+#include <mce/dbus-names.h>
+
+/* ========================================================================= *
+ * STATIC CONFIGURATION
+ * ========================================================================= */
+
+/** Name of D-Bus configuration group */
+#define MCE_CONF_DBUS_GROUP                 "DBus"
+
+/** Window for collapsing repeated outbound signals [ms]
+ *
+ * 0 = flush at the end of the current main loop iteration,
+ * negative = send signals immediately
+ */
+#define MCE_CONF_DBUS_SIGNAL_BATCH_WINDOW   "SignalBatchWindow"
+
+/** Default signal batching window [ms] */
+#define DEFAULT_DBUS_SIGNAL_BATCH_WINDOW    -1
+
+/* ========================================================================= *
+ * MCE DBUS NAMES NOT YET IN MCE-DEV
+ * ========================================================================= */
+
+/* FIXME: Once the constants are in mce-dev these can be removed */
+#ifndef MCE_CONFIG_GET
+# define MCE_CONFIG_GET                     "get_config"
+# define MCE_CONFIG_SET                     "set_config"
+# define MCE_CONFIG_CHANGE_SIG              "config_change_ind"
+#endif
+
+/** Signal to send when lpm ui state changes */
+#ifndef MCE_LPM_UI_MODE_SIG
+# define MCE_LPM_UI_MODE_SIG                "lpm_ui_mode_ind"
+#endif
+
+/** Signal to send when keyboard slide state changes */
+#ifndef MCE_KEYBOARD_SLIDE_STATE_SIG
+# define MCE_KEYBOARD_SLIDE_STATE_SIG       "keyboard_slide_state_ind"
+#endif
+
+/** Signal to send when keyboard availability changes */
+#ifndef MCE_KEYBOARD_AVAILABLE_STATE_SIG
+# define MCE_KEYBOARD_AVAILABLE_STATE_SIG   "keyboard_available_state_ind"
+#endif
+
+/** Signal to send when memory use level changes */
+#ifndef MCE_MEMORY_LEVEL_SIG
+# define MCE_MEMORY_LEVEL_SIG               "sig_memory_level_ind"
+#endif
+
 /* ========================================================================= *
  * DSME DBUS SERVICE
  * ========================================================================= */
@@ -338,7 +338,7 @@ void mce_dsme_request_powerup(void)
  */
 void mce_dsme_request_reboot(void)
 {
-    if( datapipe_get_gint(update_mode_pipe) ) {
+    if( datapipe_get_gbool(update_mode_pipe) ) {
         mce_log(LL_WARN, "reboot blocked; os update in progress");
         goto EXIT;
     }
@@ -356,7 +356,7 @@ EXIT:
  */
 void mce_dsme_request_normal_shutdown(void)
 {
-    if( datapipe_get_gint(update_mode_pipe) ) {
+    if( datapipe_get_gbool(update_mode_pipe) ) {
         mce_log(LL_WARN, "shutdown blocked; os update in progress");
         goto EXIT;
     }
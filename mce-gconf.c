@@ -527,6 +527,9 @@ EXIT:
 void mce_gconf_exit(void)
 {
 	if( gconf_client ) {
+		/* Write back changes that are still pending */
+		gconf_client_flush_values(gconf_client);
+
 		/* Free the list of GConf notifiers */
 		g_slist_foreach(gconf_notifiers, mce_gconf_notifier_remove_cb, 0);
 		gconf_notifiers = 0;
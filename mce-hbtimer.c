@@ -29,6 +29,7 @@
 #include "mce.h"
 #include "mce-log.h"
 #include "mce-lib.h"
+#include "mce-trace.h"
 
 #ifdef ENABLE_WAKELOCKS
 # include "libwakelock.h"
@@ -61,6 +62,9 @@ struct mce_hbtimer_t
     /** Timer name, used for debug logging purposes */
     char       *hbt_name;
 
+    /** Interned timer name for the flight recorder trace */
+    uint16_t    hbt_trace_name;
+
     /** Trigger time, milliseconds in CLOCK_BOOTTIME base */
     int64_t     hbt_trigger;
 
@@ -70,11 +74,23 @@ struct mce_hbtimer_t
     /** Timer delay in milliseconds */
     int         hbt_period;
 
+    /** How much triggering can be delayed for wakeup coalescing [ms] */
+    int         hbt_slack;
+
     /** Flag for: control within hbt_notify() */
     bool        hbt_in_notify;
 
+    /** Flag for: timer was deleted from within hbt_notify() */
+    bool        hbt_deleted;
+
     /** User data to pass to hbt_notify() */
     void       *hbt_user_data;
+
+    /** Position in mht_queue_heap, or MHT_QUEUE_NO_SLOT */
+    guint       hbt_slot;
+
+    /** Dispatch round in which the timer was last notified */
+    guint       hbt_round;
 };
 
 mce_hbtimer_t * mce_hbtimer_create         (const char *name, int period, GSourceFunc notify, void *user_data);
@@ -83,6 +99,7 @@ void            mce_hbtimer_delete         (mce_hbtimer_t *self);
 bool            mce_hbtimer_is_active      (const mce_hbtimer_t *self);
 const char     *mce_hbtimer_get_name       (const mce_hbtimer_t *self);
 void            mce_hbtimer_set_period     (mce_hbtimer_t *self, int period);
+void            mce_hbtimer_set_slack      (mce_hbtimer_t *self, int slack);
 void            mce_hbtimer_start          (mce_hbtimer_t *self);
 void            mce_hbtimer_stop           (mce_hbtimer_t *self);
 
@@ -102,15 +119,32 @@ static guint    mht_add_iowatch            (int fd, bool close_on_unref, GIOCond
  * QUEUE_MANAGEMENT
  * ------------------------------------------------------------------------- */
 
-/** List of registered timers */
-static GSList *mht_queue_timer_list = 0;
+/** Heap slot value used to signify "not queued" */
+#define MHT_QUEUE_NO_SLOT G_MAXUINT
+
+/** Active timers as a binary min-heap ordered by trigger time */
+static mce_hbtimer_t **mht_queue_heap = 0;
+
+/** Number of timers in mht_queue_heap */
+static guint mht_queue_heap_len = 0;
+
+/** Number of allocated mht_queue_heap slots */
+static guint mht_queue_heap_size = 0;
+
+/** Current dispatch round, used for notifying timers only once */
+static guint mht_queue_round = 0;
+
+static bool     mht_queue_timer_lt         (const mce_hbtimer_t *a, const mce_hbtimer_t *b);
+static void     mht_queue_set_slot         (guint slot, mce_hbtimer_t *timer);
+static void     mht_queue_sift_up          (guint slot);
+static void     mht_queue_sift_down        (guint slot);
+static void     mht_queue_insert_timer     (mce_hbtimer_t *self);
+static void     mht_queue_remove_timer     (mce_hbtimer_t *self);
+static void     mht_queue_update_timer     (mce_hbtimer_t *self);
+static int64_t  mht_queue_min_deadline     (guint slot, int64_t best);
 
 void            mht_queue_dispatch_timers  (void);
 static void     mht_queue_schedule_wakeups (void);
-static void     mht_queue_garbage_collect  (void);
-static void     mht_queue_add_timer        (mce_hbtimer_t *self);
-static void     mht_queue_remove_timer     (mce_hbtimer_t *self);
-static bool     mht_queue_has_timer        (const mce_hbtimer_t *self);
 
 /* ------------------------------------------------------------------------- *
  * GLIB_WAKEUPS
@@ -120,7 +154,7 @@ static bool     mht_queue_has_timer        (const mce_hbtimer_t *self);
 static guint mce_hbtimer_glib_wait_id = 0;
 
 static gboolean mht_glib_wakeup_cb         (gpointer aptr);
-static void     mht_glib_set_wakeup        (int64_t trigger, int64_t now);
+static void     mht_glib_set_wakeup        (int64_t trigger, int64_t deadline, int64_t now);
 
 /* ------------------------------------------------------------------------- *
  * IPHB_WAKEUPS
@@ -139,7 +173,25 @@ static int64_t  mht_iphb_wakeup_tick = NO_TICK;
 static guint   mht_iphb_wakeup_watch_id = 0;
 
 static gboolean mht_iphb_wakeup_cb         (GIOChannel *chn, GIOCondition cnd, gpointer data);
-static void     mht_iphb_set_wakeup        (int64_t trigger, int64_t now);
+static void     mht_iphb_set_wakeup        (int64_t trigger, int64_t deadline, int64_t now);
+
+/* ------------------------------------------------------------------------- *
+ * WAKEUP_STATS
+ * ------------------------------------------------------------------------- */
+
+/** How often wakeup statistics are reported [ms] */
+#define MHT_STATS_PERIOD_MS 60000
+
+/** Start of the current statistics period */
+static int64_t  mht_stats_start = NO_TICK;
+
+/** Number of dispatch wakeups during the current period */
+static guint    mht_stats_wakeups = 0;
+
+/** Number of timers notified during the current period */
+static guint    mht_stats_notified = 0;
+
+static void     mht_stats_update           (int64_t now, guint notified);
 
 /* ------------------------------------------------------------------------- *
  * IPHB_CONNECTION
@@ -249,13 +301,16 @@ mce_hbtimer_create(const char  *name,
     mce_hbtimer_t *self = calloc(1, sizeof *self);
 
     self->hbt_name      = name ? strdup(name) : 0;
+    self->hbt_trace_name = mce_trace_intern(name);
     self->hbt_notify    = notify;
     self->hbt_period    = period;
+    self->hbt_slack     = 0;
     self->hbt_user_data = user_data;
     self->hbt_trigger   = NO_TICK;
     self->hbt_in_notify = false;
-
-    mht_queue_add_timer(self);
+    self->hbt_deleted   = false;
+    self->hbt_slot      = MHT_QUEUE_NO_SLOT;
+    self->hbt_round     = mht_queue_round;
 
     return self;
 }
@@ -273,6 +328,13 @@ mce_hbtimer_delete(mce_hbtimer_t *self)
     mht_queue_remove_timer(self);
     mht_queue_schedule_wakeups();
 
+    /* Deleting from within notify callback: let
+     * mce_hbtimer_notify() release the memory */
+    if( self->hbt_in_notify ) {
+        self->hbt_deleted = true;
+        goto EXIT;
+    }
+
     free(self->hbt_name),
         self->hbt_name = 0;
 
@@ -327,6 +389,21 @@ mce_hbtimer_set_period(mce_hbtimer_t *self, int period)
         self->hbt_period = period;
 }
 
+/** Set heatbeat timer slack
+ *
+ * Allows triggering to be delayed by up to slack milliseconds so
+ * that it can be combined with wakeups needed by other timers.
+ *
+ * @param self  heartbeat timer object, or NULL
+ * @param slack acceptable delay [ms]
+ */
+void
+mce_hbtimer_set_slack(mce_hbtimer_t *self, int slack)
+{
+    if( self )
+        self->hbt_slack = (slack > 0) ? slack : 0;
+}
+
 /** Call heatbeat timer notification functiom
  *
  * @param self   heartbeat timer object, or NULL
@@ -340,19 +417,23 @@ mce_hbtimer_notify(mce_hbtimer_t *self)
     if( self->hbt_in_notify )
         goto EXIT;
 
+    self->hbt_trigger = NO_TICK;
+    mht_queue_remove_timer(self);
+
     if( !self->hbt_notify )
         goto EXIT;
 
     self->hbt_in_notify = true;
-    self->hbt_trigger   = NO_TICK;
 
     bool again = self->hbt_notify(self->hbt_user_data);
 
+    self->hbt_in_notify = false;
+
     /* Check that notify callback did not delete the timer */
-    if( !mht_queue_has_timer(self) )
+    if( self->hbt_deleted ) {
+        mce_hbtimer_delete(self);
         goto EXIT;
-
-    self->hbt_in_notify = false;
+    }
 
     if( again )
         mce_hbtimer_start(self);
@@ -377,6 +458,14 @@ mce_hbtimer_set_trigger(mce_hbtimer_t *self, int64_t trigger)
         goto EXIT;
 
     self->hbt_trigger = trigger;
+
+    if( trigger == NO_TICK )
+        mht_queue_remove_timer(self);
+    else if( self->hbt_slot == MHT_QUEUE_NO_SLOT )
+        mht_queue_insert_timer(self);
+    else
+        mht_queue_update_timer(self);
+
     mht_queue_schedule_wakeups();
 
 EXIT:
@@ -425,96 +514,199 @@ EXIT:
  * QUEUE_MANAGEMENT
  * ========================================================================= */
 
-/** Clean up unused timer list slots
+/** Heap ordering predicate
+ *
+ * Timers are ordered by trigger time. Ties are broken by dispatch
+ * round so that timers that were re-armed during dispatching sort
+ * after the ones that are still waiting to be notified.
+ *
+ * @param a heartbeat timer object
+ * @param b heartbeat timer object
+ *
+ * @return true if a should trigger before b, false otherwise
+ */
+static bool
+mht_queue_timer_lt(const mce_hbtimer_t *a, const mce_hbtimer_t *b)
+{
+    if( a->hbt_trigger != b->hbt_trigger )
+        return a->hbt_trigger < b->hbt_trigger;
+
+    return (gint)(a->hbt_round - b->hbt_round) < 0;
+}
+
+/** Place timer to a heap slot and update the back reference
  *
- * When timers are deleted, the associated node in mht_queue_timer_list
- * is left in place with data pointer set to zero.
+ * @param slot  heap slot index
+ * @param timer heartbeat timer object
+ */
+static void
+mht_queue_set_slot(guint slot, mce_hbtimer_t *timer)
+{
+    mht_queue_heap[slot] = timer;
+    timer->hbt_slot = slot;
+}
+
+/** Move timer towards the heap root until ordering is restored
  *
- * This function can be used to remove such stale entries in suitable
- * point outside the dispatch iteration loop.
+ * @param slot heap slot index
  */
 static void
-mht_queue_garbage_collect(void)
+mht_queue_sift_up(guint slot)
 {
-    GSList **tail = &mht_queue_timer_list;
-
-    GSList *item;
-
-    while( (item = *tail) ) {
-        if( item->data ) {
-            tail = &item->next;
-        }
-        else {
-            *tail = item->next;
-            item->next = 0;
-            g_slist_free(item);
-        }
+    mce_hbtimer_t *timer = mht_queue_heap[slot];
+
+    while( slot > 0 ) {
+        guint parent = (slot - 1) / 2;
+
+        if( !mht_queue_timer_lt(timer, mht_queue_heap[parent]) )
+            break;
+
+        mht_queue_set_slot(slot, mht_queue_heap[parent]);
+        slot = parent;
     }
+
+    mht_queue_set_slot(slot, timer);
 }
 
-/** Predicate for: heartbeat timer is registered
- *
- * @param self   heartbeat timer object, or NULL
+/** Move timer towards the heap leaves until ordering is restored
  *
- * return true if timer is registered, false otherwise
+ * @param slot heap slot index
  */
-static bool
-mht_queue_has_timer(const mce_hbtimer_t *self)
+static void
+mht_queue_sift_down(guint slot)
 {
-    bool has_timer = false;
+    mce_hbtimer_t *timer = mht_queue_heap[slot];
 
-    if( !self )
+    for( ;; ) {
+        guint child = slot * 2 + 1;
+
+        if( child >= mht_queue_heap_len )
+            break;
+
+        if( child + 1 < mht_queue_heap_len &&
+            mht_queue_timer_lt(mht_queue_heap[child + 1],
+                               mht_queue_heap[child]) )
+            child += 1;
+
+        if( !mht_queue_timer_lt(mht_queue_heap[child], timer) )
+            break;
+
+        mht_queue_set_slot(slot, mht_queue_heap[child]);
+        slot = child;
+    }
+
+    mht_queue_set_slot(slot, timer);
+}
+
+/** Add started heartbeat timer to the queue
+ *
+ * @param self   heartbeat timer object, or NULL
+ */
+static void
+mht_queue_insert_timer(mce_hbtimer_t *self)
+{
+    if( !self || self->hbt_slot != MHT_QUEUE_NO_SLOT )
         goto EXIT;
 
-    has_timer = g_slist_find(mht_queue_timer_list, self) != 0;
+    if( mht_queue_heap_len == mht_queue_heap_size ) {
+        mht_queue_heap_size = mht_queue_heap_size ? mht_queue_heap_size * 2 : 32;
+        mht_queue_heap = g_renew(mce_hbtimer_t *, mht_queue_heap,
+                                 mht_queue_heap_size);
+    }
+
+    mht_queue_set_slot(mht_queue_heap_len++, self);
+    mht_queue_sift_up(self->hbt_slot);
 
 EXIT:
-    return has_timer;
+    return;
 }
 
-/** Register heartbeat timer
+/** Remove heartbeat timer from the queue
  *
  * @param self   heartbeat timer object, or NULL
  */
 static void
-mht_queue_add_timer(mce_hbtimer_t *self)
+mht_queue_remove_timer(mce_hbtimer_t *self)
 {
-    if( !self )
+    if( !self || self->hbt_slot == MHT_QUEUE_NO_SLOT )
         goto EXIT;
 
-    /* Try to find recyclable vacated timer slot */
-    GSList *item = g_slist_find(mht_queue_timer_list, 0);
+    guint slot = self->hbt_slot;
 
-    if( item )
-        item->data = self;
-    else
-        mht_queue_timer_list = g_slist_prepend(mht_queue_timer_list, self);
+    self->hbt_slot = MHT_QUEUE_NO_SLOT;
+
+    /* Fill the hole with the last timer and restore ordering */
+    if( slot != --mht_queue_heap_len ) {
+        mht_queue_set_slot(slot, mht_queue_heap[mht_queue_heap_len]);
+        mht_queue_update_timer(mht_queue_heap[slot]);
+    }
+
+    mht_queue_heap[mht_queue_heap_len] = 0;
+
+    /* Keep the storage; timers come and go all the time and
+     * it is released in mce_hbtimer_quit() */
 
 EXIT:
     return;
 }
 
-/** Unregister heartbeat timer
+/** Restore queue ordering after trigger time of a timer has changed
  *
  * @param self   heartbeat timer object, or NULL
  */
 static void
-mht_queue_remove_timer(mce_hbtimer_t *self)
+mht_queue_update_timer(mce_hbtimer_t *self)
 {
-    if( !self )
+    if( !self || self->hbt_slot == MHT_QUEUE_NO_SLOT )
         goto EXIT;
 
-    GSList *item = g_slist_find(mht_queue_timer_list, self);
+    guint slot = self->hbt_slot;
 
-    /* Vacate the slot by clearing the data link */
-    if( item )
-        item->data = 0;
+    if( slot > 0 && mht_queue_timer_lt(self, mht_queue_heap[(slot - 1) / 2]) )
+        mht_queue_sift_up(slot);
+    else
+        mht_queue_sift_down(slot);
 
 EXIT:
     return;
 }
 
-/** Scan registered heartbeat timers and schdule nearest wakeup
+/** Find the earliest trigger time + slack from a heap subtree
+ *
+ * Children never trigger before their parent, so subtrees that
+ * start at or after the best deadline found so far are skipped.
+ *
+ * @param slot root of heap subtree
+ * @param best earliest deadline found so far
+ *
+ * @return earliest deadline
+ */
+static int64_t
+mht_queue_min_deadline(guint slot, int64_t best)
+{
+    if( slot >= mht_queue_heap_len )
+        goto EXIT;
+
+    const mce_hbtimer_t *timer = mht_queue_heap[slot];
+
+    if( timer->hbt_trigger >= best )
+        goto EXIT;
+
+    if( best > timer->hbt_trigger + timer->hbt_slack )
+        best = timer->hbt_trigger + timer->hbt_slack;
+
+    best = mht_queue_min_deadline(slot * 2 + 1, best);
+    best = mht_queue_min_deadline(slot * 2 + 2, best);
+
+EXIT:
+    return best;
+}
+
+/** Schedule wakeup for the nearest heartbeat timer trigger time
+ *
+ * The wakeup can happen anywhere between the earliest trigger time
+ * and the earliest trigger time + slack of any active timer, so all
+ * timers whose slack windows overlap get notified together.
  */
 static void
 mht_queue_schedule_wakeups(void)
@@ -522,34 +714,30 @@ mht_queue_schedule_wakeups(void)
     if( !mce_hbtimer_initialized )
         goto EXIT;
 
-    int64_t trigger = NO_TICK;
-    bool    compact = false;
-
-    for( GSList *item = mht_queue_timer_list; item; item = item->next ) {
-        mce_hbtimer_t *timer = item->data;
+    int64_t trigger  = NO_TICK;
+    int64_t deadline = NO_TICK;
 
-        if( !timer )
-            compact = true;
-        else if( trigger > timer->hbt_trigger )
-            trigger = timer->hbt_trigger;
+    if( mht_queue_heap_len > 0 ) {
+        trigger  = mht_queue_heap[0]->hbt_trigger;
+        deadline = mht_queue_min_deadline(0, NO_TICK);
     }
 
-    if( compact )
-        mht_queue_garbage_collect();
-
     int64_t now = mce_lib_get_boot_tick();
 
     if( trigger < now )
         trigger = now;
 
-    mht_glib_set_wakeup(trigger, now);
-    mht_iphb_set_wakeup(trigger, now);
+    if( deadline < trigger )
+        deadline = trigger;
+
+    mht_glib_set_wakeup(trigger, deadline, now);
+    mht_iphb_set_wakeup(trigger, deadline, now);
 
 EXIT:
     return;
 }
 
-/** Scan registered heartbeat timers and notify triggered ones
+/** Notify triggered heartbeat timers
  */
 void
 mht_queue_dispatch_timers(void)
@@ -568,35 +756,43 @@ mht_queue_dispatch_timers(void)
 
     /* Block suspend during dispatching */
 #ifdef ENABLE_WAKELOCKS
-    wakelock_lock("mce_hbtimer_dispatch", -1);
+    wakelock_acquire("mce_hbtimer_dispatch");
 #endif
 
-    int64_t now = mce_lib_get_boot_tick();
+    int64_t now      = mce_lib_get_boot_tick();
+    guint   notified = 0;
+
+    /* Timers re-armed from notify callbacks can end up triggering
+     * at "now" again; notify each timer at most once per round */
+    ++mht_queue_round;
 
-    for( GSList *item = mht_queue_timer_list; item; item = item->next ) {
-        mce_hbtimer_t *timer = item->data;
+    while( mht_queue_heap_len > 0 ) {
+        mce_hbtimer_t *timer = mht_queue_heap[0];
 
-        if( !timer )
-            continue;
+        if( now < timer->hbt_trigger )
+            break;
 
-        if( timer->hbt_trigger == NO_TICK )
-            continue;
+        if( timer->hbt_round == mht_queue_round )
+            break;
 
         mce_log(LL_DEBUG, "%s T%+"PRId64" ms",
                 mce_hbtimer_get_name(timer),
                 now - timer->hbt_trigger);
+        mce_trace_add(MCE_TRACE_HBTIMER, timer->hbt_trace_name,
+                      now - timer->hbt_trigger, 0);
 
-        if( now < timer->hbt_trigger )
-            continue;
-
+        timer->hbt_round = mht_queue_round;
         mce_hbtimer_notify(timer);
+        ++notified;
     }
 
+    mht_stats_update(now, notified);
+
     /* Check the next timer to trigger */
     mht_queue_schedule_wakeups();
 
 #ifdef ENABLE_WAKELOCKS
-    wakelock_unlock("mce_hbtimer_dispatch");
+    wakelock_release("mce_hbtimer_dispatch");
 #endif
 
     pthread_mutex_unlock(&mutex);
@@ -634,11 +830,12 @@ EXIT:
 
 /** Reprogram glib timeout for dispatching heartbeat timers
  *
- * @param trigger when to trigger
- * @param now     current time
+ * @param trigger  earliest time to trigger
+ * @param deadline latest time to trigger
+ * @param now      current time
  */
 static void
-mht_glib_set_wakeup(int64_t trigger, int64_t now)
+mht_glib_set_wakeup(int64_t trigger, int64_t deadline, int64_t now)
 {
     static int64_t prev = NO_TICK;
 
@@ -656,7 +853,10 @@ mht_glib_set_wakeup(int64_t trigger, int64_t now)
             mce_hbtimer_glib_wait_id = 0;
     }
     if( trigger != NO_TICK ) {
-        delay = (int)(trigger - now);
+        /* Align with other slack utilizing timeouts */
+        delay = mce_lib_align_delay(mce_lib_get_mono_tick(),
+                                    (int)(trigger - now),
+                                    (int)(deadline - trigger));
         mce_hbtimer_glib_wait_id =
             g_timeout_add(delay, mht_glib_wakeup_cb, 0);
     }
@@ -743,11 +943,12 @@ cleanup_nak:
 
 /** Reprogram iphb timeout for dispatching heartbeat timers
  *
- * @param trigger when to trigger
- * @param now     current time
+ * @param trigger  earliest time to trigger
+ * @param deadline latest time to trigger
+ * @param now      current time
  */
 static void
-mht_iphb_set_wakeup(int64_t trigger, int64_t now)
+mht_iphb_set_wakeup(int64_t trigger, int64_t deadline, int64_t now)
 {
     /* Assume: iphb timer should be stopped */
     int lo = 0;
@@ -758,8 +959,11 @@ mht_iphb_set_wakeup(int64_t trigger, int64_t now)
         /* Calculate the iphb wakeup range to be used. */
         int64_t delay = (trigger - now + 999) / 1000;
 
+        /* Allow slack beyond the default wakeup range */
+        int64_t slack = (deadline - trigger) / 1000;
+
         lo = (int)delay;
-        hi = lo + MHT_IPHB_WAKEUP_MAX_DELAY_S;
+        hi = lo + (int)MAX(slack, MHT_IPHB_WAKEUP_MAX_DELAY_S);
 
         /* Calculate the next full BOOTTIME second after low bound
          * of iphb wakeup. This is used for avoiding constant iphb
@@ -789,6 +993,44 @@ mht_iphb_set_wakeup(int64_t trigger, int64_t now)
     }
 }
 
+/* ========================================================================= *
+ * WAKEUP_STATS
+ * ========================================================================= */
+
+/** Update and periodically report dispatch wakeup statistics
+ *
+ * The report is logged at debug level, i.e. it needs to be
+ * explicitly enabled via "mce --verbose".
+ *
+ * The report is made lazily from the first dispatch after the
+ * statistics period has passed, so it never causes wakeups itself.
+ * Notified timers exceeding wakeups is what coalescing saved.
+ *
+ * @param now      current time
+ * @param notified number of timers notified during this wakeup
+ */
+static void
+mht_stats_update(int64_t now, guint notified)
+{
+    if( mht_stats_start == NO_TICK )
+        mht_stats_start = now;
+
+    int64_t elapsed = now - mht_stats_start;
+
+    if( elapsed >= MHT_STATS_PERIOD_MS ) {
+        mce_log(LL_DEBUG, "%.1f wakeups/min, %.1f timers notified/min",
+                mht_stats_wakeups * 60000.0 / elapsed,
+                mht_stats_notified * 60000.0 / elapsed);
+
+        mht_stats_start    = now;
+        mht_stats_wakeups  = 0;
+        mht_stats_notified = 0;
+    }
+
+    mht_stats_wakeups  += 1;
+    mht_stats_notified += notified;
+}
+
 /* ========================================================================= *
  * IPHB_CONNECTION
  * ========================================================================= */
@@ -946,7 +1188,7 @@ mht_connection_close(void)
         mce_log(LL_DEBUG, "iphb disconnected");
 
         /* reset last programmed wakeup */
-        mht_iphb_set_wakeup(NO_TICK, NO_TICK);
+        mht_iphb_set_wakeup(NO_TICK, NO_TICK, NO_TICK);
     }
 }
 
@@ -1076,9 +1318,16 @@ mce_hbtimer_quit(void)
     mht_datapipe_quit();
 
     /* Remove wakeups */
-    mht_glib_set_wakeup(NO_TICK, NO_TICK);
-    mht_iphb_set_wakeup(NO_TICK, NO_TICK);
+    mht_glib_set_wakeup(NO_TICK, NO_TICK, NO_TICK);
+    mht_iphb_set_wakeup(NO_TICK, NO_TICK, NO_TICK);
 
     /* close iphb connection */
     mht_connection_close();
+
+    /* Release queue storage, unless timers are still queued */
+    if( mht_queue_heap_len == 0 ) {
+        g_free(mht_queue_heap),
+            mht_queue_heap = 0;
+        mht_queue_heap_size = 0;
+    }
 }
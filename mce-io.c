@@ -25,6 +25,7 @@
 #include "mce.h"
 #include "mce-log.h"
 #include "mce-lib.h"
+#include "mce-trace.h"
 
 #ifdef ENABLE_WAKELOCKS
 # include "libwakelock.h"
@@ -37,6 +38,10 @@
 #include <errno.h>
 #include <fcntl.h>
 
+#include <sys/vfs.h>
+
+#include <linux/magic.h>
+
 #include <glib/gstdio.h>
 
 /* ========================================================================= *
@@ -46,6 +51,9 @@
 /** Suffix used for temporary files */
 #define TMP_SUFFIX				".tmp"
 
+/** Preferred read size for chunk I/O monitors */
+#define IOMON_CHUNK_READ_SIZE			4096
+
 /* ========================================================================= *
  * TYPES
  * ========================================================================= */
@@ -62,6 +70,8 @@ struct mce_io_mon_t {
 	gchar          *path;		/**< Monitored file */
 	iomon_type      type;		/**< Monitor type */
 	gulong          chunk_size;	/**< Read-chunk size */
+	gchar          *chunk_buf;	/**< Reusable read buffer */
+	gsize           chunk_buf_size;	/**< Size of chunk_buf */
 
 	gboolean        seekable;	/**< is the I/O channel seekable */
 	gboolean        suspended;	/**< Is the I/O monitor suspended? */
@@ -70,6 +80,8 @@ struct mce_io_mon_t {
 	guint           iowatch_id;	/**< GSource ID for input */
 
 	mce_io_mon_notify_cb nofity_cb;	/**< Input handling callback */
+	mce_io_mon_batch_cb  batch_cb;	/**< Batched input callback */
+	mce_io_mon_frame_cb  frame_cb;	/**< Batch boundary predicate */
 	mce_io_mon_delete_cb delete_cb;	/**< Iomon delete callback */
 
 	error_policy_t  error_policy;	/**< Error policy */
@@ -109,10 +121,12 @@ static gboolean      mce_io_mon_read_chunks             (GIOChannel *source, GIO
 static gboolean      mce_io_mon_read_string             (GIOChannel *source, GIOCondition condition, gpointer data);
 static gboolean      mce_io_mon_input_cb                (GIOChannel *source, GIOCondition condition, gpointer data);
 
-static mce_io_mon_t *mce_io_mon_register                (gint fd, const gchar *path, error_policy_t error_policy, gboolean rewind_policy, mce_io_mon_notify_cb callback, mce_io_mon_delete_cb delete_cb);
+static mce_io_mon_t *mce_io_mon_register                (gint fd, const gchar *path, error_policy_t error_policy, gboolean rewind_policy, mce_io_mon_notify_cb callback, mce_io_mon_batch_cb batch_cb, mce_io_mon_delete_cb delete_cb);
+static void          mce_io_mon_setup_chunk             (mce_io_mon_t *iomon, gulong chunk_size);
 
 mce_io_mon_t        *mce_io_mon_register_string         (const gint fd, const gchar *const file, error_policy_t error_policy, gboolean rewind_policy, mce_io_mon_notify_cb callback, mce_io_mon_delete_cb delete_cb);
 mce_io_mon_t        *mce_io_mon_register_chunk          (const gint fd, const gchar *const file, error_policy_t error_policy, gboolean rewind_policy, mce_io_mon_notify_cb callback, mce_io_mon_delete_cb delete_cb, gulong chunk_size);
+mce_io_mon_t        *mce_io_mon_register_batch          (const gint fd, const gchar *const file, error_policy_t error_policy, mce_io_mon_batch_cb callback, mce_io_mon_frame_cb frame_cb, mce_io_mon_delete_cb delete_cb, gulong chunk_size);
 
 void                 mce_io_mon_unregister              (mce_io_mon_t *iomon);
 void                 mce_io_mon_unregister_list         (GSList *list);
@@ -132,6 +146,7 @@ gboolean        mce_read_string_from_file               (const gchar *const file
 gboolean        mce_read_number_string_from_file        (const gchar *const file, gulong *number, FILE **fp, gboolean rewind_file, gboolean close_on_exit);
 gboolean        mce_write_string_to_file                (const gchar *const file, const gchar *const string);
 void            mce_close_output                        (output_state_t *output);
+static gboolean mce_write_number_string_to_fd           (output_state_t *output, const gulong number);
 gboolean        mce_write_number_string_to_file         (output_state_t *output, const gulong number);
 gboolean        mce_write_number_string_to_file_atomic  (const gchar *const file, const gulong number);
 gboolean        mce_are_settings_locked                 (void);
@@ -173,6 +188,7 @@ static void io_detect_resume(void)
 
 	mce_log(LL_DEVEL, "time skip: assume %"PRId64".%03"PRId64"s suspend",
 		skip / 1000, skip % 1000);
+	mce_trace_add_name(MCE_TRACE_RESUME, "resume", skip, 0);
 
 	// notify in case some timers need re-evaluating
 	execute_datapipe_output_triggers(&device_resumed_pipe,
@@ -300,6 +316,8 @@ static mce_io_mon_t *mce_io_mon_create(const char *path, mce_io_mon_delete_cb de
 	self->path          = g_strdup(path);
 	self->type          = IOMON_UNSET;
 	self->chunk_size    = 0;
+	self->chunk_buf     = 0;
+	self->chunk_buf_size = 0;
 
 	self->seekable      = FALSE;
 	self->suspended     = TRUE;
@@ -308,6 +326,8 @@ static mce_io_mon_t *mce_io_mon_create(const char *path, mce_io_mon_delete_cb de
 	self->iowatch_id    = 0;
 
 	self->nofity_cb     = 0;
+	self->batch_cb      = 0;
+	self->frame_cb      = 0;
 	self->delete_cb     = delete_cb;
 
 	self->error_policy  = MCE_IO_ERROR_POLICY_WARN;
@@ -389,6 +409,9 @@ static void mce_io_mon_delete(mce_io_mon_t *self)
 	/* Forget file path */
 	g_free(self->path), self->path = 0;
 
+	/* Release read buffer */
+	g_free(self->chunk_buf), self->chunk_buf = 0;
+
 	/* Reset to something that is likely to generate segfaults
 	 * if it ends up used after freeing ... */
 	memset(self, 0xff, sizeof *self);
@@ -443,8 +466,6 @@ static gboolean mce_io_mon_read_chunks(GIOChannel *source,
 	gboolean      status      = FALSE;
 
 	mce_io_mon_t  *iomon      = data;
-	gchar        *buffer      = NULL;
-	gsize         bytes_want  = 4096;
 	gsize         bytes_have  = 0;
 	gsize         chunks_have = 0;
 	gsize         chunks_done = 0;
@@ -455,7 +476,7 @@ static gboolean mce_io_mon_read_chunks(GIOChannel *source,
 	/* Since the locks on kernel side are released once all
 	 * events are read, we must obtain the userspace lock
 	 * before reading the available data */
-	wakelock_lock("mce_input_handler", -1);
+	wakelock_acquire("mce_input_handler");
 #endif
 
 	/* We get input from evdev nodes at resume, handle that 1st */
@@ -479,18 +500,9 @@ static gboolean mce_io_mon_read_chunks(GIOChannel *source,
 		}
 	}
 
-	/* Adjust read size to multiples of small sized chunks,
-	 * or size of one larger chunk */
-	if( iomon->chunk_size < bytes_want )
-		bytes_want -= bytes_want % iomon->chunk_size;
-	else
-		bytes_want = iomon->chunk_size;
-
-	/* Allocate read buffer */
-	buffer = g_malloc(bytes_want);
-
-	io_status = g_io_channel_read_chars(source, buffer,
-					    bytes_want, &bytes_have, &error);
+	io_status = g_io_channel_read_chars(source, iomon->chunk_buf,
+					    iomon->chunk_buf_size,
+					    &bytes_have, &error);
 
 	/* If the read was interrupted, ignore */
 	if( io_status == G_IO_STATUS_AGAIN ) {
@@ -516,11 +528,26 @@ static gboolean mce_io_mon_read_chunks(GIOChannel *source,
 		mce_log(LL_ERR, "Empty read from %s", iomon->path);
 	}
 	else {
-		gchar *chunk = buffer;
+		gchar *chunk = iomon->chunk_buf;
+		gchar *frame = chunk;
 		for( ; chunks_done < chunks_have ; chunk += iomon->chunk_size ) {
+			gboolean flush = FALSE;
+
 			++chunks_done;
 
-			if( !iomon->nofity_cb(chunk, iomon->chunk_size) ) {
+			if( !iomon->batch_cb ) {
+				flush = iomon->nofity_cb(chunk,
+							 iomon->chunk_size);
+			}
+			else if( chunks_done == chunks_have ||
+				 (iomon->frame_cb && iomon->frame_cb(chunk)) ) {
+				/* Pass chunks up to and including this one */
+				gsize count = (chunk - frame) / iomon->chunk_size + 1;
+				flush = iomon->batch_cb(frame, count);
+				frame = chunk + iomon->chunk_size;
+			}
+
+			if( !flush ) {
 				continue;
 			}
 
@@ -541,7 +568,7 @@ static gboolean mce_io_mon_read_chunks(GIOChannel *source,
 		}
 	}
 
-	mce_log(LL_INFO, "%s: status=%s, data=%d/%d=%d+%d, skipped=%d",
+	mce_log(LL_DEBUG, "%s: status=%s, data=%d/%d=%d+%d, skipped=%d",
 		iomon->path, io_status_name(io_status),
 		bytes_have, (int)iomon->chunk_size, chunks_have,
 		bytes_have % (int)iomon->chunk_size, chunks_have - chunks_done);
@@ -550,11 +577,10 @@ static gboolean mce_io_mon_read_chunks(GIOChannel *source,
 
 EXIT:
 	g_clear_error(&error);
-	g_free(buffer);
 
 #ifdef ENABLE_WAKELOCKS
 	/* Release the lock after we're done with processing it */
-	wakelock_unlock("mce_input_handler");
+	wakelock_release("mce_input_handler");
 #endif
 
 	return status;
@@ -746,6 +772,7 @@ static mce_io_mon_t *mce_io_mon_register(gint fd,
 					 error_policy_t error_policy,
 					 gboolean rewind_policy,
 					 mce_io_mon_notify_cb callback,
+					 mce_io_mon_batch_cb batch_cb,
 					 mce_io_mon_delete_cb delete_cb)
 {
 	bool          success = false;
@@ -758,7 +785,7 @@ static mce_io_mon_t *mce_io_mon_register(gint fd,
 		goto EXIT;
 	}
 
-	if( !callback ) {
+	if( !callback && !batch_cb ) {
 		mce_log(LL_ERR, "callback == NULL!");
 		goto EXIT;
 	}
@@ -776,6 +803,7 @@ static mce_io_mon_t *mce_io_mon_register(gint fd,
 
 	/* Set custom props */
 	iomon->nofity_cb    = callback;
+	iomon->batch_cb     = batch_cb;
 	iomon->error_policy = error_policy;
 
 	/* Set up io channel */
@@ -958,7 +986,7 @@ mce_io_mon_t *mce_io_mon_register_string(const gint fd,
 
 	iomon = mce_io_mon_register(fd, file,
 				    error_policy, rewind_policy,
-				    callback, delete_cb);
+				    callback, 0, delete_cb);
 
 	if (iomon == NULL)
 		goto EXIT;
@@ -995,15 +1023,75 @@ mce_io_mon_t *mce_io_mon_register_chunk(const gint fd,
 					gulong chunk_size)
 {
 	mce_io_mon_t *iomon = NULL;
-	GError *error = NULL;
 
 	iomon = mce_io_mon_register(fd, file,
 				    error_policy, rewind_policy,
-				    callback, delete_cb);
+				    callback, 0, delete_cb);
 
 	if( !iomon )
 		goto EXIT;
 
+	mce_io_mon_setup_chunk(iomon, chunk_size);
+
+EXIT:
+	return iomon;
+}
+
+/**
+ * Register an I/O monitor; reads chunks of specified size and passes
+ * them to the callback in batches
+ *
+ * A batch ends at a chunk for which frame_cb returns TRUE, or at the
+ * end of data available from a single read. For evdev input this
+ * allows handling events one SYN_REPORT frame at a time.
+ *
+ * @param fd File Descriptor; this takes priority over file; -1 if not used
+ * @param file Path to the file
+ * @param error_policy MCE_IO_ERROR_POLICY_EXIT to exit on error,
+ *                     MCE_IO_ERROR_POLICY_WARN to warn about errors
+ *                                              but ignore them,
+ *                     MCE_IO_ERROR_POLICY_IGNORE to silently ignore errors
+ * @param callback Function to call with batches of chunks
+ * @param frame_cb Predicate for batch ending chunks, or NULL to pass
+ *                 all data from each read as one batch
+ * @param delete_cb Function to call when the monitor is deleted
+ * @param chunk_size The number of bytes in each chunk
+ * @return An I/O monitor cookie on success, NULL on failure
+ */
+mce_io_mon_t *mce_io_mon_register_batch(const gint fd,
+					const gchar *const file,
+					error_policy_t error_policy,
+					mce_io_mon_batch_cb callback,
+					mce_io_mon_frame_cb frame_cb,
+					mce_io_mon_delete_cb delete_cb,
+					gulong chunk_size)
+{
+	mce_io_mon_t *iomon = NULL;
+
+	iomon = mce_io_mon_register(fd, file,
+				    error_policy, FALSE,
+				    0, callback, delete_cb);
+
+	if( !iomon )
+		goto EXIT;
+
+	iomon->frame_cb = frame_cb;
+	mce_io_mon_setup_chunk(iomon, chunk_size);
+
+EXIT:
+	return iomon;
+}
+
+/** Finish setting up chunk / batch I/O monitor
+ *
+ * @param iomon      I/O monitor object
+ * @param chunk_size The number of bytes in each chunk
+ */
+static void mce_io_mon_setup_chunk(mce_io_mon_t *iomon, gulong chunk_size)
+{
+	GError *error = NULL;
+	gsize   size  = IOMON_CHUNK_READ_SIZE;
+
 	/* We only read this file in binary form */
 	g_io_channel_set_encoding(iomon->iochan, NULL, &error);
 	g_clear_error(&error);
@@ -1019,13 +1107,22 @@ mce_io_mon_t *mce_io_mon_register_chunk(const gint fd,
 	g_io_channel_set_flags(iomon->iochan, G_IO_FLAG_NONBLOCK, &error);
 	g_clear_error(&error);
 
+	/* Adjust read size to multiples of small sized chunks,
+	 * or size of one larger chunk */
+	if( chunk_size < size )
+		size -= size % chunk_size;
+	else
+		size = chunk_size;
+
+	/* Allocate read buffer once and reuse it for every read;
+	 * malloc alignment is sufficient for any chunk struct */
+	iomon->chunk_buf      = g_malloc(size);
+	iomon->chunk_buf_size = size;
+
 	/* Set the I/O monitor type and call resume to add an I/O watch */
 	iomon->type       = IOMON_CHUNK;
 	iomon->chunk_size = chunk_size;
 	mce_io_mon_resume(iomon);
-
-EXIT:
-	return iomon;
 }
 
 /**
@@ -1481,6 +1578,70 @@ void mce_close_output(output_state_t *output)
 		}
 		output->file = 0;
 	}
+
+	if( output && output->fd_open ) {
+		if( close(output->fd) == -1 ) {
+			mce_log(LL_WARN,"%s: can't close %s: %m", output->context, output->path);
+		}
+		output->fd = -1;
+		output->fd_open = FALSE;
+		output->prev_len = 0;
+	}
+}
+
+/**
+ * Write a string representation of a number via raw file descriptor
+ *
+ * The file is opened on the first write and kept open. Each write
+ * is a single pwrite() at offset zero; sysfs attributes ignore the
+ * file offset and the rest of the content, for other files content
+ * left over from longer previous writes is truncated.
+ *
+ * @param output control structure for writing to a file
+ * @param number The number to write
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean mce_write_number_string_to_fd(output_state_t *output,
+					      const gulong number)
+{
+	gboolean status = FALSE;
+	char     txt[24];
+	int      len = snprintf(txt, sizeof txt, "%lu", number);
+
+	if( !output->fd_open ) {
+		struct statfs fs;
+
+		output->fd = open(output->path,
+				  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				  0666);
+		if( output->fd == -1 ) {
+			mce_log(LL_ERR,"%s: can't open %s: %m", output->context, output->path);
+			goto EXIT;
+		}
+		output->fd_open = TRUE;
+		output->fd_truncate = (fstatfs(output->fd, &fs) == -1 ||
+				       fs.f_type != SYSFS_MAGIC);
+		output->prev_len = 0;
+	}
+
+	if( pwrite(output->fd, txt, len, 0) != len ) {
+		mce_log(LL_WARN,"%s: can't write %s: %m", output->context, output->path);
+		/* Start from clean state on the next write */
+		mce_close_output(output);
+		goto EXIT;
+	}
+
+	if( output->fd_truncate && len < output->prev_len &&
+	    ftruncate(output->fd, len) == -1 ) {
+		mce_log(LL_WARN,"%s: can't truncate %s: %m", output->context, output->path);
+	}
+
+	output->prev_len = len;
+	status = TRUE;
+
+EXIT:
+	return status;
 }
 
 /**
@@ -1518,6 +1679,11 @@ gboolean mce_write_number_string_to_file(output_state_t *output, const gulong nu
 		goto EXIT;
 	}
 
+	if( output->raw_mode && output->truncate_file ) {
+		status = mce_write_number_string_to_fd(output, number);
+		goto EXIT;
+	}
+
 	if( !output->file ) {
 		output->file = fopen(output->path, output->truncate_file ? "w" : "a");
 		if( !output->file ) {
@@ -1548,12 +1714,8 @@ gboolean mce_write_number_string_to_file(output_state_t *output, const gulong nu
 
 EXIT:
 
-	if( output->close_on_exit && output->file ) {
-		if( fclose(output->file) == EOF ) {
-			mce_log(LL_WARN,"%s: can't close %s: %m", output->context, output->path);
-		}
-		output->file = 0;
-	}
+	if( output->close_on_exit )
+		mce_close_output(output);
 
 	return status;
 }
@@ -55,6 +55,11 @@ typedef struct {
 	 *  FALSE to leave the file open */
 	gboolean close_on_exit;
 
+	/** TRUE to keep a raw file descriptor open and write with
+	 *  a single pwrite() instead of using stdio; applies only
+	 *  to outputs with truncate_file set */
+	gboolean raw_mode;
+
 	/* runtime configuration */
 
 	/** Path to the file, or NULL (in which case one misconfiguration
@@ -66,6 +71,19 @@ typedef struct {
 	/** Cached output stream, use mce_close_output() to close */
 	FILE *file;
 
+	/** Cached raw_mode file descriptor, valid when fd_open is TRUE */
+	int fd;
+
+	/** TRUE if fd is open, use mce_close_output() to close */
+	gboolean fd_open;
+
+	/** TRUE if shorter writes must be followed by ftruncate(),
+	 *  i.e. fd does not refer to a sysfs attribute */
+	gboolean fd_truncate;
+
+	/** Length of the previous raw_mode write, or 0 if none */
+	int prev_len;
+
 	/** TRUE if missing path configuration error has already been
 	 *  written for this file */
 	gboolean invalid_config_reported;
@@ -76,6 +94,19 @@ typedef struct mce_io_mon_t mce_io_mon_t;
 /** Callback function type for I/O monitor input notifications */
 typedef gboolean (*mce_io_mon_notify_cb)(gpointer data, gsize bytes_read);
 
+/** Callback function type for I/O monitor batched input notifications
+ *
+ * @param data   array of chunks
+ * @param chunks number of chunks in the array
+ *
+ * @return FALSE to get the remaining chunks (if any),
+ *         TRUE to flush all remaining chunks
+ */
+typedef gboolean (*mce_io_mon_batch_cb)(gpointer data, gsize chunks);
+
+/** Callback function type for detecting batch ending chunks */
+typedef gboolean (*mce_io_mon_frame_cb)(gconstpointer chunk);
+
 /** Callback function type for I/O monitor delete notifications */
 typedef void (*mce_io_mon_delete_cb)(mce_io_mon_t *iomon);
 
@@ -99,6 +130,14 @@ mce_io_mon_t *mce_io_mon_register_chunk(const gint fd,
 					mce_io_mon_delete_cb delete_cb,
 					gulong chunk_size);
 
+mce_io_mon_t *mce_io_mon_register_batch(const gint fd,
+					const gchar *const file,
+					error_policy_t error_policy,
+					mce_io_mon_batch_cb callback,
+					mce_io_mon_frame_cb frame_cb,
+					mce_io_mon_delete_cb delete_cb,
+					gulong chunk_size);
+
 void mce_io_mon_unregister(mce_io_mon_t *iomon);
 
 void mce_io_mon_unregister_list(GSList *list);
@@ -406,3 +406,68 @@ int64_t mce_lib_get_real_tick(void)
 {
 	return mce_lib_get_tick(CLOCK_REALTIME);
 }
+
+/** Largest grid used for aligning timer expirations [ms] */
+#define MCE_LIB_ALIGN_GRID_MAX 16000
+
+/** Align timer delay so that expirations get coalesced
+ *
+ * Picks the latest point on a time grid shared by all timers that
+ * falls within [now + delay, now + delay + slack]. Timers with
+ * overlapping windows then tend to expire at the same grid point
+ * and share a single wakeup.
+ *
+ * The grid is one second scaled by the largest power of two that
+ * still fits in the slack.
+ *
+ * @param now   current time stamp [ms]
+ * @param delay minimum delay [ms]
+ * @param slack how much the expiration can be postponed [ms]
+ *
+ * @return delay to use [ms]
+ */
+int mce_lib_align_delay(int64_t now, int delay, int slack)
+{
+	int64_t grid = 1000;
+	int64_t lo, hi;
+
+	if( delay < 0 || slack <= 0 )
+		goto EXIT;
+
+	while( grid > slack )
+		grid /= 2;
+
+	while( grid * 2 <= slack && grid < MCE_LIB_ALIGN_GRID_MAX )
+		grid *= 2;
+
+	if( grid <= 1 )
+		goto EXIT;
+
+	lo = now + delay;
+	hi = lo + slack;
+	hi -= hi % grid;
+
+	if( hi > lo )
+		delay = (int)(hi - now);
+
+EXIT:
+	return delay;
+}
+
+/** Add glib timeout that can be delayed for wakeup coalescing
+ *
+ * @param delay minimum delay [ms]
+ * @param slack how much the expiration can be postponed [ms]
+ * @param func  timeout callback
+ * @param data  user data to pass to the callback
+ *
+ * @return glib source id
+ */
+guint mce_lib_timeout_add_slack(int delay, int slack,
+				GSourceFunc func, gpointer data)
+{
+	/* glib timeouts use CLOCK_MONOTONIC time base */
+	delay = mce_lib_align_delay(mce_lib_get_mono_tick(), delay, slack);
+
+	return g_timeout_add(delay, func, data);
+}
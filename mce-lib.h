@@ -61,4 +61,8 @@ int64_t mce_lib_get_boot_tick(void);
 int64_t mce_lib_get_mono_tick(void);
 int64_t mce_lib_get_real_tick(void);
 
+int mce_lib_align_delay(int64_t now, int delay, int slack);
+guint mce_lib_timeout_add_slack(int delay, int slack,
+				GSourceFunc func, gpointer data);
+
 #endif /* _MCE_LIB_H_ */
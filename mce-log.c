@@ -24,11 +24,16 @@
 #include "mce-log.h"
 
 #include <sys/time.h>
+#include <sys/eventfd.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 #include <fnmatch.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <glib/gprintf.h>
 
@@ -36,6 +41,23 @@ static unsigned int logverbosity = LL_WARN;	/**< Log verbosity */
 static int logtype = MCE_LOG_STDERR;		/**< Output for log messages */
 static char *logname = NULL;
 
+/** Log predicate cache generation
+ *
+ * Starts from non-zero so that zero initialized call site
+ * caches are considered stale.
+ */
+unsigned mce_log_generation = 1;
+
+/** Invalidate cached log predicate results at all call sites
+ */
+static void mce_log_invalidate_sites(void)
+{
+	/* Skip values that would make the key zero */
+	do
+		++mce_log_generation;
+	while( (mce_log_generation << 4) == 0 );
+}
+
 /** Get process identity to use for logging
  *
  * Will default to "mce" before mce_log_open() and after mce_log_close().
@@ -52,11 +74,11 @@ static void monotime(struct timeval *tv)
 	clock_gettime(CLOCK_BOOTTIME, &ts);
 	TIMESPEC_TO_TIMEVAL(tv, &ts);
 }
+/** Convert log time stamp to time since start of logging burst */
 static void timestamp(struct timeval *tv)
 {
 	static struct timeval start, prev;
 	struct timeval diff;
-	monotime(tv);
 	if( !timerisset(&start) )
 		prev = start = *tv;
 	timersub(tv, &prev, &diff);
@@ -157,6 +179,369 @@ EXIT:
 	return str;
 }
 
+/** Write formatted message to stderr or syslog
+ *
+ * @param loglevel The level of severity for this message
+ * @param tv       Time the message was logged
+ * @param file     Source file name, or NULL
+ * @param function Function name, or NULL
+ * @param msg      Formatted message; gets modified
+ */
+static void mce_log_emit(loglevel_t loglevel, struct timeval *tv,
+			 const char *file, const char *function, char *msg)
+{
+	gchar *tmp = 0;
+
+	if( file && function ) {
+		tmp = g_strconcat(file, ": ", function, "(): ",
+				  mce_log_strip_string(msg), NULL);
+		msg = tmp;
+	}
+
+	if (logtype == MCE_LOG_STDERR) {
+		timestamp(tv);
+		fprintf(stderr, "%s: T+%ld.%03ld %s: %s\n",
+			mce_log_name(),
+			(long)tv->tv_sec, (long)(tv->tv_usec/1000),
+			mce_log_level_tag(loglevel),
+			msg);
+	} else {
+		/* LL_EXTRA = devel flavor notice */
+		if( loglevel == LL_EXTRA )
+			loglevel = LL_NOTICE;
+
+		/* loglevels are subset of syslog priorities, so
+		 * we can use loglevel as is for syslog priority */
+		syslog(loglevel, "%s", msg);
+	}
+
+	g_free(tmp);
+}
+
+/* ========================================================================= *
+ * ASYNC_LOGGING
+ *
+ * When enabled, messages are formatted into a fixed size slot in a
+ * lock-free ring buffer and the potentially blocking stderr / syslog
+ * writes are done by a background thread. Producers never block or
+ * allocate memory; if the ring is full the message is dropped and
+ * counted instead.
+ *
+ * The ring is a bounded multi producer queue: each slot carries a
+ * sequence number telling whether it is free for the producer that
+ * claimed the position, or holds a message for the consumer.
+ * ========================================================================= */
+
+/** Number of slots in the log ring; must be power of two */
+#define MCE_LOG_RING_SIZE 1024
+
+/** Maximum length of a message stored in the log ring */
+#define MCE_LOG_RING_TEXT 256
+
+/** Marker replacing the tail of messages that did not fit in a slot */
+#define MCE_LOG_RING_TRUNCATED "..."
+
+/** Log ring slot */
+typedef struct {
+	unsigned        seq;		/**< Slot state, see above */
+	loglevel_t      level;		/**< Message level */
+	struct timeval  tv;		/**< Time the message was logged */
+	const char     *file;		/**< Call site file, static string */
+	const char     *function;	/**< Call site function, static string */
+	char            text[MCE_LOG_RING_TEXT]; /**< Formatted message */
+} mce_log_slot_t;
+
+/** Log message ring */
+static mce_log_slot_t mce_log_ring[MCE_LOG_RING_SIZE];
+
+/** Next position to be claimed by producers */
+static unsigned mce_log_ring_head = 0;
+
+/** Next position to be consumed
+ *
+ * Modified only while holding mce_log_ring_mutex, but also peeked
+ * at without locking by the writer thread - use atomic access. */
+static unsigned mce_log_ring_tail = 0;
+
+/** Number of messages dropped due to full ring */
+static unsigned mce_log_ring_dropped = 0;
+
+/** Serializes consumers: writer thread and mce_log_flush() */
+static pthread_mutex_t mce_log_ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Asynchronous logging is active */
+static bool mce_log_async_active = false;
+
+/** Writer thread should exit */
+static int mce_log_async_stop = 0;
+
+/** Writer thread is about to sleep and needs a wakeup */
+static int mce_log_async_sleeping = 0;
+
+/** Eventfd for waking up the writer thread */
+static int mce_log_async_wakeup_fd = -1;
+
+/** Writer thread id */
+static pthread_t mce_log_async_thread;
+
+/** Store message to the log ring
+ *
+ * @param loglevel The level of severity for this message
+ * @param tv       Time the message was logged
+ * @param file     Source file name, or NULL
+ * @param function Function name, or NULL
+ * @param fmt      The format string for this message
+ * @param va       Input to the format string
+ */
+static void mce_log_ring_push(loglevel_t loglevel, const struct timeval *tv,
+			      const char *file, const char *function,
+			      const char *fmt, va_list va)
+{
+	unsigned        pos  = __atomic_load_n(&mce_log_ring_head,
+					       __ATOMIC_RELAXED);
+	mce_log_slot_t *slot = 0;
+
+	for( ;; ) {
+		slot = mce_log_ring + pos % MCE_LOG_RING_SIZE;
+
+		unsigned seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		int      dif = (int)(seq - pos);
+
+		if( dif < 0 ) {
+			/* Slot not yet consumed = ring is full */
+			__atomic_add_fetch(&mce_log_ring_dropped, 1,
+					   __ATOMIC_RELAXED);
+			goto EXIT;
+		}
+
+		if( dif > 0 ) {
+			/* Claimed by another producer, retry */
+			pos = __atomic_load_n(&mce_log_ring_head,
+					      __ATOMIC_RELAXED);
+			continue;
+		}
+
+		if( __atomic_compare_exchange_n(&mce_log_ring_head, &pos,
+						pos + 1, false,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED) )
+			break;
+	}
+
+	slot->level    = loglevel;
+	slot->tv       = *tv;
+	slot->file     = file;
+	slot->function = function;
+
+	if( vsnprintf(slot->text, sizeof slot->text, fmt, va) >=
+	    (int)sizeof slot->text ) {
+		memcpy(slot->text + sizeof slot->text -
+		       sizeof MCE_LOG_RING_TRUNCATED,
+		       MCE_LOG_RING_TRUNCATED,
+		       sizeof MCE_LOG_RING_TRUNCATED);
+	}
+
+	/* Publish to the consumer */
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+
+	/* Wake up writer thread if needed */
+	if( __atomic_exchange_n(&mce_log_async_sleeping, 0, __ATOMIC_SEQ_CST) ) {
+		uint64_t cnt = 1;
+		if( write(mce_log_async_wakeup_fd, &cnt, sizeof cnt) == -1 ) {
+			/* Counter saturated = wakeup pending anyway */
+		}
+	}
+
+EXIT:
+	return;
+}
+
+/** Predicate for: there is a message waiting to be written
+ *
+ * @return true if the ring is not empty, false otherwise
+ */
+static bool mce_log_ring_pending(void)
+{
+	unsigned        pos  = __atomic_load_n(&mce_log_ring_tail,
+					       __ATOMIC_SEQ_CST);
+	mce_log_slot_t *slot = mce_log_ring + pos % MCE_LOG_RING_SIZE;
+
+	return __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == pos + 1;
+}
+
+/** Write out all messages in the log ring; mce_log_ring_mutex must be held
+ */
+static void mce_log_ring_drain(void)
+{
+	char     text[MCE_LOG_RING_TEXT];
+	unsigned dropped;
+
+	while( mce_log_ring_pending() ) {
+		unsigned        pos  = __atomic_load_n(&mce_log_ring_tail,
+						       __ATOMIC_RELAXED);
+		mce_log_slot_t *slot = mce_log_ring + pos % MCE_LOG_RING_SIZE;
+
+		loglevel_t      level    = slot->level;
+		struct timeval  tv       = slot->tv;
+		const char     *file     = slot->file;
+		const char     *function = slot->function;
+
+		memcpy(text, slot->text, sizeof text);
+
+		/* Release the slot before the slow write */
+		__atomic_store_n(&mce_log_ring_tail, pos + 1,
+				 __ATOMIC_SEQ_CST);
+		__atomic_store_n(&slot->seq, pos + MCE_LOG_RING_SIZE,
+				 __ATOMIC_RELEASE);
+
+		mce_log_emit(level, &tv, file, function, text);
+	}
+
+	dropped = __atomic_exchange_n(&mce_log_ring_dropped, 0,
+				      __ATOMIC_RELAXED);
+	if( dropped ) {
+		struct timeval tv;
+		monotime(&tv);
+		snprintf(text, sizeof text,
+			 "%u log messages dropped due to full buffer", dropped);
+		mce_log_emit(LL_WARN, &tv, 0, 0, text);
+	}
+}
+
+/** Write out all messages in the log ring
+ *
+ * Can be used for dumping buffered messages on demand, e.g. before
+ * an orderly exit. Messages are written in the calling thread.
+ */
+void mce_log_flush(void)
+{
+	if( !mce_log_async_active )
+		goto EXIT;
+
+	pthread_mutex_lock(&mce_log_ring_mutex);
+	mce_log_ring_drain();
+	pthread_mutex_unlock(&mce_log_ring_mutex);
+
+EXIT:
+	return;
+}
+
+/** Write out messages in the log ring on abnormal exit
+ *
+ * Best effort variant of mce_log_flush() for exit paths that might
+ * be running in signal handler context: nothing is written if the
+ * ring is being flushed by some other thread, or by the code that
+ * got interrupted.
+ */
+void mce_log_flush_on_exit(void)
+{
+	if( !mce_log_async_active )
+		goto EXIT;
+
+	if( pthread_mutex_trylock(&mce_log_ring_mutex) != 0 )
+		goto EXIT;
+
+	mce_log_ring_drain();
+	pthread_mutex_unlock(&mce_log_ring_mutex);
+
+EXIT:
+	return;
+}
+
+/** Writer thread entry point
+ *
+ * @param aptr (unused)
+ *
+ * @return NULL
+ */
+static void *mce_log_async_main(void *aptr)
+{
+	(void)aptr;
+
+	while( !__atomic_load_n(&mce_log_async_stop, __ATOMIC_ACQUIRE) ) {
+		mce_log_flush();
+
+		/* Announce sleeping, then recheck to avoid missed wakeups */
+		__atomic_store_n(&mce_log_async_sleeping, 1, __ATOMIC_SEQ_CST);
+		if( mce_log_ring_pending() )
+			continue;
+
+		struct pollfd pfd = {
+			.fd     = mce_log_async_wakeup_fd,
+			.events = POLLIN,
+		};
+		uint64_t cnt = 0;
+
+		if( poll(&pfd, 1, -1) == 1 &&
+		    read(mce_log_async_wakeup_fd, &cnt, sizeof cnt) == -1 ) {
+			/* EAGAIN = spurious wakeup */
+		}
+	}
+
+	return 0;
+}
+
+/** Start writing log messages from a background thread
+ *
+ * Should be called after daemonizing, as threads do not survive fork().
+ */
+void mce_log_start_async(void)
+{
+	int fd = -1;
+
+	if( mce_log_async_active )
+		goto EXIT;
+
+	if( (fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1 )
+		goto EXIT;
+
+	for( unsigned i = 0; i < MCE_LOG_RING_SIZE; ++i )
+		mce_log_ring[i].seq = i;
+
+	mce_log_ring_head = 0;
+	mce_log_ring_tail = 0;
+	mce_log_async_wakeup_fd = fd;
+	__atomic_store_n(&mce_log_async_stop, 0, __ATOMIC_RELEASE);
+
+	if( pthread_create(&mce_log_async_thread, 0, mce_log_async_main, 0) )
+		goto EXIT;
+
+	mce_log_async_active = true, fd = -1;
+
+EXIT:
+	if( fd != -1 ) {
+		mce_log_async_wakeup_fd = -1;
+		close(fd);
+	}
+	return;
+}
+
+/** Stop background log writer thread and flush pending messages
+ */
+static void mce_log_stop_async(void)
+{
+	uint64_t cnt = 1;
+
+	if( !mce_log_async_active )
+		goto EXIT;
+
+	__atomic_store_n(&mce_log_async_stop, 1, __ATOMIC_RELEASE);
+	if( write(mce_log_async_wakeup_fd, &cnt, sizeof cnt) == -1 ) {
+		/* Counter saturated = wakeup pending anyway */
+	}
+	pthread_join(mce_log_async_thread, 0);
+
+	/* Write out whatever got logged while the thread was exiting */
+	mce_log_flush();
+
+	mce_log_async_active = false;
+
+	close(mce_log_async_wakeup_fd), mce_log_async_wakeup_fd = -1;
+
+EXIT:
+	return;
+}
+
 /**
  * Log debug message with optional filename and function name attached
  *
@@ -172,35 +557,21 @@ void mce_log_file(loglevel_t loglevel, const char *const file,
 	loglevel = mce_log_level_normalize(loglevel);
 
 	if( mce_log_p_(loglevel, file, function) ) {
+		struct timeval tv;
 		gchar *msg = 0;
 
+		monotime(&tv);
+
 		va_start(args, fmt);
-		g_vasprintf(&msg, fmt, args);
+		if( mce_log_async_active )
+			mce_log_ring_push(loglevel, &tv, file, function,
+					  fmt, args);
+		else
+			g_vasprintf(&msg, fmt, args);
 		va_end(args);
 
-		if( file && function ) {
-			gchar *tmp = g_strconcat(file, ": ", function, "(): ",
-						 mce_log_strip_string(msg), NULL);
-			g_free(msg), msg = tmp;
-		}
-
-		if (logtype == MCE_LOG_STDERR) {
-			struct timeval tv;
-			timestamp(&tv);
-			fprintf(stderr, "%s: T+%ld.%03ld %s: %s\n",
-				mce_log_name(),
-				(long)tv.tv_sec, (long)(tv.tv_usec/1000),
-				mce_log_level_tag(loglevel),
-				msg);
-		} else {
-			/* LL_EXTRA = devel flavor notice */
-			if( loglevel == LL_EXTRA )
-				loglevel = LL_NOTICE;
-
-			/* loglevels are subset of syslog priorities, so
-			 * we can use loglevel as is for syslog priority */
-			syslog(loglevel, "%s", msg);
-		}
+		if( msg )
+			mce_log_emit(loglevel, &tv, file, function, msg);
 
 		g_free(msg);
 	}
@@ -215,6 +586,7 @@ void mce_log_file(loglevel_t loglevel, const char *const file,
 void mce_log_set_verbosity(const int verbosity)
 {
 	logverbosity = verbosity;
+	mce_log_invalidate_sites();
 }
 
 /**
@@ -238,6 +610,9 @@ void mce_log_open(const char *const name, const int facility, const int type)
  */
 void mce_log_close(void)
 {
+	/* Write out buffered messages */
+	mce_log_stop_async();
+
 	/* Logging (to stderr) after this will use default identity */
 	g_free(logname), logname = 0;
 
@@ -259,6 +634,11 @@ void mce_log_add_pattern(const char *pat)
 		mce_log_functions = g_hash_table_new_full(g_str_hash,
 							  g_str_equal,
 							  free, 0);
+
+	/* Forget cached pattern match results */
+	g_hash_table_remove_all(mce_log_functions);
+
+	mce_log_invalidate_sites();
 }
 
 static bool mce_log_check_pattern(const char *func)
@@ -313,4 +693,27 @@ int mce_log_p_(const loglevel_t loglevel,
 	return logverbosity >= loglevel;
 }
 
+/** Evaluate and cache log level predicate for a call site
+ *
+ * Slow path of mce_log_p(), used only when the cached decision
+ * is missing or stale.
+ *
+ * @param site     call site cache
+ * @param key      cache key to store
+ * @param loglevel level of logging we might do
+ * @param file     source file of the call site
+ * @param function function of the call site
+ *
+ * @return 1 if logging at givel level is enabled, 0 if not
+ */
+int mce_log_site_update_(mce_log_site_t *site, unsigned key,
+			 const loglevel_t loglevel,
+			 const char *const file, const char *const function)
+{
+	site->enabled = mce_log_p_(loglevel, file, function);
+	site->key     = key;
+
+	return site->enabled;
+}
+
 #endif /* OSSOLOG_COMPILE */
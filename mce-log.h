@@ -48,21 +48,49 @@ typedef enum {
 } loglevel_t;
 
 # ifdef OSSOLOG_COMPILE
+
+/** Cached log predicate result for one mce_log() call site
+ *
+ * The cached decision is valid as long as the key matches the
+ * current mce_log_generation combined with the level used.
+ */
+typedef struct {
+	unsigned key;		/**< Generation and level of the decision */
+	int      enabled;	/**< Cached mce_log_p_() result */
+} mce_log_site_t;
+
+/** Bumped whenever verbosity or function patterns change */
+extern unsigned mce_log_generation;
+
 void mce_log_add_pattern(const char *pat);
 void mce_log_set_verbosity(const int verbosity);
 
 int  mce_log_p_(const loglevel_t loglevel,
 		const char *const file, const char *const function);
 
+int  mce_log_site_update_(mce_log_site_t *site, unsigned key,
+			  const loglevel_t loglevel,
+			  const char *const file, const char *const function);
+
 void mce_log_file(loglevel_t loglevel, const char *const file,
 		  const char *const function, const char *const fmt, ...)
 		  __attribute__((format(printf, 4, 5)));
 
 void mce_log_open(const char *const name, const int facility, const int type);
 void mce_log_close(void);
+void mce_log_start_async(void);
+void mce_log_flush(void);
+void mce_log_flush_on_exit(void);
 
-#  define mce_log_p(LEV_)\
-	mce_log_p_(LEV_,__FILE__,__FUNCTION__)
+#  define mce_log_p(LEV_) ({\
+	static mce_log_site_t mce_log_site_;\
+	loglevel_t mce_log_lev_ = (LEV_);\
+	unsigned   mce_log_key_ = (mce_log_generation << 4) |\
+				  (mce_log_lev_ & 15);\
+	(mce_log_site_.key == mce_log_key_) ? mce_log_site_.enabled :\
+	mce_log_site_update_(&mce_log_site_, mce_log_key_, mce_log_lev_,\
+			     __FILE__, __FUNCTION__);\
+})
 
 #  define mce_log_raw(LEV_, FMT_, ARGS_...)\
 	mce_log_file(LEV_, NULL, NULL, FMT_ , ## ARGS_)
@@ -80,6 +108,9 @@ void mce_log_close(void);
 #  define mce_log_set_verbosity(LEV_)           do {} while (0)
 #  define mce_log_open(NAME_, FACILITY_, TYPE_) do {} while (0)
 #  define mce_log_close()                       do {} while (0)
+#  define mce_log_start_async()                 do {} while (0)
+#  define mce_log_flush()                       do {} while (0)
+#  define mce_log_flush_on_exit()               do {} while (0)
 #  define mce_log_p(LEV_)                       0
 #  define mce_log(LEV_, FMT_, ...)              do {} while (0)
 #  define mce_log_raw(LEV_, FMT_, ARGS_...)     do {} while (0)
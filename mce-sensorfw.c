@@ -264,6 +264,12 @@
 /** Connect path to sensord data unix domain socket  */
 #define SENSORFW_DATA_SOCKET                   "/var/run/sensord.sock"
 
+/** Size of per connection receive buffer; must be a power of two */
+#define SENSORFW_RX_RING_SIZE                  4096
+
+/** Maximum number of samples passed to plugins in one go */
+#define SENSORFW_MAX_BATCH                     256
+
 // ----------------------------------------------------------------
 
 /** Name of proximity sensor */
@@ -346,6 +352,10 @@ typedef void (*sfw_sample_fn)(sfw_plugin_t *plugin, const void *sample);
 /** Callback function type: value reset reporting */
 typedef void (*sfw_reset_fn)(sfw_plugin_t *plugin);
 
+/** Callback function type: sample batch reporting */
+typedef void (*sfw_batch_fn)(sfw_plugin_t *plugin, const void *samples,
+                             size_t count);
+
 /** Sensor specific data and callbacks */
 struct sfw_backend_t
 {
@@ -364,6 +374,9 @@ struct sfw_backend_t
     /** Callback for handling sensor data blob */
     sfw_sample_fn be_sample_cb;
 
+    /** Callback for handling all sensor data blobs received in one go */
+    sfw_batch_fn  be_batch_cb;
+
     /** D-Bus method name for querying the initial sensor value */
     const char   *be_value_method;
 
@@ -581,6 +594,26 @@ struct sfw_connection_t
 
     /** Timer for: Retry after ipc error */
     guint                   con_retry_id;
+
+    /** Receive ring buffer, SENSORFW_RX_RING_SIZE bytes */
+    uint8_t                *con_rx_ring;
+
+    /** Ring buffer write position; wraps at UINT32_MAX */
+    uint32_t                con_rx_head;
+
+    /** Ring buffer read position; wraps at UINT32_MAX */
+    uint32_t                con_rx_tail;
+
+    /** Samples still expected for current packet
+     *
+     * Zero while waiting for the sample count header. */
+    uint32_t                con_rx_expect;
+
+    /** Complete samples waiting to be passed to the plugin */
+    uint8_t                *con_batch;
+
+    /** Number of samples in con_batch */
+    size_t                  con_batch_count;
 };
 
 static const char       *sfw_connection_state_name      (sfw_connection_state_t state);
@@ -588,7 +621,11 @@ static const char       *sfw_connection_state_name      (sfw_connection_state_t
 static sfw_connection_t *sfw_connection_create          (sfw_plugin_t *plugin);
 static void              sfw_connection_delete          (sfw_connection_t *self);
 
-static bool              sfw_connection_handle_samples  (sfw_connection_t *self, char *data, size_t size);
+static size_t            sfw_connection_rx_used         (const sfw_connection_t *self);
+static void              sfw_connection_rx_take         (sfw_connection_t *self, void *data, size_t size);
+static void              sfw_connection_rx_flush        (sfw_connection_t *self);
+static void              sfw_connection_handle_samples  (sfw_connection_t *self);
+static bool              sfw_connection_parse_samples   (sfw_connection_t *self);
 
 static int               sfw_connection_get_session_id  (const sfw_connection_t *self);
 
@@ -751,6 +788,7 @@ static int               sfw_plugin_get_session_id      (const sfw_plugin_t *sel
 static const char       *sfw_plugin_get_value_method    (const sfw_plugin_t *self);
 static size_t            sfw_plugin_get_sample_size     (const sfw_plugin_t *self);
 static void              sfw_plugin_handle_sample       (sfw_plugin_t *self, const void *sample);
+static void              sfw_plugin_handle_batch        (sfw_plugin_t *self, const void *samples, size_t count);
 static void              sfw_plugin_handle_value        (sfw_plugin_t *self, unsigned value);
 static void              sfw_plugin_reset_value         (sfw_plugin_t *self);
 static void              sfw_plugin_restore_value       (sfw_plugin_t *self);
@@ -892,6 +930,8 @@ static gboolean          sfw_name_owner_changed_cb      (DBusMessage *const msg)
 static void              sfw_notify_ps                  (sfw_notify_t type, bool covered);
 static void              sfw_notify_als                 (sfw_notify_t type, unsigned lux);
 static void              sfw_notify_orient              (sfw_notify_t type, int state);
+static bool              sfw_notify_als_batch_wanted    (void);
+static void              sfw_notify_als_batch           (const mce_sensorfw_sample_t *samples, size_t count);
 
 /* ========================================================================= *
  * SENSORFW_EXCEPTION
@@ -969,6 +1009,33 @@ sfw_backend_orient_sample_cb(sfw_plugin_t *plugin, const void *sample)
 
 // ----------------------------------------------------------------
 
+/** Callback for handling batches of ambient light events from sensord */
+static void
+sfw_backend_als_batch_cb(sfw_plugin_t *plugin, const void *samples,
+                         size_t count)
+{
+    (void)plugin;
+
+    const sfw_sample_als_t *self = samples;
+    mce_sensorfw_sample_t vec[SENSORFW_MAX_BATCH];
+
+    /* Skip conversion if nobody is interested */
+    if( !sfw_notify_als_batch_wanted() )
+        goto EXIT;
+
+    for( size_t i = 0; i < count; ++i ) {
+        vec[i].time  = self[i].als_timestamp;
+        vec[i].value = self[i].als_value;
+    }
+
+    sfw_notify_als_batch(vec, count);
+
+EXIT:
+    return;
+}
+
+// ----------------------------------------------------------------
+
 /** Callback for handling reply to ambient light query from sensord */
 static void
 sfw_backend_als_value_cb(sfw_plugin_t *plugin, unsigned value)
@@ -1084,6 +1151,7 @@ static const sfw_backend_t sfw_backend_ps =
 
     .be_sample_size      = sizeof(sfw_sample_ps_t),
     .be_sample_cb        = sfw_backend_ps_sample_cb,
+    .be_batch_cb         = 0,
 
     .be_value_method     = SENSORFW_SENSOR_METHOD_READ_PS,
     .be_value_cb         = sfw_backend_ps_value_cb,
@@ -1102,6 +1170,7 @@ static const sfw_backend_t sfw_backend_als =
 
     .be_sample_size      = sizeof(sfw_sample_als_t),
     .be_sample_cb        = sfw_backend_als_sample_cb,
+    .be_batch_cb         = sfw_backend_als_batch_cb,
 
     .be_value_method     = SENSORFW_SENSOR_METHOD_READ_ALS,
     .be_value_cb         = sfw_backend_als_value_cb,
@@ -1120,6 +1189,7 @@ static const sfw_backend_t sfw_backend_orient =
 
     .be_sample_size      = sizeof(sfw_sample_orient_t),
     .be_sample_cb        = sfw_backend_orient_sample_cb,
+    .be_batch_cb         = 0,
 
     .be_value_method     = SENSORFW_SENSOR_METHOD_READ_ORIENT,
     .be_value_cb         = sfw_backend_orient_value_cb,
@@ -1927,51 +1997,116 @@ sfw_connection_get_session_id(const sfw_connection_t *self)
     return sfw_plugin_get_session_id(self->con_plugin);
 }
 
-/** Handle array of sensor events sent by sensord
+/** Get number of received bytes not yet parsed
  */
-static bool
-sfw_connection_handle_samples(sfw_connection_t *self,
-                              char *data, size_t size)
+static size_t
+sfw_connection_rx_used(const sfw_connection_t *self)
 {
-    bool     res    = false;
-    uint32_t count  = 0;
-    uint32_t block  = sfw_plugin_get_sample_size(self->con_plugin);
-    void    *sample = 0;
+    return self->con_rx_head - self->con_rx_tail;
+}
 
-    while( size > 0 ) {
-        if( size < sizeof count ) {
-            mce_log(LL_ERR, "connection(%s): received invalid packet",
-                    sfw_plugin_get_sensor_name(self->con_plugin));
-            goto EXIT;
-        }
+/** Remove bytes from the receive ring buffer
+ *
+ * The caller must make sure that enough data is available.
+ */
+static void
+sfw_connection_rx_take(sfw_connection_t *self, void *data, size_t size)
+{
+    size_t pos  = self->con_rx_tail & (SENSORFW_RX_RING_SIZE - 1);
+    size_t part = SENSORFW_RX_RING_SIZE - pos;
 
-        memcpy(&count, data, sizeof count);
-        data += sizeof count;
-        size -= sizeof count;
+    if( part > size )
+        part = size;
 
-        if( size < count * block ) {
-            mce_log(LL_ERR, "connection(%s): received invalid sample",
-                    sfw_plugin_get_sensor_name(self->con_plugin));
-            goto EXIT;
-        }
+    memcpy(data, self->con_rx_ring + pos, part);
+    memcpy((uint8_t *)data + part, self->con_rx_ring, size - part);
 
-        if( count > 0 ) {
-            sample = data + block * (count - 1);
-            data += block * count;
-            size -= block * count;
-        }
+    self->con_rx_tail += size;
+}
+
+/** Discard buffered data and reset packet parsing state
+ */
+static void
+sfw_connection_rx_flush(sfw_connection_t *self)
+{
+    self->con_rx_head     = 0;
+    self->con_rx_tail     = 0;
+    self->con_rx_expect   = 0;
+    self->con_batch_count = 0;
+}
+
+/** Pass collected sensor samples to the plugin
+ */
+static void
+sfw_connection_handle_samples(sfw_connection_t *self)
+{
+    size_t count = self->con_batch_count;
+
+    if( count > 0 ) {
+        self->con_batch_count = 0;
+        sfw_plugin_handle_batch(self->con_plugin, self->con_batch, count);
     }
+}
 
-    if( !sample ) {
-            mce_log(LL_ERR, "connection(%s): no sample was received",
-                    sfw_plugin_get_sensor_name(self->con_plugin));
-        goto EXIT;
+/** Parse sensor event packets from the receive ring buffer
+ *
+ * Sensord sends packets consisting of 32-bit sample count followed
+ * by that many fixed size samples. Packets are not guaranteed to
+ * arrive in one read, so parsing is done incrementally: header
+ * and samples are consumed only when complete and the rest is left
+ * in the buffer until more data is received.
+ *
+ * Complete samples are collected and passed to the plugin in
+ * batches of at most SENSORFW_MAX_BATCH samples.
+ *
+ * @return true on success, or false on protocol errors
+ */
+static bool
+sfw_connection_parse_samples(sfw_connection_t *self)
+{
+    bool   res   = false;
+    size_t block = sfw_plugin_get_sample_size(self->con_plugin);
+
+    for( ;; ) {
+        if( self->con_rx_expect == 0 ) {
+            /* Waiting for sample count */
+            uint32_t count = 0;
+
+            if( sfw_connection_rx_used(self) < sizeof count )
+                break;
+
+            sfw_connection_rx_take(self, &count, sizeof count);
+
+            /* Sanity check: sensord sends what it has buffered,
+             * which is nowhere near billions of samples */
+            if( count > INT32_MAX / block ) {
+                mce_log(LL_ERR, "connection(%s): received invalid packet",
+                        sfw_plugin_get_sensor_name(self->con_plugin));
+                goto EXIT;
+            }
+
+            self->con_rx_expect = count;
+        }
+        else {
+            /* Waiting for samples */
+            if( sfw_connection_rx_used(self) < block )
+                break;
+
+            if( self->con_batch_count == SENSORFW_MAX_BATCH )
+                sfw_connection_handle_samples(self);
+
+            sfw_connection_rx_take(self, self->con_batch +
+                                   block * self->con_batch_count, block);
+            self->con_batch_count += 1;
+            self->con_rx_expect   -= 1;
+        }
     }
 
     res = true;
-    sfw_plugin_handle_sample(self->con_plugin, sample);
 
 EXIT:
+    sfw_connection_handle_samples(self);
+
     return res;
 }
 
@@ -2028,15 +2163,30 @@ EXIT:
 static bool
 sfw_connection_rx_dta(sfw_connection_t *self)
 {
-    bool    res = false;
-
-    char    dta[1024];
+    bool res = false;
 
     if( self->con_fd == -1 )
         goto EXIT;
 
+    /* Read as much as fits in contiguous free space; if there is
+     * more, we get called again on the next mainloop iteration */
+    size_t used = sfw_connection_rx_used(self);
+    size_t pos  = self->con_rx_head & (SENSORFW_RX_RING_SIZE - 1);
+    size_t size = SENSORFW_RX_RING_SIZE - pos;
+
+    if( size > SENSORFW_RX_RING_SIZE - used )
+        size = SENSORFW_RX_RING_SIZE - used;
+
+    /* The parser always consumes complete headers and samples,
+     * so the buffer can't fill up with unparseable data */
+    if( size == 0 ) {
+        mce_log(LL_ERR, "connection(%s): receive buffer overflow",
+                sfw_plugin_get_sensor_name(self->con_plugin));
+        goto EXIT;
+    }
+
     errno = 0;
-    int rc = read(self->con_fd, dta, sizeof dta);
+    int rc = read(self->con_fd, self->con_rx_ring + pos, size);
 
     if( rc == 0 ) {
         mce_log(LL_ERR, "connection(%s): received EOF",
@@ -2056,19 +2206,9 @@ sfw_connection_rx_dta(sfw_connection_t *self)
     mce_log(LL_DEBUG, "connection(%s): received %d bytes",
             sfw_plugin_get_sensor_name(self->con_plugin), rc);
 
-    /* Note: Writing smallish chunks to unix domain socket
-     *       either fully succeeds or fails/sender blocks.
-     *
-     *       With this in mind it is assumed that a succesful
-     *       read will contain fully valid sample data. However,
-     *       depending on how sensord actually does the sending,
-     *       there is a slight hazard point here...
-     *
-     *       It might be that separate state needs to be
-     *       introduced for handling header (sample count)
-     *       and payload (sensor samples) separately.
-     */
-    res = sfw_connection_handle_samples(self, dta, rc);
+    self->con_rx_head += rc;
+
+    res = sfw_connection_parse_samples(self);
 
 EXIT:
     return res;
@@ -2196,6 +2336,8 @@ sfw_connection_close_socket(sfw_connection_t *self)
         close(self->con_fd),
             self->con_fd = -1;
     }
+
+    sfw_connection_rx_flush(self);
 }
 
 /** Open sensord data connection
@@ -2341,6 +2483,11 @@ sfw_connection_create(sfw_plugin_t *plugin)
     self->con_tx_id    = 0;
     self->con_retry_id = 0;
 
+    self->con_rx_ring  = malloc(SENSORFW_RX_RING_SIZE);
+    self->con_batch    = malloc(SENSORFW_MAX_BATCH *
+                                sfw_plugin_get_sample_size(plugin));
+    sfw_connection_rx_flush(self);
+
     return self;
 }
 
@@ -2354,6 +2501,8 @@ sfw_connection_delete(sfw_connection_t *self)
     if( self ) {
         sfw_connection_trans(self, CONNECTION_INITIAL);
         self->con_plugin = 0;
+        free(self->con_rx_ring);
+        free(self->con_batch);
         free(self);
     }
 }
@@ -2708,6 +2857,29 @@ sfw_plugin_handle_sample(sfw_plugin_t *self, const void *sample)
         self->plg_backend->be_sample_cb(self, sample);
 }
 
+/** Handle all sensor specific change events received in one go
+ *
+ * The batch is offered to backend batch handler first, after which
+ * the latest sample is handled as usual.
+ */
+static void
+sfw_plugin_handle_batch(sfw_plugin_t *self, const void *samples,
+                        size_t count)
+{
+    if( count < 1 )
+        goto EXIT;
+
+    if( self->plg_backend->be_batch_cb )
+        self->plg_backend->be_batch_cb(self, samples, count);
+
+    size_t block = sfw_plugin_get_sample_size(self);
+    sfw_plugin_handle_sample(self, (const char *)samples +
+                             block * (count - 1));
+
+EXIT:
+    return;
+}
+
 /** Handle sensor specific initial value received via dbus query
  */
 static void
@@ -3379,6 +3551,9 @@ static void (*sfw_notify_als_cb)(int lux) = 0;
 /** Orientation change callback used for notifying upper level logic */
 static void (*sfw_notify_orient_cb)(int state) = 0;
 
+/** Ambient light sample batch callback, or NULL if batches are not wanted */
+static mce_sensorfw_batch_fn sfw_notify_als_batch_cb = 0;
+
 /** Translate notification type to human readable form
  */
 static const char *
@@ -3555,6 +3730,30 @@ EXIT:
     return;
 }
 
+/** Check if ambient light sample batches should be notified
+ *
+ * Batches are passed on only while sensord is the data source.
+ *
+ * @return true if batch callback is set, false otherwise
+ */
+static bool
+sfw_notify_als_batch_wanted(void)
+{
+    return sfw_notify_als_batch_cb && !als_evdev_id;
+}
+
+/** Notify ambient light sample batch via callback
+ *
+ * Batches are passed on only while sensord is the data source.
+ * The last sample is notified also via sfw_notify_als().
+ */
+static void
+sfw_notify_als_batch(const mce_sensorfw_sample_t *samples, size_t count)
+{
+    if( sfw_notify_als_batch_wanted() && count > 0 )
+        sfw_notify_als_batch_cb(samples, count);
+}
+
 /* ========================================================================= *
  * SENSORFW_EXCEPTION
  * ========================================================================= */
@@ -3673,6 +3872,19 @@ mce_sensorfw_als_set_notify(void (*cb)(int lux))
         sfw_notify_als(NOTIFY_REPEAT, 0);
 }
 
+/** Set ALS sample batch notification callback
+ *
+ * When set, all samples received from sensord are passed to
+ * the callback before the latest one is notified normally.
+ *
+ * @param cb function to call when ALS samples are received, or NULL
+ */
+void
+mce_sensorfw_als_set_batch_notify(mce_sensorfw_batch_fn cb)
+{
+    sfw_notify_als_batch_cb = cb;
+}
+
 /** Try to enable ALS input
  */
 void
@@ -3770,7 +3982,7 @@ mce_sensorfw_evdev_cb(GIOChannel *chn, GIOCondition cnd, gpointer aptr)
     struct input_event eve[256];
 
     /* wakelock must be taken before reading the data */
-    wakelock_lock("mce_input_handler", -1);
+    wakelock_acquire("mce_input_handler");
 
     if( cnd & (G_IO_ERR | G_IO_HUP | G_IO_NVAL) ) {
         goto EXIT;
@@ -3823,7 +4035,7 @@ EXIT:
     }
 
     /* wakelock must be released when we are done with the data */
-    wakelock_unlock("mce_input_handler");
+    wakelock_release("mce_input_handler");
 
     return keep;
 }
@@ -2,6 +2,8 @@
 # define MCE_SENSORFW_H_
 
 # include <stdbool.h>
+# include <stddef.h>
+# include <stdint.h>
 
 # ifdef __cplusplus
 extern "C" {
@@ -9,6 +11,20 @@ extern "C" {
 } /* fool JED indentation ... */
 # endif
 
+/** ALS sample as delivered to batch notification callbacks */
+typedef struct
+{
+    /** Sample time stamp from sensord [us, monotonic] */
+    uint64_t time;
+
+    /** Lux value */
+    int      value;
+} mce_sensorfw_sample_t;
+
+/** Callback function type: all samples received from sensord in one go */
+typedef void (*mce_sensorfw_batch_fn)(const mce_sensorfw_sample_t *samples,
+                                      size_t count);
+
 bool mce_sensorfw_init(void);
 void mce_sensorfw_quit(void);
 
@@ -17,6 +33,7 @@ void mce_sensorfw_resume(void);
 
 void mce_sensorfw_als_attach(int fd);
 void mce_sensorfw_als_set_notify(void (*cb)(int lux));
+void mce_sensorfw_als_set_batch_notify(mce_sensorfw_batch_fn cb);
 void mce_sensorfw_als_enable(void);
 void mce_sensorfw_als_disable(void);
 
@@ -0,0 +1,223 @@
+/**
+ * @file mce-trace.c
+ * Flight recorder trace buffer for Mode Control Entity
+ * <p>
+ * Diagnosing things like missed display unblanking from logs
+ * requires verbose logging to be enabled before the problem occurs.
+ * To allow looking at what happened after the fact, a fixed size
+ * ring buffer of small binary records is kept always on. Records
+ * carry a boot time stamp, record type, interned name and two
+ * type specific integer values; formatting is left to the
+ * tools/mcetrace decoder.
+ * <p>
+ * Adding a record costs one clock_gettime() call and a store to
+ * static memory. Names are interned into small integers so that
+ * callers that trace the same name repeatedly can cache the id.
+ * <p>
+ * The buffer is accessed from the main thread only.
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mce-trace.h"
+
+#include "mce-log.h"
+
+#include <glib.h>
+
+#include <string.h>
+#include <time.h>
+
+/** Ring buffer of trace records */
+static mce_trace_record_t mce_trace_ring[MCE_TRACE_RECORDS];
+
+/** Sequence number of the next record to add
+ *
+ * Kept 64-bit so that the ring position and dropped record count
+ * stay valid however long mce runs.
+ */
+static uint64_t mce_trace_seq = 0;
+
+/** Interned names, indexed by name id */
+static char *mce_trace_name_tab[MCE_TRACE_NAMES];
+
+/** Number of interned names */
+static unsigned mce_trace_name_cnt = 0;
+
+/** Lookup table for name -> name id + 1 */
+static GHashTable *mce_trace_name_lut = 0;
+
+/** Get CLOCK_BOOTTIME in microseconds
+ *
+ * @return boot time stamp
+ */
+static inline uint64_t mce_trace_tick(void)
+{
+	struct timespec ts = { 0, 0 };
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return ts.tv_sec * G_GUINT64_CONSTANT(1000000) + ts.tv_nsec / 1000;
+}
+
+/** Get id for a name
+ *
+ * Callers that use the same name repeatedly should cache
+ * the returned id and use mce_trace_add() directly.
+ *
+ * @param name string to intern, or NULL
+ *
+ * @return name id, or MCE_TRACE_NAME_UNKNOWN if the name
+ *         table is full or not initialized
+ */
+uint16_t mce_trace_intern(const char *name)
+{
+	uint16_t id = MCE_TRACE_NAME_UNKNOWN;
+	gpointer val;
+
+	if( !name || !mce_trace_name_lut )
+		goto EXIT;
+
+	if( (val = g_hash_table_lookup(mce_trace_name_lut, name)) ) {
+		id = GPOINTER_TO_UINT(val) - 1;
+		goto EXIT;
+	}
+
+	if( mce_trace_name_cnt >= MCE_TRACE_NAMES ) {
+		mce_log(LL_DEBUG, "name table full; %s not interned", name);
+		goto EXIT;
+	}
+
+	id = mce_trace_name_cnt++;
+	mce_trace_name_tab[id] = g_strdup(name);
+	g_hash_table_insert(mce_trace_name_lut, mce_trace_name_tab[id],
+			    GUINT_TO_POINTER(id + 1));
+
+EXIT:
+	return id;
+}
+
+/** Add a record to the trace buffer
+ *
+ * @param type record type
+ * @param name name id from mce_trace_intern()
+ * @param a    type specific value
+ * @param b    type specific value
+ */
+void mce_trace_add(mce_trace_type_t type, uint16_t name,
+		   int32_t a, int32_t b)
+{
+	uint64_t            seq = mce_trace_seq++;
+	mce_trace_record_t *rec = &mce_trace_ring[seq % MCE_TRACE_RECORDS];
+
+	rec->tick = mce_trace_tick();
+	rec->type = type;
+	rec->name = name;
+	rec->a    = a;
+	rec->b    = b;
+	rec->seq  = (uint32_t)seq;
+}
+
+/** Add a record to the trace buffer with name lookup
+ *
+ * @param type record type
+ * @param name name string
+ * @param a    type specific value
+ * @param b    type specific value
+ */
+void mce_trace_add_name(mce_trace_type_t type, const char *name,
+			int32_t a, int32_t b)
+{
+	mce_trace_add(type, mce_trace_intern(name), a, b);
+}
+
+/** Serialize trace buffer
+ *
+ * See mce_trace_header_t for description of the layout.
+ *
+ * @param psize where to store the size of the returned data
+ *
+ * @return trace dump data, release with g_free()
+ */
+void *mce_trace_serialize(size_t *psize)
+{
+	static const guint8 pad[8] = { 0 };
+
+	GByteArray        *img = g_byte_array_new();
+	mce_trace_header_t hdr;
+	uint64_t           beg = 0;
+
+	if( mce_trace_seq > MCE_TRACE_RECORDS )
+		beg = mce_trace_seq - MCE_TRACE_RECORDS;
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, MCE_TRACE_MAGIC, sizeof hdr.magic);
+	hdr.version      = MCE_TRACE_VERSION;
+	hdr.record_size  = sizeof (mce_trace_record_t);
+	hdr.record_count = (uint32_t)(mce_trace_seq - beg);
+	hdr.name_count   = mce_trace_name_cnt;
+	hdr.dropped      = beg;
+	hdr.tick         = mce_trace_tick();
+
+	g_byte_array_append(img, (const guint8 *)&hdr, sizeof hdr);
+
+	for( unsigned i = 0; i < mce_trace_name_cnt; ++i ) {
+		const char *name = mce_trace_name_tab[i];
+		g_byte_array_append(img, (const guint8 *)name,
+				    strlen(name) + 1);
+	}
+	g_byte_array_append(img, pad, -img->len & 7);
+
+	((mce_trace_header_t *)img->data)->name_size = img->len - sizeof hdr;
+
+	for( uint64_t seq = beg; seq != mce_trace_seq; ++seq ) {
+		const mce_trace_record_t *rec =
+			&mce_trace_ring[seq % MCE_TRACE_RECORDS];
+		g_byte_array_append(img, (const guint8 *)rec, sizeof *rec);
+	}
+
+	*psize = img->len;
+	return g_byte_array_free(img, FALSE);
+}
+
+/** Initialize trace buffer
+ */
+void mce_trace_init(void)
+{
+	if( mce_trace_name_lut )
+		goto EXIT;
+
+	mce_trace_name_lut = g_hash_table_new(g_str_hash, g_str_equal);
+
+	/* Reserve id zero for names that could not be interned */
+	mce_trace_intern("?");
+
+	mce_trace_add(MCE_TRACE_MARK, mce_trace_intern("startup"), 0, 0);
+
+EXIT:
+	return;
+}
+
+/** Release dynamic resources held by the trace buffer
+ *
+ * Records can still be added, but name lookups will
+ * yield MCE_TRACE_NAME_UNKNOWN.
+ */
+void mce_trace_quit(void)
+{
+	if( mce_trace_name_lut )
+		g_hash_table_unref(mce_trace_name_lut),
+			mce_trace_name_lut = 0;
+
+	for( unsigned i = 0; i < mce_trace_name_cnt; ++i )
+		g_free(mce_trace_name_tab[i]), mce_trace_name_tab[i] = 0;
+	mce_trace_name_cnt = 0;
+}
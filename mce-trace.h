@@ -0,0 +1,99 @@
+/**
+ * @file mce-trace.h
+ * Headers for the flight recorder trace buffer for Mode Control Entity
+ * <p>
+ * The dump format definitions are shared with the tools/mcetrace
+ * decoder and thus this header must not depend on glib.
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_TRACE_H_
+#define _MCE_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Trace dump identification */
+#define MCE_TRACE_MAGIC		"MCETRACE"
+
+/** Trace dump layout version; bump on incompatible changes */
+#define MCE_TRACE_VERSION	2
+
+/** Number of records held in the trace ring buffer */
+#define MCE_TRACE_RECORDS	4096
+
+/** Maximum number of distinct names that can be interned */
+#define MCE_TRACE_NAMES		512
+
+/** Name id used when the name table is full */
+#define MCE_TRACE_NAME_UNKNOWN	0
+
+/** Trace record types */
+typedef enum {
+	MCE_TRACE_NONE,		/**< Unused slot */
+	MCE_TRACE_DATAPIPE,	/**< Datapipe execution;
+				 *   a = value, b = duration [us] */
+	MCE_TRACE_DISPLAY_STM,	/**< Display state machine transition;
+				 *   a = old state, b = new state */
+	MCE_TRACE_POWERKEY,	/**< Powerkey state machine step;
+				 *   a = display state, b = unused */
+	MCE_TRACE_HBTIMER,	/**< Heartbeat timer dispatch;
+				 *   a = lateness [ms], b = unused */
+	MCE_TRACE_RESUME,	/**< Suspend/resume detected;
+				 *   a = time skip [ms], b = unused */
+	MCE_TRACE_DBUS,		/**< D-Bus method call;
+				 *   a = handled, b = duration [us] */
+	MCE_TRACE_MARK,		/**< Free form marker */
+	MCE_TRACE_TYPES
+} mce_trace_type_t;
+
+/** Trace record, stored as is in the ring buffer and in dumps */
+typedef struct {
+	uint64_t tick;		/**< CLOCK_BOOTTIME [us] */
+	uint16_t type;		/**< mce_trace_type_t */
+	uint16_t name;		/**< Interned name id */
+	int32_t  a;		/**< Type specific value */
+	int32_t  b;		/**< Type specific value */
+	uint32_t seq;		/**< Sequence number, for spotting gaps;
+				 *   low 32 bits only */
+} mce_trace_record_t;
+
+/** Trace dump header
+ *
+ * The header is followed by name_count nul terminated strings,
+ * padded to 8 byte boundary, and record_count records in
+ * chronological order.
+ */
+typedef struct {
+	char     magic[8];	/**< MCE_TRACE_MAGIC */
+	uint32_t version;	/**< MCE_TRACE_VERSION */
+	uint32_t record_size;	/**< sizeof (mce_trace_record_t) */
+	uint32_t record_count;	/**< Number of records */
+	uint32_t name_count;	/**< Number of names */
+	uint32_t name_size;	/**< Size of padded name data */
+	uint32_t reserved;	/**< Zero */
+	uint64_t dropped;	/**< Records overwritten before dump */
+	uint64_t tick;		/**< CLOCK_BOOTTIME at dump time [us] */
+} mce_trace_header_t;
+
+uint16_t    mce_trace_intern    (const char *name);
+void        mce_trace_add       (mce_trace_type_t type, uint16_t name,
+				 int32_t a, int32_t b);
+void        mce_trace_add_name  (mce_trace_type_t type, const char *name,
+				 int32_t a, int32_t b);
+void       *mce_trace_serialize (size_t *psize);
+
+void        mce_trace_init      (void);
+void        mce_trace_quit      (void);
+
+#endif /* _MCE_TRACE_H_ */
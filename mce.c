@@ -30,6 +30,7 @@
 #include "mce-modules.h"
 #include "mce-command-line.h"
 #include "mce-sensorfw.h"
+#include "mce-trace.h"
 #include "tklock.h"
 #include "powerkey.h"
 #include "event-input.h"
@@ -107,6 +108,7 @@ static void mce_cleanup_wakelocks(void)
 
 	wakelock_unlock("mce_display_on");
 	wakelock_unlock("mce_input_handler");
+	wakelock_unlock("mce_input_thread");
 	wakelock_unlock("mce_cpu_keepalive");
 	wakelock_unlock("mce_display_stm");
 	wakelock_unlock("mce_powerkey_stm");
@@ -141,6 +143,9 @@ static void mce_exit_via_signal(int signr)
 	/* Cancel auto suspend */
 	mce_cleanup_wakelocks();
 #endif
+	/* Do not lose messages still in the async log buffer */
+	mce_log_flush_on_exit();
+
 	/* Try to exit via default handler */
 	signal(signr, SIG_DFL);
 	sigaddset(&ss, signr);
@@ -182,7 +187,8 @@ static void signal_handler(const gint signr)
 		break;
 
 	case SIGHUP:
-		/* Possibly for re-reading configuration? */
+		/* Dump buffered log messages on demand */
+		mce_log_flush();
 		break;
 
 	case SIGINT:
@@ -617,6 +623,7 @@ static struct
 	bool systembus;
 	bool show_module_info;
 	bool systemd_notify;
+	bool async_log;
 	int  auto_exit;
 } mce_args =
 {
@@ -626,6 +633,7 @@ static struct
 	.systembus        = true,
 	.show_module_info = false,
 	.systemd_notify   = false,
+	.async_log        = false,
 	.auto_exit        = -1,
 };
 
@@ -653,6 +661,13 @@ static bool mce_do_force_syslog(const char *arg)
 	return true;
 }
 
+static bool mce_do_async_log(const char *arg)
+{
+	(void)arg;
+	mce_args.async_log = true;
+	return true;
+}
+
 static bool mce_do_auto_exit(const char *arg)
 {
 	mce_args.auto_exit = arg ? strtol(arg, 0, 0) : 5;
@@ -809,6 +824,19 @@ static const mce_opt_t options[] =
 		.usage       =
 			"Add function logging override"
 	},
+	{
+		.name        = "async-log",
+		.without_arg = mce_do_async_log,
+		.usage       =
+			"Write log messages from a background thread\n"
+			"\n"
+			"Messages are buffered in memory and written to stderr\n"
+			"or syslog without blocking the mainloop. If the buffer\n"
+			"fills up, messages are dropped and the number of lost\n"
+			"messages is reported. Messages longer than 255 bytes\n"
+			"are truncated and end with \"...\". Sending SIGHUP\n"
+			"writes out buffered messages immediately.\n"
+	},
 	{
 		.name        = "auto-exit",
 		.values      = "seconds",
@@ -927,6 +955,10 @@ int main(int argc, char **argv)
 	if( mce_args.daemonflag )
 		daemonize();
 
+	/* Threads do not survive fork(), start after daemonizing */
+	if( mce_args.async_log )
+		mce_log_start_async();
+
 	/* Register a mainloop */
 	mainloop = g_main_loop_new(NULL, FALSE);
 
@@ -939,6 +971,9 @@ int main(int argc, char **argv)
 
 	/* Initialise subsystems */
 
+	/* Start flight recorder before anything gets traced */
+	mce_trace_init();
+
 	/* Open fbdev as early as possible */
 	mce_fbdev_init();
 
@@ -1065,6 +1100,7 @@ EXIT:
 	mce_dbus_exit();
 	mce_conf_exit();
 	mce_fbdev_quit();
+	mce_trace_quit();
 
 	/* If the mainloop is initialised, unreference it */
 	if (mainloop != NULL) {
@@ -0,0 +1,707 @@
+/**
+ * @file als-inputflt.c
+ * Ambient light sensor input filter backends
+ * <p>
+ * The filters are kept separate from the filter-brightness-als
+ * module so that they can be exercised without the rest of mce.
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "als-inputflt.h"
+#include "display.h"
+
+#include "../mce-log.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Hooks that an input filter backend needs to implement */
+typedef struct
+{
+	const char *fi_name;
+
+	void      (*fi_reset)(void);
+	int       (*fi_filter)(int);
+	bool      (*fi_stable)(void);
+} inputflt_t;
+
+// INPUT_FILTER_BACKEND_DUMMY
+static int      inputflt_dummy_filter(int add);
+static bool     inputflt_dummy_stable(void);
+static void     inputflt_dummy_reset(void);
+
+// INPUT_FILTER_BACKEND_MEDIAN
+static bool     inputflt_median_before(const int *heap, int a, int b);
+static void     inputflt_median_set_slot(int *heap, int slot, int idx);
+static void     inputflt_median_sift_up(int *heap, int slot);
+static void     inputflt_median_sift_down(int *heap, int len, int slot);
+static void     inputflt_median_prime(int add);
+static int      inputflt_median_filter(int add);
+static bool     inputflt_median_stable(void);
+static void     inputflt_median_reset(void);
+
+// INPUT_FILTER_BACKEND_EMA
+static int      inputflt_ema_filter(int add);
+static bool     inputflt_ema_stable(void);
+static void     inputflt_ema_reset(void);
+
+// INPUT_FILTER_BACKEND_HYSTERESIS
+static int      inputflt_hysteresis_filter(int add);
+static bool     inputflt_hysteresis_stable(void);
+static void     inputflt_hysteresis_reset(void);
+
+// INPUT_FILTER_BACKEND_SLEW
+static int      inputflt_slew_step(int val, int pct, int min);
+static int      inputflt_slew_filter(int add);
+static bool     inputflt_slew_stable(void);
+static void     inputflt_slew_reset(void);
+
+// INPUT_FILTER_CHAIN
+static bool     inputflt_chain_append(const char *name, size_t len);
+
+/* ------------------------------------------------------------------------- *
+ * INPUT_FILTER_BACKEND_DUMMY
+ * ------------------------------------------------------------------------- */
+
+static int inputflt_dummy_filter(int add)
+{
+	return add;
+}
+
+static bool inputflt_dummy_stable(void)
+{
+	return true;
+}
+
+static void inputflt_dummy_reset(void)
+{
+}
+
+/* ------------------------------------------------------------------------- *
+ * INPUT_FILTER_BACKEND_MEDIAN
+ *
+ * The samples in the window are kept in two heaps: a max-heap holding
+ * the lower half and a min-heap holding the upper half, so that the
+ * median is always at the top of the lower half heap. Both heaps store
+ * indices to the sample fifo, and each sample knows its heap slot. When
+ * a new sample replaces the oldest one, it is updated in place and at
+ * most one swap between the heap tops is needed to restore the order,
+ * i.e. the cost is O(log n) regardless of the window size.
+ * ------------------------------------------------------------------------- */
+
+/** Number of samples in the median filtering window; always odd */
+static int inputflt_median_size = ALS_MEDIAN_SIZE_DEFAULT;
+
+/** Moving window of ALS measurements; fifo in ring buffer form */
+static int inputflt_median_fifo[ALS_MEDIAN_SIZE_MAX];
+
+/** Heap slot of each sample in inputflt_median_fifo */
+static int inputflt_median_slot[ALS_MEDIAN_SIZE_MAX];
+
+/** Heap each sample in inputflt_median_fifo belongs to */
+static int *inputflt_median_heap[ALS_MEDIAN_SIZE_MAX];
+
+/** Max-heap of fifo indices for the lower half of samples */
+static int inputflt_median_lo[(ALS_MEDIAN_SIZE_MAX + 1) / 2];
+
+/** Min-heap of fifo indices for the upper half of samples */
+static int inputflt_median_hi[ALS_MEDIAN_SIZE_MAX / 2];
+
+/** Number of items in inputflt_median_lo */
+static int inputflt_median_lo_len = 0;
+
+/** Number of items in inputflt_median_hi */
+static int inputflt_median_hi_len = 0;
+
+/** Fifo index of the oldest sample */
+static int inputflt_median_head = 0;
+
+/** Number of successive equal samples at the end of the fifo */
+static int inputflt_median_run = 0;
+
+/** Flag for: the fifo holds valid samples */
+static bool inputflt_median_primed = false;
+
+/** Heap order predicate
+ *
+ * @param heap inputflt_median_lo or inputflt_median_hi
+ * @param a    fifo index
+ * @param b    fifo index
+ *
+ * @return true if sample a should be closer to heap top than sample b
+ */
+static bool inputflt_median_before(const int *heap, int a, int b)
+{
+	if( heap == inputflt_median_lo )
+		return inputflt_median_fifo[a] > inputflt_median_fifo[b];
+	return inputflt_median_fifo[a] < inputflt_median_fifo[b];
+}
+
+/** Place sample to heap slot and update the back references
+ *
+ * @param heap inputflt_median_lo or inputflt_median_hi
+ * @param slot heap slot
+ * @param idx  fifo index
+ */
+static void inputflt_median_set_slot(int *heap, int slot, int idx)
+{
+	heap[slot] = idx;
+	inputflt_median_slot[idx] = slot;
+	inputflt_median_heap[idx] = heap;
+}
+
+/** Move sample towards heap top until heap order is restored
+ *
+ * @param heap inputflt_median_lo or inputflt_median_hi
+ * @param slot heap slot
+ */
+static void inputflt_median_sift_up(int *heap, int slot)
+{
+	int idx = heap[slot];
+
+	while( slot > 0 ) {
+		int parent = (slot - 1) / 2;
+		if( !inputflt_median_before(heap, idx, heap[parent]) )
+			break;
+		inputflt_median_set_slot(heap, slot, heap[parent]);
+		slot = parent;
+	}
+	inputflt_median_set_slot(heap, slot, idx);
+}
+
+/** Move sample away from heap top until heap order is restored
+ *
+ * @param heap inputflt_median_lo or inputflt_median_hi
+ * @param len  number of items in the heap
+ * @param slot heap slot
+ */
+static void inputflt_median_sift_down(int *heap, int len, int slot)
+{
+	int idx = heap[slot];
+
+	for( ;; ) {
+		int child = 2 * slot + 1;
+		if( child >= len )
+			break;
+		if( child + 1 < len &&
+		    inputflt_median_before(heap, heap[child + 1], heap[child]) )
+			child += 1;
+		if( !inputflt_median_before(heap, heap[child], idx) )
+			break;
+		inputflt_median_set_slot(heap, slot, heap[child]);
+		slot = child;
+	}
+	inputflt_median_set_slot(heap, slot, idx);
+}
+
+/** Fill the whole window with one sample value
+ *
+ * @param add initial sample value
+ */
+static void inputflt_median_prime(int add)
+{
+	inputflt_median_lo_len = (inputflt_median_size + 1) / 2;
+	inputflt_median_hi_len = inputflt_median_size / 2;
+
+	/* Heap order is trivially satisfied when all values are equal */
+	for( int i = 0; i < inputflt_median_size; ++i ) {
+		inputflt_median_fifo[i] = add;
+		if( i < inputflt_median_lo_len )
+			inputflt_median_set_slot(inputflt_median_lo, i, i);
+		else
+			inputflt_median_set_slot(inputflt_median_hi,
+						 i - inputflt_median_lo_len, i);
+	}
+
+	inputflt_median_head   = 0;
+	inputflt_median_run    = inputflt_median_size;
+	inputflt_median_primed = true;
+}
+
+static int inputflt_median_filter(int add)
+{
+	int res = -1;
+
+	/* Adding negative sample values mean the sensor is not
+	 * in use and we should forget any history that exists */
+	if( add < 0 ) {
+		inputflt_median_primed = false;
+		goto EXIT;
+	}
+
+	/* If we do not have history, initialize with the value we have */
+	if( !inputflt_median_primed ) {
+		inputflt_median_prime(add);
+		res = add;
+		goto EXIT;
+	}
+
+	/* Replace the oldest sample in the fifo */
+	int idx  = inputflt_median_head;
+	int last = idx ? idx - 1 : inputflt_median_size - 1;
+
+	if( ++inputflt_median_head == inputflt_median_size )
+		inputflt_median_head = 0;
+
+	if( inputflt_median_fifo[last] != add )
+		inputflt_median_run = 1;
+	else if( inputflt_median_run < inputflt_median_size )
+		inputflt_median_run += 1;
+
+	/* If we shift in the same value as what was shifted out,
+	 * the ordered statistics do not change */
+	if( inputflt_median_fifo[idx] != add ) {
+		int *heap = inputflt_median_heap[idx];
+		int  len  = (heap == inputflt_median_lo) ?
+			inputflt_median_lo_len : inputflt_median_hi_len;
+
+		inputflt_median_fifo[idx] = add;
+		inputflt_median_sift_up(heap, inputflt_median_slot[idx]);
+		inputflt_median_sift_down(heap, len, inputflt_median_slot[idx]);
+
+		/* Swap heap tops if the halves are now out of order */
+		int lo = inputflt_median_lo[0];
+		int hi = inputflt_median_hi[0];
+
+		if( inputflt_median_hi_len > 0 &&
+		    inputflt_median_fifo[lo] > inputflt_median_fifo[hi] ) {
+			inputflt_median_set_slot(inputflt_median_lo, 0, hi);
+			inputflt_median_set_slot(inputflt_median_hi, 0, lo);
+			inputflt_median_sift_down(inputflt_median_lo,
+						  inputflt_median_lo_len, 0);
+			inputflt_median_sift_down(inputflt_median_hi,
+						  inputflt_median_hi_len, 0);
+		}
+	}
+
+	/* Median of the history window */
+	res = inputflt_median_fifo[inputflt_median_lo[0]];
+
+EXIT:
+	mce_log(LL_DEBUG, "median=%d run=%d/%d", res,
+		inputflt_median_primed ? inputflt_median_run : 0,
+		inputflt_median_size);
+
+	return res;
+}
+
+static bool inputflt_median_stable(void)
+{
+	/* All samples in the window are equal */
+	return (!inputflt_median_primed ||
+		inputflt_median_run >= inputflt_median_size);
+}
+
+static void inputflt_median_reset(void)
+{
+	inputflt_median_filter(-1);
+}
+
+/** Set median filtering window size
+ *
+ * Changing the size forgets the sample history.
+ *
+ * @param size number of samples; clipped to supported range
+ *             and rounded up to odd value
+ */
+void inputflt_median_set_size(int size)
+{
+	if( size < ALS_MEDIAN_SIZE_MIN )
+		size = ALS_MEDIAN_SIZE_MIN;
+	else if( size > ALS_MEDIAN_SIZE_MAX )
+		size = ALS_MEDIAN_SIZE_MAX;
+
+	size |= 1;
+
+	if( inputflt_median_size != size ) {
+		mce_log(LL_DEBUG, "median window: %d -> %d",
+			inputflt_median_size, size);
+		inputflt_median_size   = size;
+		inputflt_median_primed = false;
+	}
+}
+
+/* ------------------------------------------------------------------------- *
+ * INPUT_FILTER_BACKEND_EMA
+ *
+ * Exponential moving average. The state is kept in fixed point so
+ * that small steps do not get lost to integer truncation. Since the
+ * average approaches the input only asymptotically, the state snaps
+ * to the input when the output gets close enough, after which the
+ * filter is stable.
+ * ------------------------------------------------------------------------- */
+
+/** Weight of a new sample is 1 / 2^INPUTFLT_EMA_SHIFT */
+#define INPUTFLT_EMA_SHIFT 2
+
+/** Number of fractional bits in inputflt_ema_acc */
+#define INPUTFLT_EMA_FRAC  8
+
+/** Distance from input at which the output snaps to input [%] */
+#define INPUTFLT_EMA_SNAP_PCT 1
+
+/** Average in fixed point format */
+static int64_t inputflt_ema_acc = 0;
+
+/** Latest input sample, or -1 if there is no history */
+static int inputflt_ema_in = -1;
+
+static int inputflt_ema_filter(int add)
+{
+	int res = add;
+
+	if( add < 0 ) {
+		inputflt_ema_in = -1;
+		goto EXIT;
+	}
+
+	int64_t tgt = (int64_t)add << INPUTFLT_EMA_FRAC;
+
+	if( inputflt_ema_in < 0 ) {
+		inputflt_ema_acc = tgt;
+	}
+	else {
+		inputflt_ema_acc += (tgt - inputflt_ema_acc) /
+			(1 << INPUTFLT_EMA_SHIFT);
+		res = (int)((inputflt_ema_acc +
+			     (1 << (INPUTFLT_EMA_FRAC - 1))) >>
+			    INPUTFLT_EMA_FRAC);
+		if( abs(res - add) <= (int)((int64_t)add *
+					     INPUTFLT_EMA_SNAP_PCT / 100) ) {
+			inputflt_ema_acc = tgt;
+			res = add;
+		}
+	}
+
+	inputflt_ema_in = add;
+
+EXIT:
+	return res;
+}
+
+static bool inputflt_ema_stable(void)
+{
+	return (inputflt_ema_in < 0 ||
+		inputflt_ema_acc == (int64_t)inputflt_ema_in << INPUTFLT_EMA_FRAC);
+}
+
+static void inputflt_ema_reset(void)
+{
+	inputflt_ema_filter(-1);
+}
+
+/* ------------------------------------------------------------------------- *
+ * INPUT_FILTER_BACKEND_HYSTERESIS
+ *
+ * Holds the output until the input deviates from it by more than
+ * a percentage of the output value. Small fluctuations thus do not
+ * propagate to the brightness ramp at all.
+ * ------------------------------------------------------------------------- */
+
+/** Relative change needed for passing a new value through [%] */
+#define INPUTFLT_HYSTERESIS_PCT 10
+
+/** Absolute change that is always passed through [lux] */
+#define INPUTFLT_HYSTERESIS_MIN 2
+
+/** Value that is currently passed through, or -1 */
+static int inputflt_hysteresis_out = -1;
+
+static int inputflt_hysteresis_filter(int add)
+{
+	if( add < 0 || inputflt_hysteresis_out < 0 ) {
+		inputflt_hysteresis_out = add;
+		goto EXIT;
+	}
+
+	int lim = (int)((int64_t)inputflt_hysteresis_out *
+			INPUTFLT_HYSTERESIS_PCT / 100);
+	if( lim < INPUTFLT_HYSTERESIS_MIN )
+		lim = INPUTFLT_HYSTERESIS_MIN;
+
+	if( add > inputflt_hysteresis_out + lim ||
+	    add < inputflt_hysteresis_out - lim )
+		inputflt_hysteresis_out = add;
+
+EXIT:
+	return inputflt_hysteresis_out;
+}
+
+static bool inputflt_hysteresis_stable(void)
+{
+	/* Output changes only when the input does */
+	return true;
+}
+
+static void inputflt_hysteresis_reset(void)
+{
+	inputflt_hysteresis_filter(-1);
+}
+
+/* ------------------------------------------------------------------------- *
+ * INPUT_FILTER_BACKEND_SLEW
+ *
+ * Limits how much the output can change per sample. The limit is
+ * relative to the current output, so that moving between indoor and
+ * outdoor light levels takes roughly the same number of samples as
+ * moving between dim and dark rooms.
+ * ------------------------------------------------------------------------- */
+
+/** Maximum relative change per sample when brightening [%] */
+#define INPUTFLT_SLEW_UP_PCT   50
+
+/** Maximum relative change per sample when dimming [%] */
+#define INPUTFLT_SLEW_DOWN_PCT 25
+
+/** Lower bound for maximum change per sample [lux] */
+#define INPUTFLT_SLEW_MIN      5
+
+/** Latest input sample, or -1 if there is no history */
+static int inputflt_slew_in = -1;
+
+/** Latest output value, or -1 if there is no history */
+static int inputflt_slew_out = -1;
+
+/** Get maximum change allowed for one sample
+ *
+ * @param val  current output value
+ * @param pct  relative limit [%]
+ * @param min  absolute lower bound
+ *
+ * @return maximum allowed change
+ */
+static int inputflt_slew_step(int val, int pct, int min)
+{
+	int step = (int)((int64_t)val * pct / 100);
+	return step < min ? min : step;
+}
+
+static int inputflt_slew_filter(int add)
+{
+	int out = inputflt_slew_out;
+
+	if( add < 0 || out < 0 ) {
+		out = add;
+	}
+	else if( add > out ) {
+		int step = inputflt_slew_step(out, INPUTFLT_SLEW_UP_PCT,
+					      INPUTFLT_SLEW_MIN);
+		out = (add - out > step) ? out + step : add;
+	}
+	else if( add < out ) {
+		int step = inputflt_slew_step(out, INPUTFLT_SLEW_DOWN_PCT,
+					      INPUTFLT_SLEW_MIN);
+		out = (out - add > step) ? out - step : add;
+	}
+
+	inputflt_slew_in  = add;
+	inputflt_slew_out = out;
+
+	return out;
+}
+
+static bool inputflt_slew_stable(void)
+{
+	return inputflt_slew_out == inputflt_slew_in;
+}
+
+static void inputflt_slew_reset(void)
+{
+	inputflt_slew_filter(-1);
+}
+
+/* ------------------------------------------------------------------------- *
+ * INPUT_FILTER_LOOKUP
+ * ------------------------------------------------------------------------- */
+
+/** Array of available input filter backends
+ *
+ * The first entry is the "disabled" filter, and the
+ * array is terminated by an entry with NULL fi_name.
+ */
+static const inputflt_t inputflt_lut[] =
+{
+	// NOTE: "disabled" must be in the 1st slot
+	{
+		.fi_name   = "disabled",
+		.fi_reset  = inputflt_dummy_reset,
+		.fi_filter = inputflt_dummy_filter,
+		.fi_stable = inputflt_dummy_stable,
+	},
+	{
+		.fi_name   = "median",
+		.fi_reset  = inputflt_median_reset,
+		.fi_filter = inputflt_median_filter,
+		.fi_stable = inputflt_median_stable,
+	},
+	{
+		.fi_name   = "ema",
+		.fi_reset  = inputflt_ema_reset,
+		.fi_filter = inputflt_ema_filter,
+		.fi_stable = inputflt_ema_stable,
+	},
+	{
+		.fi_name   = "hysteresis",
+		.fi_reset  = inputflt_hysteresis_reset,
+		.fi_filter = inputflt_hysteresis_filter,
+		.fi_stable = inputflt_hysteresis_stable,
+	},
+	{
+		.fi_name   = "slew",
+		.fi_reset  = inputflt_slew_reset,
+		.fi_filter = inputflt_slew_filter,
+		.fi_stable = inputflt_slew_stable,
+	},
+	// sentinel
+	{
+		.fi_name   = 0,
+	}
+};
+
+/* ------------------------------------------------------------------------- *
+ * INPUT_FILTER_CHAIN
+ *
+ * The filter setting is a comma separated list of backend names, for
+ * example "median,ema,slew". Samples pass through the stages in the
+ * given order, and the chain is stable when all stages are.
+ * ------------------------------------------------------------------------- */
+
+/** Maximum number of stages in a filter chain */
+#define INPUTFLT_CHAIN_MAX 4
+
+/** Backends in the current filter chain */
+static const inputflt_t *inputflt_chain[INPUTFLT_CHAIN_MAX];
+
+/** Number of stages in inputflt_chain */
+static int inputflt_chain_len = 0;
+
+/** Append backend to the filter chain
+ *
+ * @param name  name of the backend, not nul terminated
+ * @param len   length of the name
+ *
+ * @return true if the backend was added, false otherwise
+ */
+static bool inputflt_chain_append(const char *name, size_t len)
+{
+	bool              res = false;
+	const inputflt_t *flt = 0;
+
+	for( flt = inputflt_lut; flt->fi_name; ++flt ) {
+		if( strlen(flt->fi_name) == len &&
+		    !memcmp(flt->fi_name, name, len) )
+			break;
+	}
+
+	if( !flt->fi_name ) {
+		mce_log(LL_WARN, "filter '%.*s' is unknown", (int)len, name);
+		goto EXIT;
+	}
+
+	/* The "disabled" filter is a no-op stage */
+	if( flt == inputflt_lut )
+		goto EXIT;
+
+	/* Backends have static state and can't be used twice */
+	for( int i = 0; i < inputflt_chain_len; ++i ) {
+		if( inputflt_chain[i] == flt ) {
+			mce_log(LL_WARN, "filter '%s' used twice", flt->fi_name);
+			goto EXIT;
+		}
+	}
+
+	if( inputflt_chain_len >= INPUTFLT_CHAIN_MAX ) {
+		mce_log(LL_WARN, "filter '%s' ignored; too many stages",
+			flt->fi_name);
+		goto EXIT;
+	}
+
+	inputflt_chain[inputflt_chain_len++] = flt;
+	res = true;
+
+EXIT:
+	return res;
+}
+
+/** Set up filter chain
+ *
+ * The history of both old and new stages is forgotten.
+ *
+ * @param spec  comma separated list of backend names, or NULL
+ */
+void inputflt_chain_select(const char *spec)
+{
+	inputflt_chain_reset();
+	inputflt_chain_len = 0;
+
+	while( spec && *spec ) {
+		size_t skip = strspn(spec, ", \t");
+		size_t len  = strcspn(spec += skip, ", \t");
+
+		if( len > 0 )
+			inputflt_chain_append(spec, len);
+		spec += len;
+	}
+
+	if( mce_log_p(LL_NOTICE) ) {
+		char  txt[128] = "disabled";
+		char *pos = txt;
+		char *end = txt + sizeof txt;
+
+		for( int i = 0; i < inputflt_chain_len && pos < end; ++i ) {
+			pos += snprintf(pos, end - pos, "%s%s",
+					i ? "," : "",
+					inputflt_chain[i]->fi_name);
+		}
+		mce_log(LL_NOTICE, "selected '%s' als filter", txt);
+	}
+
+	inputflt_chain_reset();
+}
+
+/** Forget history in all stages of the filter chain
+ */
+void inputflt_chain_reset(void)
+{
+	for( int i = 0; i < inputflt_chain_len; ++i )
+		inputflt_chain[i]->fi_reset();
+}
+
+/** Pass sample through all stages of the filter chain
+ *
+ * @param add  sample value, or -1 for no-data
+ *
+ * @return filtered value
+ */
+int inputflt_chain_filter(int add)
+{
+	for( int i = 0; i < inputflt_chain_len; ++i )
+		add = inputflt_chain[i]->fi_filter(add);
+	return add;
+}
+
+/** Check if feeding the same sample again would not change the output
+ *
+ * @return true if all stages are stable, false otherwise
+ */
+bool inputflt_chain_stable(void)
+{
+	for( int i = 0; i < inputflt_chain_len; ++i ) {
+		if( !inputflt_chain[i]->fi_stable() )
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file als-inputflt.h
+ * Headers for the ambient light sensor input filter backends
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _ALS_INPUTFLT_H_
+#define _ALS_INPUTFLT_H_
+
+#include <stdbool.h>
+
+void inputflt_median_set_size(int size);
+
+void inputflt_chain_select   (const char *spec);
+void inputflt_chain_reset    (void);
+int  inputflt_chain_filter   (int add);
+bool inputflt_chain_stable   (void);
+
+#endif /* _ALS_INPUTFLT_H_ */
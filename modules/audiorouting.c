@@ -534,7 +534,7 @@ static gboolean actions_dbus_cb(DBusMessage *sig)
                 volume_limit_inputsound <= 0);
 
 EXIT:
-    if( datapipe_get_gint(music_playback_pipe) != playback ) {
+    if( datapipe_get_gbool(music_playback_pipe) != playback ) {
         mce_log(LL_DEVEL, "music playback: %d", playback);
         execute_datapipe(&music_playback_pipe,
                          GINT_TO_POINTER(playback),
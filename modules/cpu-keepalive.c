@@ -937,6 +937,8 @@ cka_state_rethink(void)
       mce_log(LL_DEBUG, "cpu-keepalive timeout at T%+"PRId64"",
               now - maxtime);
     }
+    /* No slack here: firing late would only keep the device
+     * from suspending past the requested keepalive period */
     cka_state_timer_id = g_timeout_add(maxtime - now,
                              cka_state_timer_cb, 0);
   }
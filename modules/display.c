@@ -31,6 +31,7 @@
 #include "../mce-gconf.h"
 #include "../mce-dbus.h"
 #include "../mce-sensorfw.h"
+#include "../mce-trace.h"
 #ifdef ENABLE_HYBRIS
 # include "../mce-hybris.h"
 #endif
@@ -87,6 +88,24 @@
 /** Maximum duration for direct backlight fade animation */
 #define MCE_FADER_DURATION_HW_MAX 5000
 
+/** Minimum interval between backlight fade steps [ms]
+ *
+ * Roughly one frame at 60 Hz; changing the brightness more often
+ * than the display refreshes just generates wakeups.
+ */
+#define MCE_FADER_STEP_MIN_MS 16
+
+/** Transitions shorter than this are applied without fading [ms]
+ *
+ * Kept at the value used before the step interval was raised to
+ * MCE_FADER_STEP_MIN_MS, so that which transitions get faded at all
+ * does not change.
+ */
+#define MCE_FADER_DURATION_SHORT_MS 12
+
+/** Maximum number of steps in a backlight fade animation */
+#define MCE_FADER_STEPS_MAX 64
+
 /** Minimum duration for compositor based ui dimming animation */
 #define MCE_FADER_DURATION_UI_MIN  100
 
@@ -361,6 +380,8 @@ static void                mdy_brightness_force_level(int number);
 
 static void                mdy_brightness_set_priority_boost(bool enable);
 
+static bool                mdy_brightness_hw_ramp_is_supported(void);
+static int                 mdy_brightness_fade_build_curve(int duration);
 static gboolean            mdy_brightness_fade_timer_cb(gpointer data);
 static void                mdy_brightness_cleanup_fade_timer(void);
 static void                mdy_brightness_stop_fade_timer(void);
@@ -800,6 +821,7 @@ static output_state_t mdy_high_brightness_mode_output =
     .context = "high_brightness_mode",
     .truncate_file = TRUE,
     .close_on_exit = FALSE,
+    .raw_mode = TRUE,
 };
 
 /** Is display high brightness mode supported */
@@ -2090,6 +2112,7 @@ static output_state_t mdy_brightness_level_output =
     .context = "brightness",
     .truncate_file = TRUE,
     .close_on_exit = FALSE,
+    .raw_mode = TRUE,
 };
 
 /** Hook for setting brightness
@@ -2103,6 +2126,9 @@ static void (*mdy_brightness_set_level_hook)(int number) = mdy_brightness_set_le
 /** Is hardware driven display fading supported */
 static gboolean mdy_brightness_hw_fading_is_supported = FALSE;
 
+/** Is delegating brightness fades to the backlight driver allowed */
+static gboolean mdy_brightness_hw_ramp_is_enabled = DEFAULT_BACKLIGHT_HW_RAMP;
+
 /** File used to set hw display fading */
 static output_state_t mdy_brightness_hw_fading_output =
 {
@@ -2127,6 +2153,16 @@ static int64_t mdy_brightness_fade_end_time = 0;
 /** Brightness level at the start of brightness fade */
 static int     mdy_brightness_fade_start_level = 0;
 
+/** Precomputed brightness levels for the ongoing fade
+ *
+ * The levels are evenly spaced in time between the fade
+ * start and end times, and the last one is the end level.
+ */
+static int     mdy_brightness_fade_curve[MCE_FADER_STEPS_MAX];
+
+/** Number of levels in mdy_brightness_fade_curve */
+static int     mdy_brightness_fade_steps = 0;
+
 /** Brightness level at the end of brightness fade */
 static int     mdy_brightness_fade_end_level = 0;
 
@@ -2379,6 +2415,62 @@ EXIT:
     return;
 }
 
+/** Check if backlight driver applies brightness changes gradually
+ *
+ * When the kernel does the ramping, the fade target level is written
+ * right away and the fade timer is used only for tracking the end of
+ * the fade. Libhybris does not expose ramp controls, so this applies
+ * only to sysfs backlights with hw dimming enabled.
+ *
+ * The driver ramp speed is fixed and does not follow the configured
+ * fade durations, so this must be explicitly enabled via the
+ * MCE_CONF_BACKLIGHT_HW_RAMP config setting.
+ *
+ * @return true if fading in mce is not needed, false otherwise
+ */
+static bool mdy_brightness_hw_ramp_is_supported(void)
+{
+    return (mdy_brightness_hw_ramp_is_enabled &&
+            mdy_brightness_hw_fading_is_supported &&
+            mdy_brightness_set_level_hook == mdy_brightness_set_level_default);
+}
+
+/** Precompute levels for brightness fade
+ *
+ * The number of steps is limited both by the number of distinct
+ * levels between start and end, and by the minimum step interval.
+ * Small or fast fades thus take only a few wakeups.
+ *
+ * @param duration fade duration [ms]
+ *
+ * @return interval between steps [ms]
+ */
+static int mdy_brightness_fade_build_curve(int duration)
+{
+    int beg = mdy_brightness_fade_start_level;
+    int end = mdy_brightness_fade_end_level;
+    int cnt = abs(end - beg);
+
+    if( cnt > duration / MCE_FADER_STEP_MIN_MS )
+        cnt = duration / MCE_FADER_STEP_MIN_MS;
+    if( cnt > MCE_FADER_STEPS_MAX )
+        cnt = MCE_FADER_STEPS_MAX;
+    if( cnt < 1 )
+        cnt = 1;
+
+    /* Linear interpolation */
+    for( int i = 1; i <= cnt; ++i )
+        mdy_brightness_fade_curve[i-1] = (i * end + (cnt - i) * beg +
+                                          cnt / 2) / cnt;
+
+    mdy_brightness_fade_steps = cnt;
+
+    mce_log(LL_DEBUG, "%d steps in %d ms", cnt, duration);
+
+    /* Round up so that the last step falls on the fade end time */
+    return (duration + cnt - 1) / cnt;
+}
+
 /**
  * Timeout callback for the brightness fade
  *
@@ -2403,14 +2495,16 @@ static gboolean mdy_brightness_fade_timer_cb(gpointer data)
 
     if( mdy_brightness_fade_start_time <= now &&
         now < mdy_brightness_fade_end_time ) {
-        /* Linear interpolation */
-        int weight_end = (int)(now - mdy_brightness_fade_start_time);
-        int weight_beg = (int)(mdy_brightness_fade_end_time - now);
-        int weight_tot = weight_end + weight_beg;
-
-        lev = (weight_end * mdy_brightness_fade_end_level +
-               weight_beg * mdy_brightness_fade_start_level +
-               weight_tot/2) / weight_tot;
+        /* Pick the latest step that is due */
+        int64_t done = now - mdy_brightness_fade_start_time;
+        int64_t todo = mdy_brightness_fade_end_time -
+            mdy_brightness_fade_start_time;
+        int     step = (int)(done * mdy_brightness_fade_steps / todo);
+
+        if( step > 0 )
+            lev = mdy_brightness_fade_curve[step - 1];
+        else
+            lev = mdy_brightness_level_cached;
 
         keep_going = TRUE;
     }
@@ -2561,11 +2655,6 @@ static void mdy_brightness_set_fade_target_ex(fader_type_t type,
                                               gint new_brightness,
                                               gint transition_time)
 {
-    /* While something like 20-40 ms would suffice for most cases
-     * using smaller 4 ms value allows us to make few steps during
-     * the short time window we have available during unblanking. */
-    const int delay_min = 4;
-
     /* Negative transition time: constant velocity change [%/s] */
     if( transition_time < 0 ) {
         int d = abs(new_brightness - mdy_brightness_level_cached);
@@ -2644,23 +2733,25 @@ static void mdy_brightness_set_fade_target_ex(fader_type_t type,
     transition_time = (int)(mdy_brightness_fade_end_time -
                             mdy_brightness_fade_start_time);
 
-    if( transition_time < delay_min * 3 ) {
+    if( transition_time < MCE_FADER_DURATION_SHORT_MS ) {
         mce_log(LL_DEBUG, "short transition; not using fader");
         mdy_brightness_force_level(new_brightness);
         goto EXIT;
     }
 
-    /* Calculate desired brightness change velocity. */
-    int steps = abs(mdy_brightness_fade_end_level -
-                    mdy_brightness_fade_start_level);
-    int delay = transition_time / steps; // NB steps != 0
+    int delay = transition_time;
 
-    /* Reject insane timer wakeup frequencies. The fade timer
-     * utilizes timestamp based interpolation, so the delay
-     * does not need to be exactly as planned above.
-     */
-    if( delay < delay_min )
-        delay = delay_min;
+    if( mdy_brightness_hw_ramp_is_supported() ) {
+        /* Let the driver do the ramping; the timer just keeps
+         * the fade type active until the fade should be over */
+        mce_log(LL_DEBUG, "using hw ramp");
+        mdy_brightness_fade_curve[0] = new_brightness;
+        mdy_brightness_fade_steps    = 1;
+        mdy_brightness_set_level(new_brightness);
+    }
+    else {
+        delay = mdy_brightness_fade_build_curve(transition_time);
+    }
 
     mdy_brightness_start_fade_timer(type, delay);
 
@@ -3352,11 +3443,20 @@ static gboolean mdy_blanking_can_blank_from_low_power_mode(void)
     return FALSE;
 }
 
+/** How much blanking timers can be delayed for wakeup coalescing [ms] */
+#define MDY_BLANKING_SLACK_MS 1000
+
 // TIMER: ON -> DIM
 
 /** Display dimming timeout callback ID */
 static guint mdy_blanking_dim_cb_id = 0;
 
+/** When the dimming timer was due to trigger without slack [mono ms]
+ *
+ * Used for keeping the slack from accumulating when the blanking
+ * timer gets started from the dimming timer callback. */
+static int64_t mdy_blanking_dim_tick = 0;
+
 /**
  * Timeout callback for display dimming
  *
@@ -3433,8 +3533,11 @@ static void mdy_blanking_schedule_dim(void)
     mce_log(LL_DEBUG, "DIM timer scheduled @ %d secs", dim_timeout);
 
     /* Setup new timeout */
-    mdy_blanking_dim_cb_id = g_timeout_add_seconds(dim_timeout,
-                                                   mdy_blanking_dim_cb, NULL);
+    mdy_blanking_dim_tick = mce_lib_get_mono_tick() + dim_timeout * 1000;
+    mdy_blanking_dim_cb_id = mce_lib_timeout_add_slack(dim_timeout * 1000,
+                                                       MDY_BLANKING_SLACK_MS,
+                                                       mdy_blanking_dim_cb,
+                                                       NULL);
 
     mdy_blanking_inhibit_schedule_broadcast();
 
@@ -3574,6 +3677,7 @@ static void mdy_blanking_cancel_off(void)
 static void mdy_blanking_schedule_off(void)
 {
     gint timeout = mdy_blank_timeout;
+    gint delay   = 0;
 
     if( display_state == MCE_DISPLAY_LPM_OFF )
         timeout = mdy_blank_from_lpm_off_timeout;
@@ -3610,10 +3714,25 @@ static void mdy_blanking_schedule_off(void)
         mce_log(LL_DEBUG, "BLANK timer scheduled @ %d secs", timeout);
     }
 
+    /* When called due to dimming timer, count from the time it was
+     * due so that the slack of both timers does not add up; the
+     * blanking timer then coalesces with the inactivity timer */
+    delay = timeout * 1000;
+
+    if( display_state == MCE_DISPLAY_DIM && mdy_blanking_dim_tick ) {
+        int64_t late = mce_lib_get_mono_tick() - mdy_blanking_dim_tick;
+
+        if( late > 0 && late <= MDY_BLANKING_SLACK_MS && late < delay )
+            delay -= (gint)late;
+    }
+    mdy_blanking_dim_tick = 0;
+
     /* Use idle callback for zero timeout */
     if( timeout > 0 )
-        mdy_blanking_off_cb_id = g_timeout_add(timeout * 1000,
-                                               mdy_blanking_off_cb, 0);
+        mdy_blanking_off_cb_id =
+            mce_lib_timeout_add_slack(delay,
+                                      MDY_BLANKING_SLACK_MS,
+                                      mdy_blanking_off_cb, 0);
     else
         mdy_blanking_off_cb_id = g_idle_add(mdy_blanking_off_cb, 0);
 
@@ -3674,8 +3793,9 @@ static void mdy_blanking_schedule_lpm_off(void)
     /* Setup new timeout */
     mce_log(LL_DEBUG, "LPM-BLANK timer scheduled @ %d secs", timeout);
     mdy_blanking_lpm_off_cb_id =
-        g_timeout_add_seconds(timeout,
-                              mdy_blanking_lpm_off_cb, NULL);
+        mce_lib_timeout_add_slack(timeout * 1000,
+                                  MDY_BLANKING_SLACK_MS,
+                                  mdy_blanking_lpm_off_cb, NULL);
     return;
 }
 
@@ -6407,10 +6527,24 @@ static void mdy_stm_acquire_wakelock(void)
  */
 static void mdy_stm_trans(stm_state_t state)
 {
+    /* Trace name ids + 1, looked up once per state */
+    static unsigned trace_name[STM_LEAVE_LOGICAL_OFF + 1];
+
     if( mdy_stm_dstate != state ) {
+        uint16_t id = MCE_TRACE_NAME_UNKNOWN;
+
         mce_log(LL_INFO, "STM: %s -> %s",
                 mdy_stm_state_name(mdy_stm_dstate),
                 mdy_stm_state_name(state));
+
+        if( (unsigned)state < G_N_ELEMENTS(trace_name) ) {
+            if( !trace_name[state] )
+                trace_name[state] =
+                    mce_trace_intern(mdy_stm_state_name(state)) + 1u;
+            id = trace_name[state] - 1u;
+        }
+
+        mce_trace_add(MCE_TRACE_DISPLAY_STM, id, mdy_stm_dstate, state);
         mdy_stm_dstate = state;
     }
 }
@@ -9140,6 +9274,11 @@ static void mdy_brightness_init(void)
 
     mce_log(LL_DEBUG, "max_brightness = %d", mdy_brightness_level_maximum);
 
+    mdy_brightness_hw_ramp_is_enabled =
+        mce_conf_get_bool(MCE_CONF_DISPLAY_GROUP,
+                          MCE_CONF_BACKLIGHT_HW_RAMP,
+                          DEFAULT_BACKLIGHT_HW_RAMP);
+
     /* If we can read the current hw brightness level, update the
      * cached brightness so we can do soft transitions from the
      * initial state */
@@ -33,6 +33,12 @@
 /** List of max backlight control files to try */
 #define MCE_CONF_MAX_BACKLIGHT_PATH             "MaxBrightnessPath"
 
+/** Let the backlight driver ramp brightness changes, if it can */
+#define MCE_CONF_BACKLIGHT_HW_RAMP              "HwRamp"
+
+/** Default value for MCE_CONF_BACKLIGHT_HW_RAMP setting */
+#define DEFAULT_BACKLIGHT_HW_RAMP               FALSE
+
 /** Default timeout for the high brightness mode; in seconds */
 #define DEFAULT_HBM_TIMEOUT				1800	/* 30 min */
 
@@ -123,7 +129,7 @@
 /** Default value for MCE_GCONF_DISPLAY_ALS_AUTOBRIGHTNESS settings */
 #define ALS_AUTOBRIGHTNESS_DEFAULT                      true
 
-/** ALS input filter setting */
+/** ALS input filter setting; comma separated list of filter stages */
 #define MCE_GCONF_DISPLAY_ALS_INPUT_FILTER              MCE_GCONF_DISPLAY_PATH "/als_input_filter"
 
 /** Default value for MCE_GCONF_DISPLAY_ALS_INPUT_FILTER */
@@ -135,6 +141,16 @@
 #define ALS_SAMPLE_TIME_MIN                             50
 #define ALS_SAMPLE_TIME_MAX                             1000
 
+/** ALS median filter window size GConf setting */
+#define MCE_GCONF_DISPLAY_ALS_MEDIAN_SIZE               MCE_GCONF_DISPLAY_PATH "/als_median_size"
+#define ALS_MEDIAN_SIZE_DEFAULT                         9
+#define ALS_MEDIAN_SIZE_MIN                             3
+#define ALS_MEDIAN_SIZE_MAX                             255
+
+/** ALS sample batch GConf setting; feed all samples from sensord to filters */
+#define MCE_GCONF_DISPLAY_ALS_SAMPLE_BATCHES            MCE_GCONF_DISPLAY_PATH "/als_sample_batches"
+#define ALS_SAMPLE_BATCHES_DEFAULT                      false
+
 /** Path to the color profile GConf setting */
 #define MCE_GCONF_DISPLAY_COLOR_PROFILE                 MCE_GCONF_DISPLAY_PATH "/color_profile"
 
@@ -360,7 +360,7 @@ const gchar *g_module_check_init(GModule *module)
 
         /* Get initial state of datapipes */
         dbltap_ps_state = datapipe_get_gint(proximity_sensor_pipe);
-        dbltap_ps_blank = datapipe_get_gint(proximity_blank_pipe);
+        dbltap_ps_blank = datapipe_get_gbool(proximity_blank_pipe);
         dbltap_lid_cover_policy = datapipe_get_gint(lid_cover_policy_pipe);
 
         /* enable/disable double tap wakeups based on initial conditions */
@@ -25,6 +25,7 @@
 
 #include "filter-brightness-als.h"
 #include "display.h"
+#include "als-inputflt.h"
 
 #include "../mce.h"
 #include "../mce-log.h"
@@ -116,6 +117,18 @@ static gint   als_sample_time = ALS_SAMPLE_TIME_DEFAULT;
 /** Sample time for ALS input filtering  - config notification */
 static guint  als_sample_time_gconf_id = 0;
 
+/** Median filter window size - config value */
+static gint   als_median_size = ALS_MEDIAN_SIZE_DEFAULT;
+
+/** Median filter window size - config notification */
+static guint  als_median_size_gconf_id = 0;
+
+/** Feed all samples from sensord to input filter - config value */
+static gboolean als_sample_batches = ALS_SAMPLE_BATCHES_DEFAULT;
+
+/** Feed all samples from sensord to input filter - config notification */
+static guint  als_sample_batches_gconf_id = 0;
+
 /** Cached display state; tracked via display_state_trigger() */
 static display_state_t display_state = MCE_DISPLAY_UNDEF;
 
@@ -272,6 +285,12 @@ als_filter_load_profile(als_filter_t *self, const char *grp,
 	}
 
 	for( gsize k = 0; k < lim_cnt; ++k ) {
+		/* The ramp lookup expects ascending limits */
+		if( k > 0 && lim_val[k] < lim_val[k-1] ) {
+			mce_log(LL_WARN, "[%s] %s: item %zd: %d < %d; clamped",
+				grp, lim_key, k, lim_val[k], lim_val[k-1]);
+			lim_val[k] = lim_val[k-1];
+		}
 		self->lut[prof][k].lux = lim_val[k];
 		self->lut[prof][k].val = lev_val[k];
 	}
@@ -353,12 +372,21 @@ static int als_filter_run(als_filter_t *self, als_profile_t prof, int lux)
 		goto EXIT;
 	}
 
-	int slot;
-
-	for( slot = 0; slot < ALS_LUX_STEPS; ++slot ) {
-		if( lux < self->lut[prof][slot].lux )
-			break;
+	/* Find the first step with upper limit above the lux value.
+	 * The limits are in ascending order, so a binary search with
+	 * fixed number of conditional moves instead of branches can
+	 * be used. */
+	const als_limit_t *base = self->lut[prof];
+	int                todo = ALS_LUX_STEPS;
+
+	while( todo > 1 ) {
+		int half = todo / 2;
+		base = (base[half - 1].lux <= lux) ? base + half : base;
+		todo -= half;
 	}
+	base += (base->lux <= lux);
+
+	int slot = base - self->lut[prof];
 
 	self->prof = prof;
 
@@ -414,170 +442,25 @@ static void run_datapipes(void)
  * SENSOR_INPUT_FILTERING
  * ========================================================================= */
 
-/** Hooks that an input filter backend needs to implement */
-typedef struct
-{
-	const char *fi_name;
-
-	void      (*fi_reset)(void);
-	int       (*fi_filter)(int);
-	bool      (*fi_stable)(void);
-} inputflt_t;
-
-// INPUT_FILTER_BACKEND_MEDIAN
-static int      inputflt_median_filter(int add);
-static bool     inputflt_median_stable(void);
-static void     inputflt_median_reset(void);
-
-// INPUT_FILTER_BACKEND_DUMMY
-static int      inputflt_dummy_filter(int add);
-static bool     inputflt_dummy_stable(void);
-static void     inputflt_dummy_reset(void);
-
 // INPUT_FILTER_FRONTEND
 static void     inputflt_reset(void);
 static int      inputflt_filter(int lux);
 static bool     inputflt_stable(void);
 static void     inputflt_select(const char *name);
 static void     inputflt_flush_on_change(void);
+static void     inputflt_flush_if_requested(void);
 static void     inputflt_sampling_output(int lux);
 static gboolean inputflt_sampling_cb(gpointer aptr);
 static void     inputflt_sampling_start(void);
 static void     inputflt_sampling_stop(void);
+static void     inputflt_sampling_history(const mce_sensorfw_sample_t *samples, size_t count);
 static void     inputflt_init(void);
 static void     inputflt_quit(void);
 
-/* ------------------------------------------------------------------------- *
- * INPUT_FILTER_BACKEND_DUMMY
- * ------------------------------------------------------------------------- */
-
-static int inputflt_dummy_filter(int add)
-{
-	return add;
-}
-
-static bool inputflt_dummy_stable(void)
-{
-	return true;
-}
-
-static void inputflt_dummy_reset(void)
-{
-}
-
-/* ------------------------------------------------------------------------- *
- * INPUT_FILTER_BACKEND_MEDIAN
- * ------------------------------------------------------------------------- */
-
-/** Size of the median filtering window; the value must be odd */
-#define INPUTFLT_MEDIAN_SIZE 9
-
-/** Moving window of ALS measurements */
-static int  inputflt_median_fifo[INPUTFLT_MEDIAN_SIZE] = {  };
-
-/** Contents of inputflt_median_fifo in ascending order */
-static int  inputflt_median_stat[INPUTFLT_MEDIAN_SIZE] = {  };;
-
-static int inputflt_median_filter(int add)
-{
-	/* Adding negative sample values mean the sensor is not
-	 * in use and we should forget any history that exists */
-	if( add < 0 ) {
-		for( int i = 0; i < INPUTFLT_MEDIAN_SIZE; ++i )
-			inputflt_median_fifo[i] = inputflt_median_stat[i] = -1;
-		goto EXIT;
-	}
-
-	/* Value to be removed */
-	int rem = inputflt_median_fifo[0];
-
-	/* If negative value gets shifted out, it means we do not
-	 * have history. Initialize with the value we have */
-	if( rem < 0 ) {
-		for( int i = 0; i < INPUTFLT_MEDIAN_SIZE; ++i )
-			inputflt_median_fifo[i] = inputflt_median_stat[i] = add;
-		goto EXIT;
-	}
-
-	/* Shift the new value to the sample window fifo */
-	for( int i = 1; i < INPUTFLT_MEDIAN_SIZE; ++i )
-		inputflt_median_fifo[i-1] = inputflt_median_fifo[i];
-	inputflt_median_fifo[INPUTFLT_MEDIAN_SIZE-1] = add;
-
-	/* If we shift in the same value as what was shifted out,
-	 * the ordered statistics do not change */
-	if( add == rem )
-		goto EXIT;
-
-	/* Do one pass filtering of ordered statistics:
-	 * Remove the value we shifted out of the fifo
-	 * and insert the new sample to correct place. */
-
-	int src = 0, dst = 0, tmp;
-	int stk = inputflt_median_stat[src++];
-
-	while( dst < INPUTFLT_MEDIAN_SIZE ) {
-		if( stk < add )
-			tmp = stk, stk = add, add = tmp;
-
-		if( add == rem )
-			rem = INT_MAX;
-		else
-			inputflt_median_stat[dst++] = add;
-
-		if( src < INPUTFLT_MEDIAN_SIZE )
-			add = inputflt_median_stat[src++];
-		else
-			add = INT_MAX;
-	}
-
-EXIT:
-	mce_log(LL_DEBUG, "%d - %d - %d",
-		inputflt_median_stat[0],
-		inputflt_median_stat[INPUTFLT_MEDIAN_SIZE/2],
-		inputflt_median_stat[INPUTFLT_MEDIAN_SIZE-1]);
-
-	/* Return median of the history window */
-	return inputflt_median_stat[INPUTFLT_MEDIAN_SIZE/2];
-}
-
-static bool inputflt_median_stable(void)
-{
-	/* The smallest and the largest values in the sorted
-	 * samples buffer are equal */
-	return inputflt_median_stat[0] == inputflt_median_stat[INPUTFLT_MEDIAN_SIZE-1];
-}
-
-static void inputflt_median_reset(void)
-{
-	inputflt_median_filter(-1);
-}
-
 /* ------------------------------------------------------------------------- *
  * INPUT_FILTER_FRONTEND
  * ------------------------------------------------------------------------- */
 
-/** Array of available input filter backendss */
-static const inputflt_t inputflt_lut[] =
-{
-	// NOTE: "disabled" must be in the 1st slot
-	{
-		.fi_name   = "disabled",
-		.fi_reset  = inputflt_dummy_reset,
-		.fi_filter = inputflt_dummy_filter,
-		.fi_stable = inputflt_dummy_stable,
-	},
-	{
-		.fi_name   = "median",
-		.fi_reset  = inputflt_median_reset,
-		.fi_filter = inputflt_median_filter,
-		.fi_stable = inputflt_median_stable,
-	},
-};
-
-/** Currently used input filter backend */
-static const inputflt_t *inputflt_cur = inputflt_lut;
-
 /** Latest sensor value reported */
 static gint inputflt_lux_value = 0;
 
@@ -587,35 +470,13 @@ static bool inputflt_flush_history = true;
 /** Timer ID for: ALS data sampling */
 static guint inputflt_sampling_id = 0;
 
-/** Set input filter backend
+/** Set input filter backends
  *
- * @param name  name of the backend to use
+ * @param name  comma separated names of the backends to chain
  */
 static void inputflt_select(const char *name)
 {
-	inputflt_reset();
-
-	if( !name ) {
-		inputflt_cur = inputflt_lut;
-		goto EXIT;
-	}
-
-	for( size_t i = 0; ; ++i ) {
-		if( i == G_N_ELEMENTS(inputflt_lut) ) {
-			mce_log(LL_WARN, "filter '%s' is unknown", name);
-			inputflt_cur = inputflt_lut;
-			break;
-		}
-		if( !strcmp(inputflt_lut[i].fi_name, name) ) {
-			inputflt_cur = inputflt_lut + i;
-			break;
-		}
-	}
-EXIT:
-	mce_log(LL_NOTICE, "selected '%s' als filter",
-		inputflt_cur->fi_name);
-
-	inputflt_reset();
+	inputflt_chain_select(name);
 }
 
 /** Reset history buffer
@@ -624,7 +485,7 @@ EXIT:
  */
 static void inputflt_reset(void)
 {
-	inputflt_cur->fi_reset();
+	inputflt_chain_reset();
 }
 
 /** Apply filtering backend for als sensor value
@@ -635,16 +496,16 @@ static void inputflt_reset(void)
  */
 static int inputflt_filter(int lux)
 {
-	return inputflt_cur->fi_filter(lux);
+	return inputflt_chain_filter(lux);
 }
 
-/** Check if the whole history buffer is filled with the same value
+/** Check if all filter stages have settled to the current input
  *
  * Is used to determine when the pseudo sampling timer can be stopped.
  */
 static bool inputflt_stable(void)
 {
-	return inputflt_cur->fi_stable();
+	return inputflt_chain_stable();
 }
 
 /** Request filter history to be flushed on the next ALS change
@@ -654,6 +515,27 @@ static void inputflt_flush_on_change(void)
 	inputflt_flush_history = true;
 }
 
+/** Forget filter history if requested via inputflt_flush_on_change()
+ */
+static void inputflt_flush_if_requested(void)
+{
+	if( !inputflt_flush_history )
+		goto EXIT;
+
+	inputflt_flush_history = false;
+
+	mce_log(LL_DEBUG, "reset");
+
+	if( inputflt_sampling_id ) {
+		g_source_remove(inputflt_sampling_id),
+			inputflt_sampling_id = 0;
+	}
+	inputflt_reset();
+
+EXIT:
+	return;
+}
+
 /** Get filtered ALS state and feed it to datapipes
  *
  * @param lux  sensor reading, or -1 for no-data
@@ -717,17 +599,7 @@ static int inputflt_sampling_time(void)
 static void inputflt_sampling_start(void)
 {
 	// check if we need to flush history
-	if( inputflt_flush_history ) {
-		inputflt_flush_history = false;
-
-		mce_log(LL_DEBUG, "reset");
-
-		if( inputflt_sampling_id ) {
-			g_source_remove(inputflt_sampling_id),
-				inputflt_sampling_id = 0;
-		}
-		inputflt_reset();
-	}
+	inputflt_flush_if_requested();
 
 	// start collecting history
 	if( !inputflt_sampling_id ) {
@@ -773,10 +645,33 @@ EXIT:
 	return;
 }
 
+/** Shift older sensor readings into filter history
+ *
+ * Used when sensord delivers several samples in one go. Only the
+ * filter history is updated; the latest sample is passed on via
+ * inputflt_sampling_input() as usual.
+ *
+ * @param samples  sensor readings, oldest first
+ * @param count    number of samples
+ */
+static void inputflt_sampling_history(const mce_sensorfw_sample_t *samples,
+				      size_t count)
+{
+	inputflt_flush_if_requested();
+
+	for( size_t i = 0; i < count; ++i ) {
+		if( samples[i].value >= 0 )
+			inputflt_filter(samples[i].value);
+	}
+
+	mce_log(LL_DEBUG, "history: %zu samples", count);
+}
+
 /** Initialize ALS filtering
  */
 static void inputflt_init(void)
 {
+	inputflt_median_set_size(als_median_size);
 	inputflt_select(als_input_filter);
 }
 
@@ -808,6 +703,26 @@ static void als_lux_changed(int lux)
 			 USE_INDATA, CACHE_INDATA);
 }
 
+/** Handle all lux values received from sensord in one go
+ *
+ * @param samples  sensor readings, oldest first
+ * @param count    number of samples
+ */
+static void als_lux_batch(const mce_sensorfw_sample_t *samples, size_t count)
+{
+	/* The latest sample gets to als_lux_changed() separately */
+	if( als_enabled && count > 1 )
+		inputflt_sampling_history(samples, count - 1);
+}
+
+/** Start/stop receiving ALS sample batches from sensord
+ */
+static void als_lux_batch_rethink(void)
+{
+	mce_sensorfw_als_set_batch_notify(als_sample_batches ?
+					  als_lux_batch : 0);
+}
+
 static bool als_is_needed(void)
 {
 	bool need_als = false;
@@ -1408,6 +1323,20 @@ fba_gconf_cb(GConfClient *const gcc, const guint id,
 			// NB: takes effect on the next sample timer restart
 		}
 	}
+	else if( id == als_median_size_gconf_id ) {
+		gint old = als_median_size;
+		als_median_size = gconf_value_get_int(gcv);
+
+		if( als_median_size != old ) {
+			mce_log(LL_NOTICE, "als_median_size: %d -> %d",
+				old, als_median_size);
+			inputflt_median_set_size(als_median_size);
+		}
+	}
+	else if( id == als_sample_batches_gconf_id ) {
+		als_sample_batches = gconf_value_get_bool(gcv);
+		als_lux_batch_rethink();
+	}
 	else if (id == color_profile_gconf_id) {
 		const gchar *val = gconf_value_get_string(gcv);
 
@@ -1462,6 +1391,20 @@ static void fba_gconf_init(void)
 			    fba_gconf_cb,
 			    &als_sample_time_gconf_id);
 
+	/* ALS median filter window size setting */
+	mce_gconf_track_int(MCE_GCONF_DISPLAY_ALS_MEDIAN_SIZE,
+			    &als_median_size,
+			    ALS_MEDIAN_SIZE_DEFAULT,
+			    fba_gconf_cb,
+			    &als_median_size_gconf_id);
+
+	/* ALS sample batch setting */
+	mce_gconf_track_bool(MCE_GCONF_DISPLAY_ALS_SAMPLE_BATCHES,
+			     &als_sample_batches,
+			     ALS_SAMPLE_BATCHES_DEFAULT,
+			     fba_gconf_cb,
+			     &als_sample_batches_gconf_id);
+
 	/* Color profile setting */
 	mce_gconf_notifier_add(MCE_GCONF_DISPLAY_PATH,
 			       MCE_GCONF_DISPLAY_COLOR_PROFILE,
@@ -1490,6 +1433,12 @@ static void fba_gconf_quit(void)
 	mce_gconf_notifier_remove(als_sample_time_gconf_id),
 		als_sample_time_gconf_id = 0;
 
+	mce_gconf_notifier_remove(als_median_size_gconf_id),
+		als_median_size_gconf_id = 0;
+
+	mce_gconf_notifier_remove(als_sample_batches_gconf_id),
+		als_sample_batches_gconf_id = 0;
+
 	mce_gconf_notifier_remove(color_profile_gconf_id),
 		color_profile_gconf_id = 0;
 
@@ -1580,6 +1529,8 @@ const gchar *g_module_check_init(GModule *module)
 
 	inputflt_init();
 
+	als_lux_batch_rethink();
+
 	rethink_als_status();
 
 	return NULL;
@@ -1602,6 +1553,7 @@ void g_module_unload(GModule *module)
 
 	/* Remove callbacks pointing to unloaded module */
 	mce_sensorfw_als_set_notify(0);
+	mce_sensorfw_als_set_batch_notify(0);
 
 	inputflt_quit();
 
@@ -64,6 +64,9 @@ G_MODULE_EXPORT module_info_struct module_info = {
 /** Duration of suspend blocking after sending inactivity signals */
 #define MIA_KEEPALIVE_DURATION_MS 5000
 
+/** How much inactivity timeout can be delayed for wakeup coalescing [ms] */
+#define MIA_TIMER_SLACK_MS 1000
+
 /* ========================================================================= *
  * PROTOTYPES
  * ========================================================================= */
@@ -1168,6 +1171,7 @@ mia_timer_init(void)
     inactivity_timer_hnd = mce_hbtimer_create("inactivity-timer",
                                                inactivity_timeout * 1000,
                                                mia_timer_cb, 0);
+    mce_hbtimer_set_slack(inactivity_timer_hnd, MIA_TIMER_SLACK_MS);
 }
 
 /** Cleanup inactivity heartbeat timer
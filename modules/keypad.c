@@ -74,6 +74,7 @@ static output_state_t led_current_kb0_output =
 	.context = "led_current_kb0",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 1 LED current path */
 static output_state_t led_current_kb1_output =
@@ -81,6 +82,7 @@ static output_state_t led_current_kb1_output =
 	.context = "led_current_kb1",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 2 LED current path */
 static output_state_t led_current_kb2_output =
@@ -88,6 +90,7 @@ static output_state_t led_current_kb2_output =
 	.context = "led_current_kb2",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 3 LED current path */
 static output_state_t led_current_kb3_output =
@@ -95,6 +98,7 @@ static output_state_t led_current_kb3_output =
 	.context = "led_current_kb3",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 4 LED current path */
 static output_state_t led_current_kb4_output =
@@ -102,6 +106,7 @@ static output_state_t led_current_kb4_output =
 	.context = "led_current_kb4",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 5 LED current path */
 static output_state_t led_current_kb5_output =
@@ -109,6 +114,7 @@ static output_state_t led_current_kb5_output =
 	.context = "led_current_kb5",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 
 /** Key backlight channel 0 backlight path */
@@ -117,6 +123,7 @@ static output_state_t led_brightness_kb0_output =
 	.context = "led_brightness_kb0",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 1 backlight path */
 static output_state_t led_brightness_kb1_output =
@@ -124,6 +131,7 @@ static output_state_t led_brightness_kb1_output =
 	.context = "led_brightness_kb1",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 2 backlight path */
 static output_state_t led_brightness_kb2_output =
@@ -131,6 +139,7 @@ static output_state_t led_brightness_kb2_output =
 	.context = "led_brightness_kb2",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 3 backlight path */
 static output_state_t led_brightness_kb3_output =
@@ -138,6 +147,7 @@ static output_state_t led_brightness_kb3_output =
 	.context = "led_brightness_kb3",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 4 backlight path */
 static output_state_t led_brightness_kb4_output =
@@ -145,6 +155,7 @@ static output_state_t led_brightness_kb4_output =
 	.context = "led_brightness_kb4",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 /** Key backlight channel 5 backlight path */
 static output_state_t led_brightness_kb5_output =
@@ -152,6 +163,7 @@ static output_state_t led_brightness_kb5_output =
 	.context = "led_brightness_kb5",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 
 /** Path to engine 3 mode */
@@ -134,6 +134,9 @@ typedef enum {
  */
 #define CHANNEL_SIZE		32 * 2
 
+/** How much pattern timeouts can be delayed for wakeup coalescing [ms] */
+#define PATTERN_TIMEOUT_SLACK_MS	1000
+
 /** Structure holding LED patterns */
 typedef struct {
 	gchar *name;			/**< Pattern name */
@@ -229,6 +232,7 @@ static output_state_t led_current_rm_output =
 	.context = "led_current_rm",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 
 /** Path to green channel LED current path */
@@ -237,6 +241,7 @@ static output_state_t led_current_g_output =
 	.context = "led_current_g",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 
 /** Path to blue channel LED current path */
@@ -245,6 +250,7 @@ static output_state_t led_current_b_output =
 	.context = "led_current_b",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 
 /** Path to monochrome/red channel LED brightness path  */
@@ -253,6 +259,7 @@ static output_state_t led_brightness_rm_output =
 	.context = "led_brightness_rm",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 
 /** Path to red channel LED brightness path */
@@ -261,6 +268,7 @@ static output_state_t led_brightness_g_output =
 	.context = "led_brightness_g",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 
 /** Path to blue channel LED brightness path */
@@ -269,6 +277,7 @@ static output_state_t led_brightness_b_output =
 	.context = "led_brightness_b",
 	.truncate_file = TRUE,
 	.close_on_exit = FALSE,
+	.raw_mode = TRUE,
 };
 
 /** Path to engine 1 mode */
@@ -1179,6 +1188,7 @@ static void mono_program_led(const pattern_struct *const pattern)
 		.context = "led_on_period",
 		.truncate_file = TRUE,
 		.close_on_exit = TRUE,
+		.raw_mode = TRUE,
 		.path = MCE_LED_ON_PERIOD_PATH,
 	};
 	static output_state_t led_off_period_output =
@@ -1186,6 +1196,7 @@ static void mono_program_led(const pattern_struct *const pattern)
 		.context = "led_off_period",
 		.truncate_file = TRUE,
 		.close_on_exit = TRUE,
+		.raw_mode = TRUE,
 		.path = MCE_LED_OFF_PERIOD_PATH,
 	};
 
@@ -2789,6 +2800,8 @@ static gboolean init_patterns(void)
 						   psp->timeout * 1000,
 						   led_pattern_timeout_cb,
 						   psp);
+			mce_hbtimer_set_slack(psp->timeout_id,
+					      PATTERN_TIMEOUT_SLACK_MS);
 		}
 	}
 
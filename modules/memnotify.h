@@ -27,7 +27,9 @@ extern "C" {
  * Has a string parameter: "normal", "warning" or "critical" (actual strings
  * are defined in the memnotify_limit[] array).
  */
-# define MCE_MEMORY_LEVEL_SIG           "sig_memory_level_ind"
+# ifndef MCE_MEMORY_LEVEL_SIG
+#  define MCE_MEMORY_LEVEL_SIG          "sig_memory_level_ind"
+# endif
 
 /** Query current memory level */
 # define MCE_MEMORY_LEVEL_GET           "get_memory_level"
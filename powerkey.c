@@ -30,6 +30,7 @@
 #include "mce-gconf.h"
 #include "mce-dbus.h"
 #include "mce-dsme.h"
+#include "mce-trace.h"
 
 #ifdef ENABLE_WAKELOCKS
 # include "libwakelock.h"
@@ -1351,6 +1352,19 @@ cleanup:
  * STATE_MACHINE
  * ========================================================================= */
 
+/** Record state machine step in the flight recorder trace
+ *
+ * The name id is looked up once per call site; id + 1 is cached so
+ * that a failed lookup due to full name table is not retried.
+ */
+#define PWRKEY_STM_TRACE() do {\
+    static unsigned trace_name = 0;\
+    if( !trace_name )\
+        trace_name = mce_trace_intern(__func__) + 1u;\
+    mce_trace_add(MCE_TRACE_POWERKEY, trace_name - 1u,\
+                  datapipe_get_gint(display_state_pipe), 0);\
+} while(0)
+
 /** Check if we need to hold a wakelock for power key handling
  *
  * Wakelock is held if there are pending timers.
@@ -1399,18 +1413,24 @@ pwrkey_stm_terminate(void)
 
 static void pwrkey_stm_long_press_timeout(void)
 {
+    PWRKEY_STM_TRACE();
+
     // execute long press
     pwrkey_actions_do_long_press();
 }
 
 static void pwrkey_stm_double_press_timeout(void)
 {
+    PWRKEY_STM_TRACE();
+
     // execute single press
     pwrkey_actions_do_single_press();
 }
 
 static void pwrkey_stm_powerkey_pressed(void)
 {
+    PWRKEY_STM_TRACE();
+
     if( pwrkey_double_press_timer_cancel() ) {
         /* Pressed while we were waiting for double press */
         pwrkey_actions_do_double_press();
@@ -1430,6 +1450,8 @@ static void pwrkey_stm_powerkey_pressed(void)
 
 static void pwrkey_stm_powerkey_released(void)
 {
+    PWRKEY_STM_TRACE();
+
     if( pwrkey_long_press_timer_cancel() ) {
         /* Released while we were waiting for long press */
 
@@ -2213,13 +2235,9 @@ EXIT:
 static void
 pwrkey_datapipes_keypress_cb(gconstpointer const data)
 {
-    const struct input_event * const *evp;
-    const struct input_event *ev;
-
-    if( !(evp = data) )
-        goto EXIT;
+    const struct input_event *ev = data;
 
-    if( !(ev = *evp) )
+    if( !ev )
         goto EXIT;
 
     if( ev->type != EV_KEY )
@@ -120,6 +120,7 @@ systemctl daemon-reload || :
 %doc COPYING debian/copyright
 %{_sbindir}/mcetool
 %{_sbindir}/evdev_trace
+%{_sbindir}/mcetrace
 %{_mandir}/man8/mcetool.8.gz
 
 %files tests
@@ -0,0 +1,201 @@
+/**
+ * @file bench_alsfilter.c
+ * Benchmark for ambient light sensor input filter backends
+ * <p>
+ * Replays lux traces through a selection of input filter chains with
+ * a few median window sizes and reports the per-sample cost together with
+ * the number of times the filtered output changed, which translates
+ * to brightness adjustments made by the display plugin.
+ * <p>
+ * Recorded traces can be given as arguments; one lux value per line,
+ * negative values mark the sensor being powered off. Without
+ * arguments synthetic indoor, outdoor flicker and step traces are used.
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../modules/als-inputflt.h"
+
+#include "common.h"
+
+#include <glib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Number of samples in synthetic traces */
+#define BENCH_SAMPLES 200000
+
+/** Number of times each trace is replayed */
+#define BENCH_ROUNDS 10
+
+/** Lux trace to replay */
+typedef struct
+{
+	const char *name;
+	GArray     *data;
+} bench_trace_t;
+
+/** Load recorded lux trace from file
+ *
+ * @param path file with one lux value per line
+ *
+ * @return trace, or NULL on failure
+ */
+static GArray *bench_load_trace(const char *path)
+{
+	GArray *data = 0;
+	FILE   *file = fopen(path, "r");
+	int     lux;
+
+	if (!file) {
+		fprintf(stderr, "%s: can't open: %m\n", path);
+		goto EXIT;
+	}
+
+	data = g_array_new(FALSE, FALSE, sizeof lux);
+	while (fscanf(file, "%d", &lux) == 1)
+		g_array_append_val(data, lux);
+
+	if (data->len < 1) {
+		fprintf(stderr, "%s: no samples\n", path);
+		g_array_free(data, TRUE), data = 0;
+	}
+
+EXIT:
+	if (file)
+		fclose(file);
+
+	return data;
+}
+
+/** Generate synthetic lux trace
+ *
+ * @param base  average lux level
+ * @param noise maximum random deviation from base level
+ * @param step  interval for toggling between base and 10 x base
+ *              levels, or zero for constant level
+ *
+ * @return trace
+ */
+static GArray *bench_make_trace(int base, int noise, int step)
+{
+	GArray *data = g_array_sized_new(FALSE, FALSE, sizeof(int),
+					 BENCH_SAMPLES);
+
+	for (int i = 0; i < BENCH_SAMPLES; ++i) {
+		int lux = base;
+		if (step && (i / step) & 1)
+			lux *= 10;
+		if (noise)
+			lux += g_random_int_range(-noise, noise + 1);
+		if (lux < 0)
+			lux = 0;
+		g_array_append_val(data, lux);
+	}
+	return data;
+}
+
+/** Replay one trace through one filter chain
+ *
+ * @param chain filter chain
+ * @param size  median window size
+ * @param trace lux trace
+ */
+static void bench_run(const char *chain, int size,
+		      const bench_trace_t *trace)
+{
+	const int *lux = &g_array_index(trace->data, int, 0);
+	guint      cnt = trace->data->len;
+	guint      chg = 0;
+	guint      unstable = 0;
+	gint64     t0, t1;
+
+	inputflt_median_set_size(size);
+	inputflt_chain_select(chain);
+
+	t0 = bench_nsec();
+	for (int r = 0; r < BENCH_ROUNDS; ++r) {
+		int prev = -1;
+		for (guint i = 0; i < cnt; ++i) {
+			int out = inputflt_chain_filter(lux[i]);
+			if (out != prev)
+				chg += 1, prev = out;
+			if (!inputflt_chain_stable())
+				unstable += 1;
+		}
+		bench_sink = prev;
+		inputflt_chain_reset();
+	}
+	t1 = bench_nsec();
+
+	printf("%-22s %5d %-10s %9.1f %9u %9.1f%%\n",
+	       chain, size, trace->name,
+	       (t1 - t0) / (double)(cnt * BENCH_ROUNDS),
+	       chg / BENCH_ROUNDS,
+	       unstable * 100.0 / (cnt * BENCH_ROUNDS));
+}
+
+int main(int argc, char **argv)
+{
+	static const int sizes[] = { 9, 63, 255 };
+	static const char * const chains[] = {
+		"disabled",
+		"median",
+		"median,hysteresis",
+		"median,ema",
+		"median,slew",
+		"median,ema,slew",
+		"ema,slew",
+	};
+
+	bench_trace_t traces[argc > 1 ? argc - 1 : 3];
+	int           count = 0;
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; ++i) {
+			GArray *data = bench_load_trace(argv[i]);
+			if (!data)
+				return EXIT_FAILURE;
+			traces[count].name = argv[i];
+			traces[count].data = data;
+			++count;
+		}
+	}
+	else {
+		g_random_set_seed(42);
+		traces[count].name = "indoor";
+		traces[count++].data = bench_make_trace(300, 3, 0);
+		traces[count].name = "flicker";
+		traces[count++].data = bench_make_trace(20000, 8000, 0);
+		traces[count].name = "steps";
+		traces[count++].data = bench_make_trace(50, 5, 997);
+	}
+
+	printf("# ns per sample; output changes and unstable samples"
+	       " per replay\n");
+	printf("%-22s %5s %-10s %9s %9s %10s\n", "filter", "size", "trace",
+	       "ns", "changes", "unstable");
+
+	for (size_t c = 0; c < G_N_ELEMENTS(chains); ++c) {
+		for (size_t k = 0; k < G_N_ELEMENTS(sizes); ++k) {
+			for (int i = 0; i < count; ++i)
+				bench_run(chains[c], sizes[k], &traces[i]);
+		}
+	}
+
+	for (int i = 0; i < count; ++i)
+		g_array_free(traces[i].data, TRUE);
+
+	return EXIT_SUCCESS;
+}
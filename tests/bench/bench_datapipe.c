@@ -0,0 +1,126 @@
+/**
+ * @file bench_datapipe.c
+ * Micro-benchmark for datapipe execution cost
+ * <p>
+ * Measures the per execute_datapipe() cost as a function of the
+ * number of registered filters and output triggers.
+ *
+ * For reference the same callbacks are also dispatched using
+ * the g_slist_nth_data() walk datapipe.c used to do, so that
+ * the before/after numbers are available from a single run.
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../datapipe.h"
+
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Number of datapipe executions per measurement round */
+#define BENCH_ROUNDS 200000
+
+/** Largest number of callbacks to benchmark */
+#define BENCH_MAX_CALLBACKS 64
+
+/** Dummy filter callback */
+static gpointer bench_filter_cb(gpointer data)
+{
+	return GINT_TO_POINTER(GPOINTER_TO_INT(data) + 1);
+}
+
+/** Dummy output trigger callback */
+static void bench_trigger_cb(gconstpointer data)
+{
+	bench_sink += GPOINTER_TO_INT(data);
+}
+
+/** Reference dispatch: the pre-array linked list walk
+ *
+ * @param filters  list of filter callbacks
+ * @param triggers list of output trigger callbacks
+ * @param data     input value
+ */
+static void bench_slist_execute(GSList *filters, GSList *triggers,
+				gpointer data)
+{
+	gpointer (*filter)(gpointer input);
+	void (*trigger)(gconstpointer input);
+
+	for (gint i = 0; (filter = g_slist_nth_data(filters, i)) != NULL; i++)
+		data = filter(data);
+
+	for (gint i = 0; (trigger = g_slist_nth_data(triggers, i)) != NULL; i++)
+		trigger(data);
+}
+
+/** Measure one callback count using both dispatch methods
+ *
+ * @param count number of filters and output triggers to register
+ */
+static void bench_run(gint count)
+{
+	datapipe_struct pipe;
+	GSList *filters = NULL;
+	GSList *triggers = NULL;
+	gint64 t0, t1, t2;
+
+	setup_datapipe(&pipe, READ_WRITE, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(0));
+
+	for (gint i = 0; i < count; ++i) {
+		append_filter_to_datapipe(&pipe, bench_filter_cb);
+		append_output_trigger_to_datapipe(&pipe, bench_trigger_cb);
+		filters = g_slist_append(filters, bench_filter_cb);
+		triggers = g_slist_append(triggers, bench_trigger_cb);
+	}
+
+	t0 = bench_nsec();
+	for (gint i = 0; i < BENCH_ROUNDS; ++i)
+		bench_slist_execute(filters, triggers, GINT_TO_POINTER(i));
+
+	t1 = bench_nsec();
+	for (gint i = 0; i < BENCH_ROUNDS; ++i)
+		execute_datapipe(&pipe, GINT_TO_POINTER(i),
+				 USE_INDATA, CACHE_INDATA);
+	t2 = bench_nsec();
+
+	printf("%9d %12.1f %12.1f\n", count,
+	       (t1 - t0) / (double)BENCH_ROUNDS,
+	       (t2 - t1) / (double)BENCH_ROUNDS);
+
+	for (gint i = 0; i < count; ++i) {
+		remove_output_trigger_from_datapipe(&pipe, bench_trigger_cb);
+		remove_filter_from_datapipe(&pipe, bench_filter_cb);
+	}
+	free_datapipe(&pipe);
+
+	g_slist_free(triggers);
+	g_slist_free(filters);
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	printf("# ns per execute_datapipe(); N filters + N output triggers\n");
+	printf("%9s %12s %12s\n", "callbacks", "slist-walk", "array");
+
+	for (gint count = 1; count <= BENCH_MAX_CALLBACKS; count *= 2)
+		bench_run(count);
+
+	return EXIT_SUCCESS;
+}
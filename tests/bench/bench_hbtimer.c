@@ -0,0 +1,129 @@
+/**
+ * @file bench_hbtimer.c
+ * Stress benchmark for heartbeat timer queue operations
+ * <p>
+ * Registers a few hundred heartbeat timers, similarly to what the
+ * display, tklock, inactivity and led modules do collectively, and
+ * measures the cost of starting, re-arming, stopping and dispatching
+ * them as a function of the number of registered timers.
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../mce-hbtimer.h"
+#include "../../datapipe.h"
+
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Dispatch entry point; not exposed via mce-hbtimer.h */
+void mht_queue_dispatch_timers(void);
+
+/** Number of start/stop operations per measurement round */
+#define BENCH_OPERATIONS 200000
+
+/** Largest number of timers to benchmark */
+#define BENCH_MAX_TIMERS 1024
+
+/** Number of notified timers */
+static volatile gint bench_notified = 0;
+
+/** Dummy timer callback */
+static gboolean bench_notify_cb(gpointer aptr)
+{
+	(void)aptr;
+	bench_notified += 1;
+	return FALSE;
+}
+
+/** Measure one timer count
+ *
+ * @param count number of timers to register
+ */
+static void bench_run(gint count)
+{
+	mce_hbtimer_t *timer[BENCH_MAX_TIMERS];
+	gint64 t0, t1, t2, t3;
+
+	/* Timers with periods spread over ten minutes */
+	for (gint i = 0; i < count; ++i) {
+		gint period = 1000 + g_random_int_range(0, 600000);
+		timer[i] = mce_hbtimer_create("bench", period,
+					      bench_notify_cb, 0);
+		mce_hbtimer_start(timer[i]);
+	}
+
+	/* Re-arm random timers with random periods */
+	t0 = bench_nsec();
+	for (gint i = 0; i < BENCH_OPERATIONS; ++i) {
+		mce_hbtimer_t *t = timer[g_random_int_range(0, count)];
+		mce_hbtimer_set_period(t, 1000 + g_random_int_range(0, 600000));
+		mce_hbtimer_start(t);
+	}
+
+	/* Stop and restart random timers */
+	t1 = bench_nsec();
+	for (gint i = 0; i < BENCH_OPERATIONS; ++i) {
+		mce_hbtimer_t *t = timer[g_random_int_range(0, count)];
+		if (mce_hbtimer_is_active(t))
+			mce_hbtimer_stop(t);
+		else
+			mce_hbtimer_start(t);
+	}
+
+	/* Make all timers due and dispatch them in one go */
+	for (gint i = 0; i < count; ++i) {
+		mce_hbtimer_set_period(timer[i], 0);
+		mce_hbtimer_start(timer[i]);
+	}
+	bench_notified = 0;
+
+	t2 = bench_nsec();
+	mht_queue_dispatch_timers();
+	t3 = bench_nsec();
+
+	if (bench_notified != count)
+		fprintf(stderr, "notified %d timers, expected %d\n",
+			bench_notified, count);
+
+	printf("%9d %12.1f %12.1f %12.1f\n", count,
+	       (t1 - t0) / (double)BENCH_OPERATIONS,
+	       (t2 - t1) / (double)BENCH_OPERATIONS,
+	       (t3 - t2) / (double)count);
+
+	for (gint i = 0; i < count; ++i)
+		mce_hbtimer_delete(timer[i]);
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	mce_datapipe_init();
+	mce_hbtimer_init();
+
+	printf("# ns per operation; N registered heartbeat timers\n");
+	printf("%9s %12s %12s %12s\n", "timers", "rearm", "start/stop",
+	       "dispatch");
+
+	for (gint count = 16; count <= BENCH_MAX_TIMERS; count *= 2)
+		bench_run(count);
+
+	mce_hbtimer_quit();
+	mce_datapipe_quit();
+
+	return EXIT_SUCCESS;
+}
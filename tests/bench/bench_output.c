@@ -0,0 +1,174 @@
+/**
+ * @file bench_output.c
+ * Benchmark for output_state_t number writers
+ * <p>
+ * Writes sequences of numbers, similar to what display brightness
+ * fades and led/keypad backlight updates produce, via the stdio and
+ * raw file descriptor modes of mce_write_number_string_to_file() and
+ * reports the cost per write.
+ * <p>
+ * Sysfs nodes are substituted with regular files, by default in
+ * /dev/shm so that they live on tmpfs; another directory can be given
+ * as argument. Write syscall counts are taken from /proc/self/io,
+ * which does not include seeks and truncates - use "strace -c" for
+ * a full picture.
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../mce-io.h"
+#include "../../mce.h"
+
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Number of writes per measurement */
+#define BENCH_WRITES 100000
+
+/** Stub for mce.c functionality used by mce-io.c */
+void mce_abort(void)
+{
+	abort();
+}
+
+/** Stub for mce.c functionality used by mce-io.c */
+void mce_quit_mainloop(void)
+{
+	exit(EXIT_FAILURE);
+}
+
+/** Get number of write syscalls made by this process
+ *
+ * @return syscw value from /proc/self/io, or 0 if not available
+ */
+static guint64 bench_syscw(void)
+{
+	guint64 res = 0;
+	char    key[32];
+	guint64 val;
+	FILE   *file = fopen("/proc/self/io", "r");
+
+	if (!file)
+		goto EXIT;
+
+	while (fscanf(file, "%31s %" G_GUINT64_FORMAT, key, &val) == 2) {
+		if (!strcmp(key, "syscw:")) {
+			res = val;
+			break;
+		}
+	}
+	fclose(file);
+
+EXIT:
+	return res;
+}
+
+/** Get value for write number i in a fade-like sequence
+ *
+ * @param i       write number
+ * @param repeats number of times each value is repeated
+ *
+ * @return value to write
+ */
+static gulong bench_value(int i, int repeats)
+{
+	int k = (i / repeats) % 512;
+	return k < 256 ? k : 511 - k;
+}
+
+/** Measure one output mode
+ *
+ * @param dir     directory for the stand-in file
+ * @param mode    mode name
+ * @param raw     use raw file descriptor mode
+ * @param repeats number of times each value is repeated
+ *
+ * @return TRUE if the file content was correct afterwards
+ */
+static gboolean bench_run(const char *dir, const char *mode,
+			  gboolean raw, int repeats)
+{
+	gboolean  ok   = FALSE;
+	gchar    *path = g_strdup_printf("%s/bench_output.%d", dir,
+					 (int)getpid());
+	gchar    *data = 0;
+	gulong    last = 0;
+	gint64    t0, t1;
+	guint64   c0, c1;
+
+	output_state_t output =
+	{
+		.context = mode,
+		.truncate_file = TRUE,
+		.close_on_exit = FALSE,
+		.raw_mode = raw,
+		.path = path,
+	};
+
+	/* Open the file outside the measurement */
+	mce_write_number_string_to_file(&output, 1000);
+
+	c0 = bench_syscw();
+	t0 = bench_nsec();
+	for (int i = 0; i < BENCH_WRITES; ++i)
+		mce_write_number_string_to_file(&output,
+						last = bench_value(i, repeats));
+	t1 = bench_nsec();
+	c1 = bench_syscw();
+
+	mce_close_output(&output);
+
+	/* Shorter values must not leave stale digits behind */
+	if (g_file_get_contents(path, &data, 0, 0) &&
+	    strtoul(data, 0, 10) == last)
+		ok = TRUE;
+
+	printf("%-10s %7d %9.1f %9.3f %s\n", mode, repeats,
+	       (t1 - t0) / (double)BENCH_WRITES,
+	       (c1 - c0) / (double)BENCH_WRITES,
+	       ok ? "ok" : "MISMATCH");
+
+	unlink(path);
+	g_free(data);
+	g_free(path);
+
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	static const int repeats[] = { 1, 4 };
+
+	const char *dir = (argc > 1) ? argv[1] : "/dev/shm";
+	int         res = EXIT_SUCCESS;
+
+	if (access(dir, W_OK) == -1)
+		dir = g_get_tmp_dir();
+
+	printf("# %s: ns and write syscalls per write;"
+	       " each value written N times\n", dir);
+	printf("%-10s %7s %9s %9s\n", "mode", "N", "ns", "syscw");
+
+	for (size_t i = 0; i < G_N_ELEMENTS(repeats); ++i) {
+		if (!bench_run(dir, "stdio", FALSE, repeats[i]))
+			res = EXIT_FAILURE;
+		if (!bench_run(dir, "raw", TRUE, repeats[i]))
+			res = EXIT_FAILURE;
+	}
+
+	return res;
+}
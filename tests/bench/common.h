@@ -0,0 +1,31 @@
+/**
+ * @file common.h
+ * Helpers shared by the mce micro-benchmarks
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MCE_TESTS_BENCH_COMMON_H
+#define MCE_TESTS_BENCH_COMMON_H
+
+#include <glib.h>
+
+/** Sink for values computed in benchmark loops
+ *
+ * Storing results here keeps the compiler from optimizing
+ * away the code that is being measured.
+ */
+extern volatile gint bench_sink;
+
+gint64 bench_nsec(void);
+
+#endif /* MCE_TESTS_BENCH_COMMON_H */
@@ -0,0 +1,432 @@
+#include <check.h>
+#include <glib.h>
+
+#include "common.h"
+
+/* Tested module */
+#include "../../modules/als-inputflt.h"
+#include "../../modules/display.h"
+
+#include <string.h>
+
+/*
+ * Note that the following modules are linked instead of providing stubs:
+ *
+ * 	- modules/als-inputflt.c
+ * 	- mce-log.c
+ */
+
+/* ------------------------------------------------------------------------- *
+ * HELPERS
+ * ------------------------------------------------------------------------- */
+
+/** Feed samples through the selected chain and check the output
+ *
+ * @param in   input samples
+ * @param out  expected output values
+ * @param cnt  number of samples
+ */
+static void ut_check_sequence(const int *in, const int *out, size_t cnt)
+{
+	for( size_t i = 0; i < cnt; ++i ) {
+		int res = inputflt_chain_filter(in[i]);
+		ck_assert_msg(res == out[i],
+			      "sample %zu: in=%d out=%d expected=%d",
+			      i, in[i], res, out[i]);
+	}
+}
+
+#define UT_CHECK_SEQUENCE(IN_, OUT_) do {\
+	G_STATIC_ASSERT(G_N_ELEMENTS(IN_) == G_N_ELEMENTS(OUT_));\
+	ut_check_sequence(IN_, OUT_, G_N_ELEMENTS(IN_));\
+} while(0)
+
+/** Check that the selected chain passes samples through as is */
+static void ut_check_passthrough(void)
+{
+	static const int in[] = { 100, 3, -1, 7000, 7001, 0, 50 };
+
+	UT_CHECK_SEQUENCE(in, in);
+	ck_assert(inputflt_chain_stable());
+}
+
+static void ut_teardown(void)
+{
+	inputflt_chain_select(0);
+	inputflt_median_set_size(ALS_MEDIAN_SIZE_DEFAULT);
+}
+
+/* ------------------------------------------------------------------------- *
+ * MEDIAN REFERENCE
+ *
+ * Straightforward sort-the-window implementation that the heap based
+ * median filter is compared against.
+ * ------------------------------------------------------------------------- */
+
+/** Samples in the reference window, oldest first after ut_ref_head */
+static int ut_ref_win[ALS_MEDIAN_SIZE_MAX];
+
+/** Number of samples in the reference window */
+static int ut_ref_size = 0;
+
+/** Reference window slot to replace next */
+static int ut_ref_head = 0;
+
+/** Flag for: reference window holds valid samples */
+static bool ut_ref_primed = false;
+
+static int ut_ref_cmp(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/** Set up reference window
+ *
+ * @param size  effective median window size
+ */
+static void ut_ref_reset(int size)
+{
+	ut_ref_size   = size;
+	ut_ref_head   = 0;
+	ut_ref_primed = false;
+}
+
+/** Feed sample to the reference window
+ *
+ * @param add  sample value, or -1 for no-data
+ *
+ * @return expected filter output
+ */
+static int ut_ref_filter(int add)
+{
+	int srt[ALS_MEDIAN_SIZE_MAX];
+
+	if( add < 0 ) {
+		ut_ref_primed = false;
+		return -1;
+	}
+
+	if( !ut_ref_primed ) {
+		for( int i = 0; i < ut_ref_size; ++i )
+			ut_ref_win[i] = add;
+		ut_ref_head   = 0;
+		ut_ref_primed = true;
+	}
+	else {
+		ut_ref_win[ut_ref_head] = add;
+		ut_ref_head = (ut_ref_head + 1) % ut_ref_size;
+	}
+
+	memcpy(srt, ut_ref_win, ut_ref_size * sizeof *srt);
+	qsort(srt, ut_ref_size, sizeof *srt, ut_ref_cmp);
+	return srt[ut_ref_size / 2];
+}
+
+/** Check whether all samples in the reference window are equal */
+static bool ut_ref_stable(void)
+{
+	if( !ut_ref_primed )
+		return true;
+
+	for( int i = 1; i < ut_ref_size; ++i ) {
+		if( ut_ref_win[i] != ut_ref_win[0] )
+			return false;
+	}
+	return true;
+}
+
+/** Feed sample to both median filter and reference, compare results
+ *
+ * @param add  sample value, or -1 for no-data
+ */
+static void ut_check_median_step(int add)
+{
+	int exp = ut_ref_filter(add);
+	int res = inputflt_chain_filter(add);
+
+	ck_assert_msg(res == exp, "size=%d in=%d out=%d expected=%d",
+		      ut_ref_size, add, res, exp);
+	ck_assert_msg(inputflt_chain_stable() == ut_ref_stable(),
+		      "size=%d in=%d stable=%d expected=%d",
+		      ut_ref_size, add, inputflt_chain_stable(),
+		      ut_ref_stable());
+}
+
+/** Compare median filter against reference using random samples
+ *
+ * The sample history is refilled a few times: by no-data samples
+ * and by selecting the filter again. Each round ends with a run of
+ * equal samples long enough to make the filter stable.
+ *
+ * @param size  requested median window size
+ * @param eff   window size the request is expected to result in
+ * @param range sample values are taken from [0, range)
+ */
+static void ut_check_median(int size, int eff, int range)
+{
+	GRand *rnd = g_rand_new_with_seed(size * 1000u + range);
+
+	inputflt_median_set_size(size);
+	inputflt_chain_select("median");
+	ut_ref_reset(eff);
+
+	for( int round = 0; round < 3; ++round ) {
+		if( round == 1 ) {
+			ut_check_median_step(-1);
+		}
+		else if( round == 2 ) {
+			inputflt_chain_select("median");
+			ut_ref_reset(eff);
+		}
+
+		/* First sample fills the window and is stable */
+		ut_check_median_step(g_rand_int_range(rnd, 0, range));
+		ck_assert(inputflt_chain_stable());
+
+		for( int i = 0; i < 4 * eff + 16; ++i )
+			ut_check_median_step(g_rand_int_range(rnd, 0, range));
+
+		int add = g_rand_int_range(rnd, 0, range);
+		for( int i = 0; i < eff + 1; ++i )
+			ut_check_median_step(add);
+		ck_assert(inputflt_chain_stable());
+	}
+
+	g_rand_free(rnd);
+}
+
+/* ------------------------------------------------------------------------- *
+ * CHAIN PARSING
+ * ------------------------------------------------------------------------- */
+
+START_TEST (ut_check_chain_empty)
+{
+	inputflt_chain_select(0);
+	ut_check_passthrough();
+
+	inputflt_chain_select("");
+	ut_check_passthrough();
+
+	inputflt_chain_select(" , ,\t");
+	ut_check_passthrough();
+
+	inputflt_chain_select("disabled");
+	ut_check_passthrough();
+}
+END_TEST
+
+START_TEST (ut_check_chain_invalid)
+{
+	static const int in[]  = { 100, 1000, 1000 };
+	static const int out[] = { 100,  150,  225 };
+
+	inputflt_chain_select("bogus");
+	ut_check_passthrough();
+
+	/* Partial names do not match */
+	inputflt_chain_select("sle,slewx");
+	ut_check_passthrough();
+
+	/* Unknown entries are skipped, the rest is used */
+	inputflt_chain_select("bogus, slew");
+	UT_CHECK_SEQUENCE(in, out);
+}
+END_TEST
+
+START_TEST (ut_check_chain_order)
+{
+	/* Hysteresis after ema holds back the slowly rising average,
+	 * ema after hysteresis smooths the step that got through */
+	static const int in[]       = { 100, 112, 112 };
+	static const int ema_hyst[] = { 100, 100, 100 };
+	static const int hyst_ema[] = { 100, 103, 105 };
+
+	inputflt_chain_select("ema,hysteresis");
+	UT_CHECK_SEQUENCE(in, ema_hyst);
+
+	inputflt_chain_select("hysteresis,ema");
+	UT_CHECK_SEQUENCE(in, hyst_ema);
+
+	/* The "disabled" stage is a no-op */
+	inputflt_chain_select("disabled,ema");
+	UT_CHECK_SEQUENCE(in, hyst_ema);
+}
+END_TEST
+
+START_TEST (ut_check_chain_select_resets)
+{
+	static const int in[]  = { 100, 1000 };
+	static const int out[] = { 100,  150 };
+
+	inputflt_chain_select("slew");
+	UT_CHECK_SEQUENCE(in, out);
+
+	/* History is forgotten: first sample passes as is */
+	inputflt_chain_select("slew");
+	UT_CHECK_SEQUENCE(in, out);
+
+	/* No-data resets too */
+	ck_assert_int_eq(inputflt_chain_filter(-1), -1);
+	UT_CHECK_SEQUENCE(in, out);
+}
+END_TEST
+
+/* ------------------------------------------------------------------------- *
+ * FILTER STAGES
+ * ------------------------------------------------------------------------- */
+
+START_TEST (ut_check_stage_ema)
+{
+	static const int in[]  = {
+		100, 200, 200, 200, 200, 200, 200, 200,
+		200, 200, 200, 200, 200, 200, 200,
+	};
+	static const int out[] = {
+		100, 125, 144, 158, 168, 176, 182, 187,
+		190, 192, 194, 196, 197, 200, 200,
+	};
+	static const int dim_in[]  = { -1, 1000,   0,   0,   0 };
+	static const int dim_out[] = { -1, 1000, 750, 563, 422 };
+
+	inputflt_chain_select("ema");
+
+	ck_assert_int_eq(inputflt_chain_filter(100), 100);
+	ck_assert(inputflt_chain_stable());
+	ck_assert_int_eq(inputflt_chain_filter(200), 125);
+	ck_assert(!inputflt_chain_stable());
+
+	inputflt_chain_reset();
+	UT_CHECK_SEQUENCE(in, out);
+
+	/* Output snaps to input when close enough */
+	ck_assert(inputflt_chain_stable());
+
+	UT_CHECK_SEQUENCE(dim_in, dim_out);
+}
+END_TEST
+
+START_TEST (ut_check_stage_median_odd)
+{
+	static const int sizes[] = { 3, 5, 9, 31, ALS_MEDIAN_SIZE_MAX };
+
+	for( size_t i = 0; i < G_N_ELEMENTS(sizes); ++i ) {
+		ut_check_median(sizes[i], sizes[i], 4);
+		ut_check_median(sizes[i], sizes[i], 100000);
+	}
+}
+END_TEST
+
+START_TEST (ut_check_stage_median_even)
+{
+	/* Even sizes are rounded up, out of range sizes are clipped */
+	static const int sizes[][2] = {
+		{ 0,   ALS_MEDIAN_SIZE_MIN },
+		{ 2,   3 },
+		{ 4,   5 },
+		{ 10,  11 },
+		{ 254, ALS_MEDIAN_SIZE_MAX },
+		{ 256, ALS_MEDIAN_SIZE_MAX },
+	};
+
+	for( size_t i = 0; i < G_N_ELEMENTS(sizes); ++i ) {
+		ut_check_median(sizes[i][0], sizes[i][1], 4);
+		ut_check_median(sizes[i][0], sizes[i][1], 100000);
+	}
+}
+END_TEST
+
+START_TEST (ut_check_stage_median_resize)
+{
+	static const int in[]  = { 10, 50, 50, 50, 10 };
+	static const int out[] = { 10, 10, 50, 50, 50 };
+
+	inputflt_median_set_size(3);
+	inputflt_chain_select("median");
+	UT_CHECK_SEQUENCE(in, out);
+	ck_assert(!inputflt_chain_stable());
+
+	/* Changing the window size forgets the history */
+	inputflt_median_set_size(5);
+	ck_assert(inputflt_chain_stable());
+	ck_assert_int_eq(inputflt_chain_filter(20), 20);
+	ck_assert(inputflt_chain_stable());
+
+	/* Setting the same size again keeps it */
+	inputflt_median_set_size(4);
+	ck_assert_int_eq(inputflt_chain_filter(30), 20);
+	ck_assert(!inputflt_chain_stable());
+}
+END_TEST
+
+START_TEST (ut_check_stage_hysteresis)
+{
+	static const int in[]  = { 100, 105, 110, 111, 101, 100, 99, -1,  0, 1, 2, 3 };
+	static const int out[] = { 100, 100, 100, 111, 111, 111, 99, -1,  0, 0, 0, 3 };
+
+	inputflt_chain_select("hysteresis");
+	UT_CHECK_SEQUENCE(in, out);
+	ck_assert(inputflt_chain_stable());
+}
+END_TEST
+
+START_TEST (ut_check_stage_slew)
+{
+	static const int in[]  = { 100, 1000, 1000, 1000,   0,   0, -1, 4, 100, 100 };
+	static const int out[] = { 100,  150,  225,  337, 253, 190, -1, 4,   9,  14 };
+
+	inputflt_chain_select("slew");
+
+	ck_assert_int_eq(inputflt_chain_filter(100), 100);
+	ck_assert(inputflt_chain_stable());
+	ck_assert_int_eq(inputflt_chain_filter(1000), 150);
+	ck_assert(!inputflt_chain_stable());
+
+	inputflt_chain_reset();
+	UT_CHECK_SEQUENCE(in, out);
+
+	/* Converges eventually */
+	for( int i = 0; i < 100 && !inputflt_chain_stable(); ++i )
+		inputflt_chain_filter(100);
+	ck_assert(inputflt_chain_stable());
+	ck_assert_int_eq(inputflt_chain_filter(100), 100);
+}
+END_TEST
+
+static Suite *ut_als_inputflt_suite (void)
+{
+	Suite *s = suite_create ("ut_als_inputflt");
+
+	TCase *tc_chain = tcase_create ("chain");
+	tcase_add_checked_fixture(tc_chain, 0, ut_teardown);
+	tcase_add_test (tc_chain, ut_check_chain_empty);
+	tcase_add_test (tc_chain, ut_check_chain_invalid);
+	tcase_add_test (tc_chain, ut_check_chain_order);
+	tcase_add_test (tc_chain, ut_check_chain_select_resets);
+	suite_add_tcase (s, tc_chain);
+
+	TCase *tc_stage = tcase_create ("stage");
+	tcase_add_checked_fixture(tc_stage, 0, ut_teardown);
+	tcase_add_test (tc_stage, ut_check_stage_ema);
+	tcase_add_test (tc_stage, ut_check_stage_median_odd);
+	tcase_add_test (tc_stage, ut_check_stage_median_even);
+	tcase_add_test (tc_stage, ut_check_stage_median_resize);
+	tcase_add_test (tc_stage, ut_check_stage_hysteresis);
+	tcase_add_test (tc_stage, ut_check_stage_slew);
+	suite_add_tcase (s, tc_stage);
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	int number_failed;
+	Suite *s = ut_als_inputflt_suite ();
+	SRunner *sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed (sr);
+	srunner_free (sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
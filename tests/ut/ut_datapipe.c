@@ -0,0 +1,241 @@
+#include <check.h>
+#include <glib.h>
+
+#include "common.h"
+
+/* Tested module */
+#include "../../datapipe.c"
+
+/*
+ * Note that the following modules are linked instead of providing stubs:
+ *
+ * 	- mce-lib.c
+ * 	- mce-log.c (mce_log_file() is replaced by stub from common.h)
+ * 	- mce-trace.c
+ */
+
+/* ------------------------------------------------------------------------- *
+ * TEST DATAPIPE
+ * ------------------------------------------------------------------------- */
+
+/** Datapipe used by all test cases */
+static datapipe_struct ut_pipe;
+
+/** Value added by ut_filter() */
+static gint ut_filter_offset = 0;
+
+/** Number of ut_filter() calls */
+static gint ut_filter_calls = 0;
+
+/** Number of ut_output_trigger() calls */
+static gint ut_output_calls = 0;
+
+/** Value ut_output_trigger() was last called with */
+static gint ut_output_value = -1;
+
+static gpointer ut_filter(gpointer data)
+{
+	ut_filter_calls += 1;
+	return GINT_TO_POINTER(GPOINTER_TO_INT(data) + ut_filter_offset);
+}
+
+static void ut_output_trigger(gconstpointer data)
+{
+	ut_output_calls += 1;
+	ut_output_value = GPOINTER_TO_INT(data);
+}
+
+/** Run pending idle callbacks */
+static void ut_iterate_mainloop(void)
+{
+	while( g_main_context_iteration(NULL, FALSE) )
+		;
+}
+
+static void ut_pipe_setup(void)
+{
+	setup_datapipe(&ut_pipe, READ_WRITE, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(0));
+	append_filter_to_datapipe(&ut_pipe, ut_filter);
+	append_output_trigger_to_datapipe(&ut_pipe, ut_output_trigger);
+
+	ut_filter_offset = 0;
+	ut_filter_calls = 0;
+	ut_output_calls = 0;
+	ut_output_value = -1;
+}
+
+static void ut_pipe_teardown(void)
+{
+	remove_output_trigger_from_datapipe(&ut_pipe, ut_output_trigger);
+	remove_filter_from_datapipe(&ut_pipe, ut_filter);
+	free_datapipe(&ut_pipe);
+	ut_iterate_mainloop();
+}
+
+/* ------------------------------------------------------------------------- *
+ * TESTS
+ * ------------------------------------------------------------------------- */
+
+START_TEST (ut_check_always_dispatch)
+{
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(5),
+			 USE_INDATA, CACHE_INDATA);
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(5),
+			 USE_INDATA, CACHE_INDATA);
+
+	ck_assert_int_eq(ut_filter_calls, 2);
+	ck_assert_int_eq(ut_output_calls, 2);
+	ck_assert_int_eq(ut_output_value, 5);
+}
+END_TEST
+
+START_TEST (ut_check_on_change_suppresses_output)
+{
+	datapipe_set_dispatch_policy(&ut_pipe, DATAPIPE_DISPATCH_ON_CHANGE);
+
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(5),
+			 USE_INDATA, CACHE_INDATA);
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(5),
+			 USE_INDATA, CACHE_INDATA);
+	execute_datapipe(&ut_pipe, NULL, USE_CACHE, DONT_CACHE_INDATA);
+
+	ck_assert_int_eq(ut_filter_calls, 3);
+	ck_assert_int_eq(ut_output_calls, 1);
+	ck_assert_int_eq(ut_output_value, 5);
+	ck_assert_int_eq(ut_pipe.suppressed, 2);
+
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(6),
+			 USE_INDATA, CACHE_INDATA);
+
+	ck_assert_int_eq(ut_output_calls, 2);
+	ck_assert_int_eq(ut_output_value, 6);
+}
+END_TEST
+
+START_TEST (ut_check_on_change_reruns_filters)
+{
+	datapipe_set_dispatch_policy(&ut_pipe, DATAPIPE_DISPATCH_ON_CHANGE);
+
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(5),
+			 USE_INDATA, CACHE_INDATA);
+
+	/* Same input, but filter state changes the result */
+	ut_filter_offset = 10;
+	gconstpointer res = execute_datapipe(&ut_pipe, GINT_TO_POINTER(5),
+					     USE_INDATA, CACHE_INDATA);
+
+	ck_assert_int_eq(GPOINTER_TO_INT(res), 15);
+	ck_assert_int_eq(ut_filter_calls, 2);
+	ck_assert_int_eq(ut_output_calls, 2);
+	ck_assert_int_eq(ut_output_value, 15);
+}
+END_TEST
+
+START_TEST (ut_check_coalesce_merges_reevaluations)
+{
+	datapipe_set_dispatch_policy(&ut_pipe, DATAPIPE_DISPATCH_COALESCE);
+
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(5),
+			 USE_INDATA, CACHE_INDATA);
+	ck_assert_int_eq(ut_output_calls, 1);
+
+	ut_filter_offset = 1;
+	execute_datapipe(&ut_pipe, NULL, USE_CACHE, DONT_CACHE_INDATA);
+	ut_filter_offset = 2;
+	execute_datapipe(&ut_pipe, NULL, USE_CACHE, DONT_CACHE_INDATA);
+	ut_filter_offset = 3;
+	execute_datapipe(&ut_pipe, NULL, USE_CACHE, DONT_CACHE_INDATA);
+
+	/* Nothing is dispatched before returning to the main loop */
+	ck_assert_int_eq(ut_filter_calls, 1);
+	ck_assert_int_eq(ut_output_calls, 1);
+	ck_assert_int_eq(ut_pipe.coalesced, 2);
+
+	ut_iterate_mainloop();
+
+	ck_assert_int_eq(ut_filter_calls, 2);
+	ck_assert_int_eq(ut_output_calls, 2);
+	ck_assert_int_eq(ut_output_value, 8);
+}
+END_TEST
+
+START_TEST (ut_check_coalesce_returns_cached)
+{
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(7),
+			 USE_INDATA, CACHE_INDATA);
+	ck_assert_int_eq(ut_output_calls, 1);
+
+	/* Changing the policy forgets the last output value */
+	datapipe_set_dispatch_policy(&ut_pipe, DATAPIPE_DISPATCH_COALESCE);
+
+	ut_filter_offset = 2;
+	gconstpointer res = execute_datapipe(&ut_pipe, NULL,
+					     USE_CACHE, DONT_CACHE_INDATA);
+
+	/* Filters have not been run yet -> cached data is returned */
+	ck_assert_int_eq(GPOINTER_TO_INT(res), 7);
+	ck_assert_int_eq(ut_filter_calls, 1);
+	ck_assert_int_eq(ut_output_calls, 1);
+
+	ut_iterate_mainloop();
+
+	ck_assert_int_eq(ut_filter_calls, 2);
+	ck_assert_int_eq(ut_output_calls, 2);
+	ck_assert_int_eq(ut_output_value, 9);
+}
+END_TEST
+
+START_TEST (ut_check_coalesce_cancelled_by_indata)
+{
+	datapipe_set_dispatch_policy(&ut_pipe, DATAPIPE_DISPATCH_COALESCE);
+
+	execute_datapipe(&ut_pipe, NULL, USE_CACHE, DONT_CACHE_INDATA);
+
+	/* New input is dispatched immediately and supersedes the
+	 * pending re-evaluation */
+	execute_datapipe(&ut_pipe, GINT_TO_POINTER(7),
+			 USE_INDATA, CACHE_INDATA);
+
+	ck_assert_int_eq(ut_output_calls, 1);
+	ck_assert_int_eq(ut_output_value, 7);
+
+	ut_iterate_mainloop();
+
+	ck_assert_int_eq(ut_filter_calls, 1);
+	ck_assert_int_eq(ut_output_calls, 1);
+}
+END_TEST
+
+static Suite *ut_datapipe_suite (void)
+{
+	Suite *s = suite_create ("ut_datapipe");
+
+	TCase *tc_core = tcase_create ("dispatch");
+	tcase_add_checked_fixture(tc_core, ut_pipe_setup, ut_pipe_teardown);
+
+	tcase_add_test (tc_core, ut_check_always_dispatch);
+	tcase_add_test (tc_core, ut_check_on_change_suppresses_output);
+	tcase_add_test (tc_core, ut_check_on_change_reruns_filters);
+	tcase_add_test (tc_core, ut_check_coalesce_merges_reevaluations);
+	tcase_add_test (tc_core, ut_check_coalesce_returns_cached);
+	tcase_add_test (tc_core, ut_check_coalesce_cancelled_by_indata);
+
+	suite_add_tcase (s, tc_core);
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	int number_failed;
+	Suite *s = ut_datapipe_suite ();
+	SRunner *sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed (sr);
+	srunner_free (sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
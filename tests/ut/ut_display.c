@@ -92,6 +92,16 @@ gint, mce_conf_get_int, (const gchar *group, const gchar *key,
 	return 0;
 }
 
+EXTERN_STUB (
+gboolean, mce_conf_get_bool, (const gchar *group, const gchar *key,
+			      const gboolean defaultval))
+{
+	(void)group;
+	(void)key;
+
+	return defaultval;
+}
+
 typedef struct stub__mce_conf_get_string_item
 {
 	const gchar *group;
@@ -0,0 +1,318 @@
+#include <check.h>
+#include <glib.h>
+
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+#include "common.h"
+
+/* Tested module */
+#include "../../event-input.c"
+
+/*
+ * Note that the following modules are linked instead of providing stubs:
+ *
+ * 	- datapipe.c
+ * 	- evdev.c
+ * 	- mce-lib.c
+ * 	- mce-log.c (mce_log_file() is replaced by stub from common.h)
+ * 	- mce-trace.c
+ */
+
+/* ------------------------------------------------------------------------- *
+ * EXTERN STUBS
+ * ------------------------------------------------------------------------- */
+
+/** Make epoll_wait() used by the input thread fail */
+static bool ut_epoll_fail = false;
+
+/** I/O monitor mce_io_mon_resume() was last called with */
+static mce_io_mon_t *ut_resumed_iomon = 0;
+
+/* Linked via --defsym so that the call from input thread gets it too */
+int stub__epoll_wait(int epfd, struct epoll_event *events,
+		     int maxevents, int timeout);
+int stub__epoll_wait(int epfd, struct epoll_event *events,
+		     int maxevents, int timeout)
+{
+	if( __atomic_load_n(&ut_epoll_fail, __ATOMIC_ACQUIRE) ) {
+		errno = EBADF;
+		return -1;
+	}
+	return epoll_pwait(epfd, events, maxevents, timeout, 0);
+}
+
+EXTERN_STUB (
+gboolean, mce_conf_get_bool, (const gchar *group, const gchar *key,
+			      const gboolean defaultval))
+{
+	(void)group;
+	(void)key;
+	(void)defaultval;
+
+	/* Enable the input thread */
+	return TRUE;
+}
+
+EXTERN_STUB (
+void, wakelock_lock, (const char *name, long long ns))
+{
+	(void)name;
+	(void)ns;
+}
+
+EXTERN_STUB (
+void, wakelock_unlock, (const char *name))
+{
+	(void)name;
+}
+
+/* Fake I/O monitors are file descriptors cast to pointers */
+
+EXTERN_STUB (
+int, mce_io_mon_get_fd, (const mce_io_mon_t *iomon))
+{
+	return GPOINTER_TO_INT(iomon);
+}
+
+EXTERN_STUB (
+const gchar *, mce_io_mon_get_path, (const mce_io_mon_t *iomon))
+{
+	(void)iomon;
+
+	return "/dev/input/ut";
+}
+
+EXTERN_STUB (
+void *, mce_io_mon_get_user_data, (const mce_io_mon_t *iomon))
+{
+	(void)iomon;
+
+	return 0;
+}
+
+EXTERN_STUB (
+void, mce_io_mon_resume, (mce_io_mon_t *iomon))
+{
+	ut_resumed_iomon = iomon;
+}
+
+EXTERN_STUB (
+submode_t, mce_get_submode_int32, (void))
+{
+	return MCE_NORMAL_SUBMODE;
+}
+
+/* ------------------------------------------------------------------------- *
+ * TEST DATA
+ * ------------------------------------------------------------------------- */
+
+/** Pipe standing in for an evdev device node */
+static int ut_device[2] = { -1, -1 };
+
+/** Run main loop until the input thread has been stopped
+ *
+ * @return true if the thread was stopped, false on timeout
+ */
+static bool ut_wait_fallback(void)
+{
+	gint64 limit = g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+
+	while( evin_thread_running ) {
+		if( g_get_monotonic_time() > limit )
+			return false;
+		g_main_context_iteration(NULL, FALSE);
+		g_usleep(1000);
+	}
+	return true;
+}
+
+static void ut_queue_setup(void)
+{
+	evin_thread_queue_head = 0;
+	evin_thread_queue_tail = 0;
+}
+
+static void ut_thread_setup(void)
+{
+	ut_queue_setup();
+
+	ut_epoll_fail = false;
+	ut_resumed_iomon = 0;
+
+	ck_assert(pipe2(ut_device, O_CLOEXEC | O_NONBLOCK) == 0);
+}
+
+static void ut_thread_teardown(void)
+{
+	evin_thread_quit();
+
+	g_slist_free(evin_iomon_device_list), evin_iomon_device_list = 0;
+
+	for( int i = 0; i < 2; ++i ) {
+		if( ut_device[i] != -1 )
+			close(ut_device[i]), ut_device[i] = -1;
+	}
+}
+
+/** Start input thread and hand the fake device over to it
+ *
+ * @param type device type
+ */
+static void ut_thread_start(evin_evdevtype_t type)
+{
+	evin_thread_init();
+	ck_assert(evin_thread_running);
+
+	ck_assert(evin_thread_add_device(ut_device[0], type));
+	evin_iomon_device_list =
+		g_slist_prepend(evin_iomon_device_list,
+				GINT_TO_POINTER(ut_device[0]));
+}
+
+/* ------------------------------------------------------------------------- *
+ * TESTS
+ * ------------------------------------------------------------------------- */
+
+START_TEST (ut_check_queue_push_never_blocks)
+{
+	evin_msg_t ev   = { .type = EVIN_MSG_EVENT };
+	evin_msg_t done = { .type = EVIN_MSG_DONE };
+	evin_msg_t msg;
+	unsigned   cnt  = 0;
+
+	while( evin_thread_queue_push(&ev) )
+		++cnt;
+
+	/* Last slot is reserved for end of wakeup marker */
+	ck_assert_int_eq(cnt, EVIN_THREAD_QUEUE_SIZE - 1);
+	ck_assert(!evin_thread_queue_push(&ev));
+	ck_assert(evin_thread_queue_push(&done));
+	ck_assert(!evin_thread_queue_push(&done));
+
+	for( cnt = 0; evin_thread_queue_pop(&msg); ++cnt )
+		;
+
+	ck_assert_int_eq(cnt, EVIN_THREAD_QUEUE_SIZE);
+	ck_assert_int_eq(msg.type, EVIN_MSG_DONE);
+
+	/* Room is available again after draining */
+	ck_assert(evin_thread_queue_push(&ev));
+}
+END_TEST
+
+START_TEST (ut_check_thread_exit_falls_back)
+{
+	/* The thread fails on first epoll_wait(), but the main loop
+	 * notices it only after the device has been added */
+	ut_epoll_fail = true;
+	ut_thread_start(EVDEV_ACTIVITY);
+
+	ck_assert(ut_wait_fallback());
+	ck_assert_int_eq(mce_io_mon_get_fd(ut_resumed_iomon), ut_device[0]);
+	ck_assert_int_eq(evin_thread_notify_id, 0);
+
+	/* Devices added afterwards are read from main loop */
+	ck_assert(!evin_thread_add_device(ut_device[1], EVDEV_ACTIVITY));
+}
+END_TEST
+
+START_TEST (ut_check_full_queue_pauses_device)
+{
+	const int          total = EVIN_THREAD_QUEUE_SIZE * 2;
+	struct input_event ev    = { .type = EV_KEY, .code = KEY_POWER };
+	evin_msg_t         msg;
+	int                seen  = 0;
+	gint64             limit;
+
+	/* More events than fit in the queue are pending before the
+	 * input thread gets to read anything */
+	for( int i = 0; i < total; ++i ) {
+		ev.value = i;
+		ck_assert(write(ut_device[1], &ev, sizeof ev) == sizeof ev);
+	}
+
+	ut_thread_start(EVDEV_INPUT);
+
+	/* Nothing drains the queue -> device gets paused */
+	limit = g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+	while( !__atomic_load_n(&evin_thread_dev_paused, __ATOMIC_ACQUIRE) ) {
+		ck_assert(g_get_monotonic_time() < limit);
+		g_usleep(1000);
+	}
+
+	/* The rest stays in the device buffer */
+	int pending = 0;
+	ck_assert(ioctl(ut_device[0], FIONREAD, &pending) == 0);
+	ck_assert(pending > 0);
+
+	/* Drain and resume like the main loop does; all events must
+	 * arrive in order */
+	limit = g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+	while( seen < total ) {
+		ck_assert(g_get_monotonic_time() < limit);
+
+		while( evin_thread_queue_pop(&msg) ) {
+			if( msg.type == EVIN_MSG_DONE )
+				evin_thread_wakelock_release();
+			if( msg.type != EVIN_MSG_EVENT )
+				continue;
+			ck_assert_int_eq(msg.ev.value, seen);
+			++seen;
+		}
+		evin_thread_resume_devices();
+		g_usleep(1000);
+	}
+
+	ck_assert(!evin_thread_queue_pop(&msg) || msg.type == EVIN_MSG_DONE);
+}
+END_TEST
+
+START_TEST (ut_check_notify_error_falls_back)
+{
+	ut_thread_start(EVDEV_ACTIVITY);
+
+	/* Notify watch removal must not leave devices unread */
+	guint id = evin_thread_notify_id;
+	ck_assert(!evin_thread_notify_cb(0, G_IO_HUP, 0));
+	g_source_remove(id);
+
+	ck_assert(!evin_thread_running);
+	ck_assert_int_eq(mce_io_mon_get_fd(ut_resumed_iomon), ut_device[0]);
+	ck_assert_int_eq(evin_thread_wakelock_count, 0);
+}
+END_TEST
+
+static Suite *ut_event_input_suite (void)
+{
+	Suite *s = suite_create ("ut_event_input");
+
+	TCase *tc_queue = tcase_create ("queue");
+	tcase_add_checked_fixture(tc_queue, ut_queue_setup, 0);
+	tcase_add_test (tc_queue, ut_check_queue_push_never_blocks);
+	suite_add_tcase (s, tc_queue);
+
+	TCase *tc_thread = tcase_create ("thread");
+	tcase_add_checked_fixture(tc_thread, ut_thread_setup,
+				  ut_thread_teardown);
+	tcase_add_test (tc_thread, ut_check_thread_exit_falls_back);
+	tcase_add_test (tc_thread, ut_check_full_queue_pauses_device);
+	tcase_add_test (tc_thread, ut_check_notify_error_falls_back);
+	suite_add_tcase (s, tc_thread);
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	int number_failed;
+	Suite *s = ut_event_input_suite ();
+	SRunner *sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed (sr);
+	srunner_free (sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
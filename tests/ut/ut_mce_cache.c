@@ -0,0 +1,250 @@
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "common.h"
+
+/* Tested module */
+#include "../../mce-cache.c"
+
+/*
+ * Note that the following modules are linked instead of providing stubs:
+ *
+ * 	- mce-log.c (mce_log_file() is replaced by stub from common.h)
+ */
+
+/* ------------------------------------------------------------------------- *
+ * EXTERN STUBS
+ * ------------------------------------------------------------------------- */
+
+EXTERN_STUB (
+gboolean, mce_io_update_file_atomic, (const char *path,
+				      const void *data, size_t size,
+				      mode_t mode, gboolean keep_backup))
+{
+	(void)mode;
+	(void)keep_backup;
+
+	return g_file_set_contents(path, data, size, 0);
+}
+
+/* ------------------------------------------------------------------------- *
+ * TEST DATA
+ * ------------------------------------------------------------------------- */
+
+/** Scratch directory for cache and source files */
+static gchar *ut_dir = 0;
+
+/** Cache image file */
+static gchar *ut_cache_path = 0;
+
+/** Source file the cached data is derived from */
+static gchar *ut_source_path = 0;
+
+/** Records passed to ut_collect_cb(), as "a:b:c" strings */
+static GPtrArray *ut_records = 0;
+
+static void ut_collect_cb(const char *a, const char *b,
+			  const char *c, gpointer aptr)
+{
+	(void)aptr;
+
+	g_ptr_array_add(ut_records, g_strdup_printf("%s:%s:%s", a, b, c));
+}
+
+/** Get stamp for the single source file */
+static guint64 ut_stamp(void)
+{
+	char *paths[] = { ut_source_path };
+	return mce_cache_stamp("ut", paths, G_N_ELEMENTS(paths));
+}
+
+/** Write cache image with a few records */
+static void ut_save(guint64 stamp)
+{
+	mce_cache_t *cache = mce_cache_create();
+
+	mce_cache_add(cache, "Display", "Brightness", "3");
+	mce_cache_add(cache, "Display", 0, "");
+	mce_cache_add(cache, "LED", "Pattern", "1;2;3");
+
+	ck_assert(mce_cache_save(cache, ut_cache_path, stamp));
+
+	mce_cache_delete(cache);
+}
+
+/** Load cache image, collecting records to ut_records */
+static gboolean ut_load(guint64 stamp)
+{
+	g_ptr_array_set_size(ut_records, 0);
+	return mce_cache_load(ut_cache_path, stamp, ut_collect_cb, 0);
+}
+
+static void ut_setup(void)
+{
+	ut_dir = g_dir_make_tmp("ut_mce_cache.XXXXXX", 0);
+	ck_assert(ut_dir != 0);
+
+	ut_cache_path  = g_build_filename(ut_dir, "test.cache", NULL);
+	ut_source_path = g_build_filename(ut_dir, "test.ini", NULL);
+	ut_records     = g_ptr_array_new_with_free_func(g_free);
+
+	ck_assert(g_file_set_contents(ut_source_path,
+				      "[Display]\nBrightness=3\n", -1, 0));
+}
+
+static void ut_teardown(void)
+{
+	g_unlink(ut_cache_path);
+	g_unlink(ut_source_path);
+	g_rmdir(ut_dir);
+
+	g_ptr_array_free(ut_records, TRUE), ut_records = 0;
+	g_free(ut_source_path), ut_source_path = 0;
+	g_free(ut_cache_path), ut_cache_path = 0;
+	g_free(ut_dir), ut_dir = 0;
+}
+
+/* ------------------------------------------------------------------------- *
+ * TESTS
+ * ------------------------------------------------------------------------- */
+
+START_TEST (ut_check_cache_hit)
+{
+	guint64 stamp = ut_stamp();
+
+	ut_save(stamp);
+
+	ck_assert(ut_stamp() == stamp);
+	ck_assert(ut_load(stamp));
+
+	ck_assert_int_eq(ut_records->len, 3);
+	ck_assert_str_eq(ut_records->pdata[0], "Display:Brightness:3");
+	ck_assert_str_eq(ut_records->pdata[1], "Display::");
+	ck_assert_str_eq(ut_records->pdata[2], "LED:Pattern:1;2;3");
+}
+END_TEST
+
+START_TEST (ut_check_cache_miss)
+{
+	guint64 stamp = ut_stamp();
+
+	/* No cache file */
+	ck_assert(!ut_load(stamp));
+
+	/* Stale stamp */
+	ut_save(stamp + 1);
+	ck_assert(!ut_load(stamp));
+	ck_assert_int_eq(ut_records->len, 0);
+}
+END_TEST
+
+START_TEST (ut_check_cache_corrupted)
+{
+	guint64 stamp = ut_stamp();
+	gchar  *data  = 0;
+	gsize   size  = 0;
+
+	ut_save(stamp);
+
+	/* Flip a bit in the record data */
+	ck_assert(g_file_get_contents(ut_cache_path, &data, &size, 0));
+	ck_assert(size > sizeof(mce_cache_header_t));
+	data[size - 2] ^= 1;
+	ck_assert(g_file_set_contents(ut_cache_path, data, size, 0));
+	g_free(data);
+
+	ck_assert(!ut_load(stamp));
+	ck_assert_int_eq(ut_records->len, 0);
+
+	/* Truncated */
+	ck_assert(g_file_set_contents(ut_cache_path, "MCECACHE", 8, 0));
+	ck_assert(!ut_load(stamp));
+}
+END_TEST
+
+START_TEST (ut_check_cache_invalidated_by_edit)
+{
+	guint64     stamp = ut_stamp();
+	struct stat st;
+
+	ut_save(stamp);
+	ck_assert(stat(ut_source_path, &st) == 0);
+
+	/* Same size content, original modification time restored */
+	int fd = open(ut_source_path, O_WRONLY);
+	ck_assert(fd != -1);
+	ck_assert(pwrite(fd, "5", 1, 21) == 1);
+	struct timespec ts[2] = { st.st_atim, st.st_mtim };
+	ck_assert(futimens(fd, ts) == 0);
+	close(fd);
+
+	ck_assert(ut_stamp() != stamp);
+	ck_assert(!ut_load(ut_stamp()));
+}
+END_TEST
+
+START_TEST (ut_check_cache_survives_touch)
+{
+	guint64 stamp = ut_stamp();
+
+	ut_save(stamp);
+
+	/* Rewriting identical content is not a change */
+	g_usleep(50 * 1000);
+	ck_assert(g_file_set_contents(ut_source_path,
+				      "[Display]\nBrightness=3\n", -1, 0));
+	ck_assert(utimensat(AT_FDCWD, ut_source_path, 0, 0) == 0);
+
+	ck_assert(ut_stamp() == stamp);
+	ck_assert(ut_load(stamp));
+}
+END_TEST
+
+START_TEST (ut_check_cache_invalidated_by_removal)
+{
+	guint64 stamp = ut_stamp();
+
+	ut_save(stamp);
+	g_unlink(ut_source_path);
+
+	ck_assert(ut_stamp() != stamp);
+	ck_assert(!ut_load(ut_stamp()));
+}
+END_TEST
+
+static Suite *ut_mce_cache_suite (void)
+{
+	Suite *s = suite_create ("ut_mce_cache");
+
+	TCase *tc_core = tcase_create ("core");
+	tcase_add_checked_fixture(tc_core, ut_setup, ut_teardown);
+
+	tcase_add_test (tc_core, ut_check_cache_hit);
+	tcase_add_test (tc_core, ut_check_cache_miss);
+	tcase_add_test (tc_core, ut_check_cache_corrupted);
+	tcase_add_test (tc_core, ut_check_cache_invalidated_by_edit);
+	tcase_add_test (tc_core, ut_check_cache_survives_touch);
+	tcase_add_test (tc_core, ut_check_cache_invalidated_by_removal);
+
+	suite_add_tcase (s, tc_core);
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	int number_failed;
+	Suite *s = ut_mce_cache_suite ();
+	SRunner *sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed (sr);
+	srunner_free (sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,270 @@
+#include <check.h>
+#include <glib.h>
+
+#include "common.h"
+
+/* Tested module */
+#include "../../mce-dbus.c"
+
+/*
+ * Note that the following modules are linked instead of providing stubs:
+ *
+ * 	- mce-log.c (mce_log_file() is replaced by stub from common.h)
+ */
+
+/* ------------------------------------------------------------------------- *
+ * EXTERN STUBS
+ * ------------------------------------------------------------------------- */
+
+/** Messages passed to dbus_connection_send(), as "member:arg0" strings */
+static GPtrArray *ut_sent = 0;
+
+EXTERN_STUB (
+dbus_bool_t, dbus_connection_send, (DBusConnection *connection,
+				    DBusMessage *message,
+				    dbus_uint32_t *serial))
+{
+	(void)connection;
+	(void)serial;
+
+	const char *arg0 = 0;
+
+	if( !dbus_message_get_args(message, 0,
+				   DBUS_TYPE_STRING, &arg0,
+				   DBUS_TYPE_INVALID) )
+		arg0 = 0;
+
+	g_ptr_array_add(ut_sent,
+			g_strdup_printf("%s:%s",
+					dbus_message_get_member(message),
+					arg0 ?: ""));
+	return TRUE;
+}
+
+/* ------------------------------------------------------------------------- *
+ * HELPERS
+ * ------------------------------------------------------------------------- */
+
+/** Signal that is never collapsed */
+#define UT_EVENT_SIG "ut_event_ind"
+
+/** Send mce signal with a string argument
+ *
+ * @param member  signal name
+ * @param arg0    string argument
+ * @param dest    destination for unicast signal, or NULL
+ */
+static void ut_send_signal(const char *member, const char *arg0,
+			   const char *dest)
+{
+	DBusMessage *msg = dbus_message_new_signal(MCE_SIGNAL_PATH,
+						   MCE_SIGNAL_IF, member);
+	ck_assert(msg != 0);
+
+	ck_assert(dbus_message_append_args(msg,
+					   DBUS_TYPE_STRING, &arg0,
+					   DBUS_TYPE_INVALID));
+	if( dest )
+		ck_assert(dbus_message_set_destination(msg, dest));
+
+	ck_assert(dbus_send_message(msg));
+}
+
+/** Check messages sent so far, in order
+ *
+ * @param expect  NULL terminated array of "member:arg0" strings
+ */
+static void ut_check_sent(const char * const *expect)
+{
+	guint cnt = 0;
+
+	while( expect[cnt] )
+		++cnt;
+
+	ck_assert_int_eq(ut_sent->len, cnt);
+
+	for( guint i = 0; i < cnt; ++i )
+		ck_assert_str_eq(ut_sent->pdata[i], expect[i]);
+}
+
+/** Run pending idle callbacks */
+static void ut_iterate_mainloop(void)
+{
+	while( g_main_context_iteration(NULL, FALSE) )
+		;
+}
+
+static void ut_setup(void)
+{
+	ut_sent = g_ptr_array_new_with_free_func(g_free);
+
+	dbus_batch_window = 0;
+	dbus_batch_collapsed = 0;
+}
+
+static void ut_teardown(void)
+{
+	dbus_batch_quit();
+	ut_iterate_mainloop();
+
+	g_ptr_array_free(ut_sent, TRUE), ut_sent = 0;
+}
+
+/* ------------------------------------------------------------------------- *
+ * TESTS
+ * ------------------------------------------------------------------------- */
+
+START_TEST (ut_check_batch_disabled)
+{
+	static const char * const expect[] = {
+		MCE_DISPLAY_SIG ":on",
+		MCE_DISPLAY_SIG ":off",
+		0
+	};
+
+	dbus_batch_window = -1;
+
+	ut_send_signal(MCE_DISPLAY_SIG, "on", 0);
+	ut_send_signal(MCE_DISPLAY_SIG, "off", 0);
+
+	ut_check_sent(expect);
+	ck_assert_int_eq(dbus_batch_collapsed, 0);
+}
+END_TEST
+
+START_TEST (ut_check_batch_collapses_state)
+{
+	static const char * const expect[] = {
+		UT_EVENT_SIG ":1",
+		UT_EVENT_SIG ":2",
+		MCE_DISPLAY_SIG ":dimmed",
+		0
+	};
+
+	ut_send_signal(MCE_DISPLAY_SIG, "on", 0);
+	ut_send_signal(UT_EVENT_SIG, "1", 0);
+	ut_send_signal(MCE_DISPLAY_SIG, "off", 0);
+	ut_send_signal(UT_EVENT_SIG, "2", 0);
+	ut_send_signal(MCE_DISPLAY_SIG, "dimmed", 0);
+
+	/* Nothing is sent before returning to the main loop */
+	ck_assert_int_eq(ut_sent->len, 0);
+
+	ut_iterate_mainloop();
+
+	/* Event signals are kept, the latest state goes last */
+	ut_check_sent(expect);
+	ck_assert_int_eq(dbus_batch_collapsed, 2);
+}
+END_TEST
+
+START_TEST (ut_check_batch_arg0_keyed)
+{
+	static const char * const expect[] = {
+		MCE_CONFIG_CHANGE_SIG ":/b",
+		MCE_CONFIG_CHANGE_SIG ":/a",
+		0
+	};
+
+	ut_send_signal(MCE_CONFIG_CHANGE_SIG, "/a", 0);
+	ut_send_signal(MCE_CONFIG_CHANGE_SIG, "/b", 0);
+	ut_send_signal(MCE_CONFIG_CHANGE_SIG, "/a", 0);
+
+	ut_iterate_mainloop();
+
+	ut_check_sent(expect);
+	ck_assert_int_eq(dbus_batch_collapsed, 1);
+}
+END_TEST
+
+START_TEST (ut_check_batch_flushed_by_other)
+{
+	static const char * const expect[] = {
+		MCE_DISPLAY_SIG ":on",
+		UT_EVENT_SIG ":unicast",
+		MCE_DISPLAY_SIG ":off",
+		"ut_method:",
+		0
+	};
+
+	/* Unicast signals are not queued, but retain ordering */
+	ut_send_signal(MCE_DISPLAY_SIG, "on", 0);
+	ut_send_signal(UT_EVENT_SIG, "unicast", ":1.1");
+	ck_assert_int_eq(ut_sent->len, 2);
+
+	/* Same for method calls */
+	ut_send_signal(MCE_DISPLAY_SIG, "off", 0);
+	DBusMessage *msg = dbus_message_new_method_call(MCE_SERVICE,
+							MCE_REQUEST_PATH,
+							MCE_REQUEST_IF,
+							"ut_method");
+	ck_assert(msg != 0);
+	ck_assert(dbus_send_message(msg));
+
+	ut_check_sent(expect);
+
+	/* Nothing is left in the queue */
+	ut_iterate_mainloop();
+	ut_check_sent(expect);
+}
+END_TEST
+
+START_TEST (ut_check_batch_window)
+{
+	static const char * const expect[] = {
+		MCE_DISPLAY_SIG ":off",
+		0
+	};
+
+	dbus_batch_window = 20;
+
+	ut_send_signal(MCE_DISPLAY_SIG, "on", 0);
+	ut_iterate_mainloop();
+	ut_send_signal(MCE_DISPLAY_SIG, "off", 0);
+	ut_iterate_mainloop();
+
+	/* Collapsing spans main loop iterations within the window */
+	ck_assert_int_eq(ut_sent->len, 0);
+
+	gint64 limit = g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+	while( ut_sent->len == 0 ) {
+		ck_assert(g_get_monotonic_time() < limit);
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	ut_check_sent(expect);
+	ck_assert_int_eq(dbus_batch_collapsed, 1);
+}
+END_TEST
+
+static Suite *ut_mce_dbus_suite (void)
+{
+	Suite *s = suite_create ("ut_mce_dbus");
+
+	TCase *tc_batch = tcase_create ("batch");
+	tcase_add_checked_fixture(tc_batch, ut_setup, ut_teardown);
+
+	tcase_add_test (tc_batch, ut_check_batch_disabled);
+	tcase_add_test (tc_batch, ut_check_batch_collapses_state);
+	tcase_add_test (tc_batch, ut_check_batch_arg0_keyed);
+	tcase_add_test (tc_batch, ut_check_batch_flushed_by_other);
+	tcase_add_test (tc_batch, ut_check_batch_window);
+
+	suite_add_tcase (s, tc_batch);
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	int number_failed;
+	Suite *s = ut_mce_dbus_suite ();
+	SRunner *sr = srunner_create (s);
+	srunner_run_all (sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed (sr);
+	srunner_free (sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
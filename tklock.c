@@ -86,9 +86,6 @@ typedef enum
 /** Maximum number of concurrent notification ui exceptions */
 #define TKLOCK_NOTIF_SLOTS 32
 
-/** Signal to send when lpm ui state changes */
-#define MCE_LPM_UI_MODE_SIG "lpm_ui_mode_ind"
-
 /* ========================================================================= *
  * DATATYPES
  * ========================================================================= */
@@ -520,6 +517,7 @@ static output_state_t mce_touchscreen_sysfs_disable_output =
     .context = "touchscreen_disable",
     .truncate_file = TRUE,
     .close_on_exit = TRUE,
+    .raw_mode = TRUE,
 };
 
 /** SysFS path to touchscreen double-tap gesture control */
@@ -534,6 +532,7 @@ static output_state_t mce_keypad_sysfs_disable_output =
     .context = "keypad_disable",
     .truncate_file = TRUE,
     .close_on_exit = TRUE,
+    .raw_mode = TRUE,
 };
 
 /* ========================================================================= *
@@ -1226,13 +1225,9 @@ static void tklock_datapipe_camera_button_cb(gconstpointer const data)
  */
 static void tklock_datapipe_keypress_cb(gconstpointer const data)
 {
-    const struct input_event *const*evp;
-    const struct input_event       *ev;
-
-    if( !(evp = data) )
-        goto EXIT;
+    const struct input_event *ev = data;
 
-    if( !(ev = *evp) )
+    if( !ev )
         goto EXIT;
 
     // ignore non-key events
@@ -1440,13 +1435,9 @@ static bool tklock_datapipe_have_tklock_submode(void)
  */
 static void tklock_datapipe_touchscreen_cb(gconstpointer const data)
 {
-    struct input_event const *const *evp;
-    struct input_event const *ev;
-
-    if( !(evp = data) )
-        goto EXIT;
+    const struct input_event *ev = data;
 
-    if( !(ev = *evp) )
+    if( !ev )
         goto EXIT;
 
     mce_log(LL_DEBUG, "TS EVENT: %d %d %d", ev->type, ev->code, ev->value);
@@ -1563,6 +1554,8 @@ static void tklock_datapipe_lockkey_cb(gconstpointer const data)
          * The tklock requests get ignored in act dead
          * etc, so we can just blindly request it.
          */
+        datapipe_transaction_begin();
+
         execute_datapipe(&tk_lock_pipe,
                          GINT_TO_POINTER(LOCK_ON),
                          USE_INDATA, CACHE_INDATA);
@@ -1570,6 +1563,8 @@ static void tklock_datapipe_lockkey_cb(gconstpointer const data)
         execute_datapipe(&display_state_req_pipe,
                          GINT_TO_POINTER(MCE_DISPLAY_OFF),
                          USE_INDATA, CACHE_INDATA);
+
+        datapipe_transaction_commit();
         break;
 
     default:
@@ -2430,7 +2425,10 @@ static void tklock_lid_sensor_rethink(void)
         /* need to se non-zero lux before blanking again */
         nonzero_lux_seen_at = 0;
 
-        /* Blank display + lock ui */
+        /* Blank display + lock ui; dispatched as one transaction so
+         * that the ui gets locked before the display is blanked */
+        datapipe_transaction_begin();
+
         if( tklock_lid_close_actions != LID_CLOSE_ACTION_DISABLED ) {
             mce_log(LL_DEVEL, "lid closed - blank");
             execute_datapipe(&display_state_req_pipe,
@@ -2444,6 +2442,8 @@ static void tklock_lid_sensor_rethink(void)
                              GINT_TO_POINTER(LOCK_ON),
                              USE_INDATA, CACHE_INDATA);
         }
+
+        datapipe_transaction_commit();
         break;
 
     case COVER_OPEN:
@@ -2585,6 +2585,8 @@ static void tklock_keyboard_slide_closed(void)
     }
 
     /* Check what actions are wanted */
+    datapipe_transaction_begin();
+
     if( tklock_kbd_close_actions != LID_CLOSE_ACTION_DISABLED ) {
         mce_log(LL_DEVEL, "kbd slide closed - blank");
         execute_datapipe(&display_state_req_pipe,
@@ -2599,6 +2601,8 @@ static void tklock_keyboard_slide_closed(void)
                          USE_INDATA, CACHE_INDATA);
     }
 
+    datapipe_transaction_commit();
+
 EXIT:
     /* In any case closing the kbd slide will cancel autorelock triggers */
     if( autorelock_trigger != AUTORELOCK_NO_TRIGGERS ) {
@@ -2635,6 +2639,9 @@ static void tklock_keyboard_slide_rethink(void)
  *
  * ========================================================================= */
 
+/** How much autolocking can be delayed for wakeup coalescing [ms] */
+#define AUTOLOCK_SLACK_MS (1000)
+
 static int64_t tklock_autolock_tick = MAX_TICK;
 static mce_hbtimer_t *tklock_autolock_timer = 0;
 
@@ -2738,6 +2745,7 @@ tklock_autolock_init(void)
     tklock_autolock_timer = mce_hbtimer_create("autolock-timer",
                                                tklock_autolock_delay,
                                                tklock_autolock_cb, 0);
+    mce_hbtimer_set_slack(tklock_autolock_timer, AUTOLOCK_SLACK_MS);
 }
 
 static void
@@ -2759,6 +2767,9 @@ tklock_autolock_quit(void)
 /** Delay for enabling tklock from display off when proximity is covered */
 #define PROXLOC_DELAY_MS (3000)
 
+/** How much proximity locking can be delayed for wakeup coalescing [ms] */
+#define PROXLOC_SLACK_MS (1000)
+
 static int64_t tklock_proxlock_tick = MAX_TICK;
 static guint   tklock_proxlock_id   = 0;
 
@@ -2822,7 +2833,8 @@ static void tklock_proxlock_enable(void)
 
     if( !tklock_proxlock_id ) {
         tklock_proxlock_tick = mce_lib_get_boot_tick() + delay;
-        tklock_proxlock_id = g_timeout_add(delay, tklock_proxlock_cb, 0);
+        tklock_proxlock_id = mce_lib_timeout_add_slack(delay, PROXLOC_SLACK_MS,
+                                                       tklock_proxlock_cb, 0);
         mce_log(LL_DEBUG, "proxlock timer started (%d ms)", delay);
     }
 }
@@ -2848,7 +2860,8 @@ static void tklock_proxlock_resume(void)
         /* Re-calculate wakeup time */
         int delay = (int)(tklock_proxlock_tick - now);
         mce_log(LL_DEBUG, "adjusting proxlock time after resume (%d ms)", delay);
-        tklock_proxlock_id = g_timeout_add(delay, tklock_proxlock_cb, 0);
+        tklock_proxlock_id = mce_lib_timeout_add_slack(delay, PROXLOC_SLACK_MS,
+                                                       tklock_proxlock_cb, 0);
     }
 
 EXIT:
@@ -3138,6 +3151,8 @@ static void tklock_uiexcept_rethink(void)
 
     if( blank ) {
         if( display_state != MCE_DISPLAY_OFF ) {
+            datapipe_transaction_begin();
+
             /* expose blanking due to proximity via datapipe */
             if( proximity_blank ) {
                 mce_log(LL_DEVEL, "display proximity blank");
@@ -3151,6 +3166,8 @@ static void tklock_uiexcept_rethink(void)
             execute_datapipe(&display_state_req_pipe,
                              GINT_TO_POINTER(MCE_DISPLAY_OFF),
                              USE_INDATA, CACHE_INDATA);
+
+            datapipe_transaction_commit();
         }
         else {
             mce_log(LL_DEBUG, "display already blanked");
@@ -3956,7 +3973,7 @@ static void tklock_evctrl_rethink(void)
      * display is off
      * - - - - - - - - - - - - - - - - - - - */
 
-    bool grab_ts = datapipe_get_gint(touch_grab_wanted_pipe);
+    bool grab_ts = datapipe_get_gbool(touch_grab_wanted_pipe);
 
     switch( display_state ) {
     default:
@@ -5283,7 +5300,6 @@ tklock_dbus_display_blanking_policy_get_cb(DBusMessage *const msg)
     return TRUE;
 }
 
-#define MCE_KEYBOARD_SLIDE_STATE_SIG "keyboard_slide_state_ind"
 #define MCE_KEYBOARD_SLIDE_STATE_REQ "keyboard_slide_state_req"
 
 /** Send the keyboard slide open/closed state
@@ -5343,7 +5359,6 @@ tklock_dbus_keyboard_slide_state_get_req_cb(DBusMessage *const msg)
     return TRUE;
 }
 
-#define MCE_KEYBOARD_AVAILABLE_STATE_SIG "keyboard_available_state_ind"
 #define MCE_KEYBOARD_AVAILABLE_STATE_REQ "keyboard_available_state_req"
 
 /** Send the keyboard available state
@@ -3270,6 +3270,9 @@ static bool xmce_is_als_filter_name(const char *name)
         const char * const lut[] = {
                 "disabled",
                 "median",
+                "ema",
+                "hysteresis",
+                "slew",
         };
 
         for( size_t i = 0; i < G_N_ELEMENTS(lut); ++i ) {
@@ -3277,17 +3280,33 @@ static bool xmce_is_als_filter_name(const char *name)
                         return true;
         }
 
-        fprintf(stderr, "%s: not a valid als input filter name", name);
+        fprintf(stderr, "%s: not a valid als input filter name\n", name);
         return false;
 }
 
+/** Check that given comma separated list of ALS input filters is valid
+ */
+static bool xmce_is_als_filter_chain(const char *chain)
+{
+        bool    valid = true;
+        gchar **vec   = g_strsplit(chain, ",", 0);
+
+        for( size_t i = 0; vec[i]; ++i ) {
+                if( !xmce_is_als_filter_name(g_strstrip(vec[i])) )
+                        valid = false;
+        }
+
+        g_strfreev(vec);
+        return valid;
+}
+
 /* Set als input filter
  *
- * @param args string suitable for interpreting as filter name
+ * @param args comma separated list of filter names
  */
 static bool xmce_set_als_input_filter(const char *args)
 {
-        if( !xmce_is_als_filter_name(args) )
+        if( !xmce_is_als_filter_chain(args) )
                 return false;
 
         mcetool_gconf_set_string(MCE_GCONF_DISPLAY_ALS_INPUT_FILTER, args);
@@ -3334,6 +3353,58 @@ static void xmce_get_als_sample_time(void)
         printf("%-"PAD1"s %s\n", "Sample time for als filtering:", txt);
 }
 
+/* Set als median filter window size
+ *
+ * @param args string suitable for interpreting as number of samples
+ */
+static bool xmce_set_als_median_size(const char *args)
+{
+        int val = xmce_parse_integer(args);
+
+        if( val < ALS_MEDIAN_SIZE_MIN || val > ALS_MEDIAN_SIZE_MAX ) {
+                errorf("%d: invalid als median window size\n", val);
+                return false;
+        }
+
+        mcetool_gconf_set_int(MCE_GCONF_DISPLAY_ALS_MEDIAN_SIZE, val);
+        return true;
+}
+
+/** Get current als median filter window size from mce and print it out
+ */
+static void xmce_get_als_median_size(void)
+{
+        gint val = 0;
+        char txt[32] = "unknown";
+        if( mcetool_gconf_get_int(MCE_GCONF_DISPLAY_ALS_MEDIAN_SIZE, &val) )
+                snprintf(txt, sizeof txt, "%d", val);
+        printf("%-"PAD1"s %s\n", "Window size for als median:", txt);
+}
+
+/* Set als sample batch mode
+ *
+ * @param args string suitable for interpreting as enabled/disabled
+ */
+static bool xmce_set_als_sample_batches(const char *args)
+{
+        debugf("%s(%s)\n", __FUNCTION__, args);
+        gboolean val = xmce_parse_enabled(args);
+        mcetool_gconf_set_bool(MCE_GCONF_DISPLAY_ALS_SAMPLE_BATCHES, val);
+        return true;
+}
+
+/** Get current als sample batch mode from mce and print it out
+ */
+static void xmce_get_als_sample_batches(void)
+{
+        gboolean val = 0;
+        char txt[32] = "unknown";
+
+        if( mcetool_gconf_get_bool(MCE_GCONF_DISPLAY_ALS_SAMPLE_BATCHES, &val) )
+                snprintf(txt, sizeof txt, "%s", val ? "enabled" : "disabled");
+        printf("%-"PAD1"s %s\n", "Filter all als samples:", txt);
+}
+
 /* ------------------------------------------------------------------------- *
  * autolock
  * ------------------------------------------------------------------------- */
@@ -4719,6 +4790,108 @@ EXIT:
         return true;
 }
 
+/** Get D-Bus dispatch statistics
+ */
+static bool xmce_get_dbus_stats(const char *args)
+{
+        (void)args;
+
+        char *str = 0;
+        xmce_ipc_string_reply("get_dbus_stats", &str, DBUS_TYPE_INVALID);
+        printf("%s", str ?: "unknown\n");
+        free(str);
+
+        return true;
+}
+
+/** Get wakelock usage statistics
+ */
+static bool xmce_get_wakelock_stats(const char *args)
+{
+        (void)args;
+
+        char *str = 0;
+        xmce_ipc_string_reply("get_wakelock_stats", &str, DBUS_TYPE_INVALID);
+        printf("# name state refs writes saved held_ms longest_ms\n");
+        printf("%s", str ?: "unknown\n");
+        free(str);
+
+        return true;
+}
+
+/** Save flight recorder trace to a file
+ *
+ * Use tools/mcetrace for decoding the file content.
+ */
+static bool xmce_dump_trace(const char *args)
+{
+        DBusMessage   *rsp  = NULL;
+        DBusError      err  = DBUS_ERROR_INIT;
+        const uint8_t *data = 0;
+        int            size = 0;
+        FILE          *file = 0;
+
+        if( !xmce_ipc_message_reply("get_trace", &rsp, DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !dbus_message_get_args(rsp, &err,
+                                   DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                   &data, &size,
+                                   DBUS_TYPE_INVALID) )
+                goto EXIT;
+
+        if( !(file = fopen(args, "w")) ) {
+                errorf("%s: can't open: %m\n", args);
+                goto EXIT;
+        }
+
+        if( fwrite(data, 1, size, file) != (size_t)size ) {
+                errorf("%s: write error: %m\n", args);
+                goto EXIT;
+        }
+
+        printf("%s: %d bytes written\n", args, size);
+
+EXIT:
+        if( file && fclose(file) == EOF )
+                errorf("%s: close error: %m\n", args);
+
+        if( dbus_error_is_set(&err) ) {
+                errorf("%s: %s: %s\n", "get_trace", err.name, err.message);
+                dbus_error_free(&err);
+        }
+
+        if( rsp ) dbus_message_unref(rsp);
+
+        return true;
+}
+
+/** Get datapipe execution statistics
+ */
+static bool xmce_get_datapipe_stats(const char *args)
+{
+        (void)args;
+
+        char *str = 0;
+        xmce_ipc_string_reply("get_datapipe_stats", &str, DBUS_TYPE_INVALID);
+        printf("%s", str ?: "unknown\n");
+        free(str);
+
+        return true;
+}
+
+/** Enable/disable datapipe callback timing
+ */
+static bool xmce_set_datapipe_stats(const char *args)
+{
+        debugf("%s(%s)\n", __FUNCTION__, args);
+        gboolean val = xmce_parse_enabled(args);
+        xmce_ipc_no_reply("set_datapipe_stats",
+                          DBUS_TYPE_BOOLEAN, &val,
+                          DBUS_TYPE_INVALID);
+        return true;
+}
+
 /* ------------------------------------------------------------------------- *
  * use mouse clicks to emulate touchscreen doubletap policy
  * ------------------------------------------------------------------------- */
@@ -5034,6 +5207,8 @@ static bool xmce_get_status(const char *args)
         xmce_get_als_autobrightness();
         xmce_get_als_input_filter();
         xmce_get_als_sample_time();
+        xmce_get_als_median_size();
+        xmce_get_als_sample_batches();
         xmce_get_orientation_sensor_mode();
         xmce_get_orientation_change_is_activity();
         xmce_get_flipover_gesture_detection();
@@ -5669,6 +5844,45 @@ static const mce_opt_t options[] =
                 .usage       =
                         "get device uptime and time spent in suspend\n"
         },
+        {
+                .name        = "get-datapipe-stats",
+                .without_arg = xmce_get_datapipe_stats,
+                .usage       =
+                        "get datapipe execution counts, callback timings\n"
+                        "and execution latency histograms\n"
+        },
+        {
+                .name        = "set-datapipe-stats",
+                .with_arg    = xmce_set_datapipe_stats,
+                .values      = "enabled|disabled",
+                .usage       =
+                        "enable/disable datapipe callback timing; enabling\n"
+                        "also clears previously collected statistics\n"
+        },
+        {
+                .name        = "get-dbus-stats",
+                .without_arg = xmce_get_dbus_stats,
+                .usage       =
+                        "get D-Bus handler and reply callback timings\n"
+                        "per interface and member, and the number of\n"
+                        "messages that did not match any handler\n"
+        },
+        {
+                .name        = "get-wakelock-stats",
+                .without_arg = xmce_get_wakelock_stats,
+                .usage       =
+                        "get per wakelock sysfs write counts, writes\n"
+                        "avoided by tracking the state in mce, and the\n"
+                        "total and longest lock hold times\n"
+        },
+        {
+                .name        = "dump-trace",
+                .with_arg    = xmce_dump_trace,
+                .values      = "file",
+                .usage       =
+                        "save the mce flight recorder trace buffer to\n"
+                        "a file; use mcetrace for decoding the data\n"
+        },
         {
                 .name        = "set-cpu-scaling-governor",
                 .flag        = 'S',
@@ -5775,10 +5989,13 @@ static const mce_opt_t options[] =
         {
                 .name        = "set-als-input-filter",
                 .with_arg    = xmce_set_als_input_filter,
-                .values      = "disabled|median",
+                .values      = "filter[,filter...]",
                 .usage       =
-                        "set the als input filter; valid filters are:\n"
-                        "'disabled', 'median'\n"
+                        "set the als input filter chain; valid filters are:\n"
+                        "'disabled', 'median', 'ema', 'hysteresis' and 'slew'\n"
+                        "\n"
+                        "Filters are applied in the given order, for\n"
+                        "example 'median,ema,slew'.\n"
         },
         {
                 .name        = "set-als-sample-time",
@@ -5788,6 +6005,25 @@ static const mce_opt_t options[] =
                         "set the sample slot size for als input filtering;\n"
                         "valid values are: 50-1000\n"
         },
+        {
+                .name        = "set-als-median-size",
+                .with_arg    = xmce_set_als_median_size,
+                .values      = "3...255",
+                .usage       =
+                        "set the window size for als median filter;\n"
+                        "even values are rounded up to the next odd one\n"
+        },
+        {
+                .name        = "set-als-sample-batches",
+                .with_arg    = xmce_set_als_sample_batches,
+                .values      = "enabled|disabled",
+                .usage       =
+                        "feed all samples received from sensord to als input\n"
+                        "filters; valid modes are: 'enabled' and 'disabled'\n"
+                        "\n"
+                        "When disabled, only the latest sample of each batch\n"
+                        "is used.\n"
+        },
 
         {
                 .name        = "set-ps-mode",
@@ -0,0 +1,317 @@
+/**
+ * @file mcetrace.c
+ * Decoder for Mode Control Entity flight recorder trace dumps
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../mce-trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+/** Basename of this executable */
+static const char *progname = "mcetrace";
+
+/** Flag for: show time relative to the first record instead of dump time */
+static bool time_from_start = false;
+
+/** Human readable names for record types */
+static const char * const type_names[MCE_TRACE_TYPES] =
+{
+  [MCE_TRACE_NONE]        = "none",
+  [MCE_TRACE_DATAPIPE]    = "datapipe",
+  [MCE_TRACE_DISPLAY_STM] = "display",
+  [MCE_TRACE_POWERKEY]    = "powerkey",
+  [MCE_TRACE_HBTIMER]     = "hbtimer",
+  [MCE_TRACE_RESUME]      = "resume",
+  [MCE_TRACE_DBUS]        = "dbus",
+  [MCE_TRACE_MARK]        = "mark",
+};
+
+/** Labels for type specific values */
+static const char * const type_args[MCE_TRACE_TYPES][2] =
+{
+  [MCE_TRACE_DATAPIPE]    = { "value",   "us"     },
+  [MCE_TRACE_DISPLAY_STM] = { "from",    "to"     },
+  [MCE_TRACE_POWERKEY]    = { "display", 0        },
+  [MCE_TRACE_HBTIMER]     = { "late_ms", 0        },
+  [MCE_TRACE_RESUME]      = { "skip_ms", 0        },
+  [MCE_TRACE_DBUS]        = { "handled", "us"     },
+};
+
+/** Read whole file to memory
+ *
+ * @param path  file to read
+ * @param psize where to store file size
+ *
+ * @return file content, or NULL on failure
+ */
+static void *load_file(const char *path, size_t *psize)
+{
+  void   *data = 0;
+  size_t  size = 0;
+  size_t  used = 0;
+  FILE   *file = fopen(path, "r");
+
+  if( !file )
+  {
+    fprintf(stderr, "%s: can't open: %m\n", path);
+    goto cleanup;
+  }
+
+  for( ;; )
+  {
+    if( used == size )
+    {
+      size = size ? size * 2 : 128 << 10;
+      data = realloc(data, size);
+    }
+
+    size_t done = fread((char *)data + used, 1, size - used, file);
+    used += done;
+
+    if( done == 0 )
+    {
+      break;
+    }
+  }
+
+  if( ferror(file) )
+  {
+    fprintf(stderr, "%s: read error: %m\n", path);
+    free(data), data = 0;
+    goto cleanup;
+  }
+
+  *psize = used;
+
+cleanup:
+
+  if( file ) fclose(file);
+
+  return data;
+}
+
+/** Decode and print one trace dump file
+ *
+ * @param path file to decode
+ *
+ * @return true on success, false on errors
+ */
+static bool decode_file(const char *path)
+{
+  bool         res   = false;
+  size_t       size  = 0;
+  char        *data  = load_file(path, &size);
+  const char **names = 0;
+
+  const mce_trace_header_t *hdr = (const mce_trace_header_t *)data;
+  const mce_trace_record_t *rec = 0;
+  const char               *pos = 0;
+  const char               *end = 0;
+
+  if( !data )
+  {
+    goto cleanup;
+  }
+
+  if( size < sizeof *hdr ||
+      memcmp(hdr->magic, MCE_TRACE_MAGIC, sizeof hdr->magic) )
+  {
+    fprintf(stderr, "%s: not a trace dump\n", path);
+    goto cleanup;
+  }
+
+  if( hdr->version != MCE_TRACE_VERSION ||
+      hdr->record_size != sizeof *rec )
+  {
+    fprintf(stderr, "%s: unsupported version %"PRIu32"\n",
+            path, hdr->version);
+    goto cleanup;
+  }
+
+  pos = data + sizeof *hdr;
+  end = pos + hdr->name_size;
+
+  if( hdr->name_size > size - sizeof *hdr ||
+      (size - sizeof *hdr - hdr->name_size) / sizeof *rec
+      < hdr->record_count )
+  {
+    fprintf(stderr, "%s: truncated\n", path);
+    goto cleanup;
+  }
+
+  names = calloc(hdr->name_count + 1, sizeof *names);
+
+  for( uint32_t i = 0; i < hdr->name_count; ++i )
+  {
+    const char *zen = memchr(pos, 0, end - pos);
+    if( !zen )
+    {
+      fprintf(stderr, "%s: corrupted name table\n", path);
+      goto cleanup;
+    }
+    names[i] = pos, pos = zen + 1;
+  }
+
+  rec = (const mce_trace_record_t *)end;
+
+  uint64_t base = hdr->tick;
+  if( time_from_start && hdr->record_count > 0 )
+  {
+    base = rec[0].tick;
+  }
+
+  printf("# %s: %"PRIu32" records, %"PRIu64" dropped\n",
+         path, hdr->record_count, hdr->dropped);
+
+  for( uint32_t i = 0; i < hdr->record_count; ++i, ++rec )
+  {
+    int64_t     t    = (int64_t)(rec->tick - base);
+    uint64_t    u    = t < 0 ? -t : t;
+    unsigned    type = rec->type;
+    const char *name = "?";
+    const char *tnam = "unknown";
+    const char *arg0 = "a";
+    const char *arg1 = "b";
+
+    if( rec->name < hdr->name_count )
+    {
+      name = names[rec->name];
+    }
+
+    if( type < MCE_TRACE_TYPES )
+    {
+      tnam = type_names[type];
+      arg0 = type_args[type][0];
+      arg1 = type_args[type][1];
+    }
+
+    printf("%c%"PRIu64".%06"PRIu64" %-8s %-32s",
+           t < 0 ? '-' : '+', u / 1000000, u % 1000000,
+           tnam, name);
+
+    if( arg0 )
+    {
+      printf(" %s=%"PRId32, arg0, rec->a);
+    }
+
+    if( arg1 )
+    {
+      printf(" %s=%"PRId32, arg1, rec->b);
+    }
+
+    printf("\n");
+  }
+
+  res = true;
+
+cleanup:
+
+  free(names);
+  free(data);
+
+  return res;
+}
+
+/** Provide runtime usage information
+ */
+static void usage(void)
+{
+  printf("USAGE\n"
+         "  %s [options] <dumpfile> ...\n"
+         "\n"
+         "OPTIONS\n"
+         "  -h, --help           -- this help text\n"
+         "  -s, --from-start     -- time relative to the first record\n"
+         "\n"
+         "NOTES\n"
+         "  Dump files can be obtained with: mcetool --dump-trace=FILE\n"
+         "  \n"
+         "  By default times are relative to the time the dump was made.\n"
+         "\n",
+         progname);
+}
+
+/** Main entry point
+ */
+int
+main(int argc, char **argv)
+{
+  static const char optS[] = "hs";
+  static const struct option optL[] =
+  {
+    { "help",       no_argument, 0, 'h' },
+    { "from-start", no_argument, 0, 's' },
+    { 0,            0,           0,  0  }
+  };
+
+  int result = EXIT_FAILURE;
+
+  progname = basename(*argv);
+
+  for( ;; )
+  {
+    int opt = getopt_long(argc, argv, optS, optL, 0);
+
+    if( opt < 0 )
+    {
+      break;
+    }
+
+    switch( opt )
+    {
+    case 'h':
+      usage();
+      exit(EXIT_SUCCESS);
+
+    case 's':
+      time_from_start = true;
+      break;
+
+    case '?':
+    case ':':
+      goto cleanup;
+
+    default:
+      fprintf(stderr, "getopt() -> %d\n", opt);
+      goto cleanup;
+    }
+  }
+
+  if( optind >= argc )
+  {
+    fprintf(stderr, "%s: no dump files given\n", progname);
+    goto cleanup;
+  }
+
+  result = EXIT_SUCCESS;
+
+  for( int i = optind; i < argc; ++i )
+  {
+    if( !decode_file(argv[i]) )
+    {
+      result = EXIT_FAILURE;
+    }
+  }
+
+cleanup:
+
+  return result;
+}